@@ -34,20 +34,23 @@
 #include <libWexpr/libWexpr.h>
 #include <libWexprSchema/libWexprSchema.h>
 
+#include <cstdio>
 #include <cstdlib>
 #include <cstring>
 #include <fstream>
 #include <iostream>
+#include <map>
+#include <mutex>
+#include <sstream>
+#include <vector>
 
 namespace
 {
-	const uint32_t VersionHandled = 0x00001000; // 0.1.0
-	
-	void s_writeOutErrorWithIndent (WexprSchemaError* err, size_t indent)
+	void s_writeOutErrorWithIndent (std::ostream& out, WexprSchemaError* err, size_t indent)
 	{
 		while (err)
 		{
-			std::cerr << "WexprTool: "
+			out << "WexprTool: "
 				<< wexprSchema_Error_objectPath(err) << ": "
 				<< std::string(indent*2, ' ')
 				<< "error: "
@@ -56,7 +59,7 @@ namespace
 			WexprSchemaError* child = wexprSchema_Error_childError(err);
 			if (child)
 			{
-				s_writeOutErrorWithIndent(child, indent+1);
+				s_writeOutErrorWithIndent(out, child, indent+1);
 			}
 			
 			err = wexprSchema_Error_nextError(err);
@@ -65,7 +68,8 @@ namespace
 	
 	std::string s_readAllInputFrom (const std::string& inputPath)
 	{
-		std::string data;
+		// read in blocks instead of a character at a time
+		std::ostringstream data;
 		
 		if (inputPath == "-")
 		{
@@ -73,16 +77,15 @@ namespace
 			// - Terminal pasting (eg. copypaste to the tty directly) has a limit of 4096 characters.
 			// Anything past that gets cut off. If something wont load via paste, but is fine via cat or file, thats probably the reason.
 			// Nothing we can do about it.
-			return std::string (
-				std::istreambuf_iterator<char>(std::cin), {}
-			);
+			data << std::cin.rdbuf();
+		}
+		else
+		{
+			std::ifstream file (inputPath, std::ios::in | std::ios::binary);
+			data << file.rdbuf();
 		}
 		
-		std::fstream file (inputPath, std::ios::in);
-			
-		return std::string (
-			std::istreambuf_iterator<char>(file), {}
-		);
+		return data.str();
 	}
 
 	void s_writeAllOutputTo (const std::string& outputPath, const std::string& str)
@@ -99,195 +102,186 @@ namespace
 		}
 	}
 	
-	void s_writeAllOutputWithFileHeaderTo (const std::string& outputPath, void* buffer, size_t bufferSize)
+	// opens the path for writing, or stdout for "-". Returns null on failure.
+	FILE* s_openOutput (const std::string& outputPath)
 	{
-		std::fstream* f = nullptr;
-		std::ostream* stream = &(std::cout);
-		
-		if (outputPath != "-")
+		if (outputPath == "-")
 		{
-			f = new std::fstream(outputPath, std::ios::out | std::ios::binary);
-			stream = f;
+			return stdout;
 		}
 		
-		std::ostream& s = *stream; // the stream to write to
-		
-		// TODO(thothonegan): Move writing header to libWexpr since its part of the file format.
-		
-		// write header
-		uint8_t header [20];
-		memset (header, '\0', sizeof(header));
-		header[0] = 0x83;
-		header[1] = 'B'; header[2] = 'W'; header [3] = 'E' ; header[4] = 'X' ; header[5] = 'P'; header[6] = 'R';
-		header[7] = 0x0A;
-		
-		*reinterpret_cast<uint32_t*>(header+8) = wexpr_uint32ToBig(VersionHandled);
-		
-		// reserved is 0
-		
-		s.write (reinterpret_cast<const char*>(header), sizeof(header));
-		
-		// currently we have no aux chunks
-		
-		// write main chunk
-		s.write(static_cast<const char*>(buffer), static_cast<std::streamsize>(bufferSize));
-		
-		// flush to the stream
-		s.flush();
-		
-		if (f)
-		{
-			delete f;
-		}
+		return fopen (outputPath.c_str(), "wb");
 	}
-}
-
-class ApplicationSetup
-{
-	public:
-		ApplicationSetup () {
-			wexprSchema_Global_init();
-		}
-		~ApplicationSetup () {
-			wexprSchema_Global_free();
-		}
-};
-
-//
-/// \brief App entry point
-//
-int main (int argc, char** argv)
-{
-	ApplicationSetup appSetup;
-	(void) appSetup;
 	
-	auto results = CommandLineParser::parse (argc, argv);
-	
-	if (results.version)
+	bool s_closeOutput (FILE* file)
 	{
-		std::cout << "WexprTool " << wexpr_Version_major() << "." << wexpr_Version_minor() << "." << wexpr_Version_patch() << std::endl;
+		if (file == stdout)
+		{
+			return fflush (file) == 0;
+		}
 		
-		return EXIT_SUCCESS;
+		return fclose (file) == 0;
 	}
 	
-	if (results.help)
+	// streams the text straight to the output, so we never hold the whole string
+	bool s_writeTextTo (const std::string& outputPath, WexprExpression* expr, WexprWriteFlags flags)
 	{
-		CommandLineParser::displayHelp(argc, argv);
-		return EXIT_SUCCESS;
+		FILE* file = s_openOutput(outputPath);
+		if (!file)
+		{
+			return false;
+		}
+		
+		WexprSink sink = wexpr_Sink_forFile(file);
+		bool success = wexpr_Expression_writeText (expr, 0, flags, &sink);
+		
+		return s_closeOutput(file) && success;
 	}
 	
-	// normal flow
-	if (results.command == CommandLineParser::Command::HumanReadable ||
-		results.command == CommandLineParser::Command::Validate ||
-		results.command == CommandLineParser::Command::Mini ||
-		results.command == CommandLineParser::Command::Binary
-	)
+	bool s_writeBinaryWithFileHeaderTo (const std::string& outputPath, WexprExpression* expr, WexprWriteFlags flags)
 	{
-		bool isValidate = (results.command == CommandLineParser::Command::Validate);
-		
-		auto inputStr = s_readAllInputFrom(results.inputPath);
-		
-		WexprError err = WEXPR_ERROR_INIT();
+		FILE* file = s_openOutput(outputPath);
+		if (!file)
+		{
+			return false;
+		}
 		
-		// determine if binary or not.
-		// if so, strip the header and do the chunk.
-		WexprExpression* expr = nullptr;
+		WexprSink sink = wexpr_Sink_forFile(file);
 		
-		do { // so we can break back to here
+		// currently we have no aux chunks
+		bool success = wexpr_Expression_writeBinary (expr, WexprWriteFlagBinaryFileHeader | flags, &sink);
 		
-			if (inputStr.size() >= 1 && static_cast<unsigned char>(inputStr[0]) == 0x83)
+		return s_closeOutput(file) && success;
+	}
+	
+	// Schemas loaded so far, shared by every input so each is only loaded once.
+	// Validating only reads the schema, so inputs on different threads can use the same one.
+	class SchemaCache
+	{
+		public:
+			explicit SchemaCache (std::map<std::string, std::string>& schemaMappings)
+				: m_schemaMappings(schemaMappings)
+			{}
+			
+			~SchemaCache ()
 			{
-				if (inputStr.size() < 20)
+				for (auto& iter : m_schemas)
 				{
-					err.code = WexprErrorCodeBinaryInvalidHeader;
-					err.column = 0;
-					err.line = 0;
-					err.message = LIBWEXPR_STRDUP("Invalid binary header - not big enough");
-					break;
+					if (iter.second.schema)
+					{ wexprSchema_Schema_destroy(iter.second.schema); }
 				}
+			}
+			
+			// returns the schema, or null if it couldnt be loaded (with the errors written to messages)
+			WexprSchemaSchema* schemaForID (const std::string& schemaID, std::ostream& messages)
+			{
+				std::lock_guard<std::mutex> lock (m_mutex);
 				
-				uint8_t magic [8] = {
-					0x83, 'B', 'W', 'E', 'X', 'P', 'R', 0x0A
-				};
-				
-				if (memcmp(inputStr.data(), magic, sizeof(magic)) != 0)
+				auto iter = m_schemas.find(schemaID);
+				if (iter == m_schemas.end())
 				{
-					err.code = WexprErrorCodeBinaryInvalidHeader;
-					err.column = 0;
-					err.line = 0;
-					err.message = LIBWEXPR_STRDUP("Invalid binary header - invalid magic");
-					break;
+					iter = m_schemas.insert(std::make_pair(schemaID, p_load(schemaID))).first;
 				}
 				
-				if (*reinterpret_cast<const uint32_t*>(inputStr.data() + 8) != wexpr_uint32ToBig(VersionHandled))
+				messages << iter->second.errors;
+				return iter->second.schema;
+			}
+			
+		private:
+			struct Entry
+			{
+				WexprSchemaSchema* schema;
+				std::string errors; // if it failed to load
+			};
+			
+			Entry p_load (const std::string& schemaID)
+			{
+				WexprSchemaSchema_Callbacks callbacks = {};
+				callbacks.pathForSchemaID = [](void* pathForSchemaIDUserData, const char* schemaID) -> const char*
 				{
-					err.code = WexprErrorCodeBinaryUnknownVersion;
-					err.column = 0;
-					err.line = 0;
-					err.message = LIBWEXPR_STRDUP("Invalid binary header - unknown version");
-					break;
-				}
+					auto schemaMappings = reinterpret_cast<std::map<std::string, std::string>*> (pathForSchemaIDUserData);
+					auto iter = schemaMappings->find(schemaID);
+					if (iter != schemaMappings->end())
+						return iter->second.c_str();
+					
+					return nullptr;
+				};
+				callbacks.pathForSchemaIDUserData = &m_schemaMappings;
 				
-				// make sure reserved is blank
-				uint8_t reserved [8] = {};
-				if (memcmp(inputStr.data() + 12, reserved, 8) != 0)
-				{
-					err.code = WexprErrorCodeBinaryInvalidHeader;
-					err.column = 0;
-					err.line = 0;
-					err.message = LIBWEXPR_STRDUP("Invalid binary header - unknown reserved bits");
-					break;
-				}
+				Entry entry;
 				
-				// header seems valid, skip it
-				const uint8_t* data = reinterpret_cast<const uint8_t*> (inputStr.data());
-				size_t curPos = 20;
-				size_t endPos = inputStr.size();
+				WexprSchemaError* schemaError = nullptr;
+				entry.schema = wexprSchema_Schema_createFromSchemaID(
+					schemaID.c_str(),
+					&callbacks,
+					&schemaError
+				);
 				
-				while (curPos < endPos)
+				if (!entry.schema || schemaError)
 				{
-					// read the size and type
-					uint64_t size = 0;
-					const uint8_t* dataNewPos = wexpr_uvlq64_read(
-						reinterpret_cast<const uint8_t*>(data + curPos),
-						endPos-curPos,
-						&size
-					);
-					
-					// TODO: if !dataNewPos
-					
-					// dont move past the size yet. Just track it for later
-					auto sizeSize = size_t(dataNewPos - (data+curPos));
+					std::ostringstream errors;
+					errors << "WexprTool: Error when loading schema for validation " << std::endl;
 					
-					uint8_t type = data[curPos+sizeSize];
-					
-					if (/*given: type >= 0x00 &&*/ type <= 0x04)
+					WexprSchemaError* serr = schemaError;
+					while (serr)
 					{
-						// cool, parse it
-						if (expr)
-						{
-							err.code = WexprErrorCodeBinaryMultipleExpressions;
-							err.column = 0;
-							err.line = 0;
-							err.message = LIBWEXPR_STRDUP("Found multiple expression chunks");
-							break;
-						}
+						errors << "WexprTool: "
+							<< wexprSchema_Error_objectPath(serr) << ": "
+							<< wexprSchema_Error_message(serr) << std::endl;
 						
-						// hand it the entire chunk, including the size and the type
-						expr = wexpr_Expression_createFromBinaryChunk(
-							data + curPos, size_t(size) + sizeSize + sizeof(uint8_t),
-							&err
-						);
-					}
-					else
-					{
-						printf ("Warning: Unknown chunk with type %d at byte 0x%zx\n", int(type), curPos+sizeSize);
+						serr = wexprSchema_Error_nextError(serr);
 					}
 					
-					// move forward : pass type, pass size
-					curPos += sizeof(uint8_t) + sizeSize;
-					curPos += size;
+					if (entry.schema)
+					{ wexprSchema_Schema_destroy(entry.schema); }
+					
+					entry.schema = nullptr;
+					entry.errors = errors.str();
 				}
+				
+				return entry;
+			}
+			
+			std::map<std::string, std::string>& m_schemaMappings;
+			std::map<std::string, Entry> m_schemas;
+			std::mutex m_mutex;
+	};
+	
+	// Read, validate and convert one input. Messages for stderr go to messages (so threads dont interleave them).
+	// If writeValidateResult, validate writes true/false to the output.
+	bool s_processInput (
+		const CommandLineParser::Results& results,
+		const std::string& inputPath, const std::string& outputPath,
+		bool writeValidateResult,
+		SchemaCache& schemas,
+		std::ostream& messages
+	)
+	{
+		bool isValidate = (results.command == CommandLineParser::Command::Validate);
+		writeValidateResult &= isValidate;
+		
+		WexprError err = WEXPR_ERROR_INIT();
+		WexprExpression* expr = nullptr;
+		
+		if (inputPath != "-")
+		{
+			// detects binary or not, and maps the file if possible
+			expr = wexpr_Expression_createFromFile (
+				inputPath.c_str(), WexprParseFlagNone, &err
+			);
+		}
+		else
+		{
+			auto inputStr = s_readAllInputFrom(inputPath);
+			
+			// determine if binary or not.
+			if (inputStr.size() >= 1 && static_cast<unsigned char>(inputStr[0]) == 0x83)
+			{
+				expr = wexpr_Expression_createFromBinaryFile (
+					inputStr.data(), inputStr.size(),
+					WexprParseFlagNone,
+					&err
+				);
 			}
 			else
 			{
@@ -298,39 +292,41 @@ int main (int argc, char** argv)
 					&err
 				);
 			}
-		} while (0);
+		}
 		
 		if (err.code)
 		{
-			if (isValidate)
+			if (writeValidateResult)
 			{
-				s_writeAllOutputTo(results.outputPath, "false\n");
-				return EXIT_FAILURE;
+				s_writeAllOutputTo(outputPath, "false\n");
 			}
 			else
 			{
-				std::string input = results.inputPath;
+				std::string input = inputPath;
 				if (input == "-")
 					input = "(stdin)";
 				
-				std::cerr << "WexprTool: Error occurred with wexpr:" << std::endl;
-				std::cerr << "WexprTool: " << input << ":" << err.line << ":" << err.column << ": " << err.message << std::endl;
-				return EXIT_FAILURE;
+				messages << "WexprTool: Error occurred with wexpr:" << std::endl;
+				messages << "WexprTool: " << input << ":" << err.line << ":" << err.column << ": " << err.message << std::endl;
 			}
+			
+			wexpr_Expression_destroy (expr);
+			WEXPR_ERROR_FREE (err);
+			return false;
 		}
 		
 		if (!expr)
 		{
-			if (isValidate)
+			if (writeValidateResult)
 			{
-				s_writeAllOutputTo(results.outputPath, "false\n");
+				s_writeAllOutputTo(outputPath, "false\n");
 			}
 			else
 			{
-				std::cerr << "WexprTool: Got an empty expression back" << std::endl;
+				messages << "WexprTool: Got an empty expression back" << std::endl;
 			}
 			
-			return EXIT_FAILURE;
+			return false;
 		}
 		
 		WEXPR_ERROR_FREE (err);
@@ -341,126 +337,298 @@ int main (int argc, char** argv)
 			auto schemaID = results.schemaID;
 			if (schemaID == "(internal)")
 			{
+				const char* problem = nullptr;
+				
 				auto rootType = wexpr_Expression_type(expr);
+				auto schemaValue = (rootType == WexprExpressionTypeMap) ? wexpr_Expression_mapValueForKey(expr, "$schema") : nullptr;
+				
 				if (rootType != WexprExpressionTypeMap)
-				{
-					std::cerr << "WexprTool: Using schema (internal) but root wasn't a map" << std::endl;
-					return EXIT_FAILURE;
-				}
+				{ problem = "Using schema (internal) but root wasn't a map"; }
+				else if (schemaValue == nullptr)
+				{ problem = "Using schema (internal) but $schema didn't exist on the root map."; }
+				else if (wexpr_Expression_type(schemaValue) != WexprExpressionTypeValue)
+				{ problem = "Using schema (internal) but $schema wasn't a value on the root map."; }
 				
-				auto schemaValue = wexpr_Expression_mapValueForKey(expr, "$schema");
-				if (schemaValue == nullptr)
+				if (problem)
 				{
-					std::cerr << "WexprTool: Using schema (internal) but $schema didn't exist on the root map." << std::endl;
-					return EXIT_FAILURE;
+					messages << "WexprTool: " << problem << std::endl;
+					wexpr_Expression_destroy (expr);
+					return false;
 				}
-
-				if (wexpr_Expression_type(schemaValue) != WexprExpressionTypeValue)
-				{
-					std::cerr << "WexprTool: Using schema (internal) but $schema wasn't a value on the root map." << std::endl;
-					return EXIT_FAILURE;
-				}
-
+				
 				schemaID = std::string(wexpr_Expression_value(schemaValue));
 			}
-
-			WexprSchemaSchema_Callbacks callbacks = {};
-			callbacks.pathForSchemaID = [](void* pathForSchemaIDUserData, const char* schemaID) -> const char*
-			{
-				auto schemaMappings = reinterpret_cast<std::map<std::string, std::string>*> (pathForSchemaIDUserData);
-				auto iter = schemaMappings->find(schemaID);
-				if (iter != schemaMappings->end())
-					return iter->second.c_str();
-				
-				return nullptr;
-			};
-			callbacks.pathForSchemaIDUserData = &(results.schemaMappings);
-
-			WexprSchemaError* schemaError = nullptr;
-			WexprSchemaSchema* schema = wexprSchema_Schema_createFromSchemaID(
-				schemaID.c_str(),
-				&callbacks,
-				&schemaError
-			);
-
-			if (!schema || schemaError)
+			
+			std::ostringstream schemaMessages;
+			WexprSchemaSchema* schema = schemas.schemaForID(schemaID, schemaMessages);
+			
+			if (!schema)
 			{
-				if (isValidate)
+				if (writeValidateResult)
 				{
-					s_writeAllOutputTo(results.outputPath, "false\n");
+					s_writeAllOutputTo(outputPath, "false\n");
 				}
 				else
 				{
-					std::cerr << "WexprTool: Error when loading schema for validation " << std::endl;
-					WexprSchemaError* serr = schemaError;
-					while (serr)
-					{
-						std::cerr << "WexprTool: "
-							<< wexprSchema_Error_objectPath(serr) << ": "
-							<< wexprSchema_Error_message(serr) << std::endl;
-						
-						serr = wexprSchema_Error_nextError(serr);
-					}
+					messages << schemaMessages.str();
 				}
 				
-				return EXIT_FAILURE;
+				wexpr_Expression_destroy (expr);
+				return false;
 			}
-
+			
+			WexprSchemaError* schemaError = nullptr;
 			bool didValidate = wexprSchema_Schema_validateExpression(schema, expr, &schemaError);
 			if (!didValidate || schemaError)
 			{
-				if (isValidate)
+				if (writeValidateResult)
 				{
-					s_writeAllOutputTo(results.outputPath, "false\n");
+					s_writeAllOutputTo(outputPath, "false\n");
 				}
 				else
 				{
-					std::cerr << "WexprTool: Error when validating against schema " << std::endl;
+					messages << "WexprTool: Error when validating against schema " << std::endl;
 					
-					s_writeOutErrorWithIndent(schemaError, 0);
+					s_writeOutErrorWithIndent(messages, schemaError, 0);
 				}
-
-				return EXIT_FAILURE;
+				
+				if (schemaError)
+				{ wexprSchema_Error_destroy(schemaError); }
+				
+				wexpr_Expression_destroy (expr);
+				return false;
 			}
 		}
-
+		
+		bool success = true;
+		
 		if (isValidate)
 		{
-			s_writeAllOutputTo(results.outputPath, "true\n");
+			if (writeValidateResult)
+			{
+				s_writeAllOutputTo(outputPath, "true\n");
+			}
 		}
 		
-		else if (results.command == CommandLineParser::Command::HumanReadable)
+		else
 		{
-			char* buffer = wexpr_Expression_createStringRepresentation (
-				expr, 0, WexprWriteFlagHumanReadable
-			);
-				
-				s_writeAllOutputTo(results.outputPath, std::string(buffer));
-			free (buffer);
+			bool didWrite = false;
+			
+			if (results.command == CommandLineParser::Command::HumanReadable)
+			{
+				didWrite = s_writeTextTo(outputPath, expr, WexprWriteFlagHumanReadable);
+			}
+			
+			else if (results.command == CommandLineParser::Command::Mini)
+			{
+				didWrite = s_writeTextTo(outputPath, expr, WexprWriteFlagNone);
+			}
+			
+			else if (results.command == CommandLineParser::Command::Binary)
+			{
+				didWrite = s_writeBinaryWithFileHeaderTo(outputPath, expr, WexprWriteFlagNone);
+			}
+			
+			else if (results.command == CommandLineParser::Command::AlignedBinary)
+			{
+				// either layout can be read, so this also converts back with binary
+				didWrite = s_writeBinaryWithFileHeaderTo(outputPath, expr, WexprWriteFlagBinaryAligned);
+			}
+			
+			if (!didWrite)
+			{
+				messages << "WexprTool: Unable to write output to " << outputPath << std::endl;
+				success = false;
+			}
 		}
 		
-		else if (results.command == CommandLineParser::Command::Mini)
+		wexpr_Expression_destroy (expr);
+		return success;
+	}
+	
+	// with multiple inputs, where the output for the given input goes: in the output directory with the inputs name,
+	// but the extension for what we're writing
+	std::string s_outputPathForInput (const CommandLineParser::Results& results, const std::string& inputPath)
+	{
+		std::string name = inputPath;
+		
+		size_t slash = name.find_last_of("/\\");
+		if (slash != std::string::npos)
+		{ name = name.substr(slash+1); }
+		
+		size_t dot = name.find_last_of('.');
+		if (dot != std::string::npos && dot != 0)
+		{ name = name.substr(0, dot); }
+		
+		bool isBinary = (results.command == CommandLineParser::Command::Binary
+			|| results.command == CommandLineParser::Command::AlignedBinary);
+		
+		return results.outputPath + "/" + name + (isBinary ? ".bwexpr" : ".wexpr");
+	}
+	
+	// everything needed to process multiple inputs at once
+	struct MultipleInputs
+	{
+		const CommandLineParser::Results* results;
+		SchemaCache* schemas;
+		
+		std::vector<std::string> outputPaths; // for each input, empty when validating
+		std::vector<char> successes; // for each input
+		std::vector<std::string> messages; // for each input
+	};
+	
+	void s_processMultipleInputsTask (void* taskData, size_t index)
+	{
+		MultipleInputs* work = static_cast<MultipleInputs*>(taskData);
+		const CommandLineParser::Results& results = *work->results;
+		
+		std::ostringstream messages;
+		work->successes[index] = s_processInput(results,
+			results.inputPaths[index], work->outputPaths[index],
+			false, *work->schemas, messages
+		);
+		
+		work->messages[index] = messages.str();
+	}
+	
+	// process every input, on up to jobCount threads. Writes the results in order once they're all done.
+	int s_processMultipleInputs (const CommandLineParser::Results& results, SchemaCache& schemas)
+	{
+		bool isValidate = (results.command == CommandLineParser::Command::Validate);
+		
+		if (!isValidate && results.outputPath == "-")
 		{
-			char* buffer = wexpr_Expression_createStringRepresentation (
-				expr, 0, WexprWriteFlagNone
-			);
+			std::cerr << "WexprTool: Multiple inputs need -o to be the directory to write the outputs to" << std::endl;
+			return EXIT_FAILURE;
+		}
+		
+		size_t count = results.inputPaths.size();
+		
+		MultipleInputs work;
+		work.results = &results;
+		work.schemas = &schemas;
+		work.outputPaths.resize(count);
+		work.successes.resize(count, 0);
+		work.messages.resize(count);
+		
+		// outputs are only named after the input's file name, so inputs with the same name in different
+		// directories would overwrite each other. Refuse before writing anything.
+		if (!isValidate)
+		{
+			std::map<std::string, size_t> inputForOutput;
+			bool hasDuplicates = false;
+			
+			for (size_t i=0; i < count; ++i)
+			{
+				work.outputPaths[i] = s_outputPathForInput(results, results.inputPaths[i]);
 				
-				s_writeAllOutputTo(results.outputPath, std::string(buffer));
-			free (buffer);
+				auto inserted = inputForOutput.insert(std::make_pair(work.outputPaths[i], i));
+				if (!inserted.second)
+				{
+					std::cerr << "WexprTool: " << results.inputPaths[inserted.first->second] << " and " << results.inputPaths[i]
+						<< " would both be written to " << work.outputPaths[i] << std::endl;
+					hasDuplicates = true;
+				}
+			}
+			
+			if (hasDuplicates)
+			{ return EXIT_FAILURE; }
 		}
 		
-		else if (results.command == CommandLineParser::Command::Binary)
+		WexprExecutor executor = wexpr_Executor_forThreads(results.jobCount);
+		wexpr_Executor_parallelFor(&executor, count, &s_processMultipleInputsTask, &work);
+		
+		// results in the order given
+		std::ostringstream report;
+		size_t failedCount = 0;
+		
+		for (size_t i=0; i < count; ++i)
 		{
-			WexprMutableBuffer binDataInfo = wexpr_Expression_createBinaryRepresentation (
-				expr
-			);
+			std::cerr << work.messages[i];
 			
-			s_writeAllOutputWithFileHeaderTo(results.outputPath, binDataInfo.data, binDataInfo.byteSize);
+			if (isValidate)
+			{ report << results.inputPaths[i] << ": " << (work.successes[i] ? "true" : "false") << "\n"; }
 			
-			free (binDataInfo.data);
+			if (!work.successes[i])
+			{ ++failedCount; }
 		}
+		
+		if (isValidate)
+		{ s_writeAllOutputTo(results.outputPath, report.str()); }
+		
+		std::cerr << "WexprTool: " << count << " inputs, " << (count - failedCount) << " succeeded, " << failedCount << " failed" << std::endl;
+		
+		return (failedCount == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+	}
+}
 
-		wexpr_Expression_destroy (expr);
+class ApplicationSetup
+{
+	public:
+		ApplicationSetup () {
+			wexprSchema_Global_init();
+		}
+		~ApplicationSetup () {
+			wexprSchema_Global_free();
+		}
+};
+
+//
+/// \brief App entry point
+//
+int main (int argc, char** argv)
+{
+	ApplicationSetup appSetup;
+	(void) appSetup;
+	
+	auto results = CommandLineParser::parse (argc, argv);
+	
+	if (results.version)
+	{
+		std::cout << "WexprTool " << wexpr_Version_major() << "." << wexpr_Version_minor() << "." << wexpr_Version_patch() << std::endl;
+		
+		return EXIT_SUCCESS;
+	}
+	
+	if (results.help)
+	{
+		CommandLineParser::displayHelp(argc, argv);
+		return EXIT_SUCCESS;
+	}
+	
+	// normal flow
+	if (results.command == CommandLineParser::Command::HumanReadable ||
+		results.command == CommandLineParser::Command::Validate ||
+		results.command == CommandLineParser::Command::Mini ||
+		results.command == CommandLineParser::Command::Binary ||
+		results.command == CommandLineParser::Command::AlignedBinary
+	)
+	{
+		SchemaCache schemas (results.schemaMappings);
+		
+		if (results.multipleInputs)
+		{
+			return s_processMultipleInputs(results, schemas);
+		}
+		
+		if (results.inputPaths.empty())
+		{
+			std::cerr << "WexprTool: No inputs given" << std::endl;
+			return EXIT_FAILURE;
+		}
+		
+		std::ostringstream messages;
+		bool success = s_processInput(results,
+			results.inputPaths.front(), results.outputPath,
+			true, schemas, messages
+		);
+		
+		std::cerr << messages.str();
+		
+		if (!success)
+		{
+			return EXIT_FAILURE;
+		}
 	}
 	
 	else
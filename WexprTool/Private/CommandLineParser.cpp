@@ -31,10 +31,16 @@
  
 #include "CommandLineParser.hpp"
 
+#include <cstdlib>
+#include <fstream>
 #include <iostream>
 
 #include <libWexpr/libWexpr.h>
 
+#if !defined(_WIN32)
+	#include <glob.h>
+#endif
+
 namespace
 {
 	CommandLineParser::Command s_commandFromString (const std::string& str)
@@ -47,6 +53,8 @@ namespace
 		{ return CommandLineParser::Command::Mini; }
 		else if (str == "binary")
 		{ return CommandLineParser::Command::Binary; }
+		else if (str == "alignedBinary")
+		{ return CommandLineParser::Command::AlignedBinary; }
 		
 		return CommandLineParser::Command::Unknown;
 	}
@@ -55,6 +63,7 @@ namespace
 CommandLineParser::Results CommandLineParser::parse(int argc, char ** argv)
 {
 	CommandLineParser::Results r;
+	bool hasInput = false;
 	
 	for (int argIndex=0; argIndex < argc; ++argIndex)
 	{
@@ -79,7 +88,42 @@ CommandLineParser::Results CommandLineParser::parse(int argc, char ** argv)
 		{
 			if ( (argIndex+1) < argc)
 			{
-				r.inputPath = argv[argIndex+1];
+				if (!hasInput)
+				{ r.inputPaths.clear(); }
+				else
+				{ r.multipleInputs = true; }
+				
+				hasInput = true;
+				p_addInput(r, argv[argIndex+1]);
+				++argIndex;
+			}
+		}
+		
+		else if (arg == "-l" || arg == "--inputList")
+		{
+			if ( (argIndex+1) < argc)
+			{
+				if (!hasInput)
+				{ r.inputPaths.clear(); }
+				
+				hasInput = true;
+				r.multipleInputs = true;
+				
+				if (!p_addInputsFromList(r, argv[argIndex+1]))
+				{
+					std::cerr << "Failed to read input list: " << argv[argIndex+1] << std::endl;
+					abort();
+				}
+				
+				++argIndex;
+			}
+		}
+		
+		else if (arg == "-j" || arg == "--jobs")
+		{
+			if ( (argIndex+1) < argc)
+			{
+				r.jobCount = std::strtoul(argv[argIndex+1], nullptr, 10);
 				++argIndex;
 			}
 		}
@@ -135,9 +179,14 @@ void CommandLineParser::displayHelp(int argc, char** argv)
 	cout << "              validate           - Checks the wexpr for correct syntax. If valid outputs 'true' and returns 0, otherwise 'false' and 1." << std::endl;
 	cout << "              mini               - Minifies the wexpr output" << std::endl;
 	cout << "              binary             - Write the wexpr out as binary" << std::endl;
+	cout << "              alignedBinary      - Write the wexpr out as binary in the aligned layout, which can be read in place" << std::endl;
 	cout << std::endl;
-	cout << "-i, --input   The input file to read from (default is -, stdin)." << std::endl;
+	cout << "-i, --input   The input file to read from (default is -, stdin). Can be given multiple times, or be a glob like 'data/*.wexpr'." << std::endl;
+	cout << "-l, --inputList A file listing inputs to read, one per line." << std::endl;
 	cout << "-o, --output  The place to write the output (default is -, stdout)." << std::endl;
+	cout << "              With multiple inputs, the directory to write each output to, named after the input (so inputs cant share a name)." << std::endl;
+	cout << "              (validate) With multiple inputs, where to write 'path: true/false' for each input." << std::endl;
+	cout << "-j, --jobs    With multiple inputs, how many to process at once (default is 0, one per hardware thread)." << std::endl;
 	cout << "-s, --schema  (validate) If provided, will also validate it against the given schema (or if the magic value '(internal)' it'll use the $schema on the root object)." << std::endl;
 	cout << "-m, --schemaMap '#(originalId newPath)' If provided as a 2 wexpr array, will map the given ID to the given location to load from. Can be multiple times for differnet IDs." << std::endl;
 	cout << "-h, --help    Display this help and exit" << std::endl;
@@ -187,3 +236,52 @@ bool CommandLineParser::p_addMappingFromWexprString (Results& res, const std::st
 	res.schemaMappings[schemaID] = schemaPath;
 	return true;
 }
+
+void CommandLineParser::p_addInput (Results& res, const std::string& input)
+{
+	bool isGlob = (input.find_first_of("*?[") != std::string::npos);
+	
+#if !defined(_WIN32)
+	if (isGlob)
+	{
+		res.multipleInputs = true;
+		
+		glob_t matches;
+		if (glob(input.c_str(), 0, nullptr, &matches) == 0)
+		{
+			for (size_t i=0; i < matches.gl_pathc; ++i)
+			{ res.inputPaths.push_back(matches.gl_pathv[i]); }
+			
+			globfree (&matches);
+			return;
+		}
+		
+		globfree (&matches);
+	}
+#else
+	(void)isGlob;
+#endif
+	
+	// not a glob (or nothing matched), so its used as is
+	res.inputPaths.push_back(input);
+}
+
+bool CommandLineParser::p_addInputsFromList (Results& res, const std::string& listPath)
+{
+	std::ifstream file (listPath);
+	if (!file)
+	{ return false; }
+	
+	std::string line;
+	while (std::getline(file, line))
+	{
+		// ignore line endings from other platforms and blank lines
+		if (!line.empty() && line[line.size()-1] == '\r')
+		{ line.erase(line.size()-1); }
+		
+		if (!line.empty())
+		{ res.inputPaths.push_back(line); }
+	}
+	
+	return true;
+}
@@ -32,8 +32,10 @@
 #ifndef WEXPRTOOL_COMMANDLINEPARSER_HPP
 #define WEXPRTOOL_COMMANDLINEPARSER_HPP
 
+#include <cstddef>
 #include <map>
 #include <string>
+#include <vector>
 
 //
 /// \brief Parse commandline arguments
@@ -55,7 +57,10 @@ class CommandLineParser
 			Mini,
 			
 			/// Convert the wexpr to binary
-			Binary
+			Binary,
+			
+			/// Convert the wexpr to the aligned binary layout
+			AlignedBinary
 		};
 		
 		struct Results
@@ -65,8 +70,17 @@ class CommandLineParser
 			bool validate = false;
 			
 			Command command = Command::HumanReadable;
-			std::string inputPath = "-";
+			std::vector<std::string> inputPaths = { "-" };
 			std::string outputPath = "-";
+			
+			//
+			// If true, inputPaths came from multiple -i's, a glob or a list.
+			// Each is processed separately, and outputPath is a directory (or the report for validate).
+			bool multipleInputs = false;
+			
+			//
+			// With multiple inputs, how many to process at once. 0 for one per hardware thread.
+			std::size_t jobCount = 0;
 
 			//
 			// Can be 3 different types of values:
@@ -99,6 +113,17 @@ class CommandLineParser
 		/// \return true if success, false if not
 		//
 		static bool p_addMappingFromWexprString (Results& res, const std::string& mappingStr);
+		
+		//
+		/// \brief Add an input, expanding it if it's a glob.
+		//
+		static void p_addInput (Results& res, const std::string& input);
+		
+		//
+		/// \brief Add every input listed in the file (one per line).
+		/// \return true if success, false if the file couldn't be read
+		//
+		static bool p_addInputsFromList (Results& res, const std::string& listPath);
 };
 
 #endif // WEXPRTOOL_COMMANDLINEPARSER_HPP
@@ -0,0 +1,130 @@
+//
+/// \file libWexpr/AlignedFormat.c
+/// \brief Helpers for the aligned binary wexpr layout
+//
+// #LICENSE_BEGIN:MIT#
+// 
+// Copyright (c) 2017-2020, Kenneth Perry (thothonegan)
+// 
+// Permission is hereby granted, free of charge, to any person obtaining
+// a copy of this software and associated documentation files (the
+// "Software"), to deal in the Software without restriction, including
+// without limitation the rights to use, copy, modify, merge, publish,
+// distribute, sublicense, and/or sell copies of the Software, and to
+// permit persons to whom the Software is furnished to do so, subject to
+// the following conditions:
+// 
+// The above copyright notice and this permission notice shall be
+// included in all copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+// MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+// NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+// LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+// OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+// WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+// 
+// SPDX-License-Identifier: MIT
+// #LICENSE_END#
+//
+
+#include "AlignedFormat.h"
+#include "ErrorHelpers.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+// --- public
+
+bool wexpr_PrivateAlignedFormat_readPrologue (const uint8_t* data, size_t length,
+	uint64_t* rootOffset, uint64_t* fileSize,
+	WexprError* error
+)
+{
+	uint32_t version = 0;
+	if (!wexpr_PrivateBinaryFormat_readHeader(data, length, &version, error))
+	{ return false; }
+	
+	if (version != wexpr_PrivateAlignedFormat_version)
+	{ WEXPR_PRIVATE_FAIL_WITH(WexprErrorCodeBinaryUnknownVersion, "Invalid binary header - unknown version"); }
+	
+	if (length < WEXPR_PRIVATE_ALIGNEDFORMAT_PROLOGUESIZE)
+	{ WEXPR_PRIVATE_FAIL_WITH(WexprErrorCodeBinaryInvalidHeader, "Invalid aligned binary - prologue not big enough"); }
+	
+	*rootOffset = wexpr_PrivateAlignedFormat_readUInt64(data + 24);
+	*fileSize = wexpr_PrivateAlignedFormat_readUInt64(data + 32);
+	
+	if (*fileSize > length || *fileSize < WEXPR_PRIVATE_ALIGNEDFORMAT_PROLOGUESIZE)
+	{ WEXPR_PRIVATE_FAIL_WITH(WexprErrorCodeBinaryChunkBiggerThanData, "Invalid aligned binary - file size doesnt match the data"); }
+	
+	return true;
+}
+
+bool wexpr_PrivateAlignedFormat_readNode (const uint8_t* data, uint64_t fileSize,
+	uint64_t offset, uint64_t limit,
+	WexprPrivateAlignedNode* node,
+	WexprError* error
+)
+{
+	if (offset < WEXPR_PRIVATE_ALIGNEDFORMAT_PROLOGUESIZE || offset >= limit || limit > fileSize
+		|| (offset % WEXPR_PRIVATE_ALIGNEDFORMAT_ALIGNMENT) != 0
+		|| fileSize - offset < WEXPR_PRIVATE_ALIGNEDFORMAT_NODEHEADERSIZE)
+	{ WEXPR_PRIVATE_FAIL_WITH(WexprErrorCodeBinaryInvalidNode, "Invalid aligned binary - node is out of place"); }
+	
+	const uint8_t* header = data + offset;
+	uint32_t values[2];
+	memcpy (values, header, sizeof(values));
+	
+	node->type = (WexprExpressionType)wexpr_littleUInt32ToNative(values[0]);
+	node->extra = wexpr_littleUInt32ToNative(values[1]);
+	node->count = wexpr_PrivateAlignedFormat_readUInt64(header + sizeof(values));
+	node->payload = header + WEXPR_PRIVATE_ALIGNEDFORMAT_NODEHEADERSIZE;
+	
+	// make sure the payload fits
+	uint64_t available = fileSize - offset - WEXPR_PRIVATE_ALIGNEDFORMAT_NODEHEADERSIZE;
+	bool fits = false;
+	
+	switch (wexpr_littleUInt32ToNative(values[0]))
+	{
+		case WexprExpressionTypeNull:
+			fits = (node->count == 0);
+			break;
+		
+		case WexprExpressionTypeValue:
+			fits = (node->count < available && node->payload[node->count] == 0); // zero terminated
+			break;
+		
+		case WexprExpressionTypeBinaryData:
+			fits = (node->count <= available);
+			break;
+		
+		case WexprExpressionTypeArray:
+			fits = (node->count <= available / sizeof(uint64_t));
+			break;
+		
+		case WexprExpressionTypeMap:
+			fits = (node->count <= available / WEXPR_PRIVATE_ALIGNEDFORMAT_MAPENTRYSIZE);
+			break;
+		
+		default:
+			fits = false; // unknown type
+	}
+	
+	if (!fits)
+	{ WEXPR_PRIVATE_FAIL_WITH(WexprErrorCodeBinaryInvalidNode, "Invalid aligned binary - node doesnt fit"); }
+	
+	return true;
+}
+
+bool wexpr_PrivateAlignedFormat_markNode (uint8_t* visited, uint64_t offset, WexprError* error)
+{
+	uint64_t slot = offset / WEXPR_PRIVATE_ALIGNEDFORMAT_ALIGNMENT;
+	uint8_t bit = (uint8_t)(1u << (slot % 8));
+	
+	if (visited[slot / 8] & bit)
+	{ WEXPR_PRIVATE_FAIL_WITH(WexprErrorCodeBinaryInvalidNode, "Invalid aligned binary - node is used more than once"); }
+	
+	visited[slot / 8] |= bit;
+	return true;
+}
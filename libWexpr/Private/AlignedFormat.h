@@ -0,0 +1,199 @@
+//
+/// \file libWexpr/AlignedFormat.h
+/// \brief Constants and helpers for the aligned binary wexpr layout
+//
+// #LICENSE_BEGIN:MIT#
+// 
+// Copyright (c) 2017-2020, Kenneth Perry (thothonegan)
+// 
+// Permission is hereby granted, free of charge, to any person obtaining
+// a copy of this software and associated documentation files (the
+// "Software"), to deal in the Software without restriction, including
+// without limitation the rights to use, copy, modify, merge, publish,
+// distribute, sublicense, and/or sell copies of the Software, and to
+// permit persons to whom the Software is furnished to do so, subject to
+// the following conditions:
+// 
+// The above copyright notice and this permission notice shall be
+// included in all copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+// MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+// NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+// LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+// OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+// WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+// 
+// SPDX-License-Identifier: MIT
+// #LICENSE_END#
+//
+
+#ifndef LIBWEXPR_ALIGNEDFORMAT_H
+#define LIBWEXPR_ALIGNEDFORMAT_H
+
+#include <libWexpr/Endian.h>
+#include <libWexpr/Error.h>
+#include <libWexpr/ExpressionType.h>
+#include <libWexpr/Macros.h>
+
+#include "BinaryFormat.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+LIBWEXPR_EXTERN_C_BEGIN()
+
+// See Spec/WexprBinarySpec-0.2.0.md for details. A file is the header, the prologue, then nodes.
+// Everything is little endian and 8 byte aligned, and nodes refer to each other by offset from the start
+// of the file, so it can be read in place without parsing.
+
+//
+/// \brief The version of the aligned layout, in the header.
+//
+static const uint32_t wexpr_PrivateAlignedFormat_version = 0x00002000; // 0.2.0
+
+//
+/// \brief Everything is aligned to this many bytes.
+//
+#define WEXPR_PRIVATE_ALIGNEDFORMAT_ALIGNMENT 8
+
+//
+/// \brief Size of the header and the prologue after it (padding, root offset, file size).
+//
+#define WEXPR_PRIVATE_ALIGNEDFORMAT_PROLOGUESIZE 40
+
+//
+/// \brief Size of the header at the start of every node: type, extra, count.
+//
+#define WEXPR_PRIVATE_ALIGNEDFORMAT_NODEHEADERSIZE 16
+
+//
+/// \brief Size of each map entry: key hash, key offset, value offset.
+//
+#define WEXPR_PRIVATE_ALIGNEDFORMAT_MAPENTRYSIZE 24
+
+//
+/// \brief A node which has been bounds checked.
+//
+typedef struct WexprPrivateAlignedNode
+{
+	WexprExpressionType type;
+	uint32_t extra; // compression for binary data, otherwise 0
+	uint64_t count; // bytes for values/binary data (values have a 0 after), children for arrays, pairs for maps
+	const uint8_t* payload; // after the header
+} WexprPrivateAlignedNode;
+
+//
+/// \brief Round the size up to the alignment.
+//
+static inline uint64_t wexpr_PrivateAlignedFormat_align (uint64_t size)
+{
+	return (size + (WEXPR_PRIVATE_ALIGNEDFORMAT_ALIGNMENT - 1)) & ~(uint64_t)(WEXPR_PRIVATE_ALIGNEDFORMAT_ALIGNMENT - 1);
+}
+
+//
+/// \brief Write a little endian uint64_t.
+//
+static inline void wexpr_PrivateAlignedFormat_writeUInt64 (uint8_t* buf, uint64_t value)
+{
+	value = wexpr_uint64ToLittle(value);
+	memcpy (buf, &value, sizeof(value));
+}
+
+//
+/// \brief Read a little endian uint64_t. This is a single load on little endian machines.
+//
+static inline uint64_t wexpr_PrivateAlignedFormat_readUInt64 (const uint8_t* buf)
+{
+	uint64_t value = 0;
+	memcpy (&value, buf, sizeof(value));
+	
+	return wexpr_littleUInt64ToNative(value);
+}
+
+//
+/// \brief Fill in a node header.
+//
+static inline void wexpr_PrivateAlignedFormat_writeNodeHeader (uint8_t header[WEXPR_PRIVATE_ALIGNEDFORMAT_NODEHEADERSIZE],
+	WexprExpressionType type, uint32_t extra, uint64_t count
+)
+{
+	uint32_t values[2] = { wexpr_uint32ToLittle((uint32_t)type), wexpr_uint32ToLittle(extra) };
+	memcpy (header, values, sizeof(values));
+	
+	wexpr_PrivateAlignedFormat_writeUInt64(header + sizeof(values), count);
+}
+
+//
+/// \brief Fill in the header and prologue.
+//
+static inline void wexpr_PrivateAlignedFormat_writePrologue (uint8_t prologue[WEXPR_PRIVATE_ALIGNEDFORMAT_PROLOGUESIZE],
+	uint64_t rootOffset, uint64_t fileSize
+)
+{
+	memset (prologue, 0, WEXPR_PRIVATE_ALIGNEDFORMAT_PROLOGUESIZE);
+	wexpr_PrivateBinaryFormat_writeHeaderWithVersion(prologue, wexpr_PrivateAlignedFormat_version);
+	
+	wexpr_PrivateAlignedFormat_writeUInt64(prologue + 24, rootOffset);
+	wexpr_PrivateAlignedFormat_writeUInt64(prologue + 32, fileSize);
+}
+
+//
+/// \brief Validate the header and prologue of an aligned file.
+/// \param data The whole file
+/// \param length The size of data
+/// \param rootOffset Set to the offset of the root node
+/// \param fileSize Set to the size of the file, which every node must be within. Can be less than length.
+/// \param error If not null, filled in on failure
+/// \return true if the file is valid
+//
+bool wexpr_PrivateAlignedFormat_readPrologue (const uint8_t* data, size_t length,
+	uint64_t* rootOffset, uint64_t* fileSize,
+	WexprError* error
+);
+
+//
+/// \brief Read and bounds check the node at offset.
+/// Nodes always come after their children, so offset must be below limit (the offset of the parent, or the file
+/// size for the root). This means following offsets can never loop, but not that they form a tree - a file
+/// can still point several parents (or one parent several times) at the same node, making the tree it describes
+/// exponentially bigger than the file. Readers which build every node use wexpr_PrivateAlignedFormat_markNode() to refuse that.
+/// \param data The whole file
+/// \param fileSize The size from the prologue
+/// \param offset Offset of the node
+/// \param limit The node must start before this
+/// \param node Filled in with the node
+/// \param error If not null, filled in on failure
+/// \return true if the node is valid
+//
+bool wexpr_PrivateAlignedFormat_readNode (const uint8_t* data, uint64_t fileSize,
+	uint64_t offset, uint64_t limit,
+	WexprPrivateAlignedNode* node,
+	WexprError* error
+);
+
+//
+/// \brief Size of the buffer for wexpr_PrivateAlignedFormat_markNode(), which must start zeroed.
+/// It has a bit for each place a node could be.
+//
+static inline size_t wexpr_PrivateAlignedFormat_visitedSize (uint64_t fileSize)
+{
+	return (size_t)(fileSize / WEXPR_PRIVATE_ALIGNEDFORMAT_ALIGNMENT / 8) + 1;
+}
+
+//
+/// \brief Mark the node at offset as read, failing if it already was.
+/// In a file we wrote every node has one parent, so this only fails if nodes are shared.
+/// \param visited The buffer, of wexpr_PrivateAlignedFormat_visitedSize()
+/// \param offset Offset of the node, which wexpr_PrivateAlignedFormat_readNode() has already checked
+/// \param error If not null, filled in on failure
+/// \return true if it wasnt read before
+//
+bool wexpr_PrivateAlignedFormat_markNode (uint8_t* visited, uint64_t offset, WexprError* error);
+
+LIBWEXPR_EXTERN_C_END()
+
+#endif // LIBWEXPR_ALIGNEDFORMAT_H
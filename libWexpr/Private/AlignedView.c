@@ -0,0 +1,223 @@
+//
+/// \file libWexpr/AlignedView.c
+/// \brief Read only view into aligned binary wexpr files
+//
+// #LICENSE_BEGIN:MIT#
+// 
+// Copyright (c) 2017-2020, Kenneth Perry (thothonegan)
+// 
+// Permission is hereby granted, free of charge, to any person obtaining
+// a copy of this software and associated documentation files (the
+// "Software"), to deal in the Software without restriction, including
+// without limitation the rights to use, copy, modify, merge, publish,
+// distribute, sublicense, and/or sell copies of the Software, and to
+// permit persons to whom the Software is furnished to do so, subject to
+// the following conditions:
+// 
+// The above copyright notice and this permission notice shall be
+// included in all copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+// MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+// NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+// LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+// OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+// WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+// 
+// SPDX-License-Identifier: MIT
+// #LICENSE_END#
+//
+
+#include <libWexpr/AlignedView.h>
+
+#include <string.h>
+
+#include "AlignedFormat.h"
+#include "HashTable.h"
+
+// --- private
+
+static WexprAlignedView s_AlignedView_createInvalid (void)
+{
+	WexprAlignedView view;
+	view.file = NULL;
+	view.fileSize = 0;
+	view.offset = 0;
+	view.type = WexprExpressionTypeInvalid;
+	view.count = 0;
+	view.payload = NULL;
+	view.extra = 0;
+	
+	return view;
+}
+
+// view of the node at offset, which must be below limit
+static WexprAlignedView s_AlignedView_create (const uint8_t* file, uint64_t fileSize,
+	uint64_t offset, uint64_t limit,
+	WexprError* error
+)
+{
+	WexprPrivateAlignedNode node;
+	if (!wexpr_PrivateAlignedFormat_readNode(file, fileSize, offset, limit, &node, error))
+	{ return s_AlignedView_createInvalid(); }
+	
+	WexprAlignedView view;
+	view.file = file;
+	view.fileSize = fileSize;
+	view.offset = offset;
+	view.type = node.type;
+	view.count = node.count;
+	view.payload = node.payload;
+	view.extra = node.extra;
+	
+	return view;
+}
+
+// view of a child, which always comes before us
+static WexprAlignedView s_AlignedView_childAt (const WexprAlignedView* self, uint64_t childOffset)
+{
+	return s_AlignedView_create(self->file, self->fileSize, childOffset, self->offset, NULL);
+}
+
+// the map entry at index, which must be in range
+static const uint8_t* s_AlignedView_mapEntry (const WexprAlignedView* self, size_t index)
+{
+	return self->payload + index * WEXPR_PRIVATE_ALIGNEDFORMAT_MAPENTRYSIZE;
+}
+
+// --- Construction
+
+WexprAlignedView wexpr_AlignedView_createFromFile (const void* data, size_t length, WexprError* error)
+{
+	uint64_t rootOffset = 0;
+	uint64_t fileSize = 0;
+	
+	if (!wexpr_PrivateAlignedFormat_readPrologue(data, length, &rootOffset, &fileSize, error))
+	{ return s_AlignedView_createInvalid(); }
+	
+	return s_AlignedView_create(data, fileSize, rootOffset, fileSize, error);
+}
+
+// --- Information
+
+bool wexpr_AlignedView_isValid (const WexprAlignedView* self)
+{
+	return self->type != WexprExpressionTypeInvalid;
+}
+
+WexprExpressionType wexpr_AlignedView_type (const WexprAlignedView* self)
+{
+	return self->type;
+}
+
+// --- Values
+
+const char* wexpr_AlignedView_value (const WexprAlignedView* self, size_t* length)
+{
+	if (self->type != WexprExpressionTypeValue)
+	{
+		if (length)
+		{ *length = 0; }
+		
+		return NULL;
+	}
+	
+	if (length)
+	{ *length = (size_t)self->count; }
+	
+	return (const char*)self->payload;
+}
+
+bool wexpr_AlignedView_valueEquals (const WexprAlignedView* self, const char* str, size_t length)
+{
+	return (self->type == WexprExpressionTypeValue
+		&& self->count == length
+		&& memcmp(self->payload, str, length) == 0
+	);
+}
+
+const void* wexpr_AlignedView_binaryData (const WexprAlignedView* self, size_t* byteSize)
+{
+	if (self->type != WexprExpressionTypeBinaryData || self->extra != 0x00)
+	{
+		*byteSize = 0;
+		return NULL;
+	}
+	
+	*byteSize = (size_t)self->count;
+	return self->payload;
+}
+
+// --- Arrays/Maps
+
+size_t wexpr_AlignedView_count (const WexprAlignedView* self)
+{
+	if (self->type != WexprExpressionTypeArray && self->type != WexprExpressionTypeMap)
+	{ return 0; }
+	
+	return (size_t)self->count;
+}
+
+WexprAlignedView wexpr_AlignedView_arrayAt (const WexprAlignedView* self, size_t index)
+{
+	if (self->type != WexprExpressionTypeArray || index >= self->count)
+	{ return s_AlignedView_createInvalid(); }
+	
+	return s_AlignedView_childAt(self, wexpr_PrivateAlignedFormat_readUInt64(self->payload + index * sizeof(uint64_t)));
+}
+
+WexprAlignedView wexpr_AlignedView_mapKeyAt (const WexprAlignedView* self, size_t index)
+{
+	if (self->type != WexprExpressionTypeMap || index >= self->count)
+	{ return s_AlignedView_createInvalid(); }
+	
+	WexprAlignedView key = s_AlignedView_childAt(self, wexpr_PrivateAlignedFormat_readUInt64(s_AlignedView_mapEntry(self, index) + sizeof(uint64_t)));
+	
+	return (key.type == WexprExpressionTypeValue) ? key : s_AlignedView_createInvalid();
+}
+
+WexprAlignedView wexpr_AlignedView_mapValueAt (const WexprAlignedView* self, size_t index)
+{
+	if (self->type != WexprExpressionTypeMap || index >= self->count)
+	{ return s_AlignedView_createInvalid(); }
+	
+	return s_AlignedView_childAt(self, wexpr_PrivateAlignedFormat_readUInt64(s_AlignedView_mapEntry(self, index) + 2 * sizeof(uint64_t)));
+}
+
+WexprAlignedView wexpr_AlignedView_mapValueForLengthKey (const WexprAlignedView* self, const char* key, size_t keyLength)
+{
+	if (self->type != WexprExpressionTypeMap)
+	{ return s_AlignedView_createInvalid(); }
+	
+	// entries are sorted by key hash, so find the first with ours and check each with the same hash
+	uint64_t hash = wexpr_PrivateHashTable_hashBytes(key, keyLength);
+	
+	size_t low = 0;
+	size_t high = (size_t)self->count;
+	
+	while (low < high)
+	{
+		size_t mid = low + (high - low) / 2;
+		
+		if (wexpr_PrivateAlignedFormat_readUInt64(s_AlignedView_mapEntry(self, mid)) < hash)
+		{ low = mid + 1; }
+		else
+		{ high = mid; }
+	}
+	
+	for (; low < self->count && wexpr_PrivateAlignedFormat_readUInt64(s_AlignedView_mapEntry(self, low)) == hash; ++low)
+	{
+		WexprAlignedView childKey = wexpr_AlignedView_mapKeyAt(self, low);
+		
+		if (wexpr_AlignedView_valueEquals(&childKey, key, keyLength))
+		{ return wexpr_AlignedView_mapValueAt(self, low); }
+	}
+	
+	return s_AlignedView_createInvalid();
+}
+
+WexprAlignedView wexpr_AlignedView_mapValueForKey (const WexprAlignedView* self, const char* key)
+{
+	return wexpr_AlignedView_mapValueForLengthKey(self, key, strlen(key));
+}
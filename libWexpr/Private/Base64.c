@@ -186,32 +186,45 @@ Base64Buffer base64_encode (Base64IBuffer buf)
 {
 	Base64Buffer res;
 	
-	// estimated size : every 3 bytes becomes 4 bytes
-	res.size = 4 * ((buf.size / 3) + 1); // 4*ceil(n/3)
-	res.buffer = malloc(res.size);
+	res.size = base64_encodedSize(buf.size);
+	res.buffer = malloc(res.size + 1); // +1 so empty input is still a valid buffer
 	
 	if (!res.buffer)
 	{
 		return res; // buffer is null so its invalid
 	}
 	
+	// make sure its output size is correct
+	res.size = base64_encodeInto(buf, res.buffer);
+	
+	return res; // success
+}
+
+size_t base64_encodedSize (size_t byteSize)
+{
+	// every 3 bytes becomes 4 bytes
+	return 4 * ((byteSize + 2) / 3); // 4*ceil(n/3)
+}
+
+size_t base64_encodeInto (Base64IBuffer buf, char* output)
+{
 	size_t remaining = buf.size;
 	uint8_t inputBytes[3];
 	
 	size_t curInInputBytes = 0; // current position in inputBytes
 	size_t curInInput = 0; // current position in buf.buffer
-	size_t curInOutput = 0; // current position in res.buffer
+	size_t curInOutput = 0; // current position in output
 	
 	while (remaining--)
 	{
-		inputBytes[curInInputBytes] = *( (uint8_t*)buf.buffer + curInInput);
+		inputBytes[curInInputBytes] = *( (const uint8_t*)buf.buffer + curInInput);
 		curInInputBytes++;
 		curInInput++;
 		
 		if (curInInputBytes == 3)
 		{
 			// filled up - encode
-			s_base64EncodeAndAppend((char*)res.buffer + curInOutput, inputBytes, 4);
+			s_base64EncodeAndAppend(output + curInOutput, inputBytes, 4);
 			curInOutput += 4;
 			curInInputBytes = 0;
 		}
@@ -225,19 +238,16 @@ Base64Buffer base64_encode (Base64IBuffer buf)
 			inputBytes[j] = 0;
 		}
 		
-		s_base64EncodeAndAppend((char*)res.buffer + curInOutput, inputBytes, curInInputBytes+1);
+		s_base64EncodeAndAppend(output + curInOutput, inputBytes, curInInputBytes+1);
 		curInOutput += curInInputBytes+1;
 		
 		// append padding
 		while (curInInputBytes++ < 3)
 		{
-			((uint8_t*)res.buffer)[curInOutput] = '=';
+			output[curInOutput] = '=';
 			curInOutput++;
 		}
 	}
 	
-	// make sure its output size is correct
-	res.size = curInOutput;
-	
-	return res; // success
+	return curInOutput;
 }
@@ -56,4 +56,16 @@ Base64Buffer base64_decode (Base64IBuffer buf);
 //
 Base64Buffer base64_encode (Base64IBuffer buf);
 
+//
+/// \brief Return the number of bytes base64_encodeInto() will write for the given input size.
+//
+size_t base64_encodedSize (size_t byteSize);
+
+//
+/// \brief Encode the given buffer as Base64 into output, which must have base64_encodedSize() bytes.
+/// Input sizes that are a multiple of 3 produce no padding, so large buffers can be encoded in pieces.
+/// \return The number of bytes written.
+//
+size_t base64_encodeInto (Base64IBuffer buf, char* output);
+
 #endif // LIBWEXPR_BASE64_H
@@ -0,0 +1,320 @@
+//
+/// \file libWexpr/BinaryFormat.c
+/// \brief Constants and helpers for the binary wexpr format
+//
+// #LICENSE_BEGIN:MIT#
+// 
+// Copyright (c) 2017-2020, Kenneth Perry (thothonegan)
+// 
+// Permission is hereby granted, free of charge, to any person obtaining
+// a copy of this software and associated documentation files (the
+// "Software"), to deal in the Software without restriction, including
+// without limitation the rights to use, copy, modify, merge, publish,
+// distribute, sublicense, and/or sell copies of the Software, and to
+// permit persons to whom the Software is furnished to do so, subject to
+// the following conditions:
+// 
+// The above copyright notice and this permission notice shall be
+// included in all copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+// MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+// NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+// LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+// OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+// WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+// 
+// SPDX-License-Identifier: MIT
+// #LICENSE_END#
+//
+
+#include "BinaryFormat.h"
+#include "ErrorHelpers.h"
+
+#include <libWexpr/ExpressionType.h>
+
+#include <stdlib.h>
+#include <string.h>
+
+// --- public
+
+bool wexpr_PrivateBinaryFormat_readChunkHeader (const uint8_t* buf, size_t byteSize,
+	uint64_t* contentSize, uint8_t* chunkType, size_t* headerSize,
+	WexprError* error
+)
+{
+	const uint8_t* dataNewPos = wexpr_uvlq64_read(buf, byteSize, contentSize);
+	
+	if (!dataNewPos || (size_t)(dataNewPos - buf) >= byteSize) // need the type too
+	{
+		if (error)
+		{
+			error->message = strdup ("Chunk not big enough for header");
+			error->code = WexprErrorCodeBinaryChunkNotBigEnough;
+		}
+		
+		return false;
+	}
+	
+	size_t sizeSize = (size_t)(dataNewPos - buf);
+	
+	*chunkType = buf[sizeSize];
+	*headerSize = sizeSize + sizeof(uint8_t);
+	
+	if (*contentSize > byteSize - *headerSize)
+	{
+		if (error)
+		{
+			error->message = strdup ("Chunk size is bigger than the data");
+			error->code = WexprErrorCodeBinaryChunkBiggerThanData;
+		}
+		
+		return false;
+	}
+	
+	return true;
+}
+
+bool wexpr_PrivateBinaryFormat_readHeader (const uint8_t* data, size_t length, uint32_t* version, WexprError* error)
+{
+	if (length < WEXPR_PRIVATE_BINARYFORMAT_HEADERSIZE)
+	{ WEXPR_PRIVATE_FAIL_WITH(WexprErrorCodeBinaryInvalidHeader, "Invalid binary header - not big enough"); }
+	
+	if (memcmp(data, wexpr_PrivateBinaryFormat_magic, sizeof(wexpr_PrivateBinaryFormat_magic)) != 0)
+	{ WEXPR_PRIVATE_FAIL_WITH(WexprErrorCodeBinaryInvalidHeader, "Invalid binary header - invalid magic"); }
+	
+	// make sure reserved is blank
+	for (size_t i=12; i < WEXPR_PRIVATE_BINARYFORMAT_HEADERSIZE; ++i)
+	{
+		if (data[i] != 0)
+		{ WEXPR_PRIVATE_FAIL_WITH(WexprErrorCodeBinaryInvalidHeader, "Invalid binary header - unknown reserved bits"); }
+	}
+	
+	uint32_t bigVersion = 0;
+	memcpy (&bigVersion, data + 8, sizeof(bigVersion));
+	
+	*version = wexpr_bigUInt32ToNative(bigVersion);
+	return true;
+}
+
+bool wexpr_PrivateBinaryFormat_findExpressionChunk (const uint8_t* data, size_t length,
+	const uint8_t** chunk, size_t* chunkSize,
+	WexprError* error
+)
+{
+	// header
+	uint32_t version = 0;
+	if (!wexpr_PrivateBinaryFormat_readHeader(data, length, &version, error))
+	{ return false; }
+	
+	if (version != wexpr_PrivateBinaryFormat_version)
+	{ WEXPR_PRIVATE_FAIL_WITH(WexprErrorCodeBinaryUnknownVersion, "Invalid binary header - unknown version"); }
+	
+	// find the expression chunk. Auxiliary chunks are skipped without looking inside.
+	*chunk = NULL;
+	*chunkSize = 0;
+	
+	size_t curPos = WEXPR_PRIVATE_BINARYFORMAT_HEADERSIZE;
+	while (curPos < length)
+	{
+		uint64_t contentSize = 0;
+		uint8_t chunkType = 0;
+		size_t headerSize = 0;
+		
+		if (!wexpr_PrivateBinaryFormat_readChunkHeader(data + curPos, length - curPos, &contentSize, &chunkType, &headerSize, error))
+		{ return false; }
+		
+		size_t thisChunkSize = headerSize + (size_t)contentSize;
+		
+		// a root value can be written as a typed value
+		if (chunkType <= WexprExpressionTypeBinaryData || wexpr_PrivateBinaryFormat_isTypedValueChunk(chunkType))
+		{
+			if (*chunk)
+			{ WEXPR_PRIVATE_FAIL_WITH(WexprErrorCodeBinaryMultipleExpressions, "Found multiple expression chunks"); }
+			
+			*chunk = data + curPos;
+			*chunkSize = thisChunkSize;
+		}
+		
+		// otherwise its an auxiliary chunk we dont handle
+		
+		curPos += thisChunkSize;
+	}
+	
+	if (!*chunk)
+	{ WEXPR_PRIVATE_FAIL_WITH(WexprErrorCodeBinaryMissingExpression, "No expression chunk found"); }
+	
+	return true;
+}
+
+bool wexpr_PrivateBinaryFormat_findAuxiliaryChunk (const uint8_t* data, size_t length, uint8_t chunkType,
+	const uint8_t** content, size_t* contentSize
+)
+{
+	size_t curPos = WEXPR_PRIVATE_BINARYFORMAT_HEADERSIZE;
+	while (curPos < length)
+	{
+		uint64_t thisContentSize = 0;
+		uint8_t thisChunkType = 0;
+		size_t headerSize = 0;
+		
+		if (!wexpr_PrivateBinaryFormat_readChunkHeader(data + curPos, length - curPos, &thisContentSize, &thisChunkType, &headerSize, NULL))
+		{ return false; }
+		
+		if (thisChunkType == chunkType)
+		{
+			*content = data + curPos + headerSize;
+			*contentSize = (size_t)thisContentSize;
+			return true;
+		}
+		
+		curPos += headerSize + (size_t)thisContentSize;
+	}
+	
+	return false;
+}
+
+uint64_t wexpr_PrivateBinaryFormat_stringTableCount (const uint8_t* table, size_t tableSize)
+{
+	if (!table || tableSize < sizeof(uint64_t))
+	{ return 0; }
+	
+	uint64_t count = wexpr_PrivateBinaryFormat_readUInt64(table);
+	if (count > (tableSize - sizeof(uint64_t)) / sizeof(uint64_t))
+	{ return 0; } // offsets dont fit
+	
+	return count;
+}
+
+bool wexpr_PrivateBinaryFormat_stringTableLookup (const uint8_t* table, size_t tableSize,
+	const uint8_t* reference, size_t referenceSize,
+	uint64_t* index, const uint8_t** str, size_t* length,
+	WexprError* error
+)
+{
+	uint64_t count = wexpr_PrivateBinaryFormat_stringTableCount(table, tableSize);
+	
+	// the reference is exactly one index
+	const uint8_t* referenceEnd = wexpr_uvlq64_read(reference, referenceSize, index);
+	bool valid = (referenceEnd == reference + referenceSize && *index < count);
+	
+	uint64_t offset = 0;
+	uint64_t stringLength = 0;
+	const uint8_t* stringStart = NULL;
+	
+	if (valid)
+	{
+		offset = wexpr_PrivateBinaryFormat_readUInt64(table + sizeof(uint64_t) + (*index) * sizeof(uint64_t));
+		valid = (offset < tableSize);
+	}
+	
+	if (valid)
+	{
+		stringStart = wexpr_uvlq64_read(table + offset, tableSize - (size_t)offset, &stringLength);
+		valid = (stringStart != NULL && stringLength <= (uint64_t)(table + tableSize - stringStart));
+	}
+	
+	if (!valid)
+	{
+		if (error)
+		{
+			error->code = WexprErrorCodeBinaryInvalidStringReference;
+			error->message = strdup ("Invalid string reference");
+		}
+		
+		return false;
+	}
+	
+	*str = stringStart;
+	*length = (size_t)stringLength;
+	return true;
+}
+
+size_t wexpr_PrivateBinaryFormat_encodeTypedValue (const WexprPrivateTypedValue* value,
+	uint8_t* chunkType, uint8_t content[WEXPR_PRIVATE_BINARYFORMAT_MAXTYPEDVALUESIZE]
+)
+{
+	switch (value->kind)
+	{
+		case WexprPrivateTypedValueKindInt64:
+		{
+			// zigzag, so small negative numbers are small too
+			uint64_t bits = (uint64_t)value->int64Value;
+			uint64_t zigzag = (bits << 1U) ^ (uint64_t)(-(int64_t)(bits >> 63U));
+			
+			*chunkType = WEXPR_PRIVATE_BINARYFORMAT_CHUNKTYPE_INT64;
+			
+			size_t size = wexpr_uvlq64_bytesize(zigzag);
+			wexpr_uvlq64_write(content, size, zigzag);
+			return size;
+		}
+		
+		case WexprPrivateTypedValueKindFloat64:
+		{
+			uint64_t bits = 0;
+			memcpy (&bits, &value->float64Value, sizeof(bits));
+			
+			*chunkType = WEXPR_PRIVATE_BINARYFORMAT_CHUNKTYPE_FLOAT64;
+			wexpr_PrivateBinaryFormat_writeUInt64(content, bits);
+			return sizeof(bits);
+		}
+		
+		default: // boolean
+			*chunkType = WEXPR_PRIVATE_BINARYFORMAT_CHUNKTYPE_BOOLEAN;
+			content[0] = value->booleanValue ? 1 : 0;
+			return 1;
+	}
+}
+
+bool wexpr_PrivateBinaryFormat_decodeTypedValue (uint8_t chunkType, const uint8_t* content, size_t contentSize,
+	WexprPrivateTypedValue* value,
+	WexprError* error
+)
+{
+	bool valid = false;
+	
+	if (chunkType == WEXPR_PRIVATE_BINARYFORMAT_CHUNKTYPE_INT64)
+	{
+		uint64_t zigzag = 0;
+		valid = (wexpr_uvlq64_read(content, contentSize, &zigzag) == content + contentSize);
+		
+		value->kind = WexprPrivateTypedValueKindInt64;
+		value->int64Value = (int64_t)((zigzag >> 1U) ^ (~(zigzag & 1U) + 1U));
+	}
+	
+	else if (chunkType == WEXPR_PRIVATE_BINARYFORMAT_CHUNKTYPE_FLOAT64)
+	{
+		valid = (contentSize == sizeof(uint64_t));
+		
+		value->kind = WexprPrivateTypedValueKindFloat64;
+		value->float64Value = 0;
+		
+		if (valid)
+		{
+			uint64_t bits = wexpr_PrivateBinaryFormat_readUInt64(content);
+			memcpy (&value->float64Value, &bits, sizeof(bits));
+		}
+	}
+	
+	else if (chunkType == WEXPR_PRIVATE_BINARYFORMAT_CHUNKTYPE_BOOLEAN)
+	{
+		valid = (contentSize == 1 && content[0] <= 1);
+		
+		value->kind = WexprPrivateTypedValueKindBoolean;
+		value->booleanValue = valid && content[0] == 1;
+	}
+	
+	if (!valid)
+	{
+		if (error)
+		{
+			error->code = WexprErrorCodeBinaryInvalidTypedValue;
+			error->message = strdup ("Invalid typed value chunk");
+		}
+		
+		return false;
+	}
+	
+	return true;
+}
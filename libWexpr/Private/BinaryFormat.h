@@ -0,0 +1,297 @@
+//
+/// \file libWexpr/BinaryFormat.h
+/// \brief Constants and helpers for the binary wexpr format
+//
+// #LICENSE_BEGIN:MIT#
+// 
+// Copyright (c) 2017-2020, Kenneth Perry (thothonegan)
+// 
+// Permission is hereby granted, free of charge, to any person obtaining
+// a copy of this software and associated documentation files (the
+// "Software"), to deal in the Software without restriction, including
+// without limitation the rights to use, copy, modify, merge, publish,
+// distribute, sublicense, and/or sell copies of the Software, and to
+// permit persons to whom the Software is furnished to do so, subject to
+// the following conditions:
+// 
+// The above copyright notice and this permission notice shall be
+// included in all copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+// MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+// NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+// LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+// OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+// WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+// 
+// SPDX-License-Identifier: MIT
+// #LICENSE_END#
+//
+
+#ifndef LIBWEXPR_BINARYFORMAT_H
+#define LIBWEXPR_BINARYFORMAT_H
+
+#include <libWexpr/Endian.h>
+#include <libWexpr/Error.h>
+#include <libWexpr/Macros.h>
+#include <libWexpr/UVLQ64.h>
+
+#include "TypedValue.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+LIBWEXPR_EXTERN_C_BEGIN()
+
+// See Spec/WexprBinarySpec for details. A file is the header followed by chunks.
+
+//
+/// \brief Size of the file header in bytes: magic, version, reserved.
+//
+#define WEXPR_PRIVATE_BINARYFORMAT_HEADERSIZE 20
+
+//
+/// \brief Magic at the start of every binary file.
+//
+static const uint8_t wexpr_PrivateBinaryFormat_magic[8] = {
+	0x83, 'B', 'W', 'E', 'X', 'P', 'R', 0x0A
+};
+
+//
+/// \brief The version of the format we write.
+//
+static const uint32_t wexpr_PrivateBinaryFormat_version = 0x00001000; // 0.1.0
+
+//
+/// \brief Fill in the file header for the given version.
+//
+static inline void wexpr_PrivateBinaryFormat_writeHeaderWithVersion (uint8_t header[WEXPR_PRIVATE_BINARYFORMAT_HEADERSIZE], uint32_t nativeVersion)
+{
+	uint32_t version = wexpr_uint32ToBig(nativeVersion);
+	
+	memset (header, 0, WEXPR_PRIVATE_BINARYFORMAT_HEADERSIZE); // reserved is 0
+	memcpy (header, wexpr_PrivateBinaryFormat_magic, sizeof(wexpr_PrivateBinaryFormat_magic));
+	memcpy (header + 8, &version, sizeof(version));
+}
+
+//
+/// \brief Fill in the file header for the current version.
+//
+static inline void wexpr_PrivateBinaryFormat_writeHeader (uint8_t header[WEXPR_PRIVATE_BINARYFORMAT_HEADERSIZE])
+{
+	wexpr_PrivateBinaryFormat_writeHeaderWithVersion(header, wexpr_PrivateBinaryFormat_version);
+}
+
+//
+/// \brief Largest possible UVLQ64 in bytes.
+//
+#define WEXPR_PRIVATE_BINARYFORMAT_MAXUVLQ64SIZE 10
+
+//
+/// \brief Largest possible chunk header: the size as a UVLQ64 (at most 10 bytes), then the type.
+//
+#define WEXPR_PRIVATE_BINARYFORMAT_MAXCHUNKHEADERSIZE 11
+
+//
+/// \brief Size of the header for a chunk with the given content size.
+//
+static inline size_t wexpr_PrivateBinaryFormat_chunkHeaderSize (size_t contentSize)
+{
+	return wexpr_uvlq64_bytesize(contentSize) + sizeof(uint8_t);
+}
+
+//
+/// \brief Encode a chunk header into header, returning the number of bytes used.
+//
+static inline size_t wexpr_PrivateBinaryFormat_encodeChunkHeader (uint8_t header[WEXPR_PRIVATE_BINARYFORMAT_MAXCHUNKHEADERSIZE],
+	size_t contentSize, uint8_t chunkType
+)
+{
+	size_t sizeSize = wexpr_uvlq64_bytesize(contentSize);
+	
+	wexpr_uvlq64_write(header, sizeSize, contentSize);
+	header[sizeSize] = chunkType;
+	
+	return sizeSize + sizeof(uint8_t);
+}
+
+//
+/// \brief Auxiliary chunk type for the index of large arrays/maps in the expression chunk.
+/// It's in the experimental range, so other readers will skip it. See Documentation/BinaryIndex.md for the layout.
+//
+#define WEXPR_PRIVATE_BINARYFORMAT_CHUNKTYPE_INDEX 0x80
+
+//
+/// \brief Auxiliary chunk type which holds every chunk after the header, compressed as independent blocks.
+/// See Documentation/BinaryCompression.md for the layout.
+//
+#define WEXPR_PRIVATE_BINARYFORMAT_CHUNKTYPE_COMPRESSEDBLOCKS 0x81
+
+//
+/// \brief Auxiliary chunk type which holds strings shared by the expression chunk.
+/// It comes before the expression chunk. See Documentation/BinaryStringTable.md for the layout.
+//
+#define WEXPR_PRIVATE_BINARYFORMAT_CHUNKTYPE_STRINGTABLE 0x82
+
+//
+/// \brief Chunk type used in place of a value, whose content is the UVLQ64 index of the string in the string table.
+//
+#define WEXPR_PRIVATE_BINARYFORMAT_CHUNKTYPE_STRINGREFERENCE 0x83
+
+//
+/// \brief Chunk types used in place of a value holding a number or boolean. See Documentation/BinaryTypedValues.md.
+//
+#define WEXPR_PRIVATE_BINARYFORMAT_CHUNKTYPE_INT64 0x84 ///< zigzag encoded UVLQ64
+#define WEXPR_PRIVATE_BINARYFORMAT_CHUNKTYPE_FLOAT64 0x85 ///< big endian IEEE 754 double
+#define WEXPR_PRIVATE_BINARYFORMAT_CHUNKTYPE_BOOLEAN 0x86 ///< one byte, 0 or 1
+
+//
+/// \brief Most bytes the content of a typed value chunk can be.
+//
+#define WEXPR_PRIVATE_BINARYFORMAT_MAXTYPEDVALUESIZE WEXPR_PRIVATE_BINARYFORMAT_MAXUVLQ64SIZE
+
+//
+/// \brief Arrays/maps with fewer children than this arent indexed, since scanning them is already cheap.
+//
+#define WEXPR_PRIVATE_BINARYFORMAT_INDEXMINCOUNT 64
+
+//
+/// \brief Write a big endian uint64, as used by the index.
+//
+static inline void wexpr_PrivateBinaryFormat_writeUInt64 (uint8_t* buf, uint64_t value)
+{
+	value = wexpr_uint64ToBig(value);
+	memcpy (buf, &value, sizeof(value));
+}
+
+//
+/// \brief Read a big endian uint64, as used by the index.
+//
+static inline uint64_t wexpr_PrivateBinaryFormat_readUInt64 (const uint8_t* buf)
+{
+	uint64_t value = 0;
+	memcpy (&value, buf, sizeof(value));
+	
+	return wexpr_bigUInt64ToNative(value);
+}
+
+//
+/// \brief Return true if the chunk type is a typed value.
+//
+static inline bool wexpr_PrivateBinaryFormat_isTypedValueChunk (uint8_t chunkType)
+{
+	return chunkType >= WEXPR_PRIVATE_BINARYFORMAT_CHUNKTYPE_INT64 && chunkType <= WEXPR_PRIVATE_BINARYFORMAT_CHUNKTYPE_BOOLEAN;
+}
+
+//
+/// \brief Encode the content of a typed value chunk.
+/// \param value The value, which must be typed
+/// \param chunkType Set to the chunk type to use
+/// \param content Filled with the content
+/// \return The size of the content
+//
+size_t wexpr_PrivateBinaryFormat_encodeTypedValue (const WexprPrivateTypedValue* value,
+	uint8_t* chunkType, uint8_t content[WEXPR_PRIVATE_BINARYFORMAT_MAXTYPEDVALUESIZE]
+);
+
+//
+/// \brief Decode the content of a typed value chunk.
+/// \param chunkType The type of the chunk
+/// \param content The content of the chunk
+/// \param contentSize The size of the content
+/// \param value Filled in with the value
+/// \param error If not null, filled in on failure
+/// \return true if the content is valid
+//
+bool wexpr_PrivateBinaryFormat_decodeTypedValue (uint8_t chunkType, const uint8_t* content, size_t contentSize,
+	WexprPrivateTypedValue* value,
+	WexprError* error
+);
+
+//
+/// \brief Read the size and type at the start of a chunk, making sure the whole chunk fits in byteSize.
+/// This is the only bounds check needed per chunk, since everything inside it is within the size.
+/// \param buf Start of the chunk
+/// \param byteSize Bytes available from buf
+/// \param contentSize Set to the size of the content
+/// \param chunkType Set to the type of the chunk
+/// \param headerSize Set to the size of the header, so the content starts at buf+headerSize
+/// \param error If not null, filled in on failure
+/// \return true if the chunk is valid
+//
+bool wexpr_PrivateBinaryFormat_readChunkHeader (const uint8_t* buf, size_t byteSize,
+	uint64_t* contentSize, uint8_t* chunkType, size_t* headerSize,
+	WexprError* error
+);
+
+//
+/// \brief Validate the magic and reserved bytes of the file header, and return the version it's for.
+/// Each version has its own layout after the header, so callers check it.
+/// \param data The whole file
+/// \param length The size of data
+/// \param version Set to the version (native endian)
+/// \param error If not null, filled in on failure
+/// \return true if the header is valid
+//
+bool wexpr_PrivateBinaryFormat_readHeader (const uint8_t* data, size_t length, uint32_t* version, WexprError* error);
+
+//
+/// \brief Validate the file header, and find the expression chunk after it.
+/// Every chunk is checked against the data once, and auxiliary chunks are skipped using their size.
+/// \param data The whole file
+/// \param length The size of data
+/// \param chunk Set to the start of the expression chunk
+/// \param chunkSize Set to the size of the whole expression chunk
+/// \param error If not null, filled in on failure
+/// \return true if the file is valid and has exactly one expression chunk
+//
+bool wexpr_PrivateBinaryFormat_findExpressionChunk (const uint8_t* data, size_t length,
+	const uint8_t** chunk, size_t* chunkSize,
+	WexprError* error
+);
+
+//
+/// \brief Find the first auxiliary chunk of the given type in a file.
+/// The file must already have been validated by wexpr_PrivateBinaryFormat_findExpressionChunk().
+/// \param data The whole file
+/// \param length The size of data
+/// \param chunkType The type to find
+/// \param content Set to the content of the chunk
+/// \param contentSize Set to the size of the content
+/// \return true if found
+//
+bool wexpr_PrivateBinaryFormat_findAuxiliaryChunk (const uint8_t* data, size_t length, uint8_t chunkType,
+	const uint8_t** content, size_t* contentSize
+);
+
+//
+/// \brief Return the number of strings in a string table chunk, or 0 if the table is invalid.
+/// \param table The content of the string table chunk
+/// \param tableSize The size of the content
+//
+uint64_t wexpr_PrivateBinaryFormat_stringTableCount (const uint8_t* table, size_t tableSize);
+
+//
+/// \brief Find the string a string reference chunk refers to. Everything is bounds checked.
+/// \param table The content of the string table chunk
+/// \param tableSize The size of the content
+/// \param reference The content of the string reference chunk
+/// \param referenceSize The size of the content
+/// \param index Set to the index of the string
+/// \param str Set to the start of the string (not zero terminated)
+/// \param length Set to the length of the string
+/// \param error If not null, filled in on failure
+/// \return true if the reference is valid
+//
+bool wexpr_PrivateBinaryFormat_stringTableLookup (const uint8_t* table, size_t tableSize,
+	const uint8_t* reference, size_t referenceSize,
+	uint64_t* index, const uint8_t** str, size_t* length,
+	WexprError* error
+);
+
+LIBWEXPR_EXTERN_C_END()
+
+#endif // LIBWEXPR_BINARYFORMAT_H
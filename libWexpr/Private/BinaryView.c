@@ -0,0 +1,506 @@
+//
+/// \file libWexpr/BinaryView.c
+/// \brief Read only view into binary wexpr data, without creating expressions
+//
+// #LICENSE_BEGIN:MIT#
+// 
+// Copyright (c) 2017-2020, Kenneth Perry (thothonegan)
+// 
+// Permission is hereby granted, free of charge, to any person obtaining
+// a copy of this software and associated documentation files (the
+// "Software"), to deal in the Software without restriction, including
+// without limitation the rights to use, copy, modify, merge, publish,
+// distribute, sublicense, and/or sell copies of the Software, and to
+// permit persons to whom the Software is furnished to do so, subject to
+// the following conditions:
+// 
+// The above copyright notice and this permission notice shall be
+// included in all copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+// MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+// NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+// LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+// OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+// WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+// 
+// SPDX-License-Identifier: MIT
+// #LICENSE_END#
+//
+
+#include <libWexpr/BinaryView.h>
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "BinaryFormat.h"
+#include "Compression.h"
+#include "HashTable.h"
+
+// --- private
+
+static WexprBinaryView s_BinaryView_createInvalid (void)
+{
+	WexprBinaryView view;
+	view.content = NULL;
+	view.contentSize = 0;
+	view.chunkSize = 0;
+	view.type = WexprExpressionTypeInvalid;
+	view.typedChunkType = 0;
+	view.root = NULL;
+	view.index = NULL;
+	view.indexSize = 0;
+	view.strings = NULL;
+	view.stringsSize = 0;
+	
+	return view;
+}
+
+// create a view of the chunk at data, which must fit within byteSize.
+// root/index/indexSize/strings/stringsSize are from the parent (or the file).
+// A string reference gives a value view of the string in the table.
+static WexprBinaryView s_BinaryView_create (const uint8_t* data, size_t byteSize,
+	const uint8_t* root, const uint8_t* index, size_t indexSize,
+	const uint8_t* strings, size_t stringsSize,
+	WexprError* error
+)
+{
+	uint64_t contentSize = 0;
+	uint8_t chunkType = 0;
+	size_t headerSize = 0;
+	
+	if (!wexpr_PrivateBinaryFormat_readChunkHeader(data, byteSize, &contentSize, &chunkType, &headerSize, error))
+	{ return s_BinaryView_createInvalid(); }
+	
+	WexprBinaryView view;
+	view.content = data + headerSize;
+	view.contentSize = (size_t)contentSize;
+	view.chunkSize = headerSize + (size_t)contentSize;
+	view.type = chunkType;
+	view.typedChunkType = 0;
+	view.root = root;
+	view.index = index;
+	view.indexSize = indexSize;
+	view.strings = strings;
+	view.stringsSize = stringsSize;
+	
+	if (chunkType == WEXPR_PRIVATE_BINARYFORMAT_CHUNKTYPE_STRINGREFERENCE && strings)
+	{
+		uint64_t stringIndex = 0;
+		const uint8_t* str = NULL;
+		size_t length = 0;
+		
+		if (!wexpr_PrivateBinaryFormat_stringTableLookup(strings, stringsSize, view.content, view.contentSize,
+			&stringIndex, &str, &length, error))
+		{ return s_BinaryView_createInvalid(); }
+		
+		// chunkSize stays the reference's, so skipping it still works
+		view.content = str;
+		view.contentSize = length;
+		view.type = WexprExpressionTypeValue;
+	}
+	
+	else if (wexpr_PrivateBinaryFormat_isTypedValueChunk(chunkType))
+	{
+		// checked now so the accessors cant fail on it
+		WexprPrivateTypedValue typed;
+		if (!wexpr_PrivateBinaryFormat_decodeTypedValue(chunkType, view.content, view.contentSize, &typed, error))
+		{ return s_BinaryView_createInvalid(); }
+		
+		view.type = WexprExpressionTypeValue;
+		view.typedChunkType = chunkType;
+	}
+	
+	return view;
+}
+
+// view of the child chunk at offset (from the root), which must be within our content
+static WexprBinaryView s_BinaryView_childAt (const WexprBinaryView* self, uint64_t offset)
+{
+	size_t contentOffset = (size_t)(self->content - self->root);
+	
+	if (offset < contentOffset || offset - contentOffset >= self->contentSize)
+	{ return s_BinaryView_createInvalid(); }
+	
+	size_t childPos = (size_t)(offset - contentOffset);
+	
+	return s_BinaryView_create(self->content + childPos, self->contentSize - childPos,
+		self->root, self->index, self->indexSize, self->strings, self->stringsSize, NULL
+	);
+}
+
+// Find our record in the index. Returns the entries, or null if not indexed.
+// The index is checked as it's read, so a bad one just means falling back to scanning.
+static const uint8_t* s_BinaryView_indexRecord (const WexprBinaryView* self, size_t entrySize, uint64_t* entryCount)
+{
+	const size_t directoryEntrySize = 2 * sizeof(uint64_t);
+	
+	if (!self->index || self->indexSize < sizeof(uint64_t))
+	{ return NULL; }
+	
+	uint64_t containerCount = wexpr_PrivateBinaryFormat_readUInt64(self->index);
+	if (containerCount > (self->indexSize - sizeof(uint64_t)) / directoryEntrySize)
+	{ return NULL; }
+	
+	// directory is sorted by offset
+	uint64_t chunkOffset = (uint64_t)(self->content + self->contentSize - self->chunkSize - self->root);
+	const uint8_t* directory = self->index + sizeof(uint64_t);
+	
+	size_t low = 0;
+	size_t high = (size_t)containerCount;
+	
+	while (low < high)
+	{
+		size_t mid = low + (high - low) / 2;
+		uint64_t midOffset = wexpr_PrivateBinaryFormat_readUInt64(directory + mid * directoryEntrySize);
+		
+		if (midOffset < chunkOffset)
+		{ low = mid + 1; }
+		else
+		{ high = mid; }
+	}
+	
+	if (low == containerCount
+		|| wexpr_PrivateBinaryFormat_readUInt64(directory + low * directoryEntrySize) != chunkOffset)
+	{ return NULL; }
+	
+	uint64_t recordOffset = wexpr_PrivateBinaryFormat_readUInt64(directory + low * directoryEntrySize + sizeof(uint64_t));
+	if (recordOffset > self->indexSize - sizeof(uint64_t))
+	{ return NULL; }
+	
+	const uint8_t* record = self->index + recordOffset;
+	*entryCount = wexpr_PrivateBinaryFormat_readUInt64(record);
+	
+	if (*entryCount > (self->indexSize - recordOffset - sizeof(uint64_t)) / entrySize)
+	{ return NULL; }
+	
+	return record + sizeof(uint64_t);
+}
+
+// --- Construction
+
+WexprBinaryView wexpr_BinaryView_createFromChunk (const void* data, size_t length, WexprError* error)
+{
+	return s_BinaryView_create(data, length, data, NULL, 0, NULL, 0, error);
+}
+
+WexprBinaryView wexpr_BinaryView_createFromFile (const void* data, size_t length, WexprError* error)
+{
+	const uint8_t* chunk = NULL;
+	size_t chunkSize = 0;
+	
+	if (!wexpr_PrivateBinaryFormat_findExpressionChunk(data, length, &chunk, &chunkSize, error))
+	{ return s_BinaryView_createInvalid(); }
+	
+	const uint8_t* index = NULL;
+	size_t indexSize = 0;
+	
+	if (!wexpr_PrivateBinaryFormat_findAuxiliaryChunk(data, length, WEXPR_PRIVATE_BINARYFORMAT_CHUNKTYPE_INDEX, &index, &indexSize))
+	{ index = NULL; }
+	
+	const uint8_t* strings = NULL;
+	size_t stringsSize = 0;
+	
+	if (!wexpr_PrivateBinaryFormat_findAuxiliaryChunk(data, length, WEXPR_PRIVATE_BINARYFORMAT_CHUNKTYPE_STRINGTABLE, &strings, &stringsSize))
+	{ strings = NULL; }
+	
+	return s_BinaryView_create(chunk, chunkSize, chunk, index, indexSize, strings, stringsSize, error);
+}
+
+// --- Information
+
+bool wexpr_BinaryView_isValid (const WexprBinaryView* self)
+{
+	return self->type != WexprExpressionTypeInvalid;
+}
+
+WexprExpressionType wexpr_BinaryView_type (const WexprBinaryView* self)
+{
+	return self->type;
+}
+
+// --- Values
+
+const char* wexpr_BinaryView_value (const WexprBinaryView* self, size_t* length)
+{
+	if (self->type != WexprExpressionTypeValue || self->typedChunkType != 0)
+	{
+		*length = 0;
+		return NULL;
+	}
+	
+	*length = self->contentSize;
+	return (const char*)self->content;
+}
+
+bool wexpr_BinaryView_valueEquals (const WexprBinaryView* self, const char* str, size_t length)
+{
+	if (self->type == WexprExpressionTypeValue && self->typedChunkType != 0)
+	{
+		// compare with its text
+		WexprPrivateTypedValue typed;
+		wexpr_PrivateBinaryFormat_decodeTypedValue(self->typedChunkType, self->content, self->contentSize, &typed, NULL);
+		
+		char text[WEXPR_PRIVATE_TYPEDVALUE_TEXTBUFFERSIZE];
+		size_t textLength = wexpr_PrivateTypedValue_format(&typed, text);
+		
+		return (textLength == length && memcmp(text, str, length) == 0);
+	}
+	
+	return (self->type == WexprExpressionTypeValue
+		&& self->contentSize == length
+		&& memcmp(self->content, str, length) == 0
+	);
+}
+
+bool wexpr_BinaryView_valueAsInt64 (const WexprBinaryView* self, int64_t* result)
+{
+	if (self->type != WexprExpressionTypeValue)
+	{ return false; }
+	
+	if (self->typedChunkType != 0)
+	{
+		WexprPrivateTypedValue typed;
+		wexpr_PrivateBinaryFormat_decodeTypedValue(self->typedChunkType, self->content, self->contentSize, &typed, NULL);
+		
+		if (typed.kind != WexprPrivateTypedValueKindInt64)
+		{ return false; }
+		
+		*result = typed.int64Value;
+		return true;
+	}
+	
+	return wexpr_PrivateTypedValue_parseInt64((const char*)self->content, self->contentSize, result);
+}
+
+bool wexpr_BinaryView_valueAsDouble (const WexprBinaryView* self, double* result)
+{
+	if (self->type != WexprExpressionTypeValue)
+	{ return false; }
+	
+	if (self->typedChunkType != 0)
+	{
+		WexprPrivateTypedValue typed;
+		wexpr_PrivateBinaryFormat_decodeTypedValue(self->typedChunkType, self->content, self->contentSize, &typed, NULL);
+		
+		if (typed.kind == WexprPrivateTypedValueKindInt64)
+		{ *result = (double)typed.int64Value; }
+		else if (typed.kind == WexprPrivateTypedValueKindFloat64)
+		{ *result = typed.float64Value; }
+		else
+		{ return false; }
+		
+		return true;
+	}
+	
+	return wexpr_PrivateTypedValue_parseFloat64((const char*)self->content, self->contentSize, result);
+}
+
+bool wexpr_BinaryView_valueAsBool (const WexprBinaryView* self, bool* result)
+{
+	if (self->type != WexprExpressionTypeValue)
+	{ return false; }
+	
+	if (self->typedChunkType != 0)
+	{
+		WexprPrivateTypedValue typed;
+		wexpr_PrivateBinaryFormat_decodeTypedValue(self->typedChunkType, self->content, self->contentSize, &typed, NULL);
+		
+		if (typed.kind != WexprPrivateTypedValueKindBoolean)
+		{ return false; }
+		
+		*result = typed.booleanValue;
+		return true;
+	}
+	
+	return wexpr_PrivateTypedValue_parseBoolean((const char*)self->content, self->contentSize, result);
+}
+
+const void* wexpr_BinaryView_binaryData (const WexprBinaryView* self, size_t* byteSize)
+{
+	// first byte is the compression, and we only know raw
+	if (self->type != WexprExpressionTypeBinaryData || self->contentSize < 1 || self->content[0] != 0x00)
+	{
+		*byteSize = 0;
+		return NULL;
+	}
+	
+	*byteSize = self->contentSize - 1;
+	return self->content + 1;
+}
+
+void* wexpr_BinaryView_createBinaryData (const WexprBinaryView* self, size_t* byteSize, WexprError* error)
+{
+	*byteSize = 0;
+	
+	if (self->type != WexprExpressionTypeBinaryData || self->contentSize < 1)
+	{ return NULL; }
+	
+	WexprBinaryCompression compression = self->content[0];
+	const uint8_t* data = self->content + 1;
+	size_t dataSize = self->contentSize - 1;
+	
+	if (compression == WexprBinaryCompressionNone)
+	{
+		void* copy = malloc(dataSize ? dataSize : 1);
+		if (!copy)
+		{ return NULL; }
+		
+		memcpy (copy, data, dataSize);
+		*byteSize = dataSize;
+		return copy;
+	}
+	
+	void* decompressed = NULL;
+	if (!wexpr_PrivateCompression_decompress(compression, data, dataSize, &decompressed, byteSize, error))
+	{ return NULL; }
+	
+	return decompressed;
+}
+
+// --- Arrays/Maps
+
+WexprBinaryViewIterator wexpr_BinaryView_iterate (const WexprBinaryView* self)
+{
+	WexprBinaryViewIterator iter;
+	iter.position = NULL;
+	iter.end = NULL;
+	iter.root = self->root;
+	iter.index = self->index;
+	iter.indexSize = self->indexSize;
+	iter.strings = self->strings;
+	iter.stringsSize = self->stringsSize;
+	
+	if (self->type == WexprExpressionTypeArray || self->type == WexprExpressionTypeMap)
+	{
+		iter.position = self->content;
+		iter.end = self->content + self->contentSize;
+	}
+	
+	return iter;
+}
+
+bool wexpr_BinaryViewIterator_next (WexprBinaryViewIterator* self, WexprBinaryView* child)
+{
+	if (self->position == self->end)
+	{ return false; }
+	
+	*child = s_BinaryView_create(self->position, (size_t)(self->end - self->position),
+		self->root, self->index, self->indexSize, self->strings, self->stringsSize, NULL
+	);
+	
+	if (child->type == WexprExpressionTypeInvalid)
+	{
+		self->position = self->end; // malformed, so stop
+		return false;
+	}
+	
+	self->position += child->chunkSize;
+	return true;
+}
+
+size_t wexpr_BinaryView_count (const WexprBinaryView* self)
+{
+	uint64_t entryCount = 0;
+	size_t entrySize = (self->type == WexprExpressionTypeMap) ? 2 * sizeof(uint64_t) : sizeof(uint64_t);
+	
+	if ((self->type == WexprExpressionTypeArray || self->type == WexprExpressionTypeMap)
+		&& s_BinaryView_indexRecord(self, entrySize, &entryCount))
+	{ return (size_t)entryCount; }
+	
+	WexprBinaryViewIterator iter = wexpr_BinaryView_iterate(self);
+	WexprBinaryView child;
+	
+	size_t count = 0;
+	while (wexpr_BinaryViewIterator_next(&iter, &child))
+	{ ++count; }
+	
+	return (self->type == WexprExpressionTypeMap) ? count / 2 : count;
+}
+
+WexprBinaryView wexpr_BinaryView_arrayAt (const WexprBinaryView* self, size_t index)
+{
+	if (self->type != WexprExpressionTypeArray)
+	{ return s_BinaryView_createInvalid(); }
+	
+	uint64_t entryCount = 0;
+	const uint8_t* entries = s_BinaryView_indexRecord(self, sizeof(uint64_t), &entryCount);
+	
+	if (entries)
+	{
+		if (index >= entryCount)
+		{ return s_BinaryView_createInvalid(); }
+		
+		return s_BinaryView_childAt(self, wexpr_PrivateBinaryFormat_readUInt64(entries + index * sizeof(uint64_t)));
+	}
+	
+	WexprBinaryViewIterator iter = wexpr_BinaryView_iterate(self);
+	WexprBinaryView child;
+	
+	for (size_t i=0; wexpr_BinaryViewIterator_next(&iter, &child); ++i)
+	{
+		if (i == index)
+		{ return child; }
+	}
+	
+	return s_BinaryView_createInvalid();
+}
+
+WexprBinaryView wexpr_BinaryView_mapValueForLengthKey (const WexprBinaryView* self, const char* key, size_t keyLength)
+{
+	if (self->type != WexprExpressionTypeMap)
+	{ return s_BinaryView_createInvalid(); }
+	
+	const size_t entrySize = 2 * sizeof(uint64_t);
+	uint64_t entryCount = 0;
+	const uint8_t* entries = s_BinaryView_indexRecord(self, entrySize, &entryCount);
+	
+	if (entries)
+	{
+		// entries are sorted by key hash, so find the first with ours and check each with the same hash
+		uint64_t hash = wexpr_PrivateHashTable_hashBytes(key, keyLength);
+		
+		size_t low = 0;
+		size_t high = (size_t)entryCount;
+		
+		while (low < high)
+		{
+			size_t mid = low + (high - low) / 2;
+			
+			if (wexpr_PrivateBinaryFormat_readUInt64(entries + mid * entrySize) < hash)
+			{ low = mid + 1; }
+			else
+			{ high = mid; }
+		}
+		
+		for (; low < entryCount && wexpr_PrivateBinaryFormat_readUInt64(entries + low * entrySize) == hash; ++low)
+		{
+			uint64_t keyOffset = wexpr_PrivateBinaryFormat_readUInt64(entries + low * entrySize + sizeof(uint64_t));
+			WexprBinaryView childKey = s_BinaryView_childAt(self, keyOffset);
+			
+			if (wexpr_BinaryView_valueEquals(&childKey, key, keyLength))
+			{ return s_BinaryView_childAt(self, keyOffset + childKey.chunkSize); } // value follows its key
+		}
+		
+		return s_BinaryView_createInvalid();
+	}
+	
+	WexprBinaryViewIterator iter = wexpr_BinaryView_iterate(self);
+	WexprBinaryView childKey;
+	WexprBinaryView childValue;
+	
+	while (wexpr_BinaryViewIterator_next(&iter, &childKey)
+		&& wexpr_BinaryViewIterator_next(&iter, &childValue))
+	{
+		if (wexpr_BinaryView_valueEquals(&childKey, key, keyLength))
+		{ return childValue; }
+	}
+	
+	return s_BinaryView_createInvalid();
+}
+
+WexprBinaryView wexpr_BinaryView_mapValueForKey (const WexprBinaryView* self, const char* key)
+{
+	return wexpr_BinaryView_mapValueForLengthKey(self, key, strlen(key));
+}
@@ -0,0 +1,308 @@
+//
+/// \file libWexpr/BlockCompression.c
+/// \brief Compressing whole binary files as independent blocks
+//
+// #LICENSE_BEGIN:MIT#
+// 
+// Copyright (c) 2017-2020, Kenneth Perry (thothonegan)
+// 
+// Permission is hereby granted, free of charge, to any person obtaining
+// a copy of this software and associated documentation files (the
+// "Software"), to deal in the Software without restriction, including
+// without limitation the rights to use, copy, modify, merge, publish,
+// distribute, sublicense, and/or sell copies of the Software, and to
+// permit persons to whom the Software is furnished to do so, subject to
+// the following conditions:
+// 
+// The above copyright notice and this permission notice shall be
+// included in all copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+// MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+// NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+// LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+// OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+// WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+// 
+// SPDX-License-Identifier: MIT
+// #LICENSE_END#
+//
+
+#include "BlockCompression.h"
+
+#include <libWexpr/UVLQ64.h>
+
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "Compression.h"
+#include "Thread.h"
+
+// --- private
+
+typedef struct PrivateCompressBlocks
+{
+	WexprBinaryCompression compression;
+	int level;
+	const uint8_t* data;
+	size_t byteSize;
+	size_t blockSize;
+	
+	void** compressed; // per block, null if stored raw
+	size_t* storedSizes; // per block
+} PrivateCompressBlocks;
+
+static void s_compressBlock (void* userData, size_t index)
+{
+	PrivateCompressBlocks* state = userData;
+	
+	size_t start = index * state->blockSize;
+	size_t size = (state->byteSize - start < state->blockSize) ? state->byteSize - start : state->blockSize;
+	
+	// if it doesnt help, its stored raw
+	if (!wexpr_PrivateCompression_compress(state->compression, state->level, state->data + start, size,
+		&state->compressed[index], &state->storedSizes[index]))
+	{
+		state->compressed[index] = NULL;
+		state->storedSizes[index] = size;
+	}
+}
+
+typedef struct PrivateDecompressBlocks
+{
+	WexprBinaryCompression compression;
+	const uint8_t** inputs; // per block
+	const uint64_t* storedSizes; // per block
+	uint8_t* output;
+	size_t byteSize;
+	size_t blockSize;
+	
+	bool* succeeded; // per block
+} PrivateDecompressBlocks;
+
+static void s_decompressBlock (void* userData, size_t index)
+{
+	PrivateDecompressBlocks* state = userData;
+	
+	size_t start = index * state->blockSize;
+	size_t size = (state->byteSize - start < state->blockSize) ? state->byteSize - start : state->blockSize;
+	
+	// compressing never gives the same size, so that means raw. Otherwise it has to decompress to exactly the size.
+	if (state->storedSizes[index] == size)
+	{
+		memcpy (state->output + start, state->inputs[index], size);
+		state->succeeded[index] = true;
+	}
+	else
+	{
+		state->succeeded[index] = wexpr_PrivateCompression_decompressInto(state->compression,
+			state->inputs[index], (size_t)state->storedSizes[index],
+			state->output + start, size
+		);
+	}
+}
+
+// write the value at pos, returning the position after it
+static uint8_t* s_writeUVLQ64 (uint8_t* pos, uint64_t value)
+{
+	size_t size = wexpr_uvlq64_bytesize(value);
+	wexpr_uvlq64_write(pos, size, value);
+	
+	return pos + size;
+}
+
+static void s_setError (WexprError* error, WexprErrorCode code, const char* message)
+{
+	if (error)
+	{
+		error->code = code;
+		error->message = strdup (message);
+	}
+}
+
+// --- public
+
+uint8_t* wexpr_PrivateBlockCompression_compress (WexprBinaryCompression compression, int level, size_t blockSize,
+	const uint8_t* data, size_t byteSize,
+	size_t* contentSize
+)
+{
+	if (blockSize == 0)
+	{ blockSize = WEXPR_PRIVATE_BLOCKCOMPRESSION_DEFAULTBLOCKSIZE; }
+	
+	if (blockSize > WEXPR_PRIVATE_BLOCKCOMPRESSION_MAXBLOCKSIZE)
+	{ blockSize = WEXPR_PRIVATE_BLOCKCOMPRESSION_MAXBLOCKSIZE; } // so readers will take it
+	
+	size_t blockCount = byteSize / blockSize + ((byteSize % blockSize) ? 1 : 0);
+	
+	PrivateCompressBlocks state;
+	state.compression = compression;
+	state.level = level;
+	state.data = data;
+	state.byteSize = byteSize;
+	state.blockSize = blockSize;
+	state.compressed = calloc(blockCount ? blockCount : 1, sizeof(void*));
+	state.storedSizes = calloc(blockCount ? blockCount : 1, sizeof(size_t));
+	
+	uint8_t* content = NULL;
+	
+	if (state.compressed && state.storedSizes)
+	{
+		wexpr_PrivateThread_parallelFor(blockCount, 0, &s_compressBlock, &state);
+		
+		// method, block size, total size, stored size of each block, then the blocks
+		size_t size = sizeof(uint8_t) + wexpr_uvlq64_bytesize(blockSize) + wexpr_uvlq64_bytesize(byteSize);
+		for (size_t i=0; i < blockCount; ++i)
+		{ size += wexpr_uvlq64_bytesize(state.storedSizes[i]) + state.storedSizes[i]; }
+		
+		content = malloc(size);
+		if (content)
+		{
+			uint8_t* pos = content;
+			*pos++ = compression;
+			
+			pos = s_writeUVLQ64(pos, blockSize);
+			pos = s_writeUVLQ64(pos, byteSize);
+			
+			for (size_t i=0; i < blockCount; ++i)
+			{ pos = s_writeUVLQ64(pos, state.storedSizes[i]); }
+			
+			for (size_t i=0; i < blockCount; ++i)
+			{
+				const void* block = state.compressed[i] ? state.compressed[i] : data + i * blockSize;
+				memcpy (pos, block, state.storedSizes[i]);
+				pos += state.storedSizes[i];
+			}
+			
+			*contentSize = size;
+		}
+	}
+	
+	for (size_t i=0; state.compressed && i < blockCount; ++i)
+	{ free (state.compressed[i]); }
+	
+	free (state.compressed);
+	free (state.storedSizes);
+	
+	return content;
+}
+
+uint8_t* wexpr_PrivateBlockCompression_decompress (const uint8_t* content, size_t contentSize, size_t prefixSize,
+	size_t* byteSize,
+	WexprError* error
+)
+{
+	const uint8_t* end = content + contentSize;
+	
+	if (contentSize < 1)
+	{
+		s_setError (error, WexprErrorCodeBinaryChunkNotBigEnough, "Compressed blocks chunk is missing the compression method");
+		return NULL;
+	}
+	
+	WexprBinaryCompression compression = content[0];
+	if (!wexpr_BinaryCompression_isSupported(compression) || compression == WexprBinaryCompressionNone)
+	{
+		s_setError (error, WexprErrorCodeBinaryUnknownCompression, "Unknown compression method to use");
+		return NULL;
+	}
+	
+	uint64_t blockSize = 0;
+	uint64_t totalSize = 0;
+	
+	const uint8_t* pos = wexpr_uvlq64_read(content + 1, (size_t)(end - content - 1), &blockSize);
+	pos = pos ? wexpr_uvlq64_read(pos, (size_t)(end - pos), &totalSize) : NULL;
+	
+	if (!pos || blockSize == 0 || blockSize > WEXPR_PRIVATE_BLOCKCOMPRESSION_MAXBLOCKSIZE
+		|| totalSize == 0 || totalSize > SIZE_MAX - prefixSize
+	)
+	{
+		s_setError (error, WexprErrorCodeBinaryInvalidCompressedData, "Invalid compressed blocks header");
+		return NULL;
+	}
+	
+	// every block needs at least a byte for its size, which bounds the count before allocating
+	uint64_t blockCount = totalSize / blockSize + ((totalSize % blockSize) ? 1 : 0);
+	if (blockCount > (uint64_t)(end - pos))
+	{
+		s_setError (error, WexprErrorCodeBinaryInvalidCompressedData, "Invalid compressed blocks header");
+		return NULL;
+	}
+	
+	PrivateDecompressBlocks state;
+	state.compression = compression;
+	state.byteSize = (size_t)totalSize;
+	state.blockSize = (size_t)blockSize;
+	state.inputs = malloc((size_t)blockCount * sizeof(const uint8_t*));
+	state.storedSizes = NULL;
+	state.succeeded = calloc((size_t)blockCount, sizeof(bool));
+	state.output = NULL;
+	
+	uint64_t* storedSizes = malloc((size_t)blockCount * sizeof(uint64_t));
+	state.storedSizes = storedSizes;
+	
+	bool valid = (state.inputs && state.succeeded && storedSizes);
+	
+	for (size_t i=0; valid && i < blockCount; ++i)
+	{
+		pos = wexpr_uvlq64_read(pos, (size_t)(end - pos), &storedSizes[i]);
+		valid = (pos != NULL);
+	}
+	
+	// blocks are after the sizes, and must use up the rest exactly. Each one is either raw or smaller than its
+	// size, and cant be smaller than the method allows - which bounds the total by the content before allocating it.
+	uint64_t maxRatio = wexpr_PrivateCompression_maxRatio(compression);
+	
+	for (size_t i=0; valid && i < blockCount; ++i)
+	{
+		uint64_t size = (totalSize - i * blockSize < blockSize) ? totalSize - i * blockSize : blockSize;
+		
+		valid = (storedSizes[i] <= (uint64_t)(end - pos))
+			&& storedSizes[i] <= size
+			&& size <= storedSizes[i] * maxRatio;
+		
+		if (valid)
+		{
+			state.inputs[i] = pos;
+			pos += storedSizes[i];
+		}
+	}
+	
+	valid = valid && (pos == end);
+	
+	if (valid)
+	{
+		state.output = malloc(prefixSize + state.byteSize);
+		valid = (state.output != NULL);
+	}
+	
+	if (valid)
+	{
+		// decompress after the prefix
+		uint8_t* result = state.output;
+		state.output += prefixSize;
+		
+		wexpr_PrivateThread_parallelFor((size_t)blockCount, 0, &s_decompressBlock, &state);
+		
+		for (size_t i=0; i < blockCount; ++i)
+		{ valid = valid && state.succeeded[i]; }
+		
+		state.output = result;
+	}
+	
+	free (state.inputs);
+	free (storedSizes);
+	free (state.succeeded);
+	
+	if (!valid)
+	{
+		free (state.output);
+		s_setError (error, WexprErrorCodeBinaryInvalidCompressedData, "Invalid compressed blocks");
+		return NULL;
+	}
+	
+	*byteSize = prefixSize + state.byteSize;
+	return state.output;
+}
@@ -0,0 +1,93 @@
+//
+/// \file libWexpr/BlockCompression.h
+/// \brief Compressing whole binary files as independent blocks
+//
+// #LICENSE_BEGIN:MIT#
+// 
+// Copyright (c) 2017-2020, Kenneth Perry (thothonegan)
+// 
+// Permission is hereby granted, free of charge, to any person obtaining
+// a copy of this software and associated documentation files (the
+// "Software"), to deal in the Software without restriction, including
+// without limitation the rights to use, copy, modify, merge, publish,
+// distribute, sublicense, and/or sell copies of the Software, and to
+// permit persons to whom the Software is furnished to do so, subject to
+// the following conditions:
+// 
+// The above copyright notice and this permission notice shall be
+// included in all copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+// MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+// NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+// LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+// OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+// WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+// 
+// SPDX-License-Identifier: MIT
+// #LICENSE_END#
+//
+
+#ifndef LIBWEXPR_BLOCKCOMPRESSION_H
+#define LIBWEXPR_BLOCKCOMPRESSION_H
+
+#include <libWexpr/BinaryCompression.h>
+#include <libWexpr/Error.h>
+#include <libWexpr/Macros.h>
+
+#include <stddef.h>
+#include <stdint.h>
+
+LIBWEXPR_EXTERN_C_BEGIN()
+
+// The chunks after the header are split into blocks which are compressed independently, so they can be
+// compressed and decompressed on multiple threads. See Documentation/BinaryCompression.md for the layout.
+
+//
+/// \brief Block size used when the options dont give one.
+//
+#define WEXPR_PRIVATE_BLOCKCOMPRESSION_DEFAULTBLOCKSIZE (1024 * 1024)
+
+//
+/// \brief Largest block size. Bigger sizes are clamped when writing, and files with them are rejected when reading.
+//
+#define WEXPR_PRIVATE_BLOCKCOMPRESSION_MAXBLOCKSIZE (64 * 1024 * 1024)
+
+//
+/// \brief Compress data into the content of a compressed blocks chunk.
+/// \param compression The method. Must be supported and not raw.
+/// \param level The level, or 0 for the default
+/// \param blockSize Size of each block before compression, or 0 for the default. At most WEXPR_PRIVATE_BLOCKCOMPRESSION_MAXBLOCKSIZE.
+/// \param data The chunks to compress
+/// \param byteSize The size of data
+/// \param contentSize Set to the size of the result
+/// \return The content, which must be freed. Null if out of memory.
+//
+uint8_t* wexpr_PrivateBlockCompression_compress (WexprBinaryCompression compression, int level, size_t blockSize,
+	const uint8_t* data, size_t byteSize,
+	size_t* contentSize
+);
+
+//
+/// \brief Decompress the content of a compressed blocks chunk.
+/// Every block is decompressed into one buffer (on multiple threads) before returning, so the reader parses
+/// the whole result afterwards rather than as blocks arrive.
+/// The header is checked before anything is allocated: the block size must be at most WEXPR_PRIVATE_BLOCKCOMPRESSION_MAXBLOCKSIZE,
+/// and no block can claim more than its method could decompress its stored size to, which bounds the result by the content size.
+/// Each block must then decompress to exactly its size.
+/// \param content The content of the chunk
+/// \param contentSize The size of content
+/// \param prefixSize Bytes to leave free at the start of the result, for the caller to fill in
+/// \param byteSize Set to the size of the result, including the prefix
+/// \param error If not null, filled in on failure
+/// \return The chunks after prefixSize bytes, which must be freed. Null on failure.
+//
+uint8_t* wexpr_PrivateBlockCompression_decompress (const uint8_t* content, size_t contentSize, size_t prefixSize,
+	size_t* byteSize,
+	WexprError* error
+);
+
+LIBWEXPR_EXTERN_C_END()
+
+#endif // LIBWEXPR_BLOCKCOMPRESSION_H
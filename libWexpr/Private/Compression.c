@@ -0,0 +1,417 @@
+//
+/// \file libWexpr/Compression.c
+/// \brief Compressing and decompressing binary data
+//
+// #LICENSE_BEGIN:MIT#
+// 
+// Copyright (c) 2017-2020, Kenneth Perry (thothonegan)
+// 
+// Permission is hereby granted, free of charge, to any person obtaining
+// a copy of this software and associated documentation files (the
+// "Software"), to deal in the Software without restriction, including
+// without limitation the rights to use, copy, modify, merge, publish,
+// distribute, sublicense, and/or sell copies of the Software, and to
+// permit persons to whom the Software is furnished to do so, subject to
+// the following conditions:
+// 
+// The above copyright notice and this permission notice shall be
+// included in all copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+// MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+// NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+// LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+// OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+// WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+// 
+// SPDX-License-Identifier: MIT
+// #LICENSE_END#
+//
+
+#include "Compression.h"
+
+#include <limits.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(LIBWEXPR_ENABLE_ZLIB)
+	#include <zlib.h>
+#endif
+
+#if defined(LIBWEXPR_ENABLE_ZSTD)
+	#include <zstd.h>
+#endif
+
+// --- private
+
+static void s_setError (WexprError* error, WexprErrorCode code, const char* message)
+{
+	if (error)
+	{
+		error->code = code;
+		error->message = strdup (message);
+	}
+}
+
+#if defined(LIBWEXPR_ENABLE_ZLIB)
+
+static bool s_zlib_compress (int level, const void* data, size_t byteSize, void** compressed, size_t* compressedSize)
+{
+	if (byteSize > ULONG_MAX)
+	{ return false; } // too big for the simple api
+	
+	uLong bound = compressBound((uLong)byteSize);
+	uLongf destSize = bound;
+	
+	uint8_t* dest = malloc(bound);
+	if (!dest)
+	{ return false; }
+	
+	if (compress2(dest, &destSize, data, (uLong)byteSize, (level == 0) ? Z_DEFAULT_COMPRESSION : level) != Z_OK)
+	{
+		free (dest);
+		return false;
+	}
+	
+	*compressed = dest;
+	*compressedSize = destSize;
+	return true;
+}
+
+// zlib doesnt store the decompressed size, so the buffer grows as needed and is trimmed at the end
+static bool s_zlib_decompress (const void* data, size_t byteSize, void** decompressed, size_t* decompressedSize, WexprError* error)
+{
+	z_stream stream;
+	memset (&stream, 0, sizeof(stream));
+	
+	if (inflateInit(&stream) != Z_OK)
+	{
+		s_setError (error, WexprErrorCodeBinaryInvalidCompressedData, "Unable to start decompressing");
+		return false;
+	}
+	
+	const uint8_t* input = data;
+	size_t inputLeft = byteSize;
+	
+	uint8_t* buffer = NULL;
+	size_t size = 0;
+	size_t capacity = 0;
+	
+	int result = Z_OK;
+	for (;;)
+	{
+		if (size == capacity)
+		{
+			size_t newCapacity = capacity ? capacity * 2 : (byteSize * 4 + 64);
+			uint8_t* newBuffer = realloc(buffer, newCapacity);
+			if (!newBuffer)
+			{ result = Z_MEM_ERROR; break; }
+			
+			buffer = newBuffer;
+			capacity = newCapacity;
+		}
+		
+		// the stream sizes are only 32 bit, so feed it in pieces
+		if (stream.avail_in == 0 && inputLeft != 0)
+		{
+			uInt amount = (inputLeft > UINT_MAX) ? UINT_MAX : (uInt)inputLeft;
+			stream.next_in = (Bytef*)input;
+			stream.avail_in = amount;
+			input += amount;
+			inputLeft -= amount;
+		}
+		
+		uInt outputSpace = (capacity - size > UINT_MAX) ? UINT_MAX : (uInt)(capacity - size);
+		stream.next_out = buffer + size;
+		stream.avail_out = outputSpace;
+		
+		result = inflate(&stream, Z_NO_FLUSH);
+		size += outputSpace - stream.avail_out;
+		
+		if (result == Z_STREAM_END)
+		{ break; }
+		
+		bool outputFull = (stream.avail_out == 0);
+		bool inputDone = (stream.avail_in == 0 && inputLeft == 0);
+		
+		if ((result != Z_OK && result != Z_BUF_ERROR) || (inputDone && !outputFull))
+		{ break; } // bad or truncated data
+	}
+	
+	// the stream has to be all of the data
+	bool trailingData = (result == Z_STREAM_END && (stream.avail_in != 0 || inputLeft != 0));
+	
+	inflateEnd (&stream);
+	
+	if (result != Z_STREAM_END || trailingData)
+	{
+		free (buffer);
+		s_setError (error, WexprErrorCodeBinaryInvalidCompressedData,
+			(result == Z_MEM_ERROR) ? "Out of memory decompressing"
+			: trailingData ? "Invalid zlib compressed data - extra data after the end"
+			: "Invalid zlib compressed data"
+		);
+		
+		return false;
+	}
+	
+	uint8_t* trimmed = realloc(buffer, size ? size : 1);
+	
+	*decompressed = trimmed ? trimmed : buffer;
+	*decompressedSize = size;
+	return true;
+}
+
+static bool s_zlib_decompressInto (const void* data, size_t byteSize, void* decompressed, size_t decompressedSize)
+{
+	if (byteSize > ULONG_MAX || decompressedSize > ULONG_MAX)
+	{ return false; } // too big for the simple api
+	
+	uLongf destSize = (uLongf)decompressedSize;
+	uLong sourceSize = (uLong)byteSize;
+	
+	return uncompress2(decompressed, &destSize, data, &sourceSize) == Z_OK
+		&& destSize == decompressedSize
+		&& sourceSize == byteSize; // nothing after the stream
+}
+
+#endif // LIBWEXPR_ENABLE_ZLIB
+
+#if defined(LIBWEXPR_ENABLE_ZSTD)
+
+static bool s_zstd_compress (int level, const void* data, size_t byteSize, void** compressed, size_t* compressedSize)
+{
+	size_t bound = ZSTD_compressBound(byteSize);
+	
+	void* dest = malloc(bound);
+	if (!dest)
+	{ return false; }
+	
+	size_t result = ZSTD_compress(dest, bound, data, byteSize, level); // 0 is the default level already
+	if (ZSTD_isError(result))
+	{
+		free (dest);
+		return false;
+	}
+	
+	*compressed = dest;
+	*compressedSize = result;
+	return true;
+}
+
+// the frame's decompressed size cant be trusted, so like zlib the buffer grows as the data actually decompresses
+static bool s_zstd_decompress (const void* data, size_t byteSize, void** decompressed, size_t* decompressedSize, WexprError* error)
+{
+	unsigned long long contentSize = ZSTD_getFrameContentSize(data, byteSize);
+	
+	if (contentSize == ZSTD_CONTENTSIZE_ERROR || (contentSize != ZSTD_CONTENTSIZE_UNKNOWN && contentSize > SIZE_MAX))
+	{
+		s_setError (error, WexprErrorCodeBinaryInvalidCompressedData, "Invalid zstd compressed data");
+		return false;
+	}
+	
+	ZSTD_DCtx* context = ZSTD_createDCtx();
+	if (!context)
+	{
+		s_setError (error, WexprErrorCodeBinaryInvalidCompressedData, "Out of memory decompressing");
+		return false;
+	}
+	
+	// use the size as a hint only as far as the input could reasonably go
+	size_t initialCapacity = byteSize * 4 + 64;
+	if (contentSize != ZSTD_CONTENTSIZE_UNKNOWN && contentSize < initialCapacity)
+	{ initialCapacity = (size_t)contentSize + 1; } // +1 so the end of the frame is seen without growing
+	
+	ZSTD_inBuffer input = { data, byteSize, 0 };
+	
+	uint8_t* buffer = NULL;
+	size_t size = 0;
+	size_t capacity = 0;
+	
+	bool outOfMemory = false;
+	size_t result = 1;
+	for (;;)
+	{
+		if (size == capacity)
+		{
+			size_t newCapacity = capacity ? capacity * 2 : initialCapacity;
+			uint8_t* newBuffer = realloc(buffer, newCapacity);
+			if (!newBuffer)
+			{ outOfMemory = true; break; }
+			
+			buffer = newBuffer;
+			capacity = newCapacity;
+		}
+		
+		ZSTD_outBuffer output = { buffer + size, capacity - size, 0 };
+		
+		result = ZSTD_decompressStream(context, &output, &input);
+		size += output.pos;
+		
+		if (ZSTD_isError(result) || result == 0)
+		{ break; } // bad data, or the end of the frame
+		
+		if (input.pos == input.size && output.pos < output.size)
+		{ break; } // truncated
+	}
+	
+	ZSTD_freeDCtx (context);
+	
+	// one whole frame which is all of the data, and matches its size if it gave one
+	bool valid = !outOfMemory && !ZSTD_isError(result) && result == 0
+		&& input.pos == input.size
+		&& (contentSize == ZSTD_CONTENTSIZE_UNKNOWN || size == contentSize);
+	
+	if (!valid)
+	{
+		free (buffer);
+		s_setError (error, WexprErrorCodeBinaryInvalidCompressedData,
+			outOfMemory ? "Out of memory decompressing" : "Invalid zstd compressed data"
+		);
+		
+		return false;
+	}
+	
+	uint8_t* trimmed = realloc(buffer, size ? size : 1);
+	
+	*decompressed = trimmed ? trimmed : buffer;
+	*decompressedSize = size;
+	return true;
+}
+
+static bool s_zstd_decompressInto (const void* data, size_t byteSize, void* decompressed, size_t decompressedSize)
+{
+	size_t result = ZSTD_decompress(decompressed, decompressedSize, data, byteSize);
+	
+	return !ZSTD_isError(result) && result == decompressedSize;
+}
+
+#endif // LIBWEXPR_ENABLE_ZSTD
+
+// --- public
+
+bool wexpr_BinaryCompression_isSupported (WexprBinaryCompression compression)
+{
+	switch (compression)
+	{
+		case WexprBinaryCompressionNone:
+			return true;
+		
+	#if defined(LIBWEXPR_ENABLE_ZLIB)
+		case WexprBinaryCompressionZlib:
+			return true;
+	#endif
+		
+	#if defined(LIBWEXPR_ENABLE_ZSTD)
+		case WexprBinaryCompressionZstd:
+			return true;
+	#endif
+		
+		default:
+			return false;
+	}
+}
+
+// --- private api
+
+bool wexpr_PrivateCompression_compress (WexprBinaryCompression compression, int level,
+	const void* data, size_t byteSize,
+	void** compressed, size_t* compressedSize
+)
+{
+	bool success = false;
+	
+	switch (compression)
+	{
+	#if defined(LIBWEXPR_ENABLE_ZLIB)
+		case WexprBinaryCompressionZlib:
+			success = s_zlib_compress(level, data, byteSize, compressed, compressedSize);
+			break;
+	#endif
+		
+	#if defined(LIBWEXPR_ENABLE_ZSTD)
+		case WexprBinaryCompressionZstd:
+			success = s_zstd_compress(level, data, byteSize, compressed, compressedSize);
+			break;
+	#endif
+		
+		default:
+			(void)level; (void)data; (void)byteSize;
+			return false;
+	}
+	
+	// not worth it if it didnt get smaller
+	if (success && *compressedSize >= byteSize)
+	{
+		free (*compressed);
+		*compressed = NULL;
+		success = false;
+	}
+	
+	return success;
+}
+
+uint64_t wexpr_PrivateCompression_maxRatio (WexprBinaryCompression compression)
+{
+	switch (compression)
+	{
+		case WexprBinaryCompressionZlib:
+			return 1032; // deflates limit, a length 258 match in every two bits
+		
+		case WexprBinaryCompressionZstd:
+			return 32768; // a 128 KiB RLE block, which is a 3 byte header and the byte
+		
+		default:
+			return 1;
+	}
+}
+
+bool wexpr_PrivateCompression_decompress (WexprBinaryCompression compression,
+	const void* data, size_t byteSize,
+	void** decompressed, size_t* decompressedSize,
+	WexprError* error
+)
+{
+	switch (compression)
+	{
+	#if defined(LIBWEXPR_ENABLE_ZLIB)
+		case WexprBinaryCompressionZlib:
+			return s_zlib_decompress(data, byteSize, decompressed, decompressedSize, error);
+	#endif
+		
+	#if defined(LIBWEXPR_ENABLE_ZSTD)
+		case WexprBinaryCompressionZstd:
+			return s_zstd_decompress(data, byteSize, decompressed, decompressedSize, error);
+	#endif
+		
+		default:
+			(void)data; (void)byteSize; (void)decompressed; (void)decompressedSize;
+			s_setError (error, WexprErrorCodeBinaryUnknownCompression, "Unknown compression method to use");
+			return false;
+	}
+}
+
+bool wexpr_PrivateCompression_decompressInto (WexprBinaryCompression compression,
+	const void* data, size_t byteSize,
+	void* decompressed, size_t decompressedSize
+)
+{
+	switch (compression)
+	{
+	#if defined(LIBWEXPR_ENABLE_ZLIB)
+		case WexprBinaryCompressionZlib:
+			return s_zlib_decompressInto(data, byteSize, decompressed, decompressedSize);
+	#endif
+		
+	#if defined(LIBWEXPR_ENABLE_ZSTD)
+		case WexprBinaryCompressionZstd:
+			return s_zstd_decompressInto(data, byteSize, decompressed, decompressedSize);
+	#endif
+		
+		default:
+			(void)data; (void)byteSize; (void)decompressed; (void)decompressedSize;
+			return false;
+	}
+}
@@ -0,0 +1,99 @@
+//
+/// \file libWexpr/Compression.h
+/// \brief Compressing and decompressing binary data
+//
+// #LICENSE_BEGIN:MIT#
+// 
+// Copyright (c) 2017-2020, Kenneth Perry (thothonegan)
+// 
+// Permission is hereby granted, free of charge, to any person obtaining
+// a copy of this software and associated documentation files (the
+// "Software"), to deal in the Software without restriction, including
+// without limitation the rights to use, copy, modify, merge, publish,
+// distribute, sublicense, and/or sell copies of the Software, and to
+// permit persons to whom the Software is furnished to do so, subject to
+// the following conditions:
+// 
+// The above copyright notice and this permission notice shall be
+// included in all copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+// MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+// NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+// LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+// OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+// WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+// 
+// SPDX-License-Identifier: MIT
+// #LICENSE_END#
+//
+
+#ifndef LIBWEXPR_COMPRESSION_H
+#define LIBWEXPR_COMPRESSION_H
+
+#include <libWexpr/BinaryCompression.h>
+#include <libWexpr/Error.h>
+#include <libWexpr/Macros.h>
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+LIBWEXPR_EXTERN_C_BEGIN()
+
+//
+/// \brief Compress data into a new buffer.
+/// \param compression The method. Must be supported and not raw.
+/// \param level The level, or 0 for the default
+/// \param data The data to compress
+/// \param byteSize The size of data
+/// \param compressed Set to the compressed data, which must be freed
+/// \param compressedSize Set to the size of compressed
+/// \return false if it couldnt be compressed, or wouldnt be any smaller.
+//
+bool wexpr_PrivateCompression_compress (WexprBinaryCompression compression, int level,
+	const void* data, size_t byteSize,
+	void** compressed, size_t* compressedSize
+);
+
+//
+/// \brief The most the method can expand data by, from what its format allows.
+/// Compressed data claiming to decompress to more than its size times this is invalid.
+/// \param compression The method. Must be supported and not raw.
+//
+uint64_t wexpr_PrivateCompression_maxRatio (WexprBinaryCompression compression);
+
+//
+/// \brief Decompress data into a new buffer, which is sized for the result so it can be used as is.
+/// \param compression The method
+/// \param data The compressed data
+/// \param byteSize The size of data
+/// \param decompressed Set to the data, which must be freed
+/// \param decompressedSize Set to the size of decompressed
+/// \param error If not null, filled in on failure
+/// \return true on success
+//
+bool wexpr_PrivateCompression_decompress (WexprBinaryCompression compression,
+	const void* data, size_t byteSize,
+	void** decompressed, size_t* decompressedSize,
+	WexprError* error
+);
+
+//
+/// \brief Decompress data into a buffer, when the decompressed size is already known.
+/// \param compression The method
+/// \param data The compressed data
+/// \param byteSize The size of data
+/// \param decompressed Where to decompress to
+/// \param decompressedSize The size of decompressed, which the data must decompress to exactly
+/// \return true on success
+//
+bool wexpr_PrivateCompression_decompressInto (WexprBinaryCompression compression,
+	const void* data, size_t byteSize,
+	void* decompressed, size_t decompressedSize
+);
+
+LIBWEXPR_EXTERN_C_END()
+
+#endif // LIBWEXPR_COMPRESSION_H
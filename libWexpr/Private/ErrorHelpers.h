@@ -0,0 +1,55 @@
+//
+/// \file libWexpr/ErrorHelpers.h
+/// \brief Helpers for reporting errors from private readers
+//
+// #LICENSE_BEGIN:MIT#
+// 
+// Copyright (c) 2017-2020, Kenneth Perry (thothonegan)
+// 
+// Permission is hereby granted, free of charge, to any person obtaining
+// a copy of this software and associated documentation files (the
+// "Software"), to deal in the Software without restriction, including
+// without limitation the rights to use, copy, modify, merge, publish,
+// distribute, sublicense, and/or sell copies of the Software, and to
+// permit persons to whom the Software is furnished to do so, subject to
+// the following conditions:
+// 
+// The above copyright notice and this permission notice shall be
+// included in all copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+// MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+// NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+// LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+// OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+// WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+// 
+// SPDX-License-Identifier: MIT
+// #LICENSE_END#
+//
+
+#ifndef LIBWEXPR_ERRORHELPERS_H
+#define LIBWEXPR_ERRORHELPERS_H
+
+#include <libWexpr/Error.h>
+
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+
+//
+/// \brief Fill in the WexprError* named error (if given) and return false from the calling function.
+/// For readers which return bool and take their error as `error`.
+//
+#define WEXPR_PRIVATE_FAIL_WITH(errorCode, errorMessage) \
+	do { \
+		if (error) \
+		{ \
+			error->code = (errorCode); \
+			error->message = strdup (errorMessage); \
+		} \
+		return false; \
+	} while (0)
+
+#endif // LIBWEXPR_ERRORHELPERS_H
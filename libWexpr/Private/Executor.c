@@ -0,0 +1,72 @@
+//
+/// \file libWexpr/Executor.c
+/// \brief Runs work for libWexpr on multiple threads
+//
+// #LICENSE_BEGIN:MIT#
+// 
+// Copyright (c) 2017-2020, Kenneth Perry (thothonegan)
+// 
+// Permission is hereby granted, free of charge, to any person obtaining
+// a copy of this software and associated documentation files (the
+// "Software"), to deal in the Software without restriction, including
+// without limitation the rights to use, copy, modify, merge, publish,
+// distribute, sublicense, and/or sell copies of the Software, and to
+// permit persons to whom the Software is furnished to do so, subject to
+// the following conditions:
+// 
+// The above copyright notice and this permission notice shall be
+// included in all copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+// MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+// NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+// LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+// OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+// WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+// 
+// SPDX-License-Identifier: MIT
+// #LICENSE_END#
+//
+
+#include <libWexpr/Executor.h>
+
+#include "Thread.h"
+
+// --- public Construction
+
+WexprExecutor wexpr_Executor_forThreads (size_t threadCount)
+{
+	WexprExecutor executor;
+	executor.parallelFor = LIBWEXPR_NULLPTR;
+	executor.userData = LIBWEXPR_NULLPTR;
+	executor.threadCount = threadCount;
+	
+	return executor;
+}
+
+WexprExecutor wexpr_Executor_forCallback (WexprExecutorParallelForCallback callback, void* userData)
+{
+	WexprExecutor executor;
+	executor.parallelFor = callback;
+	executor.userData = userData;
+	executor.threadCount = 0;
+	
+	return executor;
+}
+
+// --- public Running
+
+void wexpr_Executor_parallelFor (const WexprExecutor* self, size_t count, WexprExecutorTask task, void* taskData)
+{
+	if (count == 0)
+	{ return; }
+	
+	if (self && self->parallelFor)
+	{
+		self->parallelFor(self->userData, count, task, taskData);
+		return;
+	}
+	
+	wexpr_PrivateThread_parallelFor(count, self ? self->threadCount : 0, task, taskData);
+}
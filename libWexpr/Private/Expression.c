@@ -32,15 +32,28 @@
 #include <libWexpr/Expression.h>
 
 #include <libWexpr/Endian.h>
+#include <libWexpr/Executor.h>
 #include <libWexpr/ReferenceTable.h>
+#include <libWexpr/Sink.h>
 #include <libWexpr/UVLQ64.h>
 
+#include <errno.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <stdbool.h>
 #include <string.h>
 
+#include "AlignedFormat.h"
 #include "Base64.h"
+#include "BinaryFormat.h"
+#include "BlockCompression.h"
+#include "Compression.h"
+#include "FileMapping.h"
+#include "HashTable.h"
+#include "Output.h"
+#include "PathFormat.h"
+#include "TextFormat.h"
+#include "TypedValue.h"
 
 #include "ThirdParty/sglib/sglib.h"
 #include "ThirdParty/c_hashmap/hashmap.h"
@@ -66,8 +79,9 @@ SGLIB_DEFINE_LIST_FUNCTIONS (WexprExpressionPrivateArrayElement, WEXPREXPRESSION
 
 typedef struct WexprExpressionPrivateMapElement
 {
-	char* key; // strdup, we own
+	char* key; // strdup, we own. Unless keyOwner is set.
 	WexprExpression* value; // we own
+	WexprExpression* keyOwner; // if set, key is the data of this (shared) value and we own a reference to it instead
 } WexprExpressionPrivateMapElement;
 
 // --- internals to WexprExpression based on the type it is
@@ -75,6 +89,7 @@ typedef struct WexprExpressionPrivateMapElement
 typedef struct WexprExpressionPrivateValue
 {
 	char* data; // UTF-8 zero terminated data, we own.
+	WexprPrivateTypedValue typed; // if set (from a typed chunk or setter), the value as its type. data is its canonical text.
 } WexprExpressionPrivateValue;
 
 typedef struct WexprExpressionPrivateBinaryData
@@ -102,6 +117,9 @@ struct WexprExpression
 	// our type
 	WexprExpressionType m_type;
 	
+	// number of owners. Only above 1 when deduplicating (where identical subtrees are shared), or for values from a binary string table.
+	size_t m_refCount;
+	
 	// our data based on type
 	union
 	{
@@ -114,6 +132,382 @@ struct WexprExpression
 
 // ---------------------- PRIVATE ----------------------------------
 
+// --- shared expressions
+// When deduplicating (WexprParseFlagDeduplicate), identical subtrees are interned while building so
+// repeats share one node, with m_refCount tracking the owners. The public accessors detach a shared
+// child before handing it out (copy on write), so callers only ever see nodes they can mutate.
+// Values from a binary string table are shared the same way, and map keys can use their data (keyOwner).
+
+static WexprExpression* s_Expression_alloc (WexprExpressionType type)
+{
+	WexprExpression* expr = malloc (sizeof(WexprExpression));
+	if (!expr)
+	{ return NULL; }
+	
+	expr->m_type = type;
+	expr->m_refCount = 1;
+	
+	return expr;
+}
+
+static WexprExpression* s_Expression_retain (WexprExpression* self)
+{
+	++(self->m_refCount);
+	return self;
+}
+
+static int s_shareToHash (any_t hashToWriteTo, any_t data)
+{
+	map_t hash = hashToWriteTo;
+	WexprExpressionPrivateMapElement* elem = data;
+	
+	WexprExpressionPrivateMapElement* newElem = malloc(sizeof(WexprExpressionPrivateMapElement));
+	newElem->key = elem->keyOwner ? elem->key : strdup (elem->key);
+	newElem->value = s_Expression_retain(elem->value);
+	newElem->keyOwner = elem->keyOwner ? s_Expression_retain(elem->keyOwner) : NULL;
+	
+	hashmap_put (hash, newElem->key, newElem);
+	
+	return MAP_OK; // continue
+}
+
+// Shallow copy rhs into self, sharing the children instead of copying them. self should be null.
+static void s_Expression_shareInto (WexprExpression* self, WexprExpression* rhs)
+{
+	switch (rhs->m_type)
+	{
+		case WexprExpressionTypeValue:
+		{
+			wexpr_Expression_changeType(self, WexprExpressionTypeValue);
+			self->m_value.data = strdup (rhs->m_value.data);
+			self->m_value.typed = rhs->m_value.typed;
+			break;
+		}
+		
+		case WexprExpressionTypeBinaryData:
+		{
+			wexpr_Expression_changeType(self, WexprExpressionTypeBinaryData);
+			wexpr_Expression_binaryData_setValue(self, rhs->m_binaryData.data, rhs->m_binaryData.size);
+			break;
+		}
+		
+		case WexprExpressionTypeArray:
+		{
+			wexpr_Expression_changeType(self, WexprExpressionTypeArray);
+			
+			WexprExpressionPrivateArrayElement* tail = NULL;
+			for (WexprExpressionPrivateArrayElement* list = rhs->m_array.list;
+				 list != NULL; list = list->next)
+			{
+				WexprExpressionPrivateArrayElement* lelem = malloc(sizeof(WexprExpressionPrivateArrayElement));
+				lelem->expression = s_Expression_retain(list->expression);
+				lelem->next = NULL;
+				
+				if (tail) { tail->next = lelem; }
+				else { self->m_array.list = lelem; }
+				
+				tail = lelem;
+			}
+			
+			self->m_array.listCount = rhs->m_array.listCount;
+			break;
+		}
+		
+		case WexprExpressionTypeMap:
+		{
+			wexpr_Expression_changeType(self, WexprExpressionTypeMap);
+			hashmap_iterate(rhs->m_map.hash, &s_shareToHash, self->m_map.hash);
+			break;
+		}
+		
+		default:
+		{
+			self->m_type = rhs->m_type;
+		}
+	}
+}
+
+// Make sure the child in the slot is only owned by its parent, so it can be handed out.
+// Returns the (possibly new) child.
+static WexprExpression* s_Expression_detach (WexprExpression** slot)
+{
+	WexprExpression* child = *slot;
+	
+	if (child->m_refCount > 1)
+	{
+		WexprExpression* copy = s_Expression_alloc(WexprExpressionTypeNull);
+		s_Expression_shareInto(copy, child);
+		
+		--(child->m_refCount); // parent no longer owns the shared one
+		*slot = copy;
+	}
+	
+	return *slot;
+}
+
+typedef struct PrivateMapHashState
+{
+	uint64_t hash;
+	WexprExpression* other; // for equality: the map we're comparing with
+} PrivateMapHashState;
+
+static int s_mapContentHash (any_t userData, any_t data)
+{
+	PrivateMapHashState* state = userData;
+	WexprExpressionPrivateMapElement* elem = data;
+	
+	// combine by adding so the order in the hash doesnt matter
+	state->hash += wexpr_PrivateHashTable_hashBytesContinue(
+		wexpr_PrivateHashTable_hashPointer(elem->value),
+		elem->key, strlen(elem->key)
+	);
+	
+	return MAP_OK;
+}
+
+// Hash of the content of the expression. Children are already interned, so they're hashed by pointer.
+static uint64_t s_Expression_contentHash (WexprExpression* self)
+{
+	uint8_t type = (uint8_t)self->m_type;
+	uint64_t hash = wexpr_PrivateHashTable_hashBytes(&type, sizeof(type));
+	
+	switch (self->m_type)
+	{
+		case WexprExpressionTypeValue:
+			return wexpr_PrivateHashTable_hashBytesContinue(hash, self->m_value.data, strlen(self->m_value.data));
+		
+		case WexprExpressionTypeBinaryData:
+			return wexpr_PrivateHashTable_hashBytesContinue(hash, self->m_binaryData.data, self->m_binaryData.size);
+		
+		case WexprExpressionTypeArray:
+		{
+			for (WexprExpressionPrivateArrayElement* list = self->m_array.list;
+				 list != NULL; list = list->next)
+			{
+				hash = wexpr_PrivateHashTable_hashBytesContinue(hash, &(list->expression), sizeof(list->expression));
+			}
+			
+			return hash;
+		}
+		
+		case WexprExpressionTypeMap:
+		{
+			PrivateMapHashState state;
+			state.hash = hash;
+			state.other = NULL;
+			
+			hashmap_iterate(self->m_map.hash, &s_mapContentHash, &state);
+			return state.hash;
+		}
+		
+		default:
+			return hash;
+	}
+}
+
+static int s_mapContentEquals (any_t userData, any_t data)
+{
+	PrivateMapHashState* state = userData;
+	WexprExpressionPrivateMapElement* elem = data;
+	
+	WexprExpressionPrivateMapElement* otherElem = NULL;
+	int res = hashmap_get (state->other->m_map.hash, elem->key, (void**) &otherElem);
+	
+	if (res != MAP_OK || !otherElem || otherElem->value != elem->value)
+	{ return !MAP_OK; } // different, stop
+	
+	return MAP_OK;
+}
+
+// Compare the content of two expressions. Children are already interned, so they're compared by pointer.
+static bool s_Expression_contentEquals (const void* lhsPtr, const void* rhsPtr)
+{
+	const WexprExpression* lhs = lhsPtr;
+	const WexprExpression* rhs = rhsPtr;
+	
+	if (lhs->m_type != rhs->m_type)
+	{ return false; }
+	
+	switch (lhs->m_type)
+	{
+		case WexprExpressionTypeValue:
+			return strcmp(lhs->m_value.data, rhs->m_value.data) == 0;
+		
+		case WexprExpressionTypeBinaryData:
+			return lhs->m_binaryData.size == rhs->m_binaryData.size &&
+				(lhs->m_binaryData.size == 0 || memcmp(lhs->m_binaryData.data, rhs->m_binaryData.data, lhs->m_binaryData.size) == 0);
+		
+		case WexprExpressionTypeArray:
+		{
+			if (lhs->m_array.listCount != rhs->m_array.listCount)
+			{ return false; }
+			
+			const WexprExpressionPrivateArrayElement* l = lhs->m_array.list;
+			const WexprExpressionPrivateArrayElement* r = rhs->m_array.list;
+			
+			for (; l != NULL && r != NULL; l = l->next, r = r->next)
+			{
+				if (l->expression != r->expression)
+				{ return false; }
+			}
+			
+			return true;
+		}
+		
+		case WexprExpressionTypeMap:
+		{
+			if (hashmap_length(lhs->m_map.hash) != hashmap_length(rhs->m_map.hash))
+			{ return false; }
+			
+			if (hashmap_length(lhs->m_map.hash) == 0)
+			{ return true; }
+			
+			PrivateMapHashState state;
+			state.hash = 0;
+			state.other = (WexprExpression*)rhs;
+			
+			return hashmap_iterate(lhs->m_map.hash, &s_mapContentEquals, &state) == MAP_OK;
+		}
+		
+		default:
+			return true;
+	}
+}
+
+// Return the canonical expression matching expr. Takes ownership of expr, and you own the result.
+// Does nothing if internTable is null (not deduplicating).
+static WexprExpression* s_Expression_intern (WexprPrivateHashTable* internTable, WexprExpression* expr)
+{
+	if (!internTable || expr->m_type == WexprExpressionTypeInvalid)
+	{ return expr; }
+	
+	uint64_t hash = s_Expression_contentHash(expr);
+	WexprExpression* existing = wexpr_PrivateHashTable_find(internTable, hash, expr, &s_Expression_contentEquals);
+	
+	if (existing)
+	{
+		if (existing != expr)
+		{
+			wexpr_Expression_destroy(expr);
+			s_Expression_retain(existing);
+		}
+		
+		return existing;
+	}
+	
+	// new one, the table keeps a reference while building
+	if (wexpr_PrivateHashTable_insert(internTable, hash, expr, expr))
+	{ s_Expression_retain(expr); }
+	
+	return expr;
+}
+
+static int s_internMapValue (any_t userData, any_t data);
+
+// Intern all children of self (recursively), for subtrees that were built without deduplication.
+// NOLINTNEXTLINE(misc-no-recursion)
+static void s_Expression_internChildren (WexprPrivateHashTable* internTable, WexprExpression* self)
+{
+	if (self->m_type == WexprExpressionTypeArray)
+	{
+		for (WexprExpressionPrivateArrayElement* list = self->m_array.list;
+			 list != NULL; list = list->next)
+		{
+			s_Expression_internChildren(internTable, list->expression);
+			list->expression = s_Expression_intern(internTable, list->expression);
+		}
+	}
+	
+	else if (self->m_type == WexprExpressionTypeMap)
+	{
+		hashmap_iterate(self->m_map.hash, &s_internMapValue, internTable);
+	}
+}
+
+// NOLINTNEXTLINE(misc-no-recursion)
+static int s_internMapValue (any_t userData, any_t data)
+{
+	WexprPrivateHashTable* internTable = userData;
+	WexprExpressionPrivateMapElement* elem = data;
+	
+	s_Expression_internChildren(internTable, elem->value);
+	elem->value = s_Expression_intern(internTable, elem->value);
+	
+	return MAP_OK;
+}
+
+static void s_internTable_releaseEntry (void* userData, const void* key, void* value)
+{
+	(void)userData; (void)key;
+	wexpr_Expression_destroy(value);
+}
+
+// Release the table's references and destroy it. Safe to call with null.
+static void s_internTable_destroy (WexprPrivateHashTable* internTable)
+{
+	if (!internTable)
+	{ return; }
+	
+	wexpr_PrivateHashTable_iterate(internTable, &s_internTable_releaseEntry, NULL);
+	wexpr_PrivateHashTable_destroy(internTable);
+}
+
+// Release the table's references and empty it, keeping its memory for the next document.
+static void s_internTable_clear (WexprPrivateHashTable* internTable)
+{
+	wexpr_PrivateHashTable_iterate(internTable, &s_internTable_releaseEntry, NULL);
+	wexpr_PrivateHashTable_clear(internTable);
+}
+
+// Element accessors which don't detach, for internal use (writers, copies) where we only read.
+static WexprExpressionPrivateArrayElement* s_Expression_arrayElementAt (WexprExpression* self, size_t index)
+{
+	for (WexprExpressionPrivateArrayElement* list = self->m_array.list;
+		 list != NULL; list = list->next)
+	{
+		if (index == 0)
+		{ return list; }
+		
+		--index;
+	}
+	
+	return NULL;
+}
+
+typedef struct PrivateGetKeyValueAtIndex
+{
+	size_t index; // the index we're requesting
+	void* result; // will be null if not found, or a value if found.
+} PrivateGetKeyValueAtIndex;
+
+static int s_getElementAtIndex (any_t userData, any_t data)
+{
+	PrivateGetKeyValueAtIndex* ud = userData;
+	
+	if (ud->index == 0)
+	{
+		ud->result = data;
+		return !MAP_OK; // exit
+	}
+	else
+	{
+		ud->index -= 1;
+	}
+	
+	return MAP_OK;
+}
+
+static WexprExpressionPrivateMapElement* s_Expression_mapElementAt (WexprExpression* self, size_t index)
+{
+	PrivateGetKeyValueAtIndex val;
+	val.index = index;
+	val.result = NULL;
+	
+	hashmap_iterate (self->m_map.hash, &s_getElementAtIndex, &val);
+	
+	return val.result;
+}
+
 typedef struct PrivateStringRef
 {
 	const char* ptr;
@@ -214,80 +608,229 @@ static size_t s_StringRef_findString (PrivateStringRef self, PrivateStringRef rh
 	return s_InvalidIndex;
 }
 
-typedef struct PrivateParserState
+// --- Projection
+// When given paths to parse, only the parts they select are built, and everything else is skipped over.
+// Paths advance one step per level, so every path still selecting the node being parsed is at the same step.
+
+typedef struct PrivateProjection
 {
-	// position in the data we loaded
-	WexprLineNumber line;
-	WexprColumnNumber column;
-	
-	// reference information lists
-	WexprReferenceTable* internalReferenceMap; // the internal one within the file. Takes priority and we own.
-	WexprReferenceTable* externalReferenceMap; // if provided, the external one for lookups. We dont own.
+	WexprPath* const* paths;
+	size_t pathCount;
 	
-} PrivateParserState;
+	size_t* active; // for each depth, pathCount entries for the indices of the paths which can still select the node
+	WexprExpression* skipped; // shared null, which array elements that weren't selected become so indices stay the same
+} PrivateProjection;
 
-void s_privateParserState_init (PrivateParserState* state)
+// position within a projection while parsing
+typedef struct PrivateProjectionCursor
 {
-	state->externalReferenceMap = NULL; // current not set
-	state->internalReferenceMap = wexpr_ReferenceTable_create(); // used for storing our refs
+	PrivateProjection* projection; // null if building everything
+	size_t depth;
+	size_t activeCount; // if 0, the node isn't selected and is skipped
+} PrivateProjectionCursor;
+
+// Setup the projection. Returns false if out of memory.
+static bool s_Projection_init (PrivateProjection* self, WexprPath* const* paths, size_t pathCount)
+{
+	self->paths = paths;
+	self->pathCount = pathCount;
+	self->active = NULL;
+	self->skipped = NULL;
 	
-	// first position in the file
-	state->line = 1;
-	state->column = 1;
+	size_t maxDepth = 0;
+	for (size_t i=0; i < pathCount; ++i)
+	{
+		if (paths[i]->stepCount > maxDepth)
+		{ maxDepth = paths[i]->stepCount; }
+	}
+	
+	self->active = malloc((pathCount * (maxDepth + 1) + 1) * sizeof(size_t));
+	self->skipped = s_Expression_alloc(WexprExpressionTypeNull);
+	
+	return self->active && self->skipped;
 }
 
-void s_privateParserState_free (PrivateParserState* state)
+static void s_Projection_free (PrivateProjection* self)
 {
-	// cleanup internal
-	wexpr_ReferenceTable_destroy(state->internalReferenceMap);
+	free (self->active);
+	wexpr_Expression_destroy(self->skipped);
 }
 
-void s_privateParserState_moveForwardBasedOnString (PrivateParserState* parserState, PrivateStringRef str)
+// Cursor for the root. projection can be null to build everything.
+static PrivateProjectionCursor s_Projection_begin (PrivateProjection* projection)
 {
-	for (size_t i=0; i < str.size; ++i)
+	PrivateProjectionCursor cursor;
+	cursor.projection = projection;
+	cursor.depth = 0;
+	cursor.activeCount = 0;
+	
+	if (!projection)
+	{ return cursor; }
+	
+	for (size_t i=0; i < projection->pathCount; ++i)
 	{
-		if (str.ptr[i] == '\n') // newline
+		if (projection->paths[i]->stepCount == 0)
 		{
-			parserState->line += 1;
-			parserState->column = 1;
+			cursor.projection = NULL; // "/" selects everything
+			return cursor;
 		}
-		else // normal
-		{
-			parserState->column += 1;
+		
+		projection->active[cursor.activeCount++] = i;
+	}
+	
+	return cursor;
+}
+
+// Cursor for the child with the key (for maps) or index (for arrays, key is null).
+// Uses the next level of the projection, so is only valid until the next sibling.
+static PrivateProjectionCursor s_Projection_child (PrivateProjectionCursor cursor, const char* key, size_t index)
+{
+	PrivateProjection* projection = cursor.projection;
+	
+	if (!projection)
+	{ return cursor; } // building everything
+	
+	const size_t* active = projection->active + cursor.depth * projection->pathCount;
+	
+	PrivateProjectionCursor child;
+	child.projection = projection;
+	child.depth = cursor.depth + 1;
+	child.activeCount = 0;
+	
+	size_t* childActive = projection->active + child.depth * projection->pathCount;
+	
+	for (size_t i=0; i < cursor.activeCount; ++i)
+	{
+		const WexprPath* path = projection->paths[active[i]];
+		const WexprPrivatePathStep* step = &path->steps[cursor.depth];
+		
+		bool matches = key
+			? (step->type == WexprPrivatePathStepTypeAnyValue
+				|| (step->type == WexprPrivatePathStepTypeKey && strcmp(step->key, key) == 0))
+			: (step->type == WexprPrivatePathStepTypeAnyElement
+				|| (step->type == WexprPrivatePathStepTypeIndex && step->index == index));
+		
+		if (!matches)
+		{ continue; }
+		
+		if (child.depth == path->stepCount)
+		{
+			// the path ends here, so everything below is wanted
+			child.projection = NULL;
+			return child;
 		}
+		
+		childActive[child.activeCount++] = active[i];
 	}
+	
+	return child;
 }
 
-static const char* s_StartBlockComment = ";(--";
-static const char* s_EndBlockComment = "--)";
+// --- Parse setup
 
-static bool s_isNewline (char c)
+// What to build, and what to reuse, when parsing a document. Null means the defaults.
+typedef struct PrivateParseSetup
 {
-	return (c == '\n');
+	PrivateProjection* projection; // if set, only build what it selects
+	WexprPrivateHashTable* internTable; // if set, used when deduplicating instead of creating one. Left empty afterwards.
+} PrivateParseSetup;
+
+static PrivateProjection* s_ParseSetup_projection (const PrivateParseSetup* setup)
+{
+	return setup ? setup->projection : NULL;
 }
 
-static bool s_isWhitespace (char c)
+// The intern table to use if deduplicating, otherwise null. Sets reused if it came from the setup.
+static WexprPrivateHashTable* s_ParseSetup_internTable (const PrivateParseSetup* setup, WexprParseFlags flags, bool* reused)
 {
-	// we put '\r' in whitespace and not newline so its counted as a column instead of a line, cause windows.
-	// we dont support classic macos style newlines properly as a side effect.
-	return (c == ' ' || c == '\t' || c == '\r' || s_isNewline(c));
+	*reused = false;
+	
+	if (!(flags & WexprParseFlagDeduplicate))
+	{ return NULL; }
+	
+	if (setup && setup->internTable)
+	{
+		*reused = true;
+		return setup->internTable;
+	}
+	
+	return wexpr_PrivateHashTable_create();
 }
 
-static bool s_isNotBarewordSafe (char c)
+// Done with an intern table from s_ParseSetup_internTable()
+static void s_ParseSetup_releaseInternTable (WexprPrivateHashTable* internTable, bool reused)
 {
-	return (c == '*'
-		|| c == '#'
-		|| c == '@'
-		|| c == '(' || c == ')'
-		|| c == '[' || c == ']'
-		|| c == '^'
-		|| c == '<' || c == '>'
-		|| c == '"'
-		|| c == ';'
-		|| s_isWhitespace(c)
-	);
+	if (reused)
+	{ s_internTable_clear(internTable); }
+	else
+	{ s_internTable_destroy(internTable); }
+}
+
+static bool s_Projection_isSkipped (PrivateProjectionCursor cursor)
+{
+	return cursor.projection && cursor.activeCount == 0;
+}
+
+typedef struct PrivateParserState
+{
+	// position in the data we loaded
+	WexprLineNumber line;
+	WexprColumnNumber column;
+	
+	// reference information lists
+	WexprReferenceTable* internalReferenceMap; // the internal one within the file, created with the first one. Takes priority and we own.
+	WexprReferenceTable* externalReferenceMap; // if provided, the external one for lookups. We dont own.
+	
+	// if deduplicating, the table of canonical expressions. We own unless reused.
+	WexprPrivateHashTable* internTable;
+	bool internTableReused;
+	
+	// which parts to build, if given paths
+	PrivateProjectionCursor projection;
+	
+} PrivateParserState;
+
+void s_privateParserState_init (PrivateParserState* state)
+{
+	state->externalReferenceMap = NULL; // current not set
+	state->internalReferenceMap = NULL; // most files dont have any, so only created when needed
+	state->internTable = NULL; // only if deduplicating
+	state->internTableReused = false;
+	state->projection = s_Projection_begin(NULL); // everything
+	
+	// first position in the file
+	state->line = 1;
+	state->column = 1;
+}
+
+void s_privateParserState_free (PrivateParserState* state)
+{
+	// cleanup internal
+	if (state->internalReferenceMap)
+	{ wexpr_ReferenceTable_destroy(state->internalReferenceMap); }
+	
+	s_ParseSetup_releaseInternTable(state->internTable, state->internTableReused);
+}
+
+void s_privateParserState_moveForwardBasedOnString (PrivateParserState* parserState, PrivateStringRef str)
+{
+	for (size_t i=0; i < str.size; ++i)
+	{
+		if (str.ptr[i] == '\n') // newline
+		{
+			parserState->line += 1;
+			parserState->column = 1;
+		}
+		else // normal
+		{
+			parserState->column += 1;
+		}
+	}
 }
 
+static const char* s_StartBlockComment = ";(--";
+static const char* s_EndBlockComment = "--)";
+
 static bool s_isEscapeValid (char c)
 {
 	return (c == '"' || c == 'r' || c == 'n' || c == 't' || c == '\\');
@@ -304,23 +847,6 @@ static char s_valueForEscape (char c)
 	return 0; // invalid escape
 }
 
-static bool s_requiresEscape (char c)
-{
-	return (c == '"' || c == '\r' || c == '\n' || c == '\t' || c == '\\');
-}
-
-static char s_escapeForValue (char c)
-{
-	// only returns the escape part
-	if (c == '"')  { return '"'; }
-	if (c == '\r') { return 'r'; }
-	if (c == '\n') { return 'n'; }
-	if (c == '\t') { return 't'; }
-	if (c == '\\') { return '\\'; }
-	
-	return 0; // invalid
-}
-
 // trims the given string by removing whitespace or comments from the beginning of the string
 
 static PrivateStringRef s_trimFrontOfString (PrivateStringRef str, PrivateParserState* parserState)
@@ -333,11 +859,11 @@ static PrivateStringRef s_trimFrontOfString (PrivateStringRef str, PrivateParser
 		char first = str.ptr[0];
 		
 		// skip whitespace
-		if (s_isWhitespace(first))
+		if (wexpr_PrivateTextFormat_isWhitespace(first))
 		{
 			str = s_StringRef_slice (str, 1);
 			
-			if (s_isNewline (first))
+			if (wexpr_PrivateTextFormat_isNewline (first))
 			{
 				parserState->line += 1;
 				parserState->column = 1;
@@ -407,19 +933,16 @@ typedef struct PrivateWexprStringValue
 	size_t endIndex; // index the end was found (past the value)
 } PrivateWexprStringValue;
 
-// Will copy out the value of the string to a new buffer.
-// The buffer is mallocd and must be freed by the caller.
-// Returns NULL on failure.
-static PrivateWexprStringValue s_createValueOfString (
+// Find the length of the value at the start of the string once unescaped, and where it ends (past the value).
+// Returns false if it's invalid.
+static bool s_measureValueOfString (
 	PrivateStringRef str,
 	PrivateParserState* parserState,
-	WexprError* error
+	WexprError* error,
+	size_t* valueLength,
+	size_t* endIndex
 )
 {
-	// two pass:
-	// first pass, get the length of the size
-	// second pass, store the buffer
-	
 	size_t bufferLength = 0;
 	bool isQuotedString = false;
 	bool isEscaped = false;
@@ -450,15 +973,12 @@ static PrivateWexprStringValue s_createValueOfString (
 					if (error && !error->code)
 					{
 						error->code = WexprErrorCodeInvalidStringEscape;
-						error->message = "Invalid escape found in the string";
+						error->message = strdup("Invalid escape found in the string");
 						error->column = parserState->column;
 						error->line = parserState->line;
 					}
 					
-					PrivateWexprStringValue ret;
-					ret.value = NULL;
-					ret.endIndex = pos;
-					return ret;
+					return false;
 				}
 			}
 			else
@@ -484,7 +1004,7 @@ static PrivateWexprStringValue s_createValueOfString (
 		else
 		{
 			// have we ended the word?
-			if (s_isNotBarewordSafe(c))
+			if (wexpr_PrivateTextFormat_isNotBarewordSafe(c))
 			{
 				// ended - not part of us
 				break;
@@ -507,13 +1027,38 @@ static PrivateWexprStringValue s_createValueOfString (
 			error->column = parserState->column;
 		}
 		
+		return false;
+	}
+	
+	*valueLength = bufferLength;
+	*endIndex = pos;
+	
+	return true;
+}
+
+// Will copy out the value of the string to a new buffer.
+// The buffer is mallocd and must be freed by the caller.
+// Returns NULL on failure.
+static PrivateWexprStringValue s_createValueOfString (
+	PrivateStringRef str,
+	PrivateParserState* parserState,
+	WexprError* error
+)
+{
+	size_t bufferLength = 0;
+	size_t pos = 0;
+	
+	if (!s_measureValueOfString(str, parserState, error, &bufferLength, &pos))
+	{
 		PrivateWexprStringValue ret;
 		ret.value = NULL;
-		ret.endIndex = 0;
-		
+		ret.endIndex = pos;
 		return ret;
 	}
 	
+	bool isQuotedString = (str.ptr[0] == '"');
+	bool isEscaped = false;
+	
 	size_t end = pos;
 	
 	// we now know our buffer size and the string has been checked
@@ -578,49 +1123,6 @@ static PrivateWexprStringValue s_createValueOfString (
 	return ret;
 }
 
-typedef struct PrivateWexprValueStringProperties
-{
-	bool isBarewordSafe;
-	bool needsEscaping;
-	size_t writeByteSize; // not counting quotes if not bareword safe, but counting escapes
-} PrivateWexprValueStringProperties;
-
-static PrivateWexprValueStringProperties s_wexprValueStringProperties (PrivateStringRef ref)
-{
-	PrivateWexprValueStringProperties props;
-	
-	props.isBarewordSafe = true; // default to being safe
-	props.needsEscaping = false; // but we dont need escaping
-	props.writeByteSize = 0;
-	
-	size_t len = ref.size;
-	
-	for (size_t i=0; i < len; ++i)
-	{
-		// For now, we cant escape so that stays false.
-		// Bareword safe we'll just check for a few symbols
-		char c = ref.ptr[i];
-		
-		// see any symbols that makes it not bareword safe?
-		if (s_isNotBarewordSafe(c))
-		{
-			props.isBarewordSafe = false;
-		}
-		
-		// we at least write the character
-		props.writeByteSize += 1;
-		
-		// does it need to be escaped?
-		if (s_requiresEscape(c))
-		{ props.writeByteSize += 1; } // needs the escape
-	}
-	
-	if (len == 0)
-	{ props.isBarewordSafe = false; } // empty string is not safe, since that will be nothing
-	
-	return props;
-}
-
 static int s_copyToHash (any_t hashToWriteTo, any_t data)
 {
 	map_t hash = hashToWriteTo;
@@ -629,6 +1131,7 @@ static int s_copyToHash (any_t hashToWriteTo, any_t data)
 	WexprExpressionPrivateMapElement* newElem = malloc(sizeof(WexprExpressionPrivateMapElement));
 	newElem->key = strdup (elem->key);
 	newElem->value = wexpr_Expression_createCopy(elem->value);
+	newElem->keyOwner = NULL;
 	
 	hashmap_put (hash, newElem->key, newElem);
 	
@@ -646,6 +1149,7 @@ static void s_Expression_copyInto (WexprExpression* self, WexprExpression* rhs)
 		{
 			self->m_type = WexprExpressionTypeValue;
 			self->m_value.data = strdup (rhs->m_value.data);
+			self->m_value.typed = rhs->m_value.typed;
 			break;
 		}
 		
@@ -655,10 +1159,10 @@ static void s_Expression_copyInto (WexprExpression* self, WexprExpression* rhs)
 			self->m_array.list = NULL;
 			self->m_array.listCount = rhs->m_array.listCount;
 			
-			for (size_t i=0; i < self->m_array.listCount; ++i)
+			for (WexprExpressionPrivateArrayElement* child = rhs->m_array.list;
+				 child != NULL; child = child->next)
 			{
-				WexprExpression* child = wexpr_Expression_arrayAt(rhs, i);
-				WexprExpression* childCopy = wexpr_Expression_createCopy(child);
+				WexprExpression* childCopy = wexpr_Expression_createCopy(child->expression);
 				
 				// add to our array
 				WexprExpressionPrivateArrayElement* lelem = malloc(sizeof(WexprExpressionPrivateArrayElement));
@@ -688,46 +1192,197 @@ static void s_Expression_copyInto (WexprExpression* self, WexprExpression* rhs)
 			break;
 		}
 		
+		case WexprExpressionTypeBinaryData:
+		{
+			wexpr_Expression_changeType(self, WexprExpressionTypeBinaryData);
+			wexpr_Expression_binaryData_setValue(self, rhs->m_binaryData.data, rhs->m_binaryData.size);
+			break;
+		}
+		
 		default:
 		{} // ignore
 	}
 }
 
-// returns the part of the buffer remaining
-// will load into self, setting up everything. Assumes we're empty/null to start.
+// set the value to a typed value, with its canonical text
+static void s_Expression_valueSetTyped (WexprExpression* self, const WexprPrivateTypedValue* typed)
+{
+	char text[WEXPR_PRIVATE_TYPEDVALUE_TEXTBUFFERSIZE];
+	size_t length = wexpr_PrivateTypedValue_format(typed, text);
+	
+	wexpr_Expression_valueSetLengthString(self, text, length);
+	self->m_value.typed = *typed;
+}
+
+// state while parsing a binary expression
+typedef struct PrivateBinaryParseState
+{
+	WexprPrivateHashTable* internTable; // when deduplicating, otherwise null
+	bool internTableReused; // if true, internTable came from the setup
+	
+	// string table
+	const uint8_t* strings; // content of the string table chunk, or null if there isnt one
+	size_t stringsSize;
+	WexprExpression** stringValues; // value for each string, created when first referenced. We own a reference to each.
+	size_t stringCount;
+	
+	// which parts to build, if given paths
+	PrivateProjectionCursor projection;
+	
+	// aligned files
+	uint8_t* alignedVisited; // see wexpr_PrivateAlignedFormat_markNode(), so each node is only built once
+	uint64_t alignedNodesLeft; // every node has a header, so the file cant hold more than this
+} PrivateBinaryParseState;
+
+// Setup the state for parsing. strings and setup can be null.
+// Returns false if out of memory.
+static bool s_binaryParseState_init (PrivateBinaryParseState* state, WexprParseFlags flags, const uint8_t* strings, size_t stringsSize,
+	const PrivateParseSetup* setup
+)
+{
+	state->internTable = s_ParseSetup_internTable(setup, flags, &state->internTableReused);
+	state->strings = strings;
+	state->stringsSize = stringsSize;
+	state->stringValues = NULL;
+	state->stringCount = 0;
+	state->alignedVisited = NULL;
+	state->alignedNodesLeft = 0;
+	state->projection = s_Projection_begin(s_ParseSetup_projection(setup));
+	
+	if (strings)
+	{
+		state->stringCount = (size_t)wexpr_PrivateBinaryFormat_stringTableCount(strings, stringsSize);
+		if (state->stringCount != 0)
+		{
+			state->stringValues = calloc(state->stringCount, sizeof(WexprExpression*));
+			if (!state->stringValues)
+			{ return false; }
+		}
+	}
+	
+	return true;
+}
+
+static void s_binaryParseState_free (PrivateBinaryParseState* state)
+{
+	s_ParseSetup_releaseInternTable (state->internTable, state->internTableReused);
+	
+	for (size_t i=0; i < state->stringCount && state->stringValues; ++i)
+	{ wexpr_Expression_destroy(state->stringValues[i]); }
+	
+	free (state->stringValues);
+	free (state->alignedVisited);
+}
+
+// Returns the shared value for a string reference chunk's content (you own a reference), or null if invalid.
+static WexprExpression* s_binaryParseState_stringValue (PrivateBinaryParseState* state,
+	const uint8_t* reference, size_t referenceSize, WexprError* error
+)
+{
+	uint64_t index = 0;
+	const uint8_t* str = NULL;
+	size_t length = 0;
+	
+	if (!wexpr_PrivateBinaryFormat_stringTableLookup(state->strings, state->stringsSize, reference, referenceSize,
+		&index, &str, &length, error))
+	{ return NULL; }
+	
+	WexprExpression** value = &state->stringValues[index];
+	if (!*value)
+	{
+		*value = wexpr_Expression_createValueFromLengthString((const char*)str, length);
+		if (!*value)
+		{ return NULL; }
+	}
+	
+	return s_Expression_retain(*value);
+}
+
+static WexprBuffer s_Expression_parseFromBinaryChunk (WexprExpression* self, WexprBuffer data, PrivateBinaryParseState* state, WexprError* error);
+
+// Parse the child chunk at the start of data, setting child to it (which you own).
+// String references share the value from the string table, setting fromStringTable.
+// Returns the part of the buffer remaining, which is null on failure.
 // NOLINTNEXTLINE(misc-no-recursion)
-static WexprBuffer s_Expression_parseFromBinaryChunk (WexprExpression* self, WexprBuffer data, WexprError* error)
+static WexprBuffer s_Expression_parseBinaryChild (WexprBuffer data, PrivateBinaryParseState* state,
+	WexprExpression** child, bool* fromStringTable, WexprError* error
+)
 {
+	*fromStringTable = false;
+	
+	uint64_t size = 0;
+	uint8_t chunkType = 0;
+	size_t headerSize = 0;
 	
-	if (data.byteSize < (1 + sizeof(uint8_t))) // minimum of 1
+	if (state->strings
+		&& wexpr_PrivateBinaryFormat_readChunkHeader(data.data, data.byteSize, &size, &chunkType, &headerSize, NULL)
+		&& chunkType == WEXPR_PRIVATE_BINARYFORMAT_CHUNKTYPE_STRINGREFERENCE)
 	{
-		if (error)
+		WexprBuffer rest;
+		rest.byteSize = 0; rest.data = NULL;
+		
+		*child = s_binaryParseState_stringValue(state, (const uint8_t*)data.data + headerSize, (size_t)size, error);
+		if (*child)
 		{
-			error->message = strdup ("Chunk not big enough for header");
-			error->code = WexprErrorCodeBinaryChunkNotBigEnough;
+			*fromStringTable = true;
+			rest.byteSize = data.byteSize - headerSize - (size_t)size;
+			rest.data = (const uint8_t*)data.data + headerSize + (size_t)size;
 		}
 		
-		WexprBuffer buf;
-		buf.byteSize = 0; buf.data = NULL;
-		return buf;
+		return rest;
 	}
 	
-	const uint8_t* buf = data.data;
+	*child = wexpr_Expression_createInvalid();
+	WexprBuffer rest = s_Expression_parseFromBinaryChunk(*child, data, state, error);
 	
-	#define BUFCAST(buf, position, type) ((type)((uint8_t*)buf+(position)))
+	if (rest.data == NULL)
+	{
+		wexpr_Expression_destroy(*child);
+		*child = NULL;
+	}
+	
+	return rest;
+}
+
+// Skip the chunk at the start of data without reading it, for parts a projection didn't select.
+// Returns the part of the buffer remaining, which is null on failure.
+static WexprBuffer s_Expression_skipBinaryChunk (WexprBuffer data, WexprError* error)
+{
+	WexprBuffer rest;
+	rest.byteSize = 0; rest.data = NULL;
 	
 	uint64_t size = 0;
-	const uint8_t* dataNewPos = wexpr_uvlq64_read(
-		BUFCAST(buf, 0, uint8_t*),
-		data.byteSize,
-		&size
-	);
+	uint8_t chunkType = 0;
+	size_t headerSize = 0;
+	
+	if (wexpr_PrivateBinaryFormat_readChunkHeader(data.data, data.byteSize, &size, &chunkType, &headerSize, error))
+	{
+		rest.byteSize = data.byteSize - headerSize - (size_t)size;
+		rest.data = (const uint8_t*)data.data + headerSize + (size_t)size;
+	}
+	
+	return rest;
+}
+
+// returns the part of the buffer remaining
+// will load into self, setting up everything. Assumes we're empty/null to start.
+// NOLINTNEXTLINE(misc-no-recursion)
+static WexprBuffer s_Expression_parseFromBinaryChunk (WexprExpression* self, WexprBuffer data, PrivateBinaryParseState* state, WexprError* error)
+{
+	const uint8_t* buf = data.data;
 	
-	size_t sizeSize = (size_t)(dataNewPos - buf);
+	#define BUFCAST(buf, position, type) ((type)((uint8_t*)buf+(position)))
 	
-	uint8_t chunkType = *BUFCAST(buf, sizeSize, uint8_t*);
+	uint64_t size = 0;
+	uint8_t chunkType = 0;
+	size_t readAmount = 0;
 	
-	size_t readAmount = sizeSize + sizeof(uint8_t);
+	if (!wexpr_PrivateBinaryFormat_readChunkHeader(buf, data.byteSize, &size, &chunkType, &readAmount, error))
+	{
+		WexprBuffer buf;
+		buf.byteSize = 0; buf.data = NULL;
+		return buf;
+	}
 	
 	#define RETURN_REST() \
 		{ \
@@ -774,12 +1429,33 @@ static WexprBuffer s_Expression_parseFromBinaryChunk (WexprExpression* self, Wex
 			inBuf.data = BUFCAST(buf, readAmount+curPos, const void*);
 			inBuf.byteSize = startSize;
 			
-			WexprExpression* childExpr = wexpr_Expression_createInvalid();
-			WexprBuffer remaining = s_Expression_parseFromBinaryChunk(
-				childExpr,
-				inBuf,
-				error
-			);
+			WexprExpression* childExpr = NULL;
+			bool fromStringTable = false;
+			WexprBuffer remaining;
+			
+			PrivateProjectionCursor cursor = state->projection;
+			PrivateProjectionCursor childCursor = s_Projection_child(cursor, NULL, self->m_array.listCount);
+			
+			if (s_Projection_isSkipped(childCursor))
+			{
+				// not selected, so keep its place with a shared null
+				remaining = s_Expression_skipBinaryChunk(inBuf, error);
+				
+				if (remaining.data)
+				{ childExpr = s_Expression_retain(cursor.projection->skipped); }
+			}
+			else
+			{
+				state->projection = childCursor;
+				remaining = s_Expression_parseBinaryChild(
+					inBuf,
+					state,
+					&childExpr,
+					&fromStringTable,
+					error
+				);
+				state->projection = cursor;
+			}
 			
 			curPos += (startSize - remaining.byteSize);
 			
@@ -792,6 +1468,9 @@ static WexprBuffer s_Expression_parseFromBinaryChunk (WexprExpression* self, Wex
 			}
 			
 			// otherwise, add it
+			if (!s_Projection_isSkipped(childCursor))
+			{ childExpr = s_Expression_intern(state->internTable, childExpr); }
+			
 			WexprExpressionPrivateArrayElement* lelem = malloc(sizeof(WexprExpressionPrivateArrayElement));
 				lelem->expression = childExpr;
 				lelem->next = NULL;
@@ -829,10 +1508,13 @@ static WexprBuffer s_Expression_parseFromBinaryChunk (WexprExpression* self, Wex
 			inBuf.data = BUFCAST(buf, readAmount+curPos, const void*);
 			inBuf.byteSize = startSize;
 			
-			WexprExpression* keyExpression = wexpr_Expression_createInvalid();
-			WexprBuffer remaining = s_Expression_parseFromBinaryChunk(
-				keyExpression,
+			WexprExpression* keyExpression = NULL;
+			bool keyFromStringTable = false;
+			WexprBuffer remaining = s_Expression_parseBinaryChild(
 				inBuf,
+				state,
+				&keyExpression,
+				&keyFromStringTable,
 				error
 			);
 			
@@ -847,64 +1529,178 @@ static WexprBuffer s_Expression_parseFromBinaryChunk (WexprExpression* self, Wex
 				return buf;
 			}
 			
+			if (keyExpression->m_type != WexprExpressionTypeValue)
+			{
+				if (error)
+				{
+					error->message = strdup ("Map keys must be a value");
+					error->code = WexprErrorCodeMapKeyMustBeAValue;
+				}
+				
+				wexpr_Expression_destroy(keyExpression);
+				
+				WexprBuffer buf;
+				buf.byteSize = 0; buf.data = NULL;
+				return buf;
+			}
+			
 			// now parse the value
-			WexprExpression* valueExpr = wexpr_Expression_createInvalid();
-			remaining = s_Expression_parseFromBinaryChunk(
-				valueExpr,
-				remaining,
-				error
-			);
+			WexprExpression* valueExpr = NULL;
+			bool valueFromStringTable = false;
+			
+			PrivateProjectionCursor cursor = state->projection;
+			PrivateProjectionCursor childCursor = s_Projection_child(cursor, keyExpression->m_value.data, 0);
+			
+			if (s_Projection_isSkipped(childCursor))
+			{
+				remaining = s_Expression_skipBinaryChunk(remaining, error);
+			}
+			else
+			{
+				state->projection = childCursor;
+				remaining = s_Expression_parseBinaryChild(
+					remaining,
+					state,
+					&valueExpr,
+					&valueFromStringTable,
+					error
+				);
+				state->projection = cursor;
+			}
 			
 			curPos += (startSize - remaining.byteSize - keySize);
 			
-			if (remaining.data == NULL)
+			if (remaining.data == NULL || !valueExpr)
 			{
-				// failure when parsing the child
+				// failure when parsing the child, or not selected
+				wexpr_Expression_destroy(keyExpression);
+				
+				if (remaining.data)
+				{ continue; }
+				
 				WexprBuffer buf;
 				buf.byteSize = 0; buf.data = NULL;
 				return buf;
 			}
 			
 			// now add it
+			valueExpr = s_Expression_intern(state->internTable, valueExpr);
+			
 			// both malloc so can free later
 			WexprExpressionPrivateMapElement* elem = malloc (sizeof(WexprExpressionPrivateMapElement));
-			elem->key = strdup(wexpr_Expression_value(keyExpression));
 			elem->value = valueExpr;
 			
-			hashmap_put(self->m_map.hash, elem->key, elem);
-			
-			// destroy our key since thats not stored anywhere
-			wexpr_Expression_destroy(keyExpression);
-		}
-		
-		readAmount += curPos;
-		RETURN_REST();
-	}
+			if (keyFromStringTable)
+			{
+				// share the string with everything else using it
+				elem->key = keyExpression->m_value.data;
+				elem->keyOwner = keyExpression;
+			}
+			else
+			{
+				elem->key = strdup(wexpr_Expression_value(keyExpression));
+				elem->keyOwner = NULL;
+				
+				// destroy our key since thats not stored anywhere
+				wexpr_Expression_destroy(keyExpression);
+			}
+			
+			hashmap_put(self->m_map.hash, elem->key, elem);
+		}
+		
+		readAmount += curPos;
+		RETURN_REST();
+	}
 	
 	else if (chunkType == WexprExpressionTypeBinaryData)
 	{
 		// data is the entire binary data
 		// first byte is the compression
+		if (size < 1)
+		{
+			if (error)
+			{
+				error->message = strdup ("Binary data chunk is missing the compression method");
+				error->code = WexprErrorCodeBinaryChunkNotBigEnough;
+			}
+			
+			WexprBuffer buf;
+			buf.byteSize = 0; buf.data = NULL;
+			return buf;
+		}
+		
 		uint8_t compression = *BUFCAST(buf, readAmount, uint8_t*);
 		
-		if (compression != 0x00)
+		if (compression == WexprBinaryCompressionNone)
 		{
-			if (error)
+			wexpr_Expression_changeType(self, WexprExpressionTypeBinaryData);
+			wexpr_Expression_binaryData_setValue(self, 
+				BUFCAST(buf, readAmount+1, const char*), size-1
+			);
+		}
+		
+		else
+		{
+			void* data = NULL;
+			size_t dataSize = 0;
+			
+			if (!wexpr_PrivateCompression_decompress(compression, BUFCAST(buf, readAmount+1, const void*), size-1,
+				&data, &dataSize, error))
 			{
-				error->message = strdup ("Unknown compression method to use");
-				error->code = WexprErrorCodeBinaryUnknownCompression;
+				WexprBuffer buf;
+				buf.byteSize = 0; buf.data = NULL;
+				return buf;
 			}
 			
+			// its sized for the data, so we take it instead of copying
+			wexpr_Expression_changeType(self, WexprExpressionTypeBinaryData);
+			free (self->m_binaryData.data);
+			self->m_binaryData.data = data;
+			self->m_binaryData.size = dataSize;
+		}
+		
+		readAmount += size;
+		
+		RETURN_REST();
+	}
+	
+	else if (wexpr_PrivateBinaryFormat_isTypedValueChunk(chunkType))
+	{
+		WexprPrivateTypedValue typed;
+		
+		if (!wexpr_PrivateBinaryFormat_decodeTypedValue(chunkType, BUFCAST(buf, readAmount, const uint8_t*), size, &typed, error))
+		{
 			WexprBuffer buf;
 			buf.byteSize = 0; buf.data = NULL;
 			return buf;
 		}
 		
-		// raw compression
-		wexpr_Expression_changeType(self, WexprExpressionTypeBinaryData);
-		wexpr_Expression_binaryData_setValue(self, 
-			BUFCAST(buf, readAmount+1, const char*), size-1
-		);
+		// still a value, with the text made from the type
+		wexpr_Expression_changeType(self, WexprExpressionTypeValue);
+		s_Expression_valueSetTyped(self, &typed);
+		
+		readAmount += size;
+		
+		RETURN_REST();
+	}
+	
+	else if (chunkType == WEXPR_PRIVATE_BINARYFORMAT_CHUNKTYPE_STRINGREFERENCE && state->strings)
+	{
+		// only the root gets here, children share the value instead
+		uint64_t index = 0;
+		const uint8_t* str = NULL;
+		size_t length = 0;
+		
+		if (!wexpr_PrivateBinaryFormat_stringTableLookup(state->strings, state->stringsSize,
+			BUFCAST(buf, readAmount, const uint8_t*), size, &index, &str, &length, error))
+		{
+			WexprBuffer buf;
+			buf.byteSize = 0; buf.data = NULL;
+			return buf;
+		}
+		
+		wexpr_Expression_changeType(self, WexprExpressionTypeValue);
+		wexpr_Expression_valueSetLengthString(self, (const char*)str, length);
 		
 		readAmount += size;
 		
@@ -929,389 +1725,412 @@ static WexprBuffer s_Expression_parseFromBinaryChunk (WexprExpression* self, Wex
 	#undef RETURN_REST
 }
 
-// returns the part of the string remaining
-// will load into self, setting up everything. Assumes we're empty/null to start.
-// NOLINTNEXTLINE(misc-no-recursion)
-static PrivateStringRef s_Expression_parseFromString (WexprExpression* self, PrivateStringRef str, WexprParseFlags parseFlags,
-	PrivateParserState* parserState, WexprError* error)
+// Parse an expression chunk. strings is the content of the string table chunk, or null.
+static WexprExpression* s_Expression_createFromBinary (const void* data, size_t length,
+	const uint8_t* strings, size_t stringsSize, WexprParseFlags flags, const PrivateParseSetup* setup, WexprError* error
+)
 {
-	if (str.size == 0)
+	PrivateBinaryParseState state;
+	if (!s_binaryParseState_init(&state, flags, strings, stringsSize, setup))
+	{
+		s_binaryParseState_free (&state);
+		return NULL;
+	}
+	
+	WexprExpression* expr = s_Expression_alloc (WexprExpressionTypeInvalid);
+	
+	WexprError err = WEXPR_ERROR_INIT();
+	
+	WexprBuffer inBuf;
+	inBuf.data = data;
+	inBuf.byteSize = length;
+	
+	WexprBuffer buf = s_Expression_parseFromBinaryChunk (
+		expr, inBuf, &state, &err
+	);
+	
+	(void) buf; // unused, remaining part of buffer
+	
+	s_binaryParseState_free (&state);
+	
+	if (err.code != WexprErrorCodeNone)
 	{
+		wexpr_Expression_destroy (expr);
+		expr = NULL;
+		
 		if (error)
 		{
-			error->code = WexprErrorCodeEmptyString;
-			error->message = strdup("Was told to parse an empty string");
-			error->line = parserState->line;
-			error->column = parserState->column;
+			WEXPR_ERROR_MOVE(error, &err);
 		}
 		
-		return s_StringRef_createInvalid();
+		WEXPR_ERROR_FREE (err);
 	}
 	
-	// now we parse
-	str = s_trimFrontOfString (str, parserState);
+	return expr;
+}
+
+// Parse a whole binary file, which isnt block compressed.
+static WexprExpression* s_Expression_createFromBinaryFileChunks (const uint8_t* data, size_t length,
+	WexprParseFlags flags, const PrivateParseSetup* setup, WexprError* error
+)
+{
+	const uint8_t* expressionChunk = NULL;
+	size_t expressionChunkSize = 0;
 	
-	if (str.size == 0)
+	if (!wexpr_PrivateBinaryFormat_findExpressionChunk(data, length, &expressionChunk, &expressionChunkSize, error))
+	{ return NULL; }
+	
+	const uint8_t* strings = NULL;
+	size_t stringsSize = 0;
+	
+	if (!wexpr_PrivateBinaryFormat_findAuxiliaryChunk(data, length, WEXPR_PRIVATE_BINARYFORMAT_CHUNKTYPE_STRINGTABLE, &strings, &stringsSize))
+	{ strings = NULL; }
+	
+	return s_Expression_createFromBinary (
+		expressionChunk, expressionChunkSize, strings, stringsSize, flags, setup, error
+	);
+}
+
+// Read the aligned node at offset (which must be before limit) for building, making sure its the first time.
+static bool s_binaryParseState_readAlignedNode (PrivateBinaryParseState* state, const uint8_t* data, uint64_t fileSize,
+	uint64_t offset, uint64_t limit, WexprPrivateAlignedNode* node, WexprError* error)
+{
+	if (!wexpr_PrivateAlignedFormat_readNode(data, fileSize, offset, limit, node, error)
+		|| !wexpr_PrivateAlignedFormat_markNode(state->alignedVisited, offset, error))
+	{ return false; }
+	
+	if (state->alignedNodesLeft == 0)
 	{
-		return s_StringRef_createInvalid(); // nothing left to parse
+		if (error)
+		{
+			error->message = strdup ("Invalid aligned binary - more nodes than the file can hold");
+			error->code = WexprErrorCodeBinaryInvalidNode;
+		}
+		
+		return false;
 	}
 	
-	// start parsing types:
-	// if first two characters are #(, we're an array.
-	// if @( we're a map.
-	// if [] we're a ref.
-	// if < we're a binary string
-	// otherwise, we're a value.
+	state->alignedNodesLeft -= 1;
+	return true;
+}
+
+// Load the aligned node at offset (which must be before limit) into self, which is invalid to start.
+// Each node can only be used once, so the tree built is no bigger than the file.
+// On failure self may be partly filled in, and needs to be destroyed.
+// NOLINTNEXTLINE(misc-no-recursion)
+static bool s_Expression_loadAlignedNode (WexprExpression* self, const uint8_t* data, uint64_t fileSize,
+	uint64_t offset, uint64_t limit, PrivateBinaryParseState* state, WexprError* error)
+{
+	WexprPrivateAlignedNode node;
+	if (!s_binaryParseState_readAlignedNode(state, data, fileSize, offset, limit, &node, error))
+	{ return false; }
 	
-	if (str.size >= 2 && s_StringRef_isEqual(s_StringRef_slice2 (str, 0, 2), s_StringRef_create("#(")))
+	if (node.type == WexprExpressionTypeNull)
 	{
-		// We're an array
-		self->m_type = WexprExpressionTypeArray;
-		self->m_array.listCount = 0;
-		self->m_array.list = NULL;
+		wexpr_Expression_changeType(self, WexprExpressionTypeNull);
+	}
+	
+	else if (node.type == WexprExpressionTypeValue)
+	{
+		wexpr_Expression_changeType(self, WexprExpressionTypeValue);
+		wexpr_Expression_valueSetLengthString(self, (const char*)node.payload, (size_t)node.count);
+	}
+	
+	else if (node.type == WexprExpressionTypeBinaryData)
+	{
+		wexpr_Expression_changeType(self, WexprExpressionTypeBinaryData);
 		
-		// move our string forward
-		str = s_StringRef_slice(str, 2);
-		parserState->column += 2;
+		if (node.extra == WexprBinaryCompressionNone)
+		{
+			wexpr_Expression_binaryData_setValue(self, node.payload, (size_t)node.count);
+		}
+		else
+		{
+			void* decompressed = NULL;
+			size_t decompressedSize = 0;
+			
+			if (!wexpr_PrivateCompression_decompress((WexprBinaryCompression)node.extra, node.payload, (size_t)node.count,
+				&decompressed, &decompressedSize, error))
+			{ return false; }
+			
+			free (self->m_binaryData.data);
+			self->m_binaryData.data = decompressed;
+			self->m_binaryData.size = decompressedSize;
+		}
+	}
+	
+	else if (node.type == WexprExpressionTypeArray)
+	{
+		wexpr_Expression_changeType(self, WexprExpressionTypeArray);
 		
-		// continue building children as needed
-		while (true)
+		WexprExpressionPrivateArrayElement** tail = &self->m_array.list;
+		
+		for (uint64_t i=0; i < node.count; ++i)
 		{
-			str = s_trimFrontOfString (str, parserState);
+			PrivateProjectionCursor cursor = state->projection;
+			PrivateProjectionCursor childCursor = s_Projection_child(cursor, NULL, (size_t)i);
 			
-			if (str.size == 0 && !error->code)
-			{
-				error->code = WexprErrorCodeArrayMissingEndParen;
-				error->message = strdup("An Array was missing its ending paren");
-				error->line = parserState->line;
-				error->column = parserState->column;
-				
-				return s_StringRef_createInvalid();
-			}
+			WexprExpression* child = NULL;
 			
-			if (s_StringRef_isEqual(
-				s_StringRef_slice2(str, 0, 1),
-				s_StringRef_create(")") // end array
-			))
+			if (s_Projection_isSkipped(childCursor))
 			{
-				break; // done
+				// not selected, so keep its place with a shared null
+				child = s_Expression_retain(cursor.projection->skipped);
 			}
 			else
 			{
-				// parse as a new expression
-				WexprExpression* newExpression = wexpr_Expression_createNull();
-				str = s_Expression_parseFromString(newExpression, str, parseFlags, parserState, error);
+				child = s_Expression_alloc(WexprExpressionTypeInvalid);
 				
-				if (error && error->code)
-				{
-					wexpr_Expression_destroy(newExpression); // not added
-					return s_StringRef_createInvalid(); // fail, exit
-				}
+				uint64_t childOffset = wexpr_PrivateAlignedFormat_readUInt64(node.payload + i * sizeof(uint64_t));
 				
-				// otherwise, add it to our array
-				WexprExpressionPrivateArrayElement* lelem = malloc(sizeof(WexprExpressionPrivateArrayElement));
-				lelem->expression = newExpression;
-				lelem->next = NULL;
+				state->projection = childCursor;
+				bool loaded = s_Expression_loadAlignedNode(child, data, fileSize, childOffset, offset, state, error);
+				state->projection = cursor;
 				
-				WexprExpressionPrivateArrayElement* endOfList = self->m_array.list;
-				if (endOfList) {
-					while (endOfList->next) { endOfList = endOfList->next; }
-					endOfList->next = lelem;
-				}
-				else
+				if (!loaded)
 				{
-					self->m_array.list = lelem;
+					wexpr_Expression_destroy(child);
+					return false;
 				}
 				
-				(self->m_array.listCount)++;
-				
+				child = s_Expression_intern(state->internTable, child);
 			}
+			
+			WexprExpressionPrivateArrayElement* lelem = malloc(sizeof(WexprExpressionPrivateArrayElement));
+				lelem->expression = child;
+				lelem->next = NULL;
+			
+			*tail = lelem;
+			tail = &lelem->next;
+			
+			(self->m_array.listCount)++;
 		}
-		
-		str = s_StringRef_slice(str, 1); // remove the end array
-		parserState->column += 1;
-		
-		// done with array
-		return str;
 	}
 	
-	else if (str.size >= 2 && s_StringRef_isEqual(s_StringRef_slice2 (str, 0, 2), s_StringRef_create("@(")))
+	else if (node.type == WexprExpressionTypeMap)
 	{
-		// We're a map
-		self->m_type = WexprExpressionTypeMap;
-		self->m_map.hash = hashmap_new();
-		
-		// move our string accordingly
-		str = s_StringRef_slice(str, 2);
-		parserState->column += 2;
+		wexpr_Expression_changeType(self, WexprExpressionTypeMap);
 		
-		// build our children as needed
-		while (true)
+		for (uint64_t i=0; i < node.count; ++i)
 		{
-			str = s_trimFrontOfString(str, parserState);
+			const uint8_t* entry = node.payload + i * WEXPR_PRIVATE_ALIGNEDFORMAT_MAPENTRYSIZE;
 			
-			if (str.size == 0)
+			// the key is used directly, and the hash is only for views
+			WexprPrivateAlignedNode keyNode;
+			if (!s_binaryParseState_readAlignedNode(state, data, fileSize,
+				wexpr_PrivateAlignedFormat_readUInt64(entry + sizeof(uint64_t)), offset, &keyNode, error))
+			{ return false; }
+			
+			if (keyNode.type != WexprExpressionTypeValue)
 			{
-				if (!error->code)
+				if (error)
 				{
-					error->code = WexprErrorCodeMapMissingEndParen;
-					error->message = strdup("A Map was missing its ending paren");
-					error->line = parserState->line;
-					error->column = parserState->column;
+					error->message = strdup ("Map keys must be a value");
+					error->code = WexprErrorCodeMapKeyMustBeAValue;
 				}
 				
-				return s_StringRef_createInvalid();
-			}
-			
-			if (str.size >= 1 && s_StringRef_isEqual(
-				s_StringRef_slice2(str, 0, 1),
-				s_StringRef_create(")") // end map
-			))
-			{
-				break; // done
+				return false;
 			}
 			
-			else
+			any_t existing = NULL;
+			if (hashmap_get(self->m_map.hash, (char*)keyNode.payload, &existing) == MAP_OK)
 			{
-				// parse as a new expression - we'll alternate keys and values
-				// keep our previous position just in case the value is bad
-				WexprLineNumber prevLine = parserState->line;
-				WexprColumnNumber prevColumn = parserState->column;
-				
-				WexprExpression* keyExpression = wexpr_Expression_createNull();
-				str = s_Expression_parseFromString(keyExpression, str, parseFlags, parserState, error);
-				
-				if (wexpr_Expression_type(keyExpression) != WexprExpressionTypeValue)
+				if (error)
 				{
-					if (!error->code)
-					{
-						error->code = WexprErrorCodeMapKeyMustBeAValue;
-						error->message = strdup("Map keys must be a value");
-						error->line = prevLine;
-						error->column = prevColumn;
-					}
-					
-					wexpr_Expression_destroy(keyExpression);
-					
-					return s_StringRef_createInvalid();
+					error->message = strdup ("Invalid aligned binary - map has a duplicate key");
+					error->code = WexprErrorCodeBinaryInvalidNode;
 				}
 				
-				WexprExpression* valueExpression = wexpr_Expression_createInvalid();
-				str = s_Expression_parseFromString(valueExpression, str, parseFlags, parserState, error);
-				
-				if (valueExpression->m_type == WexprExpressionTypeInvalid)
-				{
-					// it wasnt filled in! no key found.
-					// we might have an error code from the upper level (told to parse empty), so overwrite it
-					// otherpossibilites are invalid ref and stuff, and we want to keep those
-					if (!error->code || error->code == WexprErrorCodeEmptyString)
-					{
-						error->code = WexprErrorCodeMapNoValue;
-						error->message = strdup("Map key must have a value");
-						error->line = prevLine;
-						error->column = prevColumn;
-					}
-					
-					wexpr_Expression_destroy(keyExpression);
-					wexpr_Expression_destroy(valueExpression);
-					
-					return s_StringRef_createInvalid();
-				}
-				
-				// ok we now have the key and the value
-				// both malloc so can free later
-				WexprExpressionPrivateMapElement* elem = malloc (sizeof(WexprExpressionPrivateMapElement));
-				elem->key = strdup(wexpr_Expression_value(keyExpression));
-				elem->value = valueExpression;
-				
-				hashmap_put(self->m_map.hash, elem->key, elem);
-				
-				// destroy our key since thats not stored anywhere
-				wexpr_Expression_destroy(keyExpression);
-			}
-		}
-		
-		// remove the end map
-		str = s_StringRef_slice(str, 1);
-		parserState->column += 1;
-		
-		// done with map
-		return str;
-	}
-	
-	else if (str.size >= 1 && s_StringRef_isEqual(s_StringRef_slice2 (str, 0, 1), s_StringRef_create("[")))
-	{
-		// the current expression being processed is the one the attribute will be linked to.
-		
-		// process till the closing ]
-		size_t endingBracketIndex = s_StringRef_find(str, ']');
-		if (endingBracketIndex == s_InvalidIndex)
-		{
-			if (!error->code)
-			{
-				error->code = WexprErrorCodeReferenceMissingEndBracket;
-				error->message = strdup ("A reference [] is missing its ending bracket");
-				error->line = parserState->line;
-				error->column = parserState->column;
+				return false;
 			}
 			
-			return s_StringRef_createInvalid();
-		}
-		
-		PrivateStringRef refName = s_StringRef_slice2(str, 1, endingBracketIndex-1);
-		
-		// validate the contents
-		bool invalidName = false;
-		for (size_t i=0; i < refName.size; ++i)
-		{
-			char v = refName.ptr[i];
+			PrivateProjectionCursor cursor = state->projection;
+			PrivateProjectionCursor childCursor = s_Projection_child(cursor, (const char*)keyNode.payload, 0);
 			
-			bool isAlpha = (v >= 'a' && v <= 'z') || (v >= 'A' && v <= 'Z');
-			bool isNumber = (v >= '0' && v <= '9');
-			bool isUnder = (v == '_');
+			if (s_Projection_isSkipped(childCursor))
+			{ continue; } // not selected
 			
-			if (i == 0 && (isAlpha || isUnder))
-			{}
-			else if (i != 0 && (isAlpha || isNumber || isUnder))
-			{}
-			else
-			{
-				invalidName = true;
-				break;
-			}
-		}
-		
-		if (invalidName)
-		{
-			if (error && !error->code)
+			WexprExpression* value = s_Expression_alloc(WexprExpressionTypeInvalid);
+			
+			state->projection = childCursor;
+			bool loaded = s_Expression_loadAlignedNode(value, data, fileSize,
+				wexpr_PrivateAlignedFormat_readUInt64(entry + 2 * sizeof(uint64_t)), offset, state, error);
+			state->projection = cursor;
+			
+			if (!loaded)
 			{
-				error->code = WexprErrorCodeReferenceInvalidName;
-				error->message = strdup ("A reference doesn't have a valid name");
-				error->line = parserState->line;
-				error->column = parserState->column;
+				wexpr_Expression_destroy(value);
+				return false;
 			}
 			
-			return s_StringRef_createInvalid();
-		}
-		
-		// move forward
-		s_privateParserState_moveForwardBasedOnString(parserState, 
-			s_StringRef_slice2(str, 0, endingBracketIndex+1)
-		);
-		str = s_StringRef_slice(str, endingBracketIndex+1);
-		
-		// continue parsing at the same level : stored the reference name
-		PrivateStringRef resultString = s_Expression_parseFromString(self, str, parseFlags, parserState, error);
-		if (error->code != WexprErrorCodeNone)
-		{
-			return s_StringRef_createInvalid(); // failed when parsing
+			WexprExpressionPrivateMapElement* elem = malloc (sizeof(WexprExpressionPrivateMapElement));
+			elem->key = strdup((const char*)keyNode.payload);
+			elem->keyOwner = NULL;
+			elem->value = s_Expression_intern(state->internTable, value);
+			
+			hashmap_put(self->m_map.hash, elem->key, elem);
 		}
-		
-		// now bind the ref - creating a copy of what was made. This will be used for the template.
-		wexpr_ReferenceTable_setExpressionForLengthKey(
-			parserState->internalReferenceMap,
-			refName.ptr, refName.size,
-			wexpr_Expression_createCopy (self)
-		);
-		
-		// and continue
-		return resultString;
 	}
 	
-	else if (str.size >= 2 && s_StringRef_isEqual(s_StringRef_slice2 (str, 0, 2), s_StringRef_create("*[")))
+	return true;
+}
+
+// Parse a whole file in the aligned layout.
+static WexprExpression* s_Expression_createFromAlignedFile (const uint8_t* data, size_t length,
+	WexprParseFlags flags, const PrivateParseSetup* setup, WexprError* error
+)
+{
+	uint64_t rootOffset = 0;
+	uint64_t fileSize = 0;
+	
+	if (!wexpr_PrivateAlignedFormat_readPrologue(data, length, &rootOffset, &fileSize, error))
+	{ return NULL; }
+	
+	PrivateBinaryParseState state;
+	if (!s_binaryParseState_init(&state, flags, NULL, 0, setup))
 	{
-		// parse the reference name
-		size_t endingBracketIndex = s_StringRef_find(str, ']');
-		if (endingBracketIndex == s_InvalidIndex)
+		s_binaryParseState_free (&state);
+		return NULL;
+	}
+	
+	state.alignedVisited = calloc(wexpr_PrivateAlignedFormat_visitedSize(fileSize), 1);
+	state.alignedNodesLeft = fileSize / WEXPR_PRIVATE_ALIGNEDFORMAT_NODEHEADERSIZE;
+	
+	if (!state.alignedVisited)
+	{
+		s_binaryParseState_free (&state);
+		return NULL;
+	}
+	
+	WexprExpression* expr = s_Expression_alloc (WexprExpressionTypeInvalid);
+	
+	if (!s_Expression_loadAlignedNode(expr, data, fileSize, rootOffset, fileSize, &state, error))
+	{
+		wexpr_Expression_destroy (expr);
+		expr = NULL;
+	}
+	
+	s_binaryParseState_free (&state);
+	
+	return expr;
+}
+
+static PrivateStringRef s_Expression_parseFromString (WexprExpression* self, PrivateStringRef str, WexprParseFlags parseFlags,
+	PrivateParserState* parserState, WexprError* error);
+
+// Skip the expression at the start of the string without building it, for parts a projection didn't select.
+// Only the structure is checked (so no copying strings or decoding base64), but reference definitions
+// are still built since parts which are selected might insert them later.
+// NOLINTNEXTLINE(misc-no-recursion)
+static PrivateStringRef s_Expression_skipFromString (PrivateStringRef str, WexprParseFlags parseFlags,
+	PrivateParserState* parserState, WexprError* error)
+{
+	str = s_trimFrontOfString (str, parserState);
+	
+	if (str.size == 0)
+	{
+		if (!error->code)
 		{
-			error->code = WexprErrorCodeReferenceInsertMissingEndBracket;
-			error->message = strdup ("A reference insert *[] is missing its ending bracket");
+			error->code = WexprErrorCodeEmptyString;
+			error->message = strdup("Was told to parse an empty string");
 			error->line = parserState->line;
 			error->column = parserState->column;
-			
-			return s_StringRef_createInvalid();
 		}
 		
-		PrivateStringRef refName = s_StringRef_slice2(str, 2, endingBracketIndex-2);
-		
-		// move forward
-		s_privateParserState_moveForwardBasedOnString(parserState, 
-			s_StringRef_slice2(str, 0, endingBracketIndex+1)
-		);
-		str = s_StringRef_slice(str, endingBracketIndex+1);
+		return s_StringRef_createInvalid();
+	}
 	
-		WexprExpression* referenceExpr = wexpr_ReferenceTable_expressionForLengthKey(
-			parserState->internalReferenceMap,
-			refName.ptr, refName.size
-		);
+	bool isArray = (str.size >= 2 && str.ptr[0] == '#' && str.ptr[1] == '(');
+	bool isMap = (str.size >= 2 && str.ptr[0] == '@' && str.ptr[1] == '(');
+	
+	if (isArray || isMap)
+	{
+		str = s_StringRef_slice(str, 2);
+		parserState->column += 2;
 		
-		if (!referenceExpr)
+		while (true)
 		{
-			// try again with the external if we have it
-			if (parserState->externalReferenceMap)
+			str = s_trimFrontOfString (str, parserState);
+			
+			if (str.size == 0)
 			{
-				referenceExpr = wexpr_ReferenceTable_expressionForLengthKey(
-					parserState->externalReferenceMap,
-					refName.ptr, refName.size
-				);
+				if (!error->code)
+				{
+					error->code = isArray ? WexprErrorCodeArrayMissingEndParen : WexprErrorCodeMapMissingEndParen;
+					error->message = strdup(isArray ? "An Array was missing its ending paren" : "A Map was missing its ending paren");
+					error->line = parserState->line;
+					error->column = parserState->column;
+				}
+				
+				return s_StringRef_createInvalid();
 			}
-		}
-		
-		if (!referenceExpr)
-		{
-			// not found
-			if (!error->code)
+			
+			if (str.ptr[0] == ')')
+			{ break; }
+			
+			WexprLineNumber prevLine = parserState->line;
+			WexprColumnNumber prevColumn = parserState->column;
+			
+			str = s_Expression_skipFromString(str, parseFlags, parserState, error);
+			if (error->code)
+			{ return s_StringRef_createInvalid(); }
+			
+			if (isMap)
 			{
-				error->code = WexprErrorCodeReferenceUnknownReference;
-				error->message = strdup ("Tried to insert a reference, but couldn't find it.");
-				error->line = parserState->line;
-				error->column = parserState->column;
+				// and its value
+				str = s_trimFrontOfString (str, parserState);
+				
+				if (str.size == 0 || str.ptr[0] == ')')
+				{
+					error->code = WexprErrorCodeMapNoValue;
+					error->message = strdup("Map key must have a value");
+					error->line = prevLine;
+					error->column = prevColumn;
+					
+					return s_StringRef_createInvalid();
+				}
+				
+				str = s_Expression_skipFromString(str, parseFlags, parserState, error);
+				if (error->code)
+				{ return s_StringRef_createInvalid(); }
 			}
-			
-			return s_StringRef_createInvalid();
 		}
 		
-		// copy this into ourself
-		s_Expression_copyInto (self, referenceExpr);
+		str = s_StringRef_slice(str, 1); // the end paren
+		parserState->column += 1;
 		
 		return str;
 	}
 	
-	// null expressions will be treated as a value, and then parsed seperately
-	
-	else if (
-		str.size >= 1 && s_StringRef_isEqual(
-			s_StringRef_slice2(str, 0, 1), s_StringRef_create("<")
-		)
-	)
+	if (str.ptr[0] == '[')
 	{
-		// look for the ending >
-		size_t endingQuote = s_StringRef_find(str, '>');
-		if (endingQuote == s_InvalidIndex)
-		{
-			// not found
-			if (!error->code)
-			{
-				error->code = WexprErrorCodeBinaryDataNoEnding;
-				error->message = strdup ("Tried to find the ending > for binary data, but not found.");
-				error->line = parserState->line;
-				error->column = parserState->column;
-			}
-			
-			return s_StringRef_createInvalid();
-		}
+		// a reference definition, which has to be built for later
+		PrivateProjectionCursor cursor = parserState->projection;
+		parserState->projection = s_Projection_begin(NULL);
 		
-		Base64IBuffer inputBuf;
-		inputBuf.buffer = str.ptr+1;
-		inputBuf.size = endingQuote-1; // -1 for starting quote. ending was not part.
-		Base64Buffer outBuf = base64_decode(inputBuf);
+		WexprExpression* definition = wexpr_Expression_createNull();
+		str = s_Expression_parseFromString(definition, str, parseFlags, parserState, error);
+		wexpr_Expression_destroy(definition);
 		
-		if (outBuf.buffer == NULL)
+		parserState->projection = cursor;
+		return str;
+	}
+	
+	if (str.ptr[0] == '<' || (str.size >= 2 && str.ptr[0] == '*' && str.ptr[1] == '['))
+	{
+		// binary data or a reference insert, skip to the end
+		bool isBinary = (str.ptr[0] == '<');
+		size_t endIndex = s_StringRef_find(str, isBinary ? '>' : ']');
+		
+		if (endIndex == s_InvalidIndex)
 		{
 			if (!error->code)
 			{
-				error->code = WexprErrorCodeBinaryDataInvalidBase64;
-				error->message = strdup ("Unable to decode the base64 data.");
+				error->code = isBinary ? WexprErrorCodeBinaryDataNoEnding : WexprErrorCodeReferenceInsertMissingEndBracket;
+				error->message = strdup(isBinary
+					? "Tried to find the ending > for binary data, but not found."
+					: "A reference insert *[] is missing its ending bracket"
+				);
 				error->line = parserState->line;
 				error->column = parserState->column;
 			}
@@ -1319,1139 +2138,4290 @@ static PrivateStringRef s_Expression_parseFromString (WexprExpression* self, Pri
 			return s_StringRef_createInvalid();
 		}
 		
-		self->m_type = WexprExpressionTypeBinaryData;
-		self->m_binaryData.data = outBuf.buffer;
-		self->m_binaryData.size = outBuf.size;
-		
-		s_privateParserState_moveForwardBasedOnString (parserState,
-			s_StringRef_slice2 (str, 0, endingQuote+1)
-		);
-		
-		return s_StringRef_slice (str, endingQuote+1);
+		s_privateParserState_moveForwardBasedOnString(parserState, s_StringRef_slice2(str, 0, endIndex+1));
+		return s_StringRef_slice(str, endIndex+1);
 	}
 	
-	else if (str.size >= 1)// its a value : must be at least one character
-	{
-		PrivateWexprStringValue val = s_createValueOfString (str, parserState, error);
-		
-		if (error && error->code != WexprErrorCodeNone)
-			return s_StringRef_createInvalid();
-		
-		// was it a null/nil string?
-		if ((strcmp (val.value, "nil") == 0) || (strcmp (val.value, "null") == 0))
-		{
-			self->m_type = WexprExpressionTypeNull;
-			
-			// we dont need the value anymore, trash it
-			free(val.value);
-			val.value = LIBWEXPR_NULLPTR;
-		}
-		else
-		{
-			self->m_type = WexprExpressionTypeValue;
-			self->m_value.data = val.value;
-		}
-		
-		s_privateParserState_moveForwardBasedOnString (parserState,
-			s_StringRef_slice2(
-				str, 0, val.endIndex
-			)
-		);
-		
-		return s_StringRef_slice (str, val.endIndex);
-	}
+	// a value
+	size_t valueLength = 0;
+	size_t endIndex = 0;
 	
-	// otherwise, we have no idea what happened
-	return s_StringRef_createInvalid();
-}
-
-static int s_freeHashData (any_t userData, any_t data)
-{
-	WexprExpressionPrivateMapElement* elem = data;
-	free (elem->key);
-	wexpr_Expression_destroy(elem->value);
-	free (elem);
+	if (!s_measureValueOfString(str, parserState, error, &valueLength, &endIndex))
+	{ return s_StringRef_createInvalid(); }
 	
-	return MAP_OK; // keep iterating
-}
-
-static size_t s_byteSizeForIndent (size_t indent)
-{
-	return indent; // one \t just costs one byte
-}
-
-void s_fillIndent (char* buffer, size_t indent)
-{
-	for (size_t i=0; i < indent; ++i)
-		buffer[i] = '\t';
+	s_privateParserState_moveForwardBasedOnString(parserState, s_StringRef_slice2(str, 0, endIndex));
+	return s_StringRef_slice(str, endIndex);
 }
 
-//
-/// Writes string to writeBuffer using stringProps. Will add quotes and escapes as needed.
-/// The buffer must be the following sizes:
-/// - if stringProps.isBarewordSafe : writeBuffer must have stringProps.writeByteSize (strlen(string)) length
-/// - if stringProps.isBarewordSafe : writeBuffer must have stringProps.writeByteSize + 2 size (we will  write the quotes)
-//
-void s_writeStringEscapedToBuffer(char* writeBuffer, size_t bufferLength, const char* string, size_t stringLength, PrivateWexprValueStringProperties props)
+// returns the part of the string remaining
+// will load into self, setting up everything. Assumes we're empty/null to start.
+// NOLINTNEXTLINE(misc-no-recursion)
+static PrivateStringRef s_Expression_parseFromString (WexprExpression* self, PrivateStringRef str, WexprParseFlags parseFlags,
+	PrivateParserState* parserState, WexprError* error)
 {
-#if DEBUG_ASSERT
-	size_t startBufferLength = bufferLength;
-#endif
-	
-	if (!props.isBarewordSafe)
-	{
-		*writeBuffer = '\"';
-		writeBuffer += 1;
-		bufferLength -= 1;
-	}
-
-	for (size_t i=0; i < stringLength; ++i)
+	if (str.size == 0)
 	{
-		char c = string[i];
-		
-		if (s_requiresEscape(c))
-		{
-#if DEBUG_ASSERT
-		if (bufferLength <= 0) {
-			fprintf(stderr, "!! s_writeStringEscapedToBuffer() - Buffer length was not big enough - overrun on escape character\n");
-			exit (1);
-		}
-#endif
-			// write it out as an escape
-			*(writeBuffer) = '\\';
-			*(writeBuffer+1) = s_escapeForValue(c);
-			writeBuffer += 2;
-			bufferLength -= 2;
-		}
-		else
+		if (error)
 		{
-#if DEBUG_ASSERT
-		if (bufferLength <= 0) {
-			fprintf(stderr, "!! s_writeStringEscapedToBuffer() - Buffer length was not big enough - overrun on non-escape character\n");
-			exit (1);
-		}
-#endif
-			
-			*(writeBuffer) = c;
-			++writeBuffer;
-			--bufferLength;
-		}
-	}
-	
-	if (!props.isBarewordSafe)
-	{
-#if DEBUG_ASSERT
-		if (bufferLength <= 0) {
-			fprintf(stderr,
-				"!! s_writeStringEscapedToBuffer() - Buffer length was not big enough - overrun on ending quote: str='%.*s' (len: %zu) to buffer length %zu\n",
-				(int)stringLength, string, stringLength, startBufferLength
-			);
-			exit (1);
+			error->code = WexprErrorCodeEmptyString;
+			error->message = strdup("Was told to parse an empty string");
+			error->line = parserState->line;
+			error->column = parserState->column;
 		}
-#endif
 		
-		// add quotes
-		*writeBuffer = '\"';
+		return s_StringRef_createInvalid();
 	}
-}
-
-// --------------------- PRIVATE ----------------------------------
-
-// should have no room for the null pointer. append at end
-// NOTE THESE BUFFERS ARE ACTUALLY MUTABLE AND WE'RE PASSING AROUND MALLOC OWNED ADDRESSES.
-//
-// Human Readablle notes:
-// even though you pass an indent, we assume you're already indented for the start of the object
-// we assume this so that an object for example as a key-value will be writen in the correct spot.
-// if it writes multiple lines, we will use the given indent to predict.
-// it will end after writing all data, no newline generally at the end.
-//
-// Note that ownership moves around the PrivateStringRefs automatically.
-static PrivateStringRef p_wexpr_Expression_appendStringRepresentationToAllocatedBuffer (WexprExpression* self, WexprWriteFlags flags, size_t indent, PrivateStringRef strBuffer)
-{
-	
-	bool writeHumanReadable = ((flags & WexprWriteFlagHumanReadable) == WexprWriteFlagHumanReadable);
-	WexprExpressionType type = wexpr_Expression_type(self);
 	
-	char* buffer = (char*) strBuffer.ptr;
-	size_t curBufferSize = strBuffer.size;
-	
-	if (type == WexprExpressionTypeNull)
-	{
-		size_t newSize = curBufferSize + 4;
-		char* newBuffer = realloc(buffer, newSize);
-		
-		strncpy (newBuffer+curBufferSize, "null", 4);
-		return s_stringRef_createFromPointerSize(newBuffer, newSize);
-	}
+	// now we parse
+	str = s_trimFrontOfString (str, parserState);
 	
-	else if (type == WexprExpressionTypeValue)
+	if (str.size == 0)
 	{
-		// value - always write directly
-		
-		const char* value = wexpr_Expression_value(self);
-		size_t len = strlen(value);
-		
-		PrivateWexprValueStringProperties props = s_wexprValueStringProperties(
-			s_StringRef_create(value)
-		);
-		
-		char* newBuffer = buffer;
-		size_t newSize = curBufferSize + props.writeByteSize + (props.isBarewordSafe ? 0 : 2); // add quotes if needed
-		newBuffer = realloc (newBuffer, newSize);
-		
-#if 0 // DEBUG
-		fprintf(stderr, "CUR: %zu PROPS WRITE SIZE: %zu BAREWORD: %d NEW: %zu\n", curBufferSize, props.writeByteSize, (props.isBarewordSafe ? 1 : 0), newSize);
-#endif
-		
-		// copy the value, taking into account quotes or not
-		char* writeBuffer = newBuffer+curBufferSize;
-		s_writeStringEscapedToBuffer(writeBuffer, newSize-curBufferSize, value, len, props);
-
-		return s_stringRef_createFromPointerSize(newBuffer, newSize);
+		return s_StringRef_createInvalid(); // nothing left to parse
 	}
 	
-	else if (type == WexprExpressionTypeBinaryData)
-	{
-		// binary data - encode as Base64
-		const void* buf = wexpr_Expression_binaryData_data(self);
-		size_t size = wexpr_Expression_binaryData_size(self);
-		
-		Base64IBuffer ibuf;
-		ibuf.buffer = buf;
-		ibuf.size = size;
-		
-		Base64Buffer outBuf = base64_encode(ibuf);
-		size_t newSize = curBufferSize + 2 + outBuf.size;
-		char* newBuffer = realloc(buffer, newSize);
-		strncpy (newBuffer+curBufferSize, "<", 1); curBufferSize += 1;
-		
-		strncpy (newBuffer+curBufferSize, outBuf.buffer, outBuf.size);
-		curBufferSize += outBuf.size;
-		
-		strncpy(newBuffer+curBufferSize, ">", 1);
-		curBufferSize += 1;
-		
-		// cleanup our buffer
-		free (outBuf.buffer);
-		outBuf.buffer = NULL;
-		
-		return s_stringRef_createFromPointerSize(newBuffer, newSize);
-		
-	}
+	// start parsing types:
+	// if first two characters are #(, we're an array.
+	// if @( we're a map.
+	// if [] we're a ref.
+	// if < we're a binary string
+	// otherwise, we're a value.
 	
-	else if (type == WexprExpressionTypeArray)
+	if (str.size >= 2 && s_StringRef_isEqual(s_StringRef_slice2 (str, 0, 2), s_StringRef_create("#(")))
 	{
-		size_t arraySize = wexpr_Expression_arrayCount(self);
-		
-		if (arraySize == 0)
-		{
-			// straightforward, always empty structure
-			size_t newSize = curBufferSize + 3;
-			char* newBuffer = realloc(buffer, newSize);
-			strncpy (newBuffer+curBufferSize, "#()", 3);
-			return s_stringRef_createFromPointerSize(newBuffer, newSize);
-		}
-		
-		// otherwise, we have items
-		
-		// array : human readable we'll write each one on its own line.
-		size_t newSize = curBufferSize + 2 + (writeHumanReadable ? 1 : 0); // room for #( and newline if needed
-		char* newBuffer = realloc(buffer, newSize);
+		// We're an array
+		self->m_type = WexprExpressionTypeArray;
+		self->m_array.listCount = 0;
+		self->m_array.list = NULL;
 		
-		if (writeHumanReadable)
-		{ strncpy (newBuffer+curBufferSize, "#(\n", 3); }
-		else
-		{ strncpy (newBuffer+curBufferSize, "#(", 2); }
+		// move our string forward
+		str = s_StringRef_slice(str, 2);
+		parserState->column += 2;
 		
-		for (size_t i=0; i < arraySize; ++i)
+		// continue building children as needed
+		while (true)
 		{
-			WexprExpression* obj = wexpr_Expression_arrayAt(self, i);
+			str = s_trimFrontOfString (str, parserState);
 			
-			// if human readable, we need to indent the line, output the object, then add a newline
-			if (writeHumanReadable)
+			if (str.size == 0 && !error->code)
 			{
-				size_t indentBytes = s_byteSizeForIndent(indent+1);
-				newSize += indentBytes;
-				newBuffer = realloc(newBuffer, newSize);
-				s_fillIndent(newBuffer+newSize-indentBytes, indent+1);
-				
-				// now add our normal
-				PrivateStringRef newBuf = p_wexpr_Expression_appendStringRepresentationToAllocatedBuffer(
-					obj, flags, indent+1, 
-					s_stringRef_createFromPointerSize(newBuffer, newSize)
-				);
-				newBuffer = (char*) newBuf.ptr; newSize = newBuf.size;
+				error->code = WexprErrorCodeArrayMissingEndParen;
+				error->message = strdup("An Array was missing its ending paren");
+				error->line = parserState->line;
+				error->column = parserState->column;
 				
-				// add the newline
-				newSize += 1;
-				newBuffer = realloc(newBuffer, newSize);
-				newBuffer[newSize-1] = '\n';
+				return s_StringRef_createInvalid();
 			}
 			
-			// if not human readable, we just need to either output the object, or put a space then the object
+			if (s_StringRef_isEqual(
+				s_StringRef_slice2(str, 0, 1),
+				s_StringRef_create(")") // end array
+			))
+			{
+				break; // done
+			}
 			else
 			{
-				if (i > 0)
+				PrivateProjectionCursor cursor = parserState->projection;
+				PrivateProjectionCursor childCursor = s_Projection_child(cursor, NULL, self->m_array.listCount);
+				
+				WexprExpression* newExpression = NULL;
+				
+				if (s_Projection_isSkipped(childCursor))
+				{
+					// not selected, so keep its place with a shared null
+					str = s_Expression_skipFromString(str, parseFlags, parserState, error);
+					
+					if (error->code)
+					{ return s_StringRef_createInvalid(); }
+					
+					newExpression = s_Expression_retain(cursor.projection->skipped);
+				}
+				else
 				{
-					// we need a space
-					newSize += 1;
-					newBuffer = realloc(newBuffer, newSize);
-					newBuffer[newSize-1] = ' ';
+					// parse as a new expression
+					newExpression = wexpr_Expression_createNull();
+					
+					parserState->projection = childCursor;
+					str = s_Expression_parseFromString(newExpression, str, parseFlags, parserState, error);
+					parserState->projection = cursor;
+					
+					if (error && error->code)
+					{
+						wexpr_Expression_destroy(newExpression); // not added
+						return s_StringRef_createInvalid(); // fail, exit
+					}
+					
+					// otherwise, add it to our array
+					newExpression = s_Expression_intern(parserState->internTable, newExpression);
 				}
 				
-				// now add our normal
-				PrivateStringRef newBuf = p_wexpr_Expression_appendStringRepresentationToAllocatedBuffer(
-					obj, flags, indent,
-					s_stringRef_createFromPointerSize (newBuffer, newSize)
-				);
-				newBuffer = (char*) newBuf.ptr; newSize = newBuf.size;
+				WexprExpressionPrivateArrayElement* lelem = malloc(sizeof(WexprExpressionPrivateArrayElement));
+				lelem->expression = newExpression;
+				lelem->next = NULL;
+				
+				WexprExpressionPrivateArrayElement* endOfList = self->m_array.list;
+				if (endOfList) {
+					while (endOfList->next) { endOfList = endOfList->next; }
+					endOfList->next = lelem;
+				}
+				else
+				{
+					self->m_array.list = lelem;
+				}
+				
+				(self->m_array.listCount)++;
 				
 			}
 		}
 		
-		// done with the core of the array
-		// if human readable, indent and add the end array
-		// otherwise, just add the end array
-		if (writeHumanReadable)
-		{
-			size_t indentBytes = s_byteSizeForIndent(indent);
-			newSize += indentBytes;
-			newBuffer = realloc(newBuffer, newSize);
-			s_fillIndent(newBuffer+newSize-indentBytes, indent);
-		}
-		
-		newSize += 1;
-		newBuffer = realloc(newBuffer, newSize);
-		newBuffer[newSize-1] = ')';
+		str = s_StringRef_slice(str, 1); // remove the end array
+		parserState->column += 1;
 		
-		// and done
-		return s_stringRef_createFromPointerSize(newBuffer, newSize);
+		// done with array
+		return str;
 	}
 	
-	else if (type == WexprExpressionTypeMap)
+	else if (str.size >= 2 && s_StringRef_isEqual(s_StringRef_slice2 (str, 0, 2), s_StringRef_create("@(")))
 	{
-		size_t mapSize = wexpr_Expression_mapCount(self);
-		
-		if (mapSize == 0)
-		{
-			// straightforward, always empty structure
-			size_t newSize = curBufferSize + 3;
-			char* newBuffer = realloc(buffer, newSize);
-			strncpy (newBuffer + curBufferSize, "@()", 3);
-			return s_stringRef_createFromPointerSize(newBuffer, newSize);
-		}
-		
-		// otherwise, we have items
-		
-		// map : human readable we'll write each one on its own line
-		size_t newSize = curBufferSize + 2 + (writeHumanReadable ? 1 : 0); // room for @( and newline if needed
-		char* newBuffer = realloc (buffer, newSize);
+		// We're a map
+		self->m_type = WexprExpressionTypeMap;
+		self->m_map.hash = hashmap_new();
 		
-		if (writeHumanReadable)
-		{ strncpy (newBuffer+curBufferSize, "@(\n", 3); }
-		else
-		{ strncpy (newBuffer+curBufferSize, "@(", 2); }
+		// move our string accordingly
+		str = s_StringRef_slice(str, 2);
+		parserState->column += 2;
 		
-		for (size_t i=0; i < mapSize; ++i)
+		// build our children as needed
+		while (true)
 		{
-			const char* key = wexpr_Expression_mapKeyAt(self, i);
-			if (!key)
-			{ continue; } // we shouldnt ever get an empty key, but its possible currently in the case of dereffing in a key for some reason : @([a]a b *[a] c)
-			
-			size_t keyLength = strlen(key);
-			size_t keyMemoryLength = keyLength;
-			WexprExpression* value = wexpr_Expression_mapValueAt(self, i);
-			
-			PrivateWexprValueStringProperties keyProps = s_wexprValueStringProperties(s_stringRef_createFromPointerSize(key, keyLength));
-			if (!keyProps.isBarewordSafe)
-			{ keyMemoryLength = keyProps.writeByteSize + 2; } // cause we need to quote or escape it
-			
-			// if human readable, indent the line, output the key, space, object, newline
-			if (writeHumanReadable)
-			{
-				size_t indentBytes = s_byteSizeForIndent(indent+1);
-				size_t prevSize = newSize;
-				newSize += indentBytes + keyMemoryLength + 1; // get us to the object
-				newBuffer = realloc(newBuffer, newSize);
-				s_fillIndent(newBuffer+prevSize, indent+1);
-				s_writeStringEscapedToBuffer(newBuffer+prevSize+indentBytes, newSize-prevSize-indentBytes, key, keyLength, keyProps);
-				newBuffer[newSize-1] = ' ';
-				
-				// add the value
-				PrivateStringRef newBuf = p_wexpr_Expression_appendStringRepresentationToAllocatedBuffer(
-					value, flags, indent+1,
-					s_stringRef_createFromPointerSize(newBuffer, newSize)
-				);
-				newBuffer = (char*) newBuf.ptr; newSize = newBuf.size;
-				
-				// add the newline
-				newSize += 1;
-				newBuffer = realloc(newBuffer, newSize);
-				newBuffer[newSize-1] = '\n';
-			}
+			str = s_trimFrontOfString(str, parserState);
 			
-			// if not human readable, just output with spaces as needed
-			else
+			if (str.size == 0)
 			{
-				if (i > 0)
+				if (!error->code)
 				{
-					// we need a space
-					newSize += 1;
-					newBuffer = realloc(newBuffer, newSize);
-					newBuffer[newSize-1] = ' ';
+					error->code = WexprErrorCodeMapMissingEndParen;
+					error->message = strdup("A Map was missing its ending paren");
+					error->line = parserState->line;
+					error->column = parserState->column;
 				}
 				
-				// now key, space, value
-				size_t prevSize = newSize;
-				newSize += keyLength+1;
-				if (!keyProps.isBarewordSafe)
-					newSize += 2; // quotes
-
-				newBuffer = realloc(newBuffer, newSize);
-				s_writeStringEscapedToBuffer(newBuffer+prevSize, newSize-prevSize, key, keyLength, keyProps);
-				newBuffer[newSize-1] = ' ';
-				
-				// add our value
-				PrivateStringRef newBuf = p_wexpr_Expression_appendStringRepresentationToAllocatedBuffer(
-					value, flags, indent+1,
-					s_stringRef_createFromPointerSize(newBuffer, newSize)
-				);
-				newBuffer = (char*) newBuf.ptr; newSize = newBuf.size;
+				return s_StringRef_createInvalid();
 			}
-		}
-		
+			
+			if (str.size >= 1 && s_StringRef_isEqual(
+				s_StringRef_slice2(str, 0, 1),
+				s_StringRef_create(")") // end map
+			))
+			{
+				break; // done
+			}
+			
+			else
+			{
+				// parse as a new expression - we'll alternate keys and values
+				// keep our previous position just in case the value is bad
+				WexprLineNumber prevLine = parserState->line;
+				WexprColumnNumber prevColumn = parserState->column;
+				
+				WexprExpression* keyExpression = wexpr_Expression_createNull();
+				str = s_Expression_parseFromString(keyExpression, str, parseFlags, parserState, error);
+				
+				if (wexpr_Expression_type(keyExpression) != WexprExpressionTypeValue)
+				{
+					if (!error->code)
+					{
+						error->code = WexprErrorCodeMapKeyMustBeAValue;
+						error->message = strdup("Map keys must be a value");
+						error->line = prevLine;
+						error->column = prevColumn;
+					}
+					
+					wexpr_Expression_destroy(keyExpression);
+					
+					return s_StringRef_createInvalid();
+				}
+				
+				PrivateProjectionCursor cursor = parserState->projection;
+				PrivateProjectionCursor childCursor = s_Projection_child(cursor, wexpr_Expression_value(keyExpression), 0);
+				
+				if (s_Projection_isSkipped(childCursor))
+				{
+					// not selected, so isn't added
+					str = s_trimFrontOfString(str, parserState);
+					
+					if (str.size == 0 || str.ptr[0] == ')')
+					{
+						error->code = WexprErrorCodeMapNoValue;
+						error->message = strdup("Map key must have a value");
+						error->line = prevLine;
+						error->column = prevColumn;
+					}
+					else
+					{ str = s_Expression_skipFromString(str, parseFlags, parserState, error); }
+					
+					wexpr_Expression_destroy(keyExpression);
+					
+					if (error->code)
+					{ return s_StringRef_createInvalid(); }
+					
+					continue;
+				}
+				
+				WexprExpression* valueExpression = wexpr_Expression_createInvalid();
+				
+				parserState->projection = childCursor;
+				str = s_Expression_parseFromString(valueExpression, str, parseFlags, parserState, error);
+				parserState->projection = cursor;
+				
+				if (valueExpression->m_type == WexprExpressionTypeInvalid)
+				{
+					// it wasnt filled in! no key found.
+					// we might have an error code from the upper level (told to parse empty), so overwrite it
+					// otherpossibilites are invalid ref and stuff, and we want to keep those
+					if (!error->code || error->code == WexprErrorCodeEmptyString)
+					{
+						error->code = WexprErrorCodeMapNoValue;
+						error->message = strdup("Map key must have a value");
+						error->line = prevLine;
+						error->column = prevColumn;
+					}
+					
+					wexpr_Expression_destroy(keyExpression);
+					wexpr_Expression_destroy(valueExpression);
+					
+					return s_StringRef_createInvalid();
+				}
+				
+				// ok we now have the key and the value
+				valueExpression = s_Expression_intern(parserState->internTable, valueExpression);
+				
+				// both malloc so can free later
+				WexprExpressionPrivateMapElement* elem = malloc (sizeof(WexprExpressionPrivateMapElement));
+				elem->key = strdup(wexpr_Expression_value(keyExpression));
+				elem->keyOwner = NULL;
+				elem->value = valueExpression;
+				
+				hashmap_put(self->m_map.hash, elem->key, elem);
+				
+				// destroy our key since thats not stored anywhere
+				wexpr_Expression_destroy(keyExpression);
+			}
+		}
+		
+		// remove the end map
+		str = s_StringRef_slice(str, 1);
+		parserState->column += 1;
+		
+		// done with map
+		return str;
+	}
+	
+	else if (str.size >= 1 && s_StringRef_isEqual(s_StringRef_slice2 (str, 0, 1), s_StringRef_create("[")))
+	{
+		// the current expression being processed is the one the attribute will be linked to.
+		
+		// process till the closing ]
+		size_t endingBracketIndex = s_StringRef_find(str, ']');
+		if (endingBracketIndex == s_InvalidIndex)
+		{
+			if (!error->code)
+			{
+				error->code = WexprErrorCodeReferenceMissingEndBracket;
+				error->message = strdup ("A reference [] is missing its ending bracket");
+				error->line = parserState->line;
+				error->column = parserState->column;
+			}
+			
+			return s_StringRef_createInvalid();
+		}
+		
+		PrivateStringRef refName = s_StringRef_slice2(str, 1, endingBracketIndex-1);
+		
+		// validate the contents
+		bool invalidName = false;
+		for (size_t i=0; i < refName.size; ++i)
+		{
+			char v = refName.ptr[i];
+			
+			bool isAlpha = (v >= 'a' && v <= 'z') || (v >= 'A' && v <= 'Z');
+			bool isNumber = (v >= '0' && v <= '9');
+			bool isUnder = (v == '_');
+			
+			if (i == 0 && (isAlpha || isUnder))
+			{}
+			else if (i != 0 && (isAlpha || isNumber || isUnder))
+			{}
+			else
+			{
+				invalidName = true;
+				break;
+			}
+		}
+		
+		if (invalidName)
+		{
+			if (error && !error->code)
+			{
+				error->code = WexprErrorCodeReferenceInvalidName;
+				error->message = strdup ("A reference doesn't have a valid name");
+				error->line = parserState->line;
+				error->column = parserState->column;
+			}
+			
+			return s_StringRef_createInvalid();
+		}
+		
+		// move forward
+		s_privateParserState_moveForwardBasedOnString(parserState, 
+			s_StringRef_slice2(str, 0, endingBracketIndex+1)
+		);
+		str = s_StringRef_slice(str, endingBracketIndex+1);
+		
+		// continue parsing at the same level : stored the reference name
+		// All of it is built, even if projecting, since it could be inserted anywhere.
+		PrivateProjectionCursor cursor = parserState->projection;
+		parserState->projection = s_Projection_begin(NULL);
+		
+		PrivateStringRef resultString = s_Expression_parseFromString(self, str, parseFlags, parserState, error);
+		
+		parserState->projection = cursor;
+		if (error->code != WexprErrorCodeNone)
+		{
+			return s_StringRef_createInvalid(); // failed when parsing
+		}
+		
+		// now bind the ref - creating a copy of what was made. This will be used for the template.
+		// When deduplicating we share it instead, since it wont be modified.
+		if (!parserState->internalReferenceMap)
+		{ parserState->internalReferenceMap = wexpr_ReferenceTable_create(); }
+		
+		wexpr_ReferenceTable_setExpressionForLengthKey(
+			parserState->internalReferenceMap,
+			refName.ptr, refName.size,
+			parserState->internTable ? s_Expression_retain(self) : wexpr_Expression_createCopy (self)
+		);
+		
+		// and continue
+		return resultString;
+	}
+	
+	else if (str.size >= 2 && s_StringRef_isEqual(s_StringRef_slice2 (str, 0, 2), s_StringRef_create("*[")))
+	{
+		// parse the reference name
+		size_t endingBracketIndex = s_StringRef_find(str, ']');
+		if (endingBracketIndex == s_InvalidIndex)
+		{
+			error->code = WexprErrorCodeReferenceInsertMissingEndBracket;
+			error->message = strdup ("A reference insert *[] is missing its ending bracket");
+			error->line = parserState->line;
+			error->column = parserState->column;
+			
+			return s_StringRef_createInvalid();
+		}
+		
+		PrivateStringRef refName = s_StringRef_slice2(str, 2, endingBracketIndex-2);
+		
+		// move forward
+		s_privateParserState_moveForwardBasedOnString(parserState, 
+			s_StringRef_slice2(str, 0, endingBracketIndex+1)
+		);
+		str = s_StringRef_slice(str, endingBracketIndex+1);
+	
+		WexprExpression* referenceExpr = !parserState->internalReferenceMap ? NULL : wexpr_ReferenceTable_expressionForLengthKey(
+			parserState->internalReferenceMap,
+			refName.ptr, refName.size
+		);
+		bool isInternalReference = (referenceExpr != NULL);
+		
+		if (!referenceExpr)
+		{
+			// try again with the external if we have it
+			if (parserState->externalReferenceMap)
+			{
+				referenceExpr = wexpr_ReferenceTable_expressionForLengthKey(
+					parserState->externalReferenceMap,
+					refName.ptr, refName.size
+				);
+			}
+		}
+		
+		if (!referenceExpr)
+		{
+			// not found
+			if (!error->code)
+			{
+				error->code = WexprErrorCodeReferenceUnknownReference;
+				error->message = strdup ("Tried to insert a reference, but couldn't find it.");
+				error->line = parserState->line;
+				error->column = parserState->column;
+			}
+			
+			return s_StringRef_createInvalid();
+		}
+		
+		// copy this into ourself
+		if (parserState->internTable && isInternalReference)
+		{
+			// children are already interned, so share them
+			s_Expression_shareInto (self, referenceExpr);
+		}
+		else
+		{
+			s_Expression_copyInto (self, referenceExpr);
+			
+			if (parserState->internTable)
+			{ s_Expression_internChildren (parserState->internTable, self); }
+		}
+		
+		return str;
+	}
+	
+	// null expressions will be treated as a value, and then parsed seperately
+	
+	else if (
+		str.size >= 1 && s_StringRef_isEqual(
+			s_StringRef_slice2(str, 0, 1), s_StringRef_create("<")
+		)
+	)
+	{
+		// look for the ending >
+		size_t endingQuote = s_StringRef_find(str, '>');
+		if (endingQuote == s_InvalidIndex)
+		{
+			// not found
+			if (!error->code)
+			{
+				error->code = WexprErrorCodeBinaryDataNoEnding;
+				error->message = strdup ("Tried to find the ending > for binary data, but not found.");
+				error->line = parserState->line;
+				error->column = parserState->column;
+			}
+			
+			return s_StringRef_createInvalid();
+		}
+		
+		Base64IBuffer inputBuf;
+		inputBuf.buffer = str.ptr+1;
+		inputBuf.size = endingQuote-1; // -1 for starting quote. ending was not part.
+		Base64Buffer outBuf = base64_decode(inputBuf);
+		
+		if (outBuf.buffer == NULL)
+		{
+			if (!error->code)
+			{
+				error->code = WexprErrorCodeBinaryDataInvalidBase64;
+				error->message = strdup ("Unable to decode the base64 data.");
+				error->line = parserState->line;
+				error->column = parserState->column;
+			}
+			
+			return s_StringRef_createInvalid();
+		}
+		
+		self->m_type = WexprExpressionTypeBinaryData;
+		self->m_binaryData.data = outBuf.buffer;
+		self->m_binaryData.size = outBuf.size;
+		
+		s_privateParserState_moveForwardBasedOnString (parserState,
+			s_StringRef_slice2 (str, 0, endingQuote+1)
+		);
+		
+		return s_StringRef_slice (str, endingQuote+1);
+	}
+	
+	else if (str.size >= 1)// its a value : must be at least one character
+	{
+		PrivateWexprStringValue val = s_createValueOfString (str, parserState, error);
+		
+		if (error && error->code != WexprErrorCodeNone)
+			return s_StringRef_createInvalid();
+		
+		// was it a null/nil string?
+		if ((strcmp (val.value, "nil") == 0) || (strcmp (val.value, "null") == 0))
+		{
+			self->m_type = WexprExpressionTypeNull;
+			
+			// we dont need the value anymore, trash it
+			free(val.value);
+			val.value = LIBWEXPR_NULLPTR;
+		}
+		else
+		{
+			self->m_type = WexprExpressionTypeValue;
+			self->m_value.data = val.value;
+			self->m_value.typed.kind = WexprPrivateTypedValueKindNone;
+		}
+		
+		s_privateParserState_moveForwardBasedOnString (parserState,
+			s_StringRef_slice2(
+				str, 0, val.endIndex
+			)
+		);
+		
+		return s_StringRef_slice (str, val.endIndex);
+	}
+	
+	// otherwise, we have no idea what happened
+	return s_StringRef_createInvalid();
+}
+
+static int s_freeHashData (any_t userData, any_t data)
+{
+	WexprExpressionPrivateMapElement* elem = data;
+	
+	if (elem->keyOwner)
+	{ wexpr_Expression_destroy(elem->keyOwner); }
+	else
+	{ free (elem->key); }
+	
+	wexpr_Expression_destroy(elem->value);
+	free (elem);
+	
+	return MAP_OK; // keep iterating
+}
+
+// --------------------- PRIVATE ----------------------------------
+
+// --- parallel writing
+// With an executor, the children of a wide root array/map are written in pieces on multiple threads,
+// then the pieces are joined after the parent's start (and size, for binary). Each child is written exactly as
+// it would be on one thread, so the output is the same.
+
+// root containers with fewer children than this are written on one thread
+#define LIBWEXPR_PRIVATE_PARALLELWRITE_MINCOUNT 1024
+
+// children in each piece
+#define LIBWEXPR_PRIVATE_PARALLELWRITE_PIECESIZE 256
+
+// The children of a container in the order they're written: expressions for an array, map elements for a map.
+typedef struct PrivateContainerChildren
+{
+	bool isMap;
+	void** children;
+	size_t count;
+} PrivateContainerChildren;
+
+// part of the output written by one thread
+typedef struct PrivateOutputPiece
+{
+	char* data; // owned
+	size_t size;
+	bool failed;
+} PrivateOutputPiece;
+
+static int s_collectMapChild (any_t userData, any_t data)
+{
+	PrivateContainerChildren* children = userData;
+	children->children[(children->count)++] = data;
+	
+	return MAP_OK;
+}
+
+// true if the expression is a container with enough children to write in parallel
+static bool s_parallelWrite_wants (WexprExpression* self, const WexprExecutor* executor)
+{
+	if (!executor)
+	{ return false; }
+	
+	if (self->m_type == WexprExpressionTypeArray)
+	{ return self->m_array.listCount >= LIBWEXPR_PRIVATE_PARALLELWRITE_MINCOUNT; }
+	
+	if (self->m_type == WexprExpressionTypeMap)
+	{ return (size_t)hashmap_length(self->m_map.hash) >= LIBWEXPR_PRIVATE_PARALLELWRITE_MINCOUNT; }
+	
+	return false;
+}
+
+// Fill in the children of the array/map. Returns false if out of memory. Free children->children afterwards.
+static bool s_containerChildren_collect (WexprExpression* self, PrivateContainerChildren* children)
+{
+	children->isMap = (self->m_type == WexprExpressionTypeMap);
+	children->count = 0;
+	
+	size_t count = children->isMap ? (size_t)hashmap_length(self->m_map.hash) : self->m_array.listCount;
+	children->children = malloc(sizeof(void*) * count);
+	if (!children->children)
+	{ return false; }
+	
+	if (children->isMap)
+	{
+		hashmap_iterate(self->m_map.hash, &s_collectMapChild, children);
+	}
+	else
+	{
+		for (WexprExpressionPrivateArrayElement* list = self->m_array.list;
+			 list != NULL; list = list->next)
+		{
+			children->children[(children->count)++] = list->expression;
+		}
+	}
+	
+	return true;
+}
+
+static size_t s_outputPieces_count (size_t childCount)
+{
+	return (childCount + LIBWEXPR_PRIVATE_PARALLELWRITE_PIECESIZE - 1) / LIBWEXPR_PRIVATE_PARALLELWRITE_PIECESIZE;
+}
+
+// the children [begin, end) written by the piece
+static void s_outputPieces_range (size_t pieceIndex, size_t childCount, size_t* begin, size_t* end)
+{
+	*begin = pieceIndex * LIBWEXPR_PRIVATE_PARALLELWRITE_PIECESIZE;
+	*end = *begin + LIBWEXPR_PRIVATE_PARALLELWRITE_PIECESIZE;
+	
+	if (*end > childCount)
+	{ *end = childCount; }
+}
+
+// Write the pieces to the output in order. Returns false (and marks the output failed) if any of them failed.
+static bool s_outputPieces_write (PrivateOutputPiece* pieces, size_t pieceCount, WexprPrivateOutput* out)
+{
+	for (size_t i=0; i < pieceCount; ++i)
+	{
+		if (pieces[i].failed)
+		{
+			out->failed = true;
+			return false;
+		}
+	}
+	
+	for (size_t i=0; i < pieceCount; ++i)
+	{ wexpr_PrivateOutput_write(out, pieces[i].data, pieces[i].size); }
+	
+	return true;
+}
+
+static void s_outputPieces_free (PrivateOutputPiece* pieces, size_t pieceCount)
+{
+	if (!pieces)
+	{ return; }
+	
+	for (size_t i=0; i < pieceCount; ++i)
+	{ free (pieces[i].data); }
+	
+	free (pieces);
+}
+
+typedef struct PrivateWriteMapState
+{
+	WexprPrivateOutput* out;
+	WexprWriteFlags flags;
+	size_t indent;
+	bool isFirst; // first pair written
+} PrivateWriteMapState;
+
+static void p_wexpr_Expression_writeStringRepresentation (WexprExpression* self, WexprWriteFlags flags, size_t indent, WexprPrivateOutput* out);
+
+// NOLINTNEXTLINE(misc-no-recursion)
+static int s_writeMapPair (any_t userData, any_t data)
+{
+	PrivateWriteMapState* state = userData;
+	WexprExpressionPrivateMapElement* elem = data;
+	WexprPrivateOutput* out = state->out;
+	
+	bool writeHumanReadable = ((state->flags & WexprWriteFlagHumanReadable) == WexprWriteFlagHumanReadable);
+	
+	const char* key = elem->key;
+	if (!key)
+	{ return MAP_OK; } // we shouldnt ever get an empty key, but its possible currently in the case of dereffing in a key for some reason : @([a]a b *[a] c)
+	
+	size_t keyLength = strlen(key);
+	
+	// if human readable, indent the line, output the key, space, object, newline
+	if (writeHumanReadable)
+	{
+		wexpr_PrivateOutput_writeRepeated(out, '\t', state->indent+1);
+		wexpr_PrivateTextFormat_writeValue(out, key, keyLength);
+		wexpr_PrivateOutput_writeChar(out, ' ');
+		
+		p_wexpr_Expression_writeStringRepresentation(elem->value, state->flags, state->indent+1, out);
+		
+		wexpr_PrivateOutput_writeChar(out, '\n');
+	}
+	
+	// if not human readable, just output with spaces as needed
+	else
+	{
+		if (!state->isFirst)
+		{ wexpr_PrivateOutput_writeChar(out, ' '); } // we need a space
+		
+		// now key, space, value
+		wexpr_PrivateTextFormat_writeValue(out, key, keyLength);
+		wexpr_PrivateOutput_writeChar(out, ' ');
+		
+		p_wexpr_Expression_writeStringRepresentation(elem->value, state->flags, state->indent+1, out);
+	}
+	
+	state->isFirst = false;
+	return MAP_OK;
+}
+
+// Writes an element of an array (at the given indent) to the output, along with the spacing around it.
+// NOLINTNEXTLINE(misc-no-recursion)
+static void s_writeArrayElementString (WexprExpression* obj, WexprWriteFlags flags, size_t indent, bool isFirst, WexprPrivateOutput* out)
+{
+	bool writeHumanReadable = ((flags & WexprWriteFlagHumanReadable) == WexprWriteFlagHumanReadable);
+	
+	// if human readable, we need to indent the line, output the object, then add a newline
+	if (writeHumanReadable)
+	{
+		wexpr_PrivateOutput_writeRepeated(out, '\t', indent+1);
+		
+		// now add our normal
+		p_wexpr_Expression_writeStringRepresentation(obj, flags, indent+1, out);
+		
+		// add the newline
+		wexpr_PrivateOutput_writeChar(out, '\n');
+	}
+	
+	// if not human readable, we just need to either output the object, or put a space then the object
+	else
+	{
+		if (!isFirst)
+		{ wexpr_PrivateOutput_writeChar(out, ' '); } // we need a space
+		
+		// now add our normal
+		p_wexpr_Expression_writeStringRepresentation(obj, flags, indent, out);
+	}
+}
+
+// Writes the text representation to the output, appending at the end.
+//
+// Human Readablle notes:
+// even though you pass an indent, we assume you're already indented for the start of the object
+// we assume this so that an object for example as a key-value will be writen in the correct spot.
+// if it writes multiple lines, we will use the given indent to predict.
+// it will end after writing all data, no newline generally at the end.
+// NOLINTNEXTLINE(misc-no-recursion)
+static void p_wexpr_Expression_writeStringRepresentation (WexprExpression* self, WexprWriteFlags flags, size_t indent, WexprPrivateOutput* out)
+{
+	bool writeHumanReadable = ((flags & WexprWriteFlagHumanReadable) == WexprWriteFlagHumanReadable);
+	WexprExpressionType type = wexpr_Expression_type(self);
+	
+	if (type == WexprExpressionTypeNull)
+	{
+		wexpr_PrivateOutput_write(out, "null", 4);
+	}
+	
+	else if (type == WexprExpressionTypeValue)
+	{
+		// value - always write directly
+		const char* value = self->m_value.data;
+		
+		// copy the value, taking into account quotes or not
+		wexpr_PrivateTextFormat_writeValue(out, value, strlen(value));
+	}
+	
+	else if (type == WexprExpressionTypeBinaryData)
+	{
+		// binary data - encode as Base64
+		wexpr_PrivateOutput_writeChar(out, '<');
+		wexpr_PrivateTextFormat_writeBase64(out, self->m_binaryData.data, self->m_binaryData.size);
+		wexpr_PrivateOutput_writeChar(out, '>');
+	}
+	
+	else if (type == WexprExpressionTypeArray)
+	{
+		if (self->m_array.listCount == 0)
+		{
+			// straightforward, always empty structure
+			wexpr_PrivateOutput_write(out, "#()", 3);
+			return;
+		}
+		
+		// otherwise, we have items
+		
+		// array : human readable we'll write each one on its own line.
+		if (writeHumanReadable)
+		{ wexpr_PrivateOutput_write(out, "#(\n", 3); }
+		else
+		{ wexpr_PrivateOutput_write(out, "#(", 2); }
+		
+		for (WexprExpressionPrivateArrayElement* list = self->m_array.list;
+			 list != NULL; list = list->next)
+		{
+			s_writeArrayElementString(list->expression, flags, indent, (list == self->m_array.list), out);
+		}
+		
+		// done with the core of the array
+		// if human readable, indent and add the end array
+		// otherwise, just add the end array
+		if (writeHumanReadable)
+		{ wexpr_PrivateOutput_writeRepeated(out, '\t', indent); }
+		
+		wexpr_PrivateOutput_writeChar(out, ')');
+	}
+	
+	else if (type == WexprExpressionTypeMap)
+	{
+		if (hashmap_length(self->m_map.hash) == 0)
+		{
+			// straightforward, always empty structure
+			wexpr_PrivateOutput_write(out, "@()", 3);
+			return;
+		}
+		
+		// otherwise, we have items
+		
+		// map : human readable we'll write each one on its own line
+		if (writeHumanReadable)
+		{ wexpr_PrivateOutput_write(out, "@(\n", 3); }
+		else
+		{ wexpr_PrivateOutput_write(out, "@(", 2); }
+		
+		PrivateWriteMapState state;
+		state.out = out;
+		state.flags = flags;
+		state.indent = indent;
+		state.isFirst = true;
+		
+		hashmap_iterate(self->m_map.hash, &s_writeMapPair, &state);
+		
 		// done with the core of the map
 		// if human readable, indent and add the end map
 		// otherwise, just add the end map
 		if (writeHumanReadable)
+		{ wexpr_PrivateOutput_writeRepeated(out, '\t', indent); }
+		
+		wexpr_PrivateOutput_writeChar(out, ')');
+	}
+	
+	else
+	{
+		fprintf (stderr, "p_wexpr_Expression_writeStringRepresentation() - Unknown type to generate string for\n");
+		abort();
+	}
+}
+
+typedef struct PrivateTextParallelWork
+{
+	PrivateContainerChildren children;
+	WexprWriteFlags flags;
+	size_t indent;
+	PrivateOutputPiece* pieces;
+} PrivateTextParallelWork;
+
+static void s_textParallel_writePiece (void* taskData, size_t pieceIndex)
+{
+	PrivateTextParallelWork* work = taskData;
+	PrivateOutputPiece* piece = &work->pieces[pieceIndex];
+	
+	size_t begin = 0, end = 0;
+	s_outputPieces_range(pieceIndex, work->children.count, &begin, &end);
+	
+	WexprPrivateOutput out;
+	wexpr_PrivateOutput_initGrowable(&out, 4096);
+	
+	for (size_t i=begin; i < end; ++i)
+	{
+		if (work->children.isMap)
+		{
+			PrivateWriteMapState state;
+			state.out = &out;
+			state.flags = work->flags;
+			state.indent = work->indent;
+			state.isFirst = (i == 0);
+			
+			s_writeMapPair(&state, work->children.children[i]);
+		}
+		else
+		{
+			s_writeArrayElementString(work->children.children[i], work->flags, work->indent, (i == 0), &out);
+		}
+	}
+	
+	piece->data = out.buffer;
+	piece->size = out.size;
+	piece->failed = out.failed;
+}
+
+// Same as p_wexpr_Expression_writeStringRepresentation(), but with the children of a wide root array/map written
+// in parallel with the executor (if not null).
+static void s_Expression_writeStringRepresentationWithExecutor (WexprExpression* self, WexprWriteFlags flags, size_t indent,
+	const WexprExecutor* executor, WexprPrivateOutput* out
+)
+{
+	PrivateTextParallelWork work;
+	work.flags = flags;
+	work.indent = indent;
+	work.pieces = NULL;
+	work.children.children = NULL;
+	
+	if (!s_parallelWrite_wants(self, executor) || !s_containerChildren_collect(self, &work.children))
+	{
+		p_wexpr_Expression_writeStringRepresentation(self, flags, indent, out);
+		return;
+	}
+	
+	size_t pieceCount = s_outputPieces_count(work.children.count);
+	work.pieces = calloc(pieceCount, sizeof(PrivateOutputPiece));
+	
+	if (!work.pieces)
+	{
+		free (work.children.children);
+		p_wexpr_Expression_writeStringRepresentation(self, flags, indent, out);
+		return;
+	}
+	
+	wexpr_Executor_parallelFor(executor, pieceCount, &s_textParallel_writePiece, &work);
+	
+	// same start and end as writing it on one thread
+	bool writeHumanReadable = ((flags & WexprWriteFlagHumanReadable) == WexprWriteFlagHumanReadable);
+	
+	wexpr_PrivateOutput_writeChar(out, work.children.isMap ? '@' : '#');
+	wexpr_PrivateOutput_writeChar(out, '(');
+	
+	if (writeHumanReadable)
+	{ wexpr_PrivateOutput_writeChar(out, '\n'); }
+	
+	if (s_outputPieces_write(work.pieces, pieceCount, out))
+	{
+		if (writeHumanReadable)
+		{ wexpr_PrivateOutput_writeRepeated(out, '\t', indent); }
+		
+		wexpr_PrivateOutput_writeChar(out, ')');
+	}
+	
+	s_outputPieces_free(work.pieces, pieceCount);
+	free (work.children.children);
+}
+
+// --- binary writing
+// Containers need their size written before their children, so writing is two passes:
+// the first works out the content size of every array/map once (in the order they'll be written),
+// and the second writes everything using those sizes. Both are linear in the size of the tree.
+// With WexprWriteFlagBinaryIndex, the first pass also sizes the index chunk and the second fills it in
+// as the offsets become known (see Documentation/BinaryIndex.md).
+// With compression, the first pass compresses the binary data (since its size depends on it) and the second writes it.
+// With WexprWriteFlagBinaryStringTable, an earlier pass counts the strings to pick which go in the string table
+// (see Documentation/BinaryStringTable.md), and both passes look each string up to see if it's written as a reference.
+
+typedef struct PrivateCompressedData
+{
+	void* data; // null if it's stored raw
+	size_t size;
+} PrivateCompressedData;
+
+typedef struct PrivateStringTableEntry
+{
+	const char* str; // key or value in the expression
+	size_t length;
+	size_t count; // number of times its written
+	bool inTable;
+	uint64_t index; // if inTable, its index in the string table
+} PrivateStringTableEntry;
+
+typedef struct PrivateBinarySizes
+{
+	size_t* sizes; // content size of each array/map, in the order they're written
+	size_t count;
+	size_t capacity;
+	size_t next; // when writing, the next size to use
+	bool failed; // out of memory
+	
+	// index chunk
+	bool buildIndex; // if false, nothing is indexed
+	size_t indexContainerCount; // arrays/maps big enough to index
+	size_t indexRecordsSize; // bytes used by their records
+	uint8_t* index; // when writing, the index content
+	size_t indexDirectoryNext; // when writing, the next directory entry to fill in
+	size_t indexRecordNext; // when writing, offset in the index of the next record
+	size_t rootPosition; // when writing, output position of the expression chunk which offsets are relative to
+	
+	// compression
+	const WexprBinaryWriteOptions* options;
+	PrivateCompressedData* compressed; // each binary data big enough to compress, in the order they're written
+	size_t compressedCount;
+	size_t compressedCapacity;
+	size_t compressedNext; // when writing, the next one to use
+	
+	// string table
+	WexprPrivateHashTable* strings; // string -> 1 + its index in stringEntries, or null if theres no string table
+	PrivateStringTableEntry* stringEntries; // every distinct key/value
+	size_t stringEntryCount;
+	size_t stringEntryCapacity;
+	PrivateStringTableEntry** stringTable; // entries in the string table, in index order
+	size_t stringTableCount;
+	size_t stringTableSize; // content size of the string table chunk, or 0 if theres nothing in it
+	
+	// aligned layout
+	bool aligned; // if true, written in the aligned layout instead of chunks and everything else is unused
+	size_t alignedStackNeeded; // offsets waiting for their parent at once
+	uint64_t alignedFileSize; // total size of the file
+	
+	// parallel writing (options->executor)
+	PrivateOutputPiece* pieces; // if set, the root's children already written, and everything else is unused for the root
+	size_t pieceCount;
+	size_t piecesContentSize; // content size of the root
+} PrivateBinarySizes;
+
+// size of a whole chunk with the given content size
+static size_t s_binaryChunkSize (size_t contentSize)
+{
+	return wexpr_PrivateBinaryFormat_chunkHeaderSize(contentSize) + contentSize;
+}
+
+// reserve the next slot, returning its index
+static size_t s_binarySizes_add (PrivateBinarySizes* self)
+{
+	if (self->count == self->capacity)
+	{
+		size_t newCapacity = self->capacity ? self->capacity * 2 : 64;
+		size_t* newSizes = realloc(self->sizes, newCapacity * sizeof(size_t));
+		if (!newSizes)
+		{
+			self->failed = true;
+			return 0;
+		}
+		
+		self->sizes = newSizes;
+		self->capacity = newCapacity;
+	}
+	
+	self->sizes[self->count] = 0;
+	return (self->count)++;
+}
+
+// true if a container with the given children gets an index record
+static bool s_binaryIndex_wants (const PrivateBinarySizes* sizes, size_t childCount)
+{
+	return sizes->buildIndex && childCount >= WEXPR_PRIVATE_BINARYFORMAT_INDEXMINCOUNT;
+}
+
+// size of the index content, or 0 if nothing is indexed
+static size_t s_binaryIndex_contentSize (const PrivateBinarySizes* sizes)
+{
+	if (sizes->indexContainerCount == 0)
+	{ return 0; }
+	
+	// container count, directory, records
+	return sizeof(uint64_t) + sizes->indexContainerCount * 2 * sizeof(uint64_t) + sizes->indexRecordsSize;
+}
+
+// first pass: reserve a record for a container
+static void s_binaryIndex_addContainer (PrivateBinarySizes* sizes, size_t entryCount, size_t entrySize)
+{
+	sizes->indexContainerCount += 1;
+	sizes->indexRecordsSize += sizeof(uint64_t) + entryCount * entrySize;
+}
+
+// offset of the current position from the start of the expression chunk
+static uint64_t s_binaryIndex_offset (const PrivateBinarySizes* sizes, const WexprPrivateOutput* out)
+{
+	return out->flushedSize + out->size - sizes->rootPosition;
+}
+
+// second pass: fill in the directory entry for the container at the current position, returning where its entries go
+static uint8_t* s_binaryIndex_beginRecord (PrivateBinarySizes* sizes, const WexprPrivateOutput* out, size_t entryCount, size_t entrySize)
+{
+	uint8_t* directory = sizes->index + sizeof(uint64_t) + sizes->indexDirectoryNext * 2 * sizeof(uint64_t);
+	uint8_t* record = sizes->index + sizes->indexRecordNext;
+	
+	wexpr_PrivateBinaryFormat_writeUInt64(directory, s_binaryIndex_offset(sizes, out));
+	wexpr_PrivateBinaryFormat_writeUInt64(directory + sizeof(uint64_t), sizes->indexRecordNext);
+	wexpr_PrivateBinaryFormat_writeUInt64(record, entryCount);
+	
+	sizes->indexDirectoryNext += 1;
+	sizes->indexRecordNext += sizeof(uint64_t) + entryCount * entrySize;
+	
+	return record + sizeof(uint64_t);
+}
+
+// orders map entries by key hash, then offset
+static int s_binaryIndex_compareMapEntries (const void* lhs, const void* rhs)
+{
+	for (size_t i=0; i < 2; ++i)
+	{
+		uint64_t l = wexpr_PrivateBinaryFormat_readUInt64((const uint8_t*)lhs + i * sizeof(uint64_t));
+		uint64_t r = wexpr_PrivateBinaryFormat_readUInt64((const uint8_t*)rhs + i * sizeof(uint64_t));
+		
+		if (l != r)
+		{ return (l < r) ? -1 : 1; }
+	}
+	
+	return 0;
+}
+
+// true if binary data of the given size should be compressed
+static bool s_binaryCompression_wants (const PrivateBinarySizes* sizes, size_t byteSize)
+{
+	return sizes->options->compression != WexprBinaryCompressionNone
+		&& byteSize >= sizes->options->compressionThreshold;
+}
+
+// first pass: compress the data (if it helps), returning the size of the chunk content
+static size_t s_binaryCompression_add (PrivateBinarySizes* sizes, const void* data, size_t byteSize)
+{
+	if (sizes->compressedCount == sizes->compressedCapacity)
+	{
+		size_t newCapacity = sizes->compressedCapacity ? sizes->compressedCapacity * 2 : 16;
+		PrivateCompressedData* newCompressed = realloc(sizes->compressed, newCapacity * sizeof(PrivateCompressedData));
+		if (!newCompressed)
+		{
+			sizes->failed = true;
+			return 0;
+		}
+		
+		sizes->compressed = newCompressed;
+		sizes->compressedCapacity = newCapacity;
+	}
+	
+	PrivateCompressedData* entry = &sizes->compressed[(sizes->compressedCount)++];
+	
+	// if it doesnt help (or isnt supported), its stored raw
+	if (!wexpr_PrivateCompression_compress(sizes->options->compression, sizes->options->compressionLevel,
+		data, byteSize, &entry->data, &entry->size))
+	{
+		entry->data = NULL;
+		entry->size = byteSize;
+	}
+	
+	return sizeof(uint8_t) + entry->size; // compression method + data
+}
+
+static bool s_stringTable_equals (const void* lhs, const void* rhs)
+{
+	return strcmp(lhs, rhs) == 0;
+}
+
+// find the entry for the string, or null if it wasnt counted
+static PrivateStringTableEntry* s_stringTable_find (const PrivateBinarySizes* sizes, const char* str, uint64_t hash)
+{
+	size_t entryIndex = (size_t)(uintptr_t)wexpr_PrivateHashTable_find(sizes->strings, hash, str, &s_stringTable_equals);
+	
+	return (entryIndex != 0) ? &sizes->stringEntries[entryIndex - 1] : NULL;
+}
+
+// first pass: count a key/value being written
+static void s_stringTable_count (PrivateBinarySizes* sizes, const char* str)
+{
+	size_t length = strlen(str);
+	uint64_t hash = wexpr_PrivateHashTable_hashBytes(str, length);
+	
+	PrivateStringTableEntry* entry = s_stringTable_find(sizes, str, hash);
+	if (entry)
+	{
+		entry->count += 1;
+		return;
+	}
+	
+	if (sizes->stringEntryCount == sizes->stringEntryCapacity)
+	{
+		size_t newCapacity = sizes->stringEntryCapacity ? sizes->stringEntryCapacity * 2 : 64;
+		PrivateStringTableEntry* newEntries = realloc(sizes->stringEntries, newCapacity * sizeof(PrivateStringTableEntry));
+		if (!newEntries)
+		{
+			sizes->failed = true;
+			return;
+		}
+		
+		sizes->stringEntries = newEntries;
+		sizes->stringEntryCapacity = newCapacity;
+	}
+	
+	entry = &sizes->stringEntries[sizes->stringEntryCount];
+	entry->str = str;
+	entry->length = length;
+	entry->count = 1;
+	entry->inTable = false;
+	entry->index = 0;
+	
+	sizes->stringEntryCount += 1;
+	
+	// the table stores the entry index, since the entries move as they grow
+	if (!wexpr_PrivateHashTable_insert(sizes->strings, hash, str, (void*)(uintptr_t)sizes->stringEntryCount))
+	{ sizes->failed = true; }
+}
+
+static int s_countMapStrings (any_t userData, any_t data);
+
+// true if the value should be written as a typed chunk, filling in typed
+static bool s_binaryTypedValue_get (const PrivateBinarySizes* sizes, WexprExpression* self, WexprPrivateTypedValue* typed)
+{
+	if (!(sizes->options->flags & WexprWriteFlagBinaryTypedValues))
+	{ return false; }
+	
+	if (self->m_value.typed.kind != WexprPrivateTypedValueKindNone)
+	{
+		*typed = self->m_value.typed;
+		return true;
+	}
+	
+	return wexpr_PrivateTypedValue_fromCanonicalText(self->m_value.data, strlen(self->m_value.data), typed);
+}
+
+// first pass: count every key/value in the expression
+// NOLINTNEXTLINE(misc-no-recursion)
+static void s_Expression_countStrings (WexprExpression* self, PrivateBinarySizes* sizes)
+{
+	if (self->m_type == WexprExpressionTypeValue)
+	{
+		WexprPrivateTypedValue typed;
+		if (!s_binaryTypedValue_get(sizes, self, &typed))
+		{ s_stringTable_count(sizes, self->m_value.data); }
+	}
+	
+	else if (self->m_type == WexprExpressionTypeArray)
+	{
+		for (WexprExpressionPrivateArrayElement* list = self->m_array.list;
+			 list != NULL && !sizes->failed; list = list->next)
+		{
+			s_Expression_countStrings(list->expression, sizes);
+		}
+	}
+	
+	else if (self->m_type == WexprExpressionTypeMap)
+	{
+		hashmap_iterate(self->m_map.hash, &s_countMapStrings, sizes);
+	}
+}
+
+// NOLINTNEXTLINE(misc-no-recursion)
+static int s_countMapStrings (any_t userData, any_t data)
+{
+	PrivateBinarySizes* sizes = userData;
+	WexprExpressionPrivateMapElement* elem = data;
+	
+	s_stringTable_count(sizes, elem->key);
+	s_Expression_countStrings(elem->value, sizes);
+	
+	return (sizes->failed ? !MAP_OK : MAP_OK);
+}
+
+// orders entries by count (most used first), then by when they were found
+static int s_stringTable_compareEntries (const void* lhs, const void* rhs)
+{
+	const PrivateStringTableEntry* l = *(PrivateStringTableEntry* const*)lhs;
+	const PrivateStringTableEntry* r = *(PrivateStringTableEntry* const*)rhs;
+	
+	if (l->count != r->count)
+	{ return (l->count > r->count) ? -1 : 1; }
+	
+	return (l < r) ? -1 : (l > r);
+}
+
+// Pick the strings for the table once counted. The most used get the smallest indices, and a string only
+// goes in if referencing it saves more than it costs to store it in the table.
+static void s_stringTable_build (PrivateBinarySizes* sizes)
+{
+	size_t candidateCount = 0;
+	for (size_t i=0; i < sizes->stringEntryCount; ++i)
+	{
+		if (sizes->stringEntries[i].count > 1)
+		{ candidateCount += 1; }
+	}
+	
+	if (candidateCount == 0)
+	{ return; }
+	
+	sizes->stringTable = malloc(candidateCount * sizeof(PrivateStringTableEntry*));
+	if (!sizes->stringTable)
+	{
+		sizes->failed = true;
+		return;
+	}
+	
+	size_t next = 0;
+	for (size_t i=0; i < sizes->stringEntryCount; ++i)
+	{
+		if (sizes->stringEntries[i].count > 1)
+		{ sizes->stringTable[next++] = &sizes->stringEntries[i]; }
+	}
+	
+	qsort (sizes->stringTable, candidateCount, sizeof(PrivateStringTableEntry*), &s_stringTable_compareEntries);
+	
+	size_t stringsSize = 0;
+	for (size_t i=0; i < candidateCount; ++i)
+	{
+		PrivateStringTableEntry* entry = sizes->stringTable[i];
+		uint64_t index = sizes->stringTableCount;
+		
+		size_t valueChunkSize = s_binaryChunkSize(entry->length);
+		size_t referenceChunkSize = s_binaryChunkSize(wexpr_uvlq64_bytesize(index));
+		size_t tableCost = sizeof(uint64_t) + wexpr_uvlq64_bytesize(entry->length) + entry->length; // offset + string
+		
+		if (valueChunkSize <= referenceChunkSize || entry->count * (valueChunkSize - referenceChunkSize) <= tableCost)
+		{ continue; }
+		
+		entry->inTable = true;
+		entry->index = index;
+		
+		sizes->stringTable[(sizes->stringTableCount)++] = entry;
+		stringsSize += wexpr_uvlq64_bytesize(entry->length) + entry->length;
+	}
+	
+	if (sizes->stringTableCount != 0)
+	{
+		// count, offsets, strings
+		sizes->stringTableSize = sizeof(uint64_t) + sizes->stringTableCount * sizeof(uint64_t) + stringsSize;
+	}
+}
+
+// if the string is written as a reference, return true and set its index
+static bool s_stringTable_reference (const PrivateBinarySizes* sizes, const char* str, uint64_t* index)
+{
+	if (sizes->stringTableCount == 0)
+	{ return false; }
+	
+	PrivateStringTableEntry* entry = s_stringTable_find(sizes, str, wexpr_PrivateHashTable_hashBytes(str, strlen(str)));
+	if (!entry || !entry->inTable)
+	{ return false; }
+	
+	*index = entry->index;
+	return true;
+}
+
+// size of the chunk content for a key/value
+static size_t s_binaryStringContentSize (const PrivateBinarySizes* sizes, const char* str)
+{
+	uint64_t index = 0;
+	if (s_stringTable_reference(sizes, str, &index))
+	{ return wexpr_uvlq64_bytesize(index); }
+	
+	return strlen(str);
+}
+
+static size_t s_Expression_computeBinaryContentSize (WexprExpression* self, PrivateBinarySizes* sizes);
+
+typedef struct PrivateMapBinarySize
+{
+	PrivateBinarySizes* sizes;
+	size_t total;
+} PrivateMapBinarySize;
+
+// NOLINTNEXTLINE(misc-no-recursion)
+static int s_addMapPairBinarySize (any_t userData, any_t data)
+{
+	PrivateMapBinarySize* ud = userData;
+	WexprExpressionPrivateMapElement* elem = data;
+	
+	ud->total += s_binaryChunkSize(s_binaryStringContentSize(ud->sizes, elem->key)); // key is written as a value
+	ud->total += s_binaryChunkSize(s_Expression_computeBinaryContentSize(elem->value, ud->sizes));
+	
+	return (ud->sizes->failed ? !MAP_OK : MAP_OK);
+}
+
+// size of the chunk's data, not including the size and type. Records array/map sizes for the writer.
+// NOLINTNEXTLINE(misc-no-recursion)
+static size_t s_Expression_computeBinaryContentSize (WexprExpression* self, PrivateBinarySizes* sizes)
+{
+	switch (self->m_type)
+	{
+		case WexprExpressionTypeValue:
+		{
+			WexprPrivateTypedValue typed;
+			if (s_binaryTypedValue_get(sizes, self, &typed))
+			{
+				uint8_t chunkType = 0;
+				uint8_t content[WEXPR_PRIVATE_BINARYFORMAT_MAXTYPEDVALUESIZE];
+				
+				return wexpr_PrivateBinaryFormat_encodeTypedValue(&typed, &chunkType, content);
+			}
+			
+			return s_binaryStringContentSize(sizes, self->m_value.data);
+		}
+		
+		case WexprExpressionTypeBinaryData:
+			if (s_binaryCompression_wants(sizes, self->m_binaryData.size))
+			{ return s_binaryCompression_add(sizes, self->m_binaryData.data, self->m_binaryData.size); }
+			
+			return sizeof(uint8_t) + self->m_binaryData.size; // compression method + data
+		
+		case WexprExpressionTypeArray:
+		{
+			size_t slot = s_binarySizes_add(sizes); // before the children, so its in write order
+			size_t total = 0;
+			
+			for (WexprExpressionPrivateArrayElement* list = self->m_array.list;
+				 list != NULL && !sizes->failed; list = list->next)
+			{
+				total += s_binaryChunkSize(s_Expression_computeBinaryContentSize(list->expression, sizes));
+			}
+			
+			if (!sizes->failed)
+			{ sizes->sizes[slot] = total; }
+			
+			if (s_binaryIndex_wants(sizes, self->m_array.listCount))
+			{ s_binaryIndex_addContainer(sizes, self->m_array.listCount, sizeof(uint64_t)); } // element offset
+			
+			return total;
+		}
+		
+		case WexprExpressionTypeMap:
+		{
+			size_t slot = s_binarySizes_add(sizes);
+			
+			PrivateMapBinarySize ud;
+			ud.sizes = sizes;
+			ud.total = 0;
+			
+			if (!sizes->failed)
+			{ hashmap_iterate(self->m_map.hash, &s_addMapPairBinarySize, &ud); }
+			
+			if (!sizes->failed)
+			{ sizes->sizes[slot] = ud.total; }
+			
+			size_t pairCount = (size_t)hashmap_length(self->m_map.hash);
+			if (s_binaryIndex_wants(sizes, pairCount))
+			{ s_binaryIndex_addContainer(sizes, pairCount, 2 * sizeof(uint64_t)); } // key hash, key offset
+			
+			return ud.total;
+		}
+		
+		default:
+			return 0; // null has no data
+	}
+}
+
+// --- aligned layout
+// The aligned layout (see Spec/WexprBinarySpec-0.2.0.md) writes children before their parents, so it streams too.
+// The first pass works out the total size (which tells us where the root will be) and how much stack is needed,
+// and the second writes the nodes. Child offsets wait on the stack until their parent is written.
+
+typedef struct PrivateAlignedWriter
+{
+	WexprPrivateOutput* out;
+	uint64_t start; // output position of the start of the file
+	uint64_t* stack; // offsets (or map entries) of children whose parent isnt written yet
+	size_t stackCount;
+} PrivateAlignedWriter;
+
+static uint64_t s_alignedValueNodeSize (size_t length)
+{
+	return WEXPR_PRIVATE_ALIGNEDFORMAT_NODEHEADERSIZE + wexpr_PrivateAlignedFormat_align(length + 1); // zero terminated
+}
+
+// size of the node itself, without its children
+static uint64_t s_Expression_alignedNodeSize (WexprExpression* self)
+{
+	switch (self->m_type)
+	{
+		case WexprExpressionTypeValue:
+			return s_alignedValueNodeSize(strlen(self->m_value.data));
+		
+		case WexprExpressionTypeBinaryData:
+			return WEXPR_PRIVATE_ALIGNEDFORMAT_NODEHEADERSIZE + wexpr_PrivateAlignedFormat_align(self->m_binaryData.size);
+		
+		case WexprExpressionTypeArray:
+			return WEXPR_PRIVATE_ALIGNEDFORMAT_NODEHEADERSIZE + self->m_array.listCount * sizeof(uint64_t);
+		
+		case WexprExpressionTypeMap:
+			return WEXPR_PRIVATE_ALIGNEDFORMAT_NODEHEADERSIZE + (uint64_t)hashmap_length(self->m_map.hash) * WEXPR_PRIVATE_ALIGNEDFORMAT_MAPENTRYSIZE;
+		
+		default:
+			return WEXPR_PRIVATE_ALIGNEDFORMAT_NODEHEADERSIZE; // null
+	}
+}
+
+static uint64_t s_Expression_alignedSize (WexprExpression* self, size_t* stackNeeded);
+
+typedef struct PrivateMapAlignedSize
+{
+	uint64_t total;
+	size_t stackNeeded;
+	size_t pairIndex;
+} PrivateMapAlignedSize;
+
+// NOLINTNEXTLINE(misc-no-recursion)
+static int s_addMapPairAlignedSize (any_t userData, any_t data)
+{
+	PrivateMapAlignedSize* ud = userData;
+	WexprExpressionPrivateMapElement* elem = data;
+	
+	size_t childStack = 0;
+	ud->total += s_alignedValueNodeSize(strlen(elem->key));
+	ud->total += s_Expression_alignedSize(elem->value, &childStack);
+	
+	// the earlier pairs are waiting while the value is written
+	size_t needed = ud->pairIndex * 3 + childStack;
+	if (needed > ud->stackNeeded)
+	{ ud->stackNeeded = needed; }
+	
+	ud->pairIndex += 1;
+	return MAP_OK;
+}
+
+// first pass: size of the node and all of its children, and the stack needed to write them
+// NOLINTNEXTLINE(misc-no-recursion)
+static uint64_t s_Expression_alignedSize (WexprExpression* self, size_t* stackNeeded)
+{
+	uint64_t total = s_Expression_alignedNodeSize(self);
+	*stackNeeded = 0;
+	
+	if (self->m_type == WexprExpressionTypeArray)
+	{
+		size_t childIndex = 0;
+		for (WexprExpressionPrivateArrayElement* list = self->m_array.list;
+			 list != NULL; list = list->next)
+		{
+			size_t childStack = 0;
+			total += s_Expression_alignedSize(list->expression, &childStack);
+			
+			if (childIndex + childStack > *stackNeeded)
+			{ *stackNeeded = childIndex + childStack; }
+			
+			childIndex += 1;
+		}
+		
+		if (childIndex > *stackNeeded)
+		{ *stackNeeded = childIndex; }
+	}
+	
+	else if (self->m_type == WexprExpressionTypeMap)
+	{
+		PrivateMapAlignedSize ud;
+		ud.total = 0;
+		ud.stackNeeded = 0;
+		ud.pairIndex = 0;
+		
+		hashmap_iterate(self->m_map.hash, &s_addMapPairAlignedSize, &ud);
+		
+		total += ud.total;
+		*stackNeeded = (ud.pairIndex * 3 > ud.stackNeeded) ? ud.pairIndex * 3 : ud.stackNeeded;
+	}
+	
+	return total;
+}
+
+// offset in the file of the current position
+static uint64_t s_alignedWriter_position (const PrivateAlignedWriter* writer)
+{
+	return writer->out->flushedSize + writer->out->size - writer->start;
+}
+
+static void s_alignedWriter_writeNodeHeader (PrivateAlignedWriter* writer, WexprExpressionType type, uint32_t extra, uint64_t count)
+{
+	uint8_t header[WEXPR_PRIVATE_ALIGNEDFORMAT_NODEHEADERSIZE];
+	wexpr_PrivateAlignedFormat_writeNodeHeader(header, type, extra, count);
+	
+	wexpr_PrivateOutput_write(writer->out, header, sizeof(header));
+}
+
+// write the data and pad it to the alignment
+static void s_alignedWriter_writePadded (PrivateAlignedWriter* writer, const void* data, size_t byteSize, size_t paddedSize)
+{
+	wexpr_PrivateOutput_write(writer->out, data, byteSize);
+	wexpr_PrivateOutput_writeRepeated(writer->out, 0, paddedSize - byteSize);
+}
+
+// write a value node, returning its offset
+static uint64_t s_alignedWriter_writeValue (PrivateAlignedWriter* writer, const char* str, size_t length)
+{
+	uint64_t offset = s_alignedWriter_position(writer);
+	
+	s_alignedWriter_writeNodeHeader(writer, WexprExpressionTypeValue, 0, length);
+	s_alignedWriter_writePadded(writer, str, length + 1, (size_t)wexpr_PrivateAlignedFormat_align(length + 1)); // with the terminator
+	
+	return offset;
+}
+
+// write the top count entries of the stack (as little endian) and pop them
+static void s_alignedWriter_popEntries (PrivateAlignedWriter* writer, size_t count)
+{
+	uint64_t* entries = writer->stack + writer->stackCount - count;
+	
+	for (size_t i=0; i < count; ++i)
+	{ entries[i] = wexpr_uint64ToLittle(entries[i]); }
+	
+	wexpr_PrivateOutput_write(writer->out, entries, count * sizeof(uint64_t));
+	writer->stackCount -= count;
+}
+
+// orders map entries (native on the stack) by key hash, then key offset
+static int s_alignedWriter_compareMapEntries (const void* lhs, const void* rhs)
+{
+	const uint64_t* l = lhs;
+	const uint64_t* r = rhs;
+	
+	for (size_t i=0; i < 2; ++i)
+	{
+		if (l[i] != r[i])
+		{ return (l[i] < r[i]) ? -1 : 1; }
+	}
+	
+	return 0;
+}
+
+static uint64_t s_Expression_writeAligned (WexprExpression* self, PrivateAlignedWriter* writer);
+
+// NOLINTNEXTLINE(misc-no-recursion)
+static int s_writeMapPairAligned (any_t userData, any_t data)
+{
+	PrivateAlignedWriter* writer = userData;
+	WexprExpressionPrivateMapElement* elem = data;
+	
+	size_t keyLength = strlen(elem->key);
+	
+	uint64_t hash = wexpr_PrivateHashTable_hashBytes(elem->key, keyLength);
+	uint64_t keyOffset = s_alignedWriter_writeValue(writer, elem->key, keyLength);
+	uint64_t valueOffset = s_Expression_writeAligned(elem->value, writer);
+	
+	writer->stack[(writer->stackCount)++] = hash;
+	writer->stack[(writer->stackCount)++] = keyOffset;
+	writer->stack[(writer->stackCount)++] = valueOffset;
+	
+	return MAP_OK;
+}
+
+// second pass: write the children then the node, returning the node's offset
+// NOLINTNEXTLINE(misc-no-recursion)
+static uint64_t s_Expression_writeAligned (WexprExpression* self, PrivateAlignedWriter* writer)
+{
+	WexprExpressionType type = self->m_type;
+	
+	if (type == WexprExpressionTypeValue)
+	{
+		return s_alignedWriter_writeValue(writer, self->m_value.data, strlen(self->m_value.data));
+	}
+	
+	else if (type == WexprExpressionTypeBinaryData)
+	{
+		uint64_t offset = s_alignedWriter_position(writer);
+		size_t byteSize = self->m_binaryData.size;
+		
+		s_alignedWriter_writeNodeHeader(writer, type, WexprBinaryCompressionNone, byteSize);
+		s_alignedWriter_writePadded(writer, self->m_binaryData.data, byteSize, (size_t)wexpr_PrivateAlignedFormat_align(byteSize));
+		
+		return offset;
+	}
+	
+	else if (type == WexprExpressionTypeArray)
+	{
+		for (WexprExpressionPrivateArrayElement* list = self->m_array.list;
+			 list != NULL; list = list->next)
+		{
+			uint64_t childOffset = s_Expression_writeAligned(list->expression, writer);
+			writer->stack[(writer->stackCount)++] = childOffset;
+		}
+		
+		uint64_t offset = s_alignedWriter_position(writer);
+		
+		s_alignedWriter_writeNodeHeader(writer, type, 0, self->m_array.listCount);
+		s_alignedWriter_popEntries(writer, self->m_array.listCount);
+		
+		return offset;
+	}
+	
+	else if (type == WexprExpressionTypeMap)
+	{
+		size_t pairCount = (size_t)hashmap_length(self->m_map.hash);
+		
+		hashmap_iterate(self->m_map.hash, &s_writeMapPairAligned, writer);
+		
+		// sorted by hash so readers can binary search
+		qsort (writer->stack + writer->stackCount - pairCount * 3, pairCount, 3 * sizeof(uint64_t), &s_alignedWriter_compareMapEntries);
+		
+		uint64_t offset = s_alignedWriter_position(writer);
+		
+		s_alignedWriter_writeNodeHeader(writer, type, 0, pairCount);
+		s_alignedWriter_popEntries(writer, pairCount * 3);
+		
+		return offset;
+	}
+	
+	// null
+	uint64_t offset = s_alignedWriter_position(writer);
+	s_alignedWriter_writeNodeHeader(writer, WexprExpressionTypeNull, 0, 0);
+	
+	return offset;
+}
+
+// Writes the whole file in the aligned layout. sizes must come from s_Expression_prepareBinary().
+// Returns false (without writing anything) if out of memory.
+static bool s_Expression_writeAlignedFile (WexprExpression* self, const PrivateBinarySizes* sizes, WexprPrivateOutput* out)
+{
+	PrivateAlignedWriter writer;
+	writer.out = out;
+	writer.start = out->flushedSize + out->size;
+	writer.stack = malloc((sizes->alignedStackNeeded ? sizes->alignedStackNeeded : 1) * sizeof(uint64_t));
+	writer.stackCount = 0;
+	
+	if (!writer.stack)
+	{ return false; }
+	
+	// the root is written last
+	uint8_t prologue[WEXPR_PRIVATE_ALIGNEDFORMAT_PROLOGUESIZE];
+	wexpr_PrivateAlignedFormat_writePrologue(prologue, sizes->alignedFileSize - s_Expression_alignedNodeSize(self), sizes->alignedFileSize);
+	wexpr_PrivateOutput_write(out, prologue, sizeof(prologue));
+	
+	s_Expression_writeAligned(self, &writer);
+	
+	free (writer.stack);
+	return true;
+}
+
+// header needed for the flags, if any
+static size_t s_binaryHeaderSize (WexprWriteFlags flags)
+{
+	return (flags & WexprWriteFlagBinaryFileHeader) ? WEXPR_PRIVATE_BINARYFORMAT_HEADERSIZE : 0;
+}
+
+static bool s_binaryParallel_wants (WexprExpression* self, const PrivateBinarySizes* sizes);
+static size_t s_binaryParallel_prepare (WexprExpression* self, PrivateBinarySizes* sizes);
+
+// Start empty sizes for the options
+static void s_binarySizes_init (PrivateBinarySizes* sizes, const WexprBinaryWriteOptions* options)
+{
+	WexprWriteFlags flags = options->flags;
+	
+	sizes->sizes = NULL;
+	sizes->count = 0;
+	sizes->capacity = 0;
+	sizes->next = 0;
+	sizes->failed = false;
+	
+	// the index is an auxiliary chunk, so only exists in files
+	sizes->buildIndex = (flags & WexprWriteFlagBinaryFileHeader) && (flags & WexprWriteFlagBinaryIndex);
+	sizes->indexContainerCount = 0;
+	sizes->indexRecordsSize = 0;
+	sizes->index = NULL;
+	sizes->indexDirectoryNext = 0;
+	sizes->indexRecordNext = 0;
+	sizes->rootPosition = 0;
+	
+	sizes->options = options;
+	sizes->compressed = NULL;
+	sizes->compressedCount = 0;
+	sizes->compressedCapacity = 0;
+	sizes->compressedNext = 0;
+	
+	sizes->strings = NULL;
+	sizes->stringEntries = NULL;
+	sizes->stringEntryCount = 0;
+	sizes->stringEntryCapacity = 0;
+	sizes->stringTable = NULL;
+	sizes->stringTableCount = 0;
+	sizes->stringTableSize = 0;
+	
+	sizes->aligned = (flags & WexprWriteFlagBinaryAligned);
+	sizes->alignedStackNeeded = 0;
+	sizes->alignedFileSize = 0;
+	
+	sizes->pieces = NULL;
+	sizes->pieceCount = 0;
+	sizes->piecesContentSize = 0;
+}
+
+// Works out the sizes needed to write the expression with the given options, which must stay valid until writing is done.
+// Returns the size of everything written (header, string table, expression chunk, index chunk), or 0 if it cant be written (invalid or out of memory).
+// Free the sizes with s_binarySizes_free() afterwards.
+static size_t s_Expression_prepareBinary (WexprExpression* self, const WexprBinaryWriteOptions* options, PrivateBinarySizes* sizes)
+{
+	WexprWriteFlags flags = options->flags;
+	
+	s_binarySizes_init(sizes, options);
+	
+	if (self->m_type == WexprExpressionTypeInvalid)
+	{ return 0; }
+	
+	if (sizes->aligned)
+	{
+		sizes->alignedFileSize = WEXPR_PRIVATE_ALIGNEDFORMAT_PROLOGUESIZE + s_Expression_alignedSize(self, &sizes->alignedStackNeeded);
+		return (size_t)sizes->alignedFileSize;
+	}
+	
+	// the string table is an auxiliary chunk too
+	if ((flags & WexprWriteFlagBinaryFileHeader) && (flags & WexprWriteFlagBinaryStringTable))
+	{
+		sizes->strings = wexpr_PrivateHashTable_create();
+		if (!sizes->strings)
+		{ return 0; }
+		
+		s_Expression_countStrings(self, sizes);
+		
+		if (!sizes->failed)
+		{ s_stringTable_build(sizes); }
+		
+		if (sizes->failed)
+		{ return 0; }
+	}
+	
+	size_t contentSize = s_binaryParallel_wants(self, sizes)
+		? s_binaryParallel_prepare(self, sizes)
+		: s_Expression_computeBinaryContentSize(self, sizes);
+	
+	if (sizes->failed)
+	{ return 0; }
+	
+	size_t totalSize = s_binaryHeaderSize(flags) + s_binaryChunkSize(contentSize);
+	
+	if (sizes->stringTableSize != 0)
+	{ totalSize += s_binaryChunkSize(sizes->stringTableSize); }
+	
+	size_t indexSize = s_binaryIndex_contentSize(sizes);
+	if (indexSize != 0)
+	{ totalSize += s_binaryChunkSize(indexSize); }
+	
+	return totalSize;
+}
+
+static void s_writeBinaryHeader (WexprPrivateOutput* out, WexprWriteFlags flags)
+{
+	if (flags & WexprWriteFlagBinaryFileHeader)
+	{
+		uint8_t header[WEXPR_PRIVATE_BINARYFORMAT_HEADERSIZE];
+		wexpr_PrivateBinaryFormat_writeHeader(header);
+		
+		wexpr_PrivateOutput_write(out, header, sizeof(header));
+	}
+}
+
+static void s_binarySizes_free (PrivateBinarySizes* sizes)
+{
+	free (sizes->sizes);
+	sizes->sizes = NULL;
+	
+	free (sizes->index);
+	sizes->index = NULL;
+	
+	for (size_t i=0; i < sizes->compressedCount; ++i)
+	{ free (sizes->compressed[i].data); }
+	
+	free (sizes->compressed);
+	sizes->compressed = NULL;
+	sizes->compressedCount = 0;
+	
+	if (sizes->strings)
+	{ wexpr_PrivateHashTable_destroy(sizes->strings); }
+	sizes->strings = NULL;
+	
+	free (sizes->stringEntries);
+	sizes->stringEntries = NULL;
+	sizes->stringEntryCount = 0;
+	
+	free (sizes->stringTable);
+	sizes->stringTable = NULL;
+	sizes->stringTableCount = 0;
+	
+	s_outputPieces_free(sizes->pieces, sizes->pieceCount);
+	sizes->pieces = NULL;
+	sizes->pieceCount = 0;
+}
+
+static void s_writeBinaryChunkHeader (WexprPrivateOutput* out, size_t contentSize, WexprExpressionType chunkType)
+{
+	uint8_t header[WEXPR_PRIVATE_BINARYFORMAT_MAXCHUNKHEADERSIZE];
+	size_t headerSize = wexpr_PrivateBinaryFormat_encodeChunkHeader(header, contentSize, (uint8_t)chunkType);
+	
+	wexpr_PrivateOutput_write(out, header, headerSize);
+}
+
+typedef struct PrivateWriteMapBinary
+{
+	PrivateBinarySizes* sizes;
+	WexprPrivateOutput* out;
+	uint8_t* indexEntry; // next index entry to fill in, or null if the map isnt indexed
+} PrivateWriteMapBinary;
+
+static void p_wexpr_Expression_writeBinaryRepresentation (WexprExpression* self, PrivateBinarySizes* sizes, WexprPrivateOutput* out);
+
+// writes a key/value as a value chunk, or a reference to the string table
+static void s_writeBinaryString (PrivateBinarySizes* sizes, WexprPrivateOutput* out, const char* str, size_t length)
+{
+	uint64_t index = 0;
+	if (s_stringTable_reference(sizes, str, &index))
+	{
+		uint8_t reference[WEXPR_PRIVATE_BINARYFORMAT_MAXUVLQ64SIZE];
+		size_t referenceSize = wexpr_uvlq64_bytesize(index);
+		wexpr_uvlq64_write(reference, sizeof(reference), index);
+		
+		s_writeBinaryChunkHeader(out, referenceSize, WEXPR_PRIVATE_BINARYFORMAT_CHUNKTYPE_STRINGREFERENCE);
+		wexpr_PrivateOutput_write(out, reference, referenceSize);
+		return;
+	}
+	
+	s_writeBinaryChunkHeader(out, length, WexprExpressionTypeValue);
+	wexpr_PrivateOutput_write(out, str, length);
+}
+
+// writes the string table chunk, if theres anything in it
+static void s_writeBinaryStringTable (PrivateBinarySizes* sizes, WexprPrivateOutput* out)
+{
+	if (sizes->stringTableSize == 0)
+	{ return; }
+	
+	s_writeBinaryChunkHeader(out, sizes->stringTableSize, WEXPR_PRIVATE_BINARYFORMAT_CHUNKTYPE_STRINGTABLE);
+	
+	uint8_t value[sizeof(uint64_t)];
+	wexpr_PrivateBinaryFormat_writeUInt64(value, sizes->stringTableCount);
+	wexpr_PrivateOutput_write(out, value, sizeof(value));
+	
+	// offsets from the start of the content
+	uint64_t offset = sizeof(uint64_t) + sizes->stringTableCount * sizeof(uint64_t);
+	for (size_t i=0; i < sizes->stringTableCount; ++i)
+	{
+		const PrivateStringTableEntry* entry = sizes->stringTable[i];
+		
+		wexpr_PrivateBinaryFormat_writeUInt64(value, offset);
+		wexpr_PrivateOutput_write(out, value, sizeof(value));
+		
+		offset += wexpr_uvlq64_bytesize(entry->length) + entry->length;
+	}
+	
+	for (size_t i=0; i < sizes->stringTableCount; ++i)
+	{
+		const PrivateStringTableEntry* entry = sizes->stringTable[i];
+		
+		uint8_t length[WEXPR_PRIVATE_BINARYFORMAT_MAXUVLQ64SIZE];
+		size_t lengthSize = wexpr_uvlq64_bytesize(entry->length);
+		wexpr_uvlq64_write(length, sizeof(length), entry->length);
+		
+		wexpr_PrivateOutput_write(out, length, lengthSize);
+		wexpr_PrivateOutput_write(out, entry->str, entry->length);
+	}
+}
+
+// NOLINTNEXTLINE(misc-no-recursion)
+static int s_writeMapPairBinary (any_t userData, any_t data)
+{
+	PrivateWriteMapBinary* ud = userData;
+	WexprExpressionPrivateMapElement* elem = data;
+	
+	// write the map key as a new value
+	size_t keyLength = strlen(elem->key);
+	
+	if (ud->indexEntry)
+	{
+		wexpr_PrivateBinaryFormat_writeUInt64(ud->indexEntry, wexpr_PrivateHashTable_hashBytes(elem->key, keyLength));
+		wexpr_PrivateBinaryFormat_writeUInt64(ud->indexEntry + sizeof(uint64_t), s_binaryIndex_offset(ud->sizes, ud->out));
+		ud->indexEntry += 2 * sizeof(uint64_t);
+	}
+	
+	s_writeBinaryString(ud->sizes, ud->out, elem->key, keyLength);
+	
+	// write the map value
+	p_wexpr_Expression_writeBinaryRepresentation(elem->value, ud->sizes, ud->out);
+	
+	return MAP_OK;
+}
+
+// Writes the binary chunk for the expression (and all children) to the output.
+// sizes must come from s_Expression_prepareBinary() on the same expression.
+// NOLINTNEXTLINE(misc-no-recursion)
+static void p_wexpr_Expression_writeBinaryRepresentation (WexprExpression* self, PrivateBinarySizes* sizes, WexprPrivateOutput* out)
+{
+	WexprExpressionType type = self->m_type;
+	
+	if (type == WexprExpressionTypeNull)
+	{
+		s_writeBinaryChunkHeader(out, 0, type);
+	}
+	
+	else if (type == WexprExpressionTypeValue)
+	{
+		WexprPrivateTypedValue typed;
+		if (s_binaryTypedValue_get(sizes, self, &typed))
+		{
+			uint8_t chunkType = 0;
+			uint8_t content[WEXPR_PRIVATE_BINARYFORMAT_MAXTYPEDVALUESIZE];
+			size_t contentSize = wexpr_PrivateBinaryFormat_encodeTypedValue(&typed, &chunkType, content);
+			
+			s_writeBinaryChunkHeader(out, contentSize, chunkType);
+			wexpr_PrivateOutput_write(out, content, contentSize);
+		}
+		else
+		{
+			s_writeBinaryString(sizes, out, self->m_value.data, strlen(self->m_value.data));
+		}
+	}
+	
+	else if (type == WexprExpressionTypeBinaryData)
+	{
+		const PrivateCompressedData* compressed = s_binaryCompression_wants(sizes, self->m_binaryData.size)
+			? &sizes->compressed[(sizes->compressedNext)++]
+			: NULL;
+		
+		if (compressed && compressed->data)
+		{
+			s_writeBinaryChunkHeader(out, compressed->size + 1, type); // 1 byte for compression method
+			wexpr_PrivateOutput_writeChar(out, (char)sizes->options->compression);
+			wexpr_PrivateOutput_write(out, compressed->data, compressed->size);
+		}
+		else
+		{
+			s_writeBinaryChunkHeader(out, self->m_binaryData.size + 1, type);
+			wexpr_PrivateOutput_writeChar(out, WexprBinaryCompressionNone);
+			wexpr_PrivateOutput_write(out, self->m_binaryData.data, self->m_binaryData.size);
+		}
+	}
+	
+	else if (type == WexprExpressionTypeArray)
+	{
+		uint8_t* indexEntry = s_binaryIndex_wants(sizes, self->m_array.listCount)
+			? s_binaryIndex_beginRecord(sizes, out, self->m_array.listCount, sizeof(uint64_t))
+			: NULL;
+		
+		s_writeBinaryChunkHeader(out, sizes->sizes[(sizes->next)++], type);
+		
+		for (WexprExpressionPrivateArrayElement* list = self->m_array.list;
+			 list != NULL; list = list->next)
+		{
+			if (indexEntry)
+			{
+				wexpr_PrivateBinaryFormat_writeUInt64(indexEntry, s_binaryIndex_offset(sizes, out));
+				indexEntry += sizeof(uint64_t);
+			}
+			
+			p_wexpr_Expression_writeBinaryRepresentation(list->expression, sizes, out);
+		}
+	}
+	
+	else if (type == WexprExpressionTypeMap)
+	{
+		// key value pairs
+		size_t pairCount = (size_t)hashmap_length(self->m_map.hash);
+		uint8_t* indexEntries = s_binaryIndex_wants(sizes, pairCount)
+			? s_binaryIndex_beginRecord(sizes, out, pairCount, 2 * sizeof(uint64_t))
+			: NULL;
+		
+		s_writeBinaryChunkHeader(out, sizes->sizes[(sizes->next)++], type);
+		
+		PrivateWriteMapBinary ud;
+		ud.sizes = sizes;
+		ud.out = out;
+		ud.indexEntry = indexEntries;
+		
+		hashmap_iterate(self->m_map.hash, &s_writeMapPairBinary, &ud);
+		
+		// sorted by hash so readers can binary search
+		if (indexEntries)
+		{ qsort (indexEntries, pairCount, 2 * sizeof(uint64_t), &s_binaryIndex_compareMapEntries); }
+	}
+}
+
+typedef struct PrivateBinaryParallelWork
+{
+	const WexprBinaryWriteOptions* options;
+	PrivateContainerChildren children;
+	PrivateOutputPiece* pieces;
+} PrivateBinaryParallelWork;
+
+// true if the root's children should be written in parallel. Only plain chunks can be, since the index and
+// string table are shared by the whole file.
+static bool s_binaryParallel_wants (WexprExpression* self, const PrivateBinarySizes* sizes)
+{
+	return !sizes->aligned && !sizes->buildIndex && !sizes->strings
+		&& s_parallelWrite_wants(self, sizes->options->executor);
+}
+
+// size of the chunks for a child of the container (including the key for a map)
+static size_t s_binaryParallel_childSize (const PrivateContainerChildren* children, size_t index, PrivateBinarySizes* sizes)
+{
+	if (children->isMap)
+	{
+		WexprExpressionPrivateMapElement* elem = children->children[index];
+		
+		return s_binaryChunkSize(s_binaryStringContentSize(sizes, elem->key))
+			+ s_binaryChunkSize(s_Expression_computeBinaryContentSize(elem->value, sizes));
+	}
+	
+	return s_binaryChunkSize(s_Expression_computeBinaryContentSize(children->children[index], sizes));
+}
+
+static void s_binaryParallel_writeChild (const PrivateContainerChildren* children, size_t index, PrivateBinarySizes* sizes, WexprPrivateOutput* out)
+{
+	if (children->isMap)
+	{
+		WexprExpressionPrivateMapElement* elem = children->children[index];
+		
+		s_writeBinaryString(sizes, out, elem->key, strlen(elem->key));
+		p_wexpr_Expression_writeBinaryRepresentation(elem->value, sizes, out);
+		return;
+	}
+	
+	p_wexpr_Expression_writeBinaryRepresentation(children->children[index], sizes, out);
+}
+
+// both passes for the piece's children, with its own sizes
+static void s_binaryParallel_writePiece (void* taskData, size_t pieceIndex)
+{
+	PrivateBinaryParallelWork* work = taskData;
+	PrivateOutputPiece* piece = &work->pieces[pieceIndex];
+	
+	size_t begin = 0, end = 0;
+	s_outputPieces_range(pieceIndex, work->children.count, &begin, &end);
+	
+	PrivateBinarySizes sizes;
+	s_binarySizes_init(&sizes, work->options);
+	
+	size_t total = 0;
+	for (size_t i=begin; i < end && !sizes.failed; ++i)
+	{ total += s_binaryParallel_childSize(&work->children, i, &sizes); }
+	
+	piece->data = (!sizes.failed && total != 0) ? malloc(total) : NULL;
+	piece->size = total;
+	piece->failed = (piece->data == NULL);
+	
+	if (piece->data)
+	{
+		// exact size, so a fixed output always fits
+		WexprPrivateOutput out;
+		wexpr_PrivateOutput_initFixed(&out, piece->data, total);
+		
+		for (size_t i=begin; i < end; ++i)
+		{ s_binaryParallel_writeChild(&work->children, i, &sizes, &out); }
+		
+		piece->failed = out.failed;
+	}
+	
+	s_binarySizes_free(&sizes);
+}
+
+// Write the root's children in pieces with the executor, keeping them in sizes for s_Expression_writeBinaryFile().
+// Returns the content size of the root.
+static size_t s_binaryParallel_prepare (WexprExpression* self, PrivateBinarySizes* sizes)
+{
+	PrivateBinaryParallelWork work;
+	work.options = sizes->options;
+	
+	if (!s_containerChildren_collect(self, &work.children))
+	{
+		sizes->failed = true;
+		return 0;
+	}
+	
+	size_t pieceCount = s_outputPieces_count(work.children.count);
+	work.pieces = calloc(pieceCount, sizeof(PrivateOutputPiece));
+	
+	if (!work.pieces)
+	{
+		free (work.children.children);
+		sizes->failed = true;
+		return 0;
+	}
+	
+	wexpr_Executor_parallelFor(sizes->options->executor, pieceCount, &s_binaryParallel_writePiece, &work);
+	
+	sizes->pieces = work.pieces;
+	sizes->pieceCount = pieceCount;
+	sizes->piecesContentSize = 0;
+	
+	for (size_t i=0; i < pieceCount; ++i)
+	{
+		sizes->failed |= work.pieces[i].failed;
+		sizes->piecesContentSize += work.pieces[i].size;
+	}
+	
+	free (work.children.children);
+	
+	return sizes->piecesContentSize;
+}
+
+// Writes everything for the options: the header, the string table, the expression chunk, and the index chunk
+// (or the aligned layout instead).
+// sizes must come from s_Expression_prepareBinary().
+// Returns false (without writing anything) if out of memory.
+static bool s_Expression_writeBinaryFile (WexprExpression* self, PrivateBinarySizes* sizes, WexprPrivateOutput* out)
+{
+	if (sizes->aligned)
+	{ return s_Expression_writeAlignedFile(self, sizes, out); }
+	
+	size_t indexSize = s_binaryIndex_contentSize(sizes);
+	
+	if (indexSize != 0)
+	{
+		sizes->index = malloc(indexSize);
+		if (!sizes->index)
+		{ return false; }
+		
+		wexpr_PrivateBinaryFormat_writeUInt64(sizes->index, sizes->indexContainerCount);
+		sizes->indexRecordNext = sizeof(uint64_t) + sizes->indexContainerCount * 2 * sizeof(uint64_t);
+	}
+	
+	s_writeBinaryHeader(out, sizes->options->flags);
+	s_writeBinaryStringTable(sizes, out);
+	
+	sizes->rootPosition = out->flushedSize + out->size;
+	
+	if (sizes->pieces)
+	{
+		s_writeBinaryChunkHeader(out, sizes->piecesContentSize, self->m_type);
+		s_outputPieces_write(sizes->pieces, sizes->pieceCount, out);
+	}
+	else
+	{
+		p_wexpr_Expression_writeBinaryRepresentation(self, sizes, out);
+	}
+	
+	if (indexSize != 0)
+	{
+		s_writeBinaryChunkHeader(out, indexSize, WEXPR_PRIVATE_BINARYFORMAT_CHUNKTYPE_INDEX);
+		wexpr_PrivateOutput_write(out, sizes->index, indexSize);
+	}
+	
+	return true;
+}
+
+// true if the options want the file compressed as blocks (and we can)
+static bool s_binaryBlockCompression_wants (const WexprBinaryWriteOptions* options)
+{
+	return (options->flags & WexprWriteFlagBinaryFileHeader)
+		&& !(options->flags & WexprWriteFlagBinaryAligned)
+		&& options->blockCompression != WexprBinaryCompressionNone
+		&& wexpr_BinaryCompression_isSupported(options->blockCompression);
+}
+
+// Writes the file with everything after the header compressed as blocks.
+// The chunks are written uncompressed first, since the blocks are compressed in parallel.
+// Returns false (without writing anything) if out of memory.
+static bool s_Expression_writeBinaryBlockCompressed (WexprExpression* self, const WexprBinaryWriteOptions* options, WexprPrivateOutput* out)
+{
+	PrivateBinarySizes sizes;
+	size_t totalSize = s_Expression_prepareBinary(self, options, &sizes);
+	
+	uint8_t* plain = (totalSize != 0) ? malloc(totalSize) : NULL;
+	bool success = (plain != NULL);
+	
+	if (success)
+	{
+		WexprPrivateOutput plainOut;
+		wexpr_PrivateOutput_initFixed(&plainOut, plain, totalSize);
+		
+		success = s_Expression_writeBinaryFile(self, &sizes, &plainOut);
+	}
+	
+	s_binarySizes_free(&sizes);
+	
+	size_t contentSize = 0;
+	uint8_t* content = success
+		? wexpr_PrivateBlockCompression_compress(options->blockCompression, options->compressionLevel, options->blockSize,
+			plain + WEXPR_PRIVATE_BINARYFORMAT_HEADERSIZE, totalSize - WEXPR_PRIVATE_BINARYFORMAT_HEADERSIZE,
+			&contentSize
+		)
+		: NULL;
+	
+	free (plain);
+	
+	if (!content)
+	{ return false; }
+	
+	s_writeBinaryHeader(out, options->flags);
+	s_writeBinaryChunkHeader(out, contentSize, WEXPR_PRIVATE_BINARYFORMAT_CHUNKTYPE_COMPRESSEDBLOCKS);
+	wexpr_PrivateOutput_write(out, content, contentSize);
+	
+	free (content);
+	return true;
+}
+
+// ---------------------- PUBLIC -----------------------------------
+
+// --- Construction/Destruction
+
+WexprExpression* wexpr_Expression_createFromString (
+	const char* str, WexprParseFlags flags,
+	WexprError* error
+)
+{
+	return wexpr_Expression_createFromLengthString (
+		str, strlen(str), flags, error
+	);
+}
+
+WexprExpression* wexpr_Expression_createFromStringWithExternalReferenceTable (
+	const char* str, WexprParseFlags flags,
+	struct WexprReferenceTable* referenceTable,
+	WexprError* error
+)
+{
+	return wexpr_Expression_createFromLengthStringWithExternalReferenceTable(
+		str, strlen(str), flags, referenceTable, error
+	);
+}
+
+WexprExpression* wexpr_Expression_createFromLengthString (
+	const char* str, size_t length, WexprParseFlags flags,
+	WexprError* error
+)
+{
+	return wexpr_Expression_createFromLengthStringWithExternalReferenceTable(
+		str, length, flags, NULL, error
+	);
+}
+
+// Parse text. setup can be null.
+static WexprExpression* s_Expression_createFromLengthString (
+	const char* str, size_t length, WexprParseFlags flags,
+	struct WexprReferenceTable* referenceTable, const PrivateParseSetup* setup,
+	WexprError* error
+)
+{
+	WexprExpression* expr = s_Expression_alloc (WexprExpressionTypeInvalid);
+	
+	PrivateParserState parserState;
+	s_privateParserState_init (&parserState);
+	
+	// use the external ref table if it exists
+	parserState.externalReferenceMap = referenceTable;
+	parserState.projection = s_Projection_begin(s_ParseSetup_projection(setup));
+	parserState.internTable = s_ParseSetup_internTable(setup, flags, &parserState.internTableReused);
+	
+	WexprError err = WEXPR_ERROR_INIT();
+	
+	// we dont check that str is valid UTF8. Possibly TODO [WolfWexpr does].
+	if (true)
+	{
+		// now start parsing
+		PrivateStringRef rest = s_Expression_parseFromString (expr, 
+			s_stringRef_createFromPointerSize(str, length),
+			flags, &parserState, &err
+		);
+		
+		PrivateStringRef postRest = s_trimFrontOfString (rest, &parserState);
+		
+		if (postRest.size != 0)
+		{
+			if (!err.code)
+			{
+				err.code = WexprErrorCodeExtraDataAfterParsingRoot;
+				err.message = strdup ("Extra data after parsing the root expression");
+				err.line = parserState.line;
+				err.column = parserState.column;
+			}
+		}
+		
+		if (expr->m_type == WexprExpressionTypeInvalid && err.code == WexprErrorCodeNone)
+		{
+			// we didnt get an expression and no error currently reported
+			err.code = WexprErrorCodeEmptyString;
+			err.message = strdup ("No expression found [remained invalid]");
+			err.line = parserState.line;
+			err.column = parserState.column;
+		}
+	}
+	else
+	{
+		if (!err.code)
+		{
+			err.code = WexprErrorCodeInvalidUTF8;
+			err.message = strdup ("Invalid UTF8");
+		}
+	}
+	
+	// cleanup our parser state
+	if (err.code != WexprErrorCodeNone)
+	{
+		wexpr_Expression_destroy(expr);
+		
+		if (error)
+		{
+			WEXPR_ERROR_MOVE(error, &err);
+		}
+		
+		WEXPR_ERROR_FREE (err);
+		
+		s_privateParserState_free(&parserState);
+		
+		return NULL;
+	}
+	
+	s_privateParserState_free(&parserState);
+	
+	return expr;
+}
+
+WexprExpression* wexpr_Expression_createFromLengthStringWithExternalReferenceTable (
+	const char* str, size_t length, WexprParseFlags flags,
+	struct WexprReferenceTable* referenceTable,
+	WexprError* error
+)
+{
+	return s_Expression_createFromLengthString(str, length, flags, referenceTable, NULL, error);
+}
+
+WexprExpression* wexpr_Expression_createFromLengthStringWithProjection (
+	const char* str, size_t length, WexprParseFlags flags,
+	WexprPath* const* paths, size_t pathCount,
+	WexprError* error
+)
+{
+	PrivateProjection projection;
+	PrivateParseSetup setup = { &projection, NULL };
+	WexprExpression* expr = NULL;
+	
+	if (s_Projection_init(&projection, paths, pathCount))
+	{ expr = s_Expression_createFromLengthString(str, length, flags, NULL, &setup, error); }
+	
+	s_Projection_free(&projection);
+	return expr;
+}
+
+WexprExpression* wexpr_Expression_createFromBinaryChunk (
+	const void* data, size_t length, WexprError* error
+)
+{
+	return wexpr_Expression_createFromBinaryChunkWithFlags (
+		data, length, WexprParseFlagNone, error
+	);
+}
+
+WexprExpression* wexpr_Expression_createFromBinaryChunkWithFlags (
+	const void* data, size_t length, WexprParseFlags flags, WexprError* error
+)
+{
+	return s_Expression_createFromBinary (data, length, NULL, 0, flags, NULL, error);
+}
+
+WexprExpression* wexpr_Expression_createFromBinaryChunkWithProjection (
+	const void* data, size_t length, WexprParseFlags flags,
+	WexprPath* const* paths, size_t pathCount,
+	WexprError* error
+)
+{
+	PrivateProjection projection;
+	PrivateParseSetup setup = { &projection, NULL };
+	WexprExpression* expr = NULL;
+	
+	if (s_Projection_init(&projection, paths, pathCount))
+	{ expr = s_Expression_createFromBinary (data, length, NULL, 0, flags, &setup, error); }
+	
+	s_Projection_free(&projection);
+	return expr;
+}
+
+// Parse a whole binary file. setup can be null.
+static WexprExpression* s_Expression_createFromBinaryFile (
+	const void* data, size_t length, WexprParseFlags flags, const PrivateParseSetup* setup, WexprError* error
+)
+{
+	const uint8_t* blocks = NULL;
+	size_t blocksSize = 0;
+	
+	if (length >= WEXPR_PRIVATE_BINARYFORMAT_HEADERSIZE
+		&& wexpr_PrivateBinaryFormat_findAuxiliaryChunk(data, length, WEXPR_PRIVATE_BINARYFORMAT_CHUNKTYPE_COMPRESSEDBLOCKS, &blocks, &blocksSize))
+	{
+		// the chunks were compressed as blocks, so decompress them after a copy of the header and read that instead
+		size_t plainSize = 0;
+		uint8_t* plain = wexpr_PrivateBlockCompression_decompress(blocks, blocksSize, WEXPR_PRIVATE_BINARYFORMAT_HEADERSIZE, &plainSize, error);
+		if (!plain)
+		{ return NULL; }
+		
+		memcpy (plain, data, WEXPR_PRIVATE_BINARYFORMAT_HEADERSIZE);
+		
+		WexprExpression* expr = s_Expression_createFromBinaryFileChunks (plain, plainSize, flags, setup, error);
+		
+		free (plain);
+		return expr;
+	}
+	
+	uint32_t version = 0;
+	if (length >= WEXPR_PRIVATE_BINARYFORMAT_HEADERSIZE
+		&& wexpr_PrivateBinaryFormat_readHeader(data, length, &version, NULL)
+		&& version == wexpr_PrivateAlignedFormat_version)
+	{
+		return s_Expression_createFromAlignedFile (data, length, flags, setup, error);
+	}
+	
+	return s_Expression_createFromBinaryFileChunks (data, length, flags, setup, error);
+}
+
+WexprExpression* wexpr_Expression_createFromBinaryFile (
+	const void* data, size_t length, WexprParseFlags flags, WexprError* error
+)
+{
+	return s_Expression_createFromBinaryFile (data, length, flags, NULL, error);
+}
+
+WexprExpression* wexpr_Expression_createFromBinaryFileWithProjection (
+	const void* data, size_t length, WexprParseFlags flags,
+	WexprPath* const* paths, size_t pathCount,
+	WexprError* error
+)
+{
+	PrivateProjection projection;
+	PrivateParseSetup setup = { &projection, NULL };
+	WexprExpression* expr = NULL;
+	
+	if (s_Projection_init(&projection, paths, pathCount))
+	{ expr = s_Expression_createFromBinaryFile (data, length, flags, &setup, error); }
+	
+	s_Projection_free(&projection);
+	return expr;
+}
+
+WexprExpression* wexpr_Expression_createFromFile (
+	const char* path, WexprParseFlags flags, WexprError* error
+)
+{
+	WexprPrivateFileMapping file;
+	if (!wexpr_PrivateFileMapping_open(&file, path))
+	{
+		if (error)
+		{
+			const char* reason = strerror(errno);
+			size_t messageSize = strlen("Unable to read file : ") + strlen(path) + strlen(reason) + 1;
+			
+			error->code = WexprErrorCodeUnableToReadFile;
+			error->message = malloc(messageSize);
+			if (error->message)
+			{ snprintf (error->message, messageSize, "Unable to read file %s: %s", path, reason); }
+		}
+		
+		return NULL;
+	}
+	
+	WexprExpression* expr = NULL;
+	
+	// binary files always start with the magic, which isnt valid text
+	if (file.size >= 1 && *(const uint8_t*)file.data == wexpr_PrivateBinaryFormat_magic[0])
+	{
+		expr = wexpr_Expression_createFromBinaryFile (file.data, file.size, flags, error);
+	}
+	else
+	{
+		expr = wexpr_Expression_createFromLengthString (file.data, file.size, flags, error);
+	}
+	
+	wexpr_PrivateFileMapping_close(&file);
+	
+	return expr;
+}
+
+// most documents parsed as one piece of work by wexpr_Expression_createFromBatch()
+#define LIBWEXPR_PRIVATE_BATCH_MAXGROUPSIZE 32
+
+typedef struct PrivateBatch
+{
+	const WexprDocument* documents;
+	size_t count;
+	size_t groupSize;
+	WexprParseFlags flags;
+	WexprExpression** results;
+	WexprError* errors;
+} PrivateBatch;
+
+// parse one group of documents, reusing the scratch tables between them
+static void s_batch_parseGroup (void* userData, size_t group)
+{
+	PrivateBatch* batch = userData;
+	
+	size_t begin = group * batch->groupSize;
+	size_t end = begin + batch->groupSize;
+	if (end > batch->count)
+	{ end = batch->count; }
+	
+	PrivateParseSetup setup;
+	setup.projection = NULL;
+	setup.internTable = (batch->flags & WexprParseFlagDeduplicate) ? wexpr_PrivateHashTable_create() : NULL;
+	
+	for (size_t i=begin; i < end; ++i)
+	{
+		const WexprDocument* document = &batch->documents[i];
+		WexprError* error = batch->errors ? &batch->errors[i] : NULL;
+		WexprExpression* expr = NULL;
+		
+		switch (document->format)
+		{
+			case WexprDocumentFormatText:
+				expr = s_Expression_createFromLengthString(document->data, document->length, batch->flags, NULL, &setup, error);
+				break;
+			
+			case WexprDocumentFormatBinaryChunk:
+				expr = s_Expression_createFromBinary(document->data, document->length, NULL, 0, batch->flags, &setup, error);
+				break;
+			
+			case WexprDocumentFormatBinaryFile:
+				expr = s_Expression_createFromBinaryFile(document->data, document->length, batch->flags, &setup, error);
+				break;
+			
+			default:
+				if (error)
+				{
+					error->code = WexprErrorCodeUnknownDocumentFormat;
+					error->message = strdup ("Unknown document format");
+				}
+		}
+		
+		batch->results[i] = expr;
+	}
+	
+	// tables from the setup are left empty
+	if (setup.internTable)
+	{ wexpr_PrivateHashTable_destroy(setup.internTable); }
+}
+
+size_t wexpr_Expression_createFromBatch (
+	const WexprDocument* documents, size_t count, WexprParseFlags flags,
+	WexprExpression** results, WexprError* errors,
+	const WexprExecutor* executor
+)
+{
+	PrivateBatch batch;
+	batch.documents = documents;
+	batch.count = count;
+	batch.flags = flags;
+	batch.results = results;
+	batch.errors = errors;
+	
+	// big enough groups to reuse things, but enough of them to spread over the threads
+	batch.groupSize = count / 64;
+	if (batch.groupSize < 1)
+	{ batch.groupSize = 1; }
+	if (batch.groupSize > LIBWEXPR_PRIVATE_BATCH_MAXGROUPSIZE)
+	{ batch.groupSize = LIBWEXPR_PRIVATE_BATCH_MAXGROUPSIZE; }
+	
+	size_t groupCount = (count + batch.groupSize - 1) / batch.groupSize;
+	wexpr_Executor_parallelFor(executor, groupCount, &s_batch_parseGroup, &batch);
+	
+	size_t parsed = 0;
+	for (size_t i=0; i < count; ++i)
+	{
+		if (results[i])
+		{ ++parsed; }
+	}
+	
+	return parsed;
+}
+
+WexprExpression* wexpr_Expression_createInvalid (void)
+{
+	return s_Expression_alloc (WexprExpressionTypeInvalid);
+}
+
+WexprExpression* wexpr_Expression_createNull (void)
+{
+	return s_Expression_alloc (WexprExpressionTypeNull);
+}
+
+WexprExpression* wexpr_Expression_createValue (const char* val)
+{
+	WexprExpression* expr = wexpr_Expression_createNull();
+	if (expr)
+	{
+		wexpr_Expression_changeType(expr, WexprExpressionTypeValue);
+		wexpr_Expression_valueSet(expr, val);
+	}
+	
+	return expr;
+}
+
+WexprExpression* wexpr_Expression_createValueFromLengthString (const char* val, size_t length)
+{
+	WexprExpression* expr = wexpr_Expression_createNull();
+	if (expr)
+	{
+		wexpr_Expression_changeType(expr, WexprExpressionTypeValue);
+		wexpr_Expression_valueSetLengthString(expr, val, length);
+	}
+	
+	return expr;
+}
+
+WexprExpression* wexpr_Expression_createCopy (WexprExpression* rhs)
+{
+	WexprExpression* expr = wexpr_Expression_createNull();
+	
+	s_Expression_copyInto(expr, rhs);
+	
+	return expr; // you own
+}
+
+void wexpr_Expression_destroy (WexprExpression* self)
+{
+	if (!self)
+	{ return; }
+	
+	// shared expressions are only destroyed by their last owner
+	if (self->m_refCount > 1)
+	{
+		--(self->m_refCount);
+		return;
+	}
+	
+	// null doesnt store anything, so can use this to destroy it
+	wexpr_Expression_changeType(self, WexprExpressionTypeNull);
+	
+	free (self);
+}
+
+// --- Information
+
+WexprExpressionType wexpr_Expression_type (WexprExpression* self)
+{
+	return self->m_type;
+}
+
+void wexpr_Expression_changeType (WexprExpression* self, WexprExpressionType type)
+{
+	// first destroy
+	if (self->m_type == WexprExpressionTypeValue)
+	{
+		free (self->m_value.data);
+	}
+	
+	else if (self->m_type == WexprExpressionTypeBinaryData)
+	{
+		free(self->m_binaryData.data);
+		self->m_binaryData.size = 0;
+	}
+	
+	else if (self->m_type == WexprExpressionTypeArray)
+	{
+		struct sglib_WexprExpressionPrivateArrayElement_iterator it;
+		for (WexprExpressionPrivateArrayElement* list = sglib_WexprExpressionPrivateArrayElement_it_init(&it, self->m_array.list);
+			 list != NULL; list = sglib_WexprExpressionPrivateArrayElement_it_next(&it))
+		{
+			wexpr_Expression_destroy (list->expression);
+			free (list);
+		}
+		self->m_array.listCount = 0;
+	}
+	
+	else if (self->m_type == WexprExpressionTypeMap)
+	{
+		hashmap_iterate(self->m_map.hash, &s_freeHashData, NULL);
+		
+		hashmap_free (self->m_map.hash);
+	}
+	
+	// then set
+	self->m_type = type;
+	
+	// then init
+	if (self->m_type == WexprExpressionTypeValue)
+	{
+		self->m_value.data = NULL;
+		self->m_value.typed.kind = WexprPrivateTypedValueKindNone;
+	}
+	
+	else if (self->m_type == WexprExpressionTypeBinaryData)
+	{
+		self->m_binaryData.data = NULL;
+		self->m_binaryData.size = 0;
+	}
+	
+	else if (self->m_type == WexprExpressionTypeArray)
+	{
+		self->m_array.list = NULL;
+		self->m_array.listCount = 0;
+	}
+	
+	else if (self->m_type == WexprExpressionTypeMap)
+	{
+		self->m_map.hash = hashmap_new();
+	}
+}
+
+char* wexpr_Expression_createStringRepresentation (WexprExpression* self, size_t indent, WexprWriteFlags flags)
+{
+	return wexpr_Expression_createStringRepresentationWithExecutor (self, indent, flags, NULL);
+}
+
+char* wexpr_Expression_createStringRepresentationWithExecutor (WexprExpression* self, size_t indent, WexprWriteFlags flags,
+	const WexprExecutor* executor
+)
+{
+	WexprPrivateOutput out;
+	wexpr_PrivateOutput_initGrowable(&out, 256);
+	
+	s_Expression_writeStringRepresentationWithExecutor (self, flags, indent, executor, &out);
+	wexpr_PrivateOutput_writeChar(&out, 0); // null terminator
+	
+	if (out.failed)
+	{
+		// out of memory
+		free (out.buffer);
+		return NULL;
+	}
+	
+	return out.buffer;
+}
+
+size_t wexpr_Expression_stringRepresentationSize (WexprExpression* self, size_t indent, WexprWriteFlags flags)
+{
+	WexprPrivateOutput out;
+	wexpr_PrivateOutput_initCount(&out);
+	
+	p_wexpr_Expression_writeStringRepresentation (self, flags, indent, &out);
+	
+	return out.size;
+}
+
+bool wexpr_Expression_writeStringInto (WexprExpression* self, size_t indent, WexprWriteFlags flags,
+	char* buffer, size_t capacity, size_t* written
+)
+{
+	WexprPrivateOutput out;
+	wexpr_PrivateOutput_initFixed(&out, buffer, capacity);
+	
+	p_wexpr_Expression_writeStringRepresentation (self, flags, indent, &out);
+	wexpr_PrivateOutput_writeChar(&out, 0); // null terminator
+	
+	if (written)
+	{ *written = out.size - 1; } // without the terminator
+	
+	return !out.failed;
+}
+
+WexprMutableBuffer wexpr_Expression_createBinaryRepresentation (WexprExpression* self)
+{
+	return wexpr_Expression_createBinaryRepresentationWithFlags (self, WexprWriteFlagNone);
+}
+
+WexprMutableBuffer wexpr_Expression_createBinaryRepresentationWithFlags (WexprExpression* self, WexprWriteFlags flags)
+{
+	WexprBinaryWriteOptions options = WEXPR_BINARYWRITEOPTIONS_INIT(flags);
+	return wexpr_Expression_createBinaryRepresentationWithOptions (self, &options);
+}
+
+WexprMutableBuffer wexpr_Expression_createBinaryRepresentationWithOptions (WexprExpression* self, const WexprBinaryWriteOptions* options)
+{
+	WexprMutableBuffer buf;
+	buf.byteSize = 0;
+	buf.data = 0;
+	
+	if (s_binaryBlockCompression_wants(options))
+	{
+		// size isnt known until its compressed
+		WexprPrivateOutput out;
+		wexpr_PrivateOutput_initGrowable(&out, 0);
+		
+		if (s_Expression_writeBinaryBlockCompressed(self, options, &out) && !out.failed)
+		{
+			buf.data = out.buffer;
+			buf.byteSize = out.size;
+		}
+		else
+		{ free (out.buffer); }
+		
+		return buf;
+	}
+	
+	PrivateBinarySizes sizes;
+	size_t totalSize = s_Expression_prepareBinary(self, options, &sizes);
+	
+	if (totalSize != 0)
+	{
+		buf.data = malloc(totalSize);
+	}
+	
+	if (buf.data)
+	{
+		// exact size, so a fixed output always fits
+		WexprPrivateOutput out;
+		wexpr_PrivateOutput_initFixed(&out, buf.data, totalSize);
+		
+		if (s_Expression_writeBinaryFile(self, &sizes, &out))
+		{ buf.byteSize = out.size; }
+		else
+		{
+			free (buf.data);
+			buf.data = NULL;
+		}
+	}
+	
+	s_binarySizes_free(&sizes);
+	
+	return buf;
+}
+
+size_t wexpr_Expression_binaryRepresentationSize (WexprExpression* self, WexprWriteFlags flags)
+{
+	WexprBinaryWriteOptions options = WEXPR_BINARYWRITEOPTIONS_INIT(flags);
+	
+	PrivateBinarySizes sizes;
+	size_t totalSize = s_Expression_prepareBinary(self, &options, &sizes);
+	s_binarySizes_free(&sizes);
+	
+	return totalSize;
+}
+
+bool wexpr_Expression_writeBinaryInto (WexprExpression* self, WexprWriteFlags flags,
+	void* buffer, size_t capacity, size_t* written
+)
+{
+	WexprBinaryWriteOptions options = WEXPR_BINARYWRITEOPTIONS_INIT(flags);
+	
+	PrivateBinarySizes sizes;
+	size_t totalSize = s_Expression_prepareBinary(self, &options, &sizes);
+	
+	if (written)
+	{ *written = totalSize; }
+	
+	// check up front, so we dont write a partial chunk
+	bool success = (totalSize != 0 && totalSize <= capacity);
+	
+	if (success)
+	{
+		WexprPrivateOutput out;
+		wexpr_PrivateOutput_initFixed(&out, buffer, capacity);
+		
+		success = s_Expression_writeBinaryFile(self, &sizes, &out);
+	}
+	
+	s_binarySizes_free(&sizes);
+	
+	return success;
+}
+
+bool wexpr_Expression_writeText (WexprExpression* self, size_t indent, WexprWriteFlags flags, WexprSink* sink)
+{
+	return wexpr_Expression_writeTextWithExecutor (self, indent, flags, NULL, sink);
+}
+
+bool wexpr_Expression_writeTextWithExecutor (WexprExpression* self, size_t indent, WexprWriteFlags flags,
+	const WexprExecutor* executor, WexprSink* sink
+)
+{
+	void* buffer = malloc(WEXPR_PRIVATE_OUTPUT_SINKBUFFERSIZE);
+	
+	WexprPrivateOutput out;
+	wexpr_PrivateOutput_initSink(&out, sink, buffer, WEXPR_PRIVATE_OUTPUT_SINKBUFFERSIZE);
+	
+	if (buffer)
+	{ s_Expression_writeStringRepresentationWithExecutor(self, flags, indent, executor, &out); }
+	
+	bool success = wexpr_PrivateOutput_finish(&out);
+	free (buffer);
+	
+	return success;
+}
+
+bool wexpr_Expression_writeBinary (WexprExpression* self, WexprWriteFlags flags, WexprSink* sink)
+{
+	WexprBinaryWriteOptions options = WEXPR_BINARYWRITEOPTIONS_INIT(flags);
+	return wexpr_Expression_writeBinaryWithOptions (self, &options, sink);
+}
+
+bool wexpr_Expression_writeBinaryWithOptions (WexprExpression* self, const WexprBinaryWriteOptions* options, WexprSink* sink)
+{
+	if (s_binaryBlockCompression_wants(options))
+	{
+		void* buffer = malloc(WEXPR_PRIVATE_OUTPUT_SINKBUFFERSIZE);
+		
+		WexprPrivateOutput out;
+		wexpr_PrivateOutput_initSink(&out, sink, buffer, WEXPR_PRIVATE_OUTPUT_SINKBUFFERSIZE);
+		
+		bool wrote = (buffer && s_Expression_writeBinaryBlockCompressed(self, options, &out));
+		
+		bool success = wexpr_PrivateOutput_finish(&out) && wrote;
+		free (buffer);
+		
+		return success;
+	}
+	
+	PrivateBinarySizes sizes;
+	size_t totalSize = s_Expression_prepareBinary(self, options, &sizes);
+	
+	void* buffer = (totalSize != 0) ? malloc(WEXPR_PRIVATE_OUTPUT_SINKBUFFERSIZE) : NULL;
+	
+	WexprPrivateOutput out;
+	wexpr_PrivateOutput_initSink(&out, sink, buffer, WEXPR_PRIVATE_OUTPUT_SINKBUFFERSIZE);
+	
+	bool wrote = (buffer && s_Expression_writeBinaryFile(self, &sizes, &out));
+	
+	bool success = wexpr_PrivateOutput_finish(&out) && wrote;
+	free (buffer);
+	s_binarySizes_free(&sizes);
+	
+	return success;
+}
+
+typedef struct PrivateNodeStatsState
+{
+	WexprPrivateHashTable* visited; // shared expressions already counted -> their subtree count
+	size_t uniqueNodeCount;
+} PrivateNodeStatsState;
+
+typedef struct PrivateCountMapNodes
+{
+	PrivateNodeStatsState* state;
+	size_t count; // total so far
+} PrivateCountMapNodes;
+
+static size_t s_Expression_countNodes (WexprExpression* self, PrivateNodeStatsState* state);
+
+// NOLINTNEXTLINE(misc-no-recursion)
+static int s_countMapNodes (any_t userData, any_t data)
+{
+	PrivateCountMapNodes* ud = userData;
+	WexprExpressionPrivateMapElement* elem = data;
+	
+	ud->count += s_Expression_countNodes(elem->value, ud->state);
+	
+	return MAP_OK;
+}
+
+// returns the number of nodes in the subtree, counting shared ones each time
+// NOLINTNEXTLINE(misc-no-recursion)
+static size_t s_Expression_countNodes (WexprExpression* self, PrivateNodeStatsState* state)
+{
+	// only shared expressions can be reached twice, so only remember those
+	uint64_t hash = 0;
+	if (self->m_refCount > 1)
+	{
+		hash = wexpr_PrivateHashTable_hashPointer(self);
+		
+		void* found = wexpr_PrivateHashTable_find(state->visited, hash, self, NULL);
+		if (found)
+		{ return (size_t)(uintptr_t)found; }
+	}
+	
+	size_t count = 1;
+	state->uniqueNodeCount += 1;
+	
+	if (self->m_type == WexprExpressionTypeArray)
+	{
+		for (WexprExpressionPrivateArrayElement* list = self->m_array.list;
+			 list != NULL; list = list->next)
+		{
+			count += s_Expression_countNodes(list->expression, state);
+		}
+	}
+	
+	else if (self->m_type == WexprExpressionTypeMap)
+	{
+		PrivateCountMapNodes ud;
+		ud.state = state;
+		ud.count = 0;
+		
+		hashmap_iterate(self->m_map.hash, &s_countMapNodes, &ud);
+		count += ud.count;
+	}
+	
+	if (self->m_refCount > 1)
+	{
+		wexpr_PrivateHashTable_insert(state->visited, hash, self, (void*)(uintptr_t)count);
+	}
+	
+	return count;
+}
+
+WexprExpressionNodeStats wexpr_Expression_nodeStats (WexprExpression* self)
+{
+	WexprExpressionNodeStats stats;
+	stats.nodeCount = 0;
+	stats.uniqueNodeCount = 0;
+	
+	if (!self)
+	{ return stats; }
+	
+	PrivateNodeStatsState state;
+	state.visited = wexpr_PrivateHashTable_create();
+	state.uniqueNodeCount = 0;
+	
+	stats.nodeCount = s_Expression_countNodes(self, &state);
+	stats.uniqueNodeCount = state.uniqueNodeCount;
+	
+	wexpr_PrivateHashTable_destroy(state.visited);
+	
+	return stats;
+}
+
+static void s_Expression_unshareChildren (WexprExpression* self);
+
+// NOLINTNEXTLINE(misc-no-recursion)
+static int s_unshareMapValue (any_t userData, any_t data)
+{
+	(void)userData;
+	WexprExpressionPrivateMapElement* elem = data;
+	
+	s_Expression_unshareChildren(s_Expression_detach(&(elem->value)));
+	
+	return MAP_OK;
+}
+
+// Detach every shared child below self, the same way the accessors would when handing them out.
+// Keys using a shared value's data (keyOwner) are left alone, since reading a key never changes it.
+// NOLINTNEXTLINE(misc-no-recursion)
+static void s_Expression_unshareChildren (WexprExpression* self)
+{
+	if (self->m_type == WexprExpressionTypeArray)
+	{
+		for (WexprExpressionPrivateArrayElement* list = self->m_array.list;
+			 list != NULL; list = list->next)
 		{
-			size_t indentBytes = s_byteSizeForIndent(indent);
-			newSize += indentBytes;
-			newBuffer = realloc(newBuffer, newSize);
-			s_fillIndent(newBuffer+newSize-indentBytes, indent);
+			s_Expression_unshareChildren(s_Expression_detach(&(list->expression)));
 		}
+	}
+	
+	else if (self->m_type == WexprExpressionTypeMap)
+	{
+		hashmap_iterate(self->m_map.hash, &s_unshareMapValue, NULL);
+	}
+}
+
+void wexpr_Expression_unshare (WexprExpression* self)
+{
+	if (!self)
+	{ return; }
+	
+	s_Expression_unshareChildren(self);
+}
+
+// --- Value
+
+const char* wexpr_Expression_value (WexprExpression* self)
+{
+	if (self->m_type != WexprExpressionTypeValue)
+	{ return NULL; }
+	
+	return self->m_value.data;
+}
+
+void wexpr_Expression_valueSet (WexprExpression* self, const char* str)
+{
+	if (self->m_type != WexprExpressionTypeValue)
+	{ return; }
+	
+	free (self->m_value.data);
+	self->m_value.data = strdup(str);
+	self->m_value.typed.kind = WexprPrivateTypedValueKindNone;
+}
+
+void wexpr_Expression_valueSetLengthString (WexprExpression* self, const char* str, size_t length)
+{
+	if (self->m_type != WexprExpressionTypeValue)
+	{ return; }
+	
+	free (self->m_value.data);
+	self->m_value.data = malloc(length+1);
+	memcpy (self->m_value.data, str, length);
+	self->m_value.data[length] = 0;
+	self->m_value.typed.kind = WexprPrivateTypedValueKindNone;
+}
+
+bool wexpr_Expression_valueAsInt64 (WexprExpression* self, int64_t* result)
+{
+	if (self->m_type != WexprExpressionTypeValue)
+	{ return false; }
+	
+	if (self->m_value.typed.kind != WexprPrivateTypedValueKindNone)
+	{
+		if (self->m_value.typed.kind != WexprPrivateTypedValueKindInt64)
+		{ return false; }
+		
+		*result = self->m_value.typed.int64Value;
+		return true;
+	}
+	
+	return wexpr_PrivateTypedValue_parseInt64(self->m_value.data, strlen(self->m_value.data), result);
+}
+
+bool wexpr_Expression_valueAsDouble (WexprExpression* self, double* result)
+{
+	if (self->m_type != WexprExpressionTypeValue)
+	{ return false; }
+	
+	switch (self->m_value.typed.kind)
+	{
+		case WexprPrivateTypedValueKindInt64:
+			*result = (double)self->m_value.typed.int64Value;
+			return true;
 		
-		newSize += 1;
-		newBuffer = realloc(newBuffer, newSize);
-		newBuffer[newSize-1] = ')';
+		case WexprPrivateTypedValueKindFloat64:
+			*result = self->m_value.typed.float64Value;
+			return true;
+		
+		case WexprPrivateTypedValueKindBoolean:
+			return false;
+		
+		default:
+			return wexpr_PrivateTypedValue_parseFloat64(self->m_value.data, strlen(self->m_value.data), result);
+	}
+}
+
+bool wexpr_Expression_valueAsBool (WexprExpression* self, bool* result)
+{
+	if (self->m_type != WexprExpressionTypeValue)
+	{ return false; }
+	
+	if (self->m_value.typed.kind != WexprPrivateTypedValueKindNone)
+	{
+		if (self->m_value.typed.kind != WexprPrivateTypedValueKindBoolean)
+		{ return false; }
 		
-		// and done
-		return s_stringRef_createFromPointerSize(newBuffer, newSize);
+		*result = self->m_value.typed.booleanValue;
+		return true;
 	}
 	
-	else
-	{
-		fprintf (stderr, "p_wexpr_Expression_appendStringRepresentationToAllocatedBuffer() - Unknown type to generate string for\n");
-		abort();
-	}
+	return wexpr_PrivateTypedValue_parseBoolean(self->m_value.data, strlen(self->m_value.data), result);
 }
 
-// ---------------------- PUBLIC -----------------------------------
+void wexpr_Expression_valueSetInt64 (WexprExpression* self, int64_t value)
+{
+	if (self->m_type != WexprExpressionTypeValue)
+	{ return; }
+	
+	WexprPrivateTypedValue typed;
+	typed.kind = WexprPrivateTypedValueKindInt64;
+	typed.int64Value = value;
+	
+	s_Expression_valueSetTyped(self, &typed);
+}
 
-// --- Construction/Destruction
+void wexpr_Expression_valueSetDouble (WexprExpression* self, double value)
+{
+	if (self->m_type != WexprExpressionTypeValue)
+	{ return; }
+	
+	WexprPrivateTypedValue typed;
+	typed.kind = WexprPrivateTypedValueKindFloat64;
+	typed.float64Value = value;
+	
+	s_Expression_valueSetTyped(self, &typed);
+}
 
-WexprExpression* wexpr_Expression_createFromString (
-	const char* str, WexprParseFlags flags,
-	WexprError* error
-)
+void wexpr_Expression_valueSetBool (WexprExpression* self, bool value)
 {
-	return wexpr_Expression_createFromLengthString (
-		str, strlen(str), flags, error
-	);
+	if (self->m_type != WexprExpressionTypeValue)
+	{ return; }
+	
+	WexprPrivateTypedValue typed;
+	typed.kind = WexprPrivateTypedValueKindBoolean;
+	typed.booleanValue = value;
+	
+	s_Expression_valueSetTyped(self, &typed);
 }
 
-WexprExpression* wexpr_Expression_createFromStringWithExternalReferenceTable (
-	const char* str, WexprParseFlags flags,
-	struct WexprReferenceTable* referenceTable,
-	WexprError* error
-)
+// --- BinaryData
+
+const void* wexpr_Expression_binaryData_data (WexprExpression* self)
 {
-	return wexpr_Expression_createFromLengthStringWithExternalReferenceTable(
-		str, strlen(str), flags, referenceTable, error
-	);
+	if (self->m_type != WexprExpressionTypeBinaryData)
+	{ return NULL; }
+	
+	return self->m_binaryData.data;
 }
 
-WexprExpression* wexpr_Expression_createFromLengthString (
-	const char* str, size_t length, WexprParseFlags flags,
-	WexprError* error
-)
+size_t wexpr_Expression_binaryData_size (WexprExpression* self)
 {
-	return wexpr_Expression_createFromLengthStringWithExternalReferenceTable(
-		str, length, flags, NULL, error
-	);
+	if (self->m_type != WexprExpressionTypeBinaryData)
+	{ return 0; }
+	
+	return self->m_binaryData.size;
 }
 
-WexprExpression* wexpr_Expression_createFromLengthStringWithExternalReferenceTable (
-	const char* str, size_t length, WexprParseFlags flags,
-	struct WexprReferenceTable* referenceTable,
-	WexprError* error
-)
+void wexpr_Expression_binaryData_setValue (WexprExpression* self, const void* buffer, size_t byteSize)
 {
-	WexprExpression* expr = malloc (sizeof(WexprExpression));
-	expr->m_type = WexprExpressionTypeInvalid;
+	if (self->m_type != WexprExpressionTypeBinaryData)
+	{ return; }
 	
-	PrivateParserState parserState;
-	s_privateParserState_init (&parserState);
+	free(self->m_binaryData.data);
+	self->m_binaryData.size = byteSize;
+	self->m_binaryData.data = malloc(byteSize);
+	if (!self->m_binaryData.data)
+	{ return; } // unable to allocate
 	
-	// use the external ref table if it exists
-	parserState.externalReferenceMap = referenceTable;
+	memcpy (self->m_binaryData.data, buffer, byteSize);
+}
+
+// --- Array
+
+size_t wexpr_Expression_arrayCount (WexprExpression* self)
+{
+	if (self->m_type != WexprExpressionTypeArray)
+	{ return 0; }
 	
-	WexprError err = WEXPR_ERROR_INIT();
+	return self->m_array.listCount;
+}
+
+WexprExpression* wexpr_Expression_arrayAt (WexprExpression* self, size_t index)
+{
+	if (self->m_type != WexprExpressionTypeArray)
+	{ return NULL; }
 	
-	// we dont check that str is valid UTF8. Possibly TODO [WolfWexpr does].
-	if (true)
+	WexprExpressionPrivateArrayElement* elem = s_Expression_arrayElementAt(self, index);
+	if (!elem)
+	{ return NULL; } // Couldnt find, out of range.
+	
+	return s_Expression_detach(&(elem->expression));
+}
+
+void wexpr_Expression_arrayAddElementToEnd (WexprExpression* self, WexprExpression* element)
+{
+	if (self->m_type != WexprExpressionTypeArray)
+	{ return; }
+	
+	WexprExpressionPrivateArrayElement* elem = malloc(sizeof(WexprExpressionPrivateArrayElement));
+	elem->expression = element;
+	elem->next = NULL;
+	
+	if (self->m_array.listCount == 0)
 	{
-		// now start parsing
-		PrivateStringRef rest = s_Expression_parseFromString (expr, 
-			s_stringRef_createFromPointerSize(str, length),
-			flags, &parserState, &err
-		);
-		
-		PrivateStringRef postRest = s_trimFrontOfString (rest, &parserState);
-		
-		if (postRest.size != 0)
-		{
-			if (!err.code)
-			{
-				err.code = WexprErrorCodeExtraDataAfterParsingRoot;
-				err.message = strdup ("Extra data after parsing the root expression");
-				err.line = parserState.line;
-				err.column = parserState.column;
-			}
-		}
-		
-		if (expr->m_type == WexprExpressionTypeInvalid && err.code == WexprErrorCodeNone)
-		{
-			// we didnt get an expression and no error currently reported
-			err.code = WexprErrorCodeEmptyString;
-			err.message = strdup ("No expression found [remained invalid]");
-			err.line = parserState.line;
-			err.column = parserState.column;
-		}
+		self->m_array.list = elem;
 	}
 	else
 	{
-		if (!err.code)
-		{
-			err.code = WexprErrorCodeInvalidUTF8;
-			err.message = strdup ("Invalid UTF8");
-		}
-	}
-	
-	// cleanup our parser state
-	if (err.code != WexprErrorCodeNone)
-	{
-		wexpr_Expression_destroy(expr);
-		
-		if (error)
-		{
-			WEXPR_ERROR_MOVE(error, &err);
-		}
+		WexprExpressionPrivateArrayElement* head = self->m_array.list;
 		
-		WEXPR_ERROR_FREE (err);
+		while (head->next != NULL) { head = head->next; }
 		
-		s_privateParserState_free(&parserState);
+		head->next = elem;
+	}
+	
+	++(self->m_array.listCount);
+}
+
+// --- Map
+
+size_t wexpr_Expression_mapCount (WexprExpression* self)
+{
+	if (self->m_type != WexprExpressionTypeMap)
+	{ return 0; }
+	
+	return hashmap_length(self->m_map.hash);
+}
+
+const char* wexpr_Expression_mapKeyAt (WexprExpression* self, size_t index)
+{
+	if (!self || self->m_type != WexprExpressionTypeMap)
+	{ return NULL; } // not a map
+	
+	WexprExpressionPrivateMapElement* elem = s_Expression_mapElementAt(self, index);
+	
+	return elem ? elem->key : NULL;
+}
+
+WexprExpression* wexpr_Expression_mapValueAt (WexprExpression* self, size_t index)
+{
+	if (!self || self->m_type != WexprExpressionTypeMap)
+	{ return NULL; } // not a map
 		
-		return NULL;
+	WexprExpressionPrivateMapElement* elem = s_Expression_mapElementAt(self, index);
+	
+	return elem ? s_Expression_detach(&(elem->value)) : NULL;
+}
+
+WexprExpression* wexpr_Expression_mapValueForKey (WexprExpression* self, const char* key)
+{
+	if (!self || self->m_type != WexprExpressionTypeMap)
+	{ return NULL; } // not a map
+	
+	WexprExpressionPrivateMapElement* elem = NULL;
+	int res = hashmap_get (self->m_map.hash, (char*) key, (void**) &elem);
+	
+	if (res == MAP_OK && elem)
+	{
+		return s_Expression_detach(&(elem->value));
 	}
 	
-	s_privateParserState_free(&parserState);
+	return NULL;
+}
+
+WexprExpression* wexpr_Expression_mapValueForLengthKey (WexprExpression* self, const char* key, size_t length)
+{
+	// key has to be 0 terminated for our hash
+	// TODO: use stack functions for this if its short? then we dont have to hit memory
+	char* newKey = malloc(length+1);
+	memcpy (newKey, key, length);
+	newKey[length] = 0; // end terminator
 	
-	return expr;
+	WexprExpression* res = wexpr_Expression_mapValueForKey (self, newKey);
+	free (newKey);
+	
+	return res;
 }
 
-WexprExpression* wexpr_Expression_createFromBinaryChunk (
-	const void* data, size_t length, WexprError* error
-)
+void wexpr_Expression_mapSetValueForKey (WexprExpression* self, const char* key, WexprExpression* value)
+{
+	if (!self || self->m_type != WexprExpressionTypeMap)
+	{ return; }
+	
+	WexprExpressionPrivateMapElement* elem = malloc (sizeof(WexprExpressionPrivateMapElement));
+	elem->key = strdup(key);
+	elem->value = value;
+	elem->keyOwner = NULL;
+	
+	hashmap_put(self->m_map.hash, elem->key, elem);
+}
+
+void wexpr_Expression_mapSetValueForKeyLengthString (WexprExpression* self, const char* key, size_t length, WexprExpression* value)
+{
+	if (!self || self->m_type != WexprExpressionTypeMap)
+	{ return; }
+	
+	WexprExpressionPrivateMapElement* elem = malloc (sizeof(WexprExpressionPrivateMapElement));
+	elem->value = value;
+	elem->keyOwner = NULL;
+	elem->key = malloc(length+1);
+	memcpy (elem->key, key, length);
+	elem->key[length] = 0;
+	
+	hashmap_put(self->m_map.hash, elem->key, elem);
+}
+
+// --- Diff/Patch
+// A patch is itself an expression (see Documentation/Diff.md). Subtrees are compared with a structural (merkle)
+// hash, computed once per node, so identical subtrees are skipped without walking them again.
+
+typedef struct PrivateDiffState
+{
+	WexprPrivateHashTable* hashes; // node -> its structural hash
+	bool failed; // out of memory
+} PrivateDiffState;
+
+static uint64_t s_Expression_structuralHash (WexprExpression* self, PrivateDiffState* state);
+
+typedef struct PrivateMapStructuralHash
+{
+	PrivateDiffState* state;
+	uint64_t hash;
+} PrivateMapStructuralHash;
+
+// NOLINTNEXTLINE(misc-no-recursion)
+static int s_mapStructuralHash (any_t userData, any_t data)
+{
+	PrivateMapStructuralHash* ud = userData;
+	WexprExpressionPrivateMapElement* elem = data;
+	
+	// combine by adding so the order in the hash doesnt matter
+	ud->hash += wexpr_PrivateHashTable_hashBytesContinue(
+		s_Expression_structuralHash(elem->value, ud->state),
+		elem->key, strlen(elem->key)
+	);
+	
+	return MAP_OK;
+}
+
+// Hash of the whole subtree, so equal subtrees have equal hashes. Remembered per node.
+// NOLINTNEXTLINE(misc-no-recursion)
+static uint64_t s_Expression_structuralHash (WexprExpression* self, PrivateDiffState* state)
 {
-	WexprExpression* expr = malloc (sizeof(WexprExpression));
-	expr->m_type = WexprExpressionTypeInvalid;
+	uint64_t nodeHash = wexpr_PrivateHashTable_hashPointer(self);
+	void* found = wexpr_PrivateHashTable_find(state->hashes, nodeHash, self, NULL);
 	
-	WexprError err = WEXPR_ERROR_INIT();
+	if (found)
+	{ return (uint64_t)(uintptr_t)found; }
 	
-	WexprBuffer inBuf;
-	inBuf.data = data;
-	inBuf.byteSize = length;
+	uint8_t type = (uint8_t)self->m_type;
+	uint64_t hash = wexpr_PrivateHashTable_hashBytes(&type, sizeof(type));
 	
-	WexprBuffer buf = s_Expression_parseFromBinaryChunk (
-		expr, inBuf, &err
-	);
+	if (self->m_type == WexprExpressionTypeValue)
+	{
+		hash = wexpr_PrivateHashTable_hashBytesContinue(hash, self->m_value.data, strlen(self->m_value.data));
+	}
 	
-	(void) buf; // unused, remaining part of buffer
+	else if (self->m_type == WexprExpressionTypeBinaryData)
+	{
+		hash = wexpr_PrivateHashTable_hashBytesContinue(hash, self->m_binaryData.data, self->m_binaryData.size);
+	}
 	
-	if (err.code != WexprErrorCodeNone)
+	else if (self->m_type == WexprExpressionTypeArray)
 	{
-		wexpr_Expression_destroy (expr);
-		expr = NULL;
-		
-		if (error)
+		for (WexprExpressionPrivateArrayElement* list = self->m_array.list;
+			 list != NULL; list = list->next)
 		{
-			WEXPR_ERROR_MOVE(error, &err);
+			uint64_t childHash = s_Expression_structuralHash(list->expression, state);
+			hash = wexpr_PrivateHashTable_hashBytesContinue(hash, &childHash, sizeof(childHash));
 		}
+	}
+	
+	else if (self->m_type == WexprExpressionTypeMap)
+	{
+		PrivateMapStructuralHash ud;
+		ud.state = state;
+		ud.hash = hash;
 		
-		WEXPR_ERROR_FREE (err);
+		hashmap_iterate(self->m_map.hash, &s_mapStructuralHash, &ud);
+		hash = ud.hash;
 	}
 	
-	return expr;
+	// stored as the value, which cant be null (and might only be pointer sized)
+	hash = (uint64_t)(uintptr_t)hash;
+	if (hash == 0)
+	{ hash = 1; }
+	
+	if (!wexpr_PrivateHashTable_insert(state->hashes, nodeHash, self, (void*)(uintptr_t)hash))
+	{ state->failed = true; }
+	
+	return hash;
 }
 
-WexprExpression* wexpr_Expression_createInvalid (void)
+static bool s_Expression_structurallyEquals (WexprExpression* lhs, WexprExpression* rhs, PrivateDiffState* state);
+
+typedef struct PrivateMapStructurallyEquals
 {
-	WexprExpression* expr = malloc (sizeof(WexprExpression));
-	expr->m_type = WexprExpressionTypeInvalid;
-	
-	return expr;
-}
+	PrivateDiffState* state;
+	WexprExpression* other;
+} PrivateMapStructurallyEquals;
 
-WexprExpression* wexpr_Expression_createNull (void)
+// NOLINTNEXTLINE(misc-no-recursion)
+static int s_mapStructurallyEquals (any_t userData, any_t data)
 {
-	WexprExpression* expr = malloc (sizeof(WexprExpression));
-	expr->m_type = WexprExpressionTypeNull;
+	PrivateMapStructurallyEquals* ud = userData;
+	WexprExpressionPrivateMapElement* elem = data;
 	
-	return expr;
+	WexprExpressionPrivateMapElement* otherElem = NULL;
+	if (hashmap_get(ud->other->m_map.hash, elem->key, (void**)&otherElem) != MAP_OK || !otherElem
+		|| !s_Expression_structurallyEquals(elem->value, otherElem->value, ud->state))
+	{ return !MAP_OK; } // different, stop
+	
+	return MAP_OK;
 }
 
-WexprExpression* wexpr_Expression_createValue (const char* val)
+// True if the subtrees are the same. Different hashes are different without looking further,
+// and the same hash is confirmed (so a collision can't lose a change).
+// NOLINTNEXTLINE(misc-no-recursion)
+static bool s_Expression_structurallyEquals (WexprExpression* lhs, WexprExpression* rhs, PrivateDiffState* state)
 {
-	WexprExpression* expr = wexpr_Expression_createNull();
-	if (expr)
+	if (lhs == rhs)
+	{ return true; } // shared
+	
+	if (lhs->m_type != rhs->m_type
+		|| s_Expression_structuralHash(lhs, state) != s_Expression_structuralHash(rhs, state))
+	{ return false; }
+	
+	switch (lhs->m_type)
 	{
-		wexpr_Expression_changeType(expr, WexprExpressionTypeValue);
-		wexpr_Expression_valueSet(expr, val);
+		case WexprExpressionTypeValue:
+		case WexprExpressionTypeBinaryData:
+			return s_Expression_contentEquals(lhs, rhs);
+		
+		case WexprExpressionTypeArray:
+		{
+			if (lhs->m_array.listCount != rhs->m_array.listCount)
+			{ return false; }
+			
+			const WexprExpressionPrivateArrayElement* l = lhs->m_array.list;
+			const WexprExpressionPrivateArrayElement* r = rhs->m_array.list;
+			
+			for (; l != NULL && r != NULL; l = l->next, r = r->next)
+			{
+				if (!s_Expression_structurallyEquals(l->expression, r->expression, state))
+				{ return false; }
+			}
+			
+			return true;
+		}
+		
+		case WexprExpressionTypeMap:
+		{
+			if (hashmap_length(lhs->m_map.hash) != hashmap_length(rhs->m_map.hash))
+			{ return false; }
+			
+			PrivateMapStructurallyEquals ud;
+			ud.state = state;
+			ud.other = rhs;
+			
+			return hashmap_iterate(lhs->m_map.hash, &s_mapStructurallyEquals, &ud) == MAP_OK;
+		}
+		
+		default:
+			return true;
 	}
+}
+
+// @(replace <copy of expr>)
+static WexprExpression* s_Patch_createReplace (WexprExpression* expr)
+{
+	WexprExpression* patch = wexpr_Expression_createNull();
+	wexpr_Expression_changeType(patch, WexprExpressionTypeMap);
+	wexpr_Expression_mapSetValueForKey(patch, "replace", wexpr_Expression_createCopy(expr));
 	
-	return expr;
+	return patch;
 }
 
-WexprExpression* wexpr_Expression_createValueFromLengthString (const char* val, size_t length)
+// key -> value in the map, creating the map if needed
+static void s_Patch_addToMap (WexprExpression** map, const char* key, WexprExpression* value)
 {
-	WexprExpression* expr = wexpr_Expression_createNull();
-	if (expr)
+	if (!*map)
 	{
-		wexpr_Expression_changeType(expr, WexprExpressionTypeValue);
-		wexpr_Expression_valueSetLengthString(expr, val, length);
+		*map = wexpr_Expression_createNull();
+		wexpr_Expression_changeType(*map, WexprExpressionTypeMap);
 	}
 	
-	return expr;
+	wexpr_Expression_mapSetValueForKey(*map, key, value);
 }
 
-WexprExpression* wexpr_Expression_createCopy (WexprExpression* rhs)
+// @(<kind> @(...)), or null if nothing changed
+static WexprExpression* s_Patch_wrap (const char* kind, WexprExpression* changes)
 {
-	WexprExpression* expr = wexpr_Expression_createNull();
+	if (!changes)
+	{ return NULL; }
 	
-	s_Expression_copyInto(expr, rhs);
+	WexprExpression* patch = wexpr_Expression_createNull();
+	wexpr_Expression_changeType(patch, WexprExpressionTypeMap);
+	wexpr_Expression_mapSetValueForKey(patch, kind, changes);
 	
-	return expr; // you own
+	return patch;
 }
 
-void wexpr_Expression_destroy (WexprExpression* self)
-{
-	// null doesnt store anything, so can use this to destroy it
-	if (self)
-	{
-		wexpr_Expression_changeType(self, WexprExpressionTypeNull);
-	}
-	
-	free (self);
-}
+static WexprExpression* s_Expression_diff (WexprExpression* from, WexprExpression* to, PrivateDiffState* state);
 
-// --- Information
+typedef struct PrivateMapDiff
+{
+	PrivateDiffState* state;
+	WexprExpression* other; // the map being compared with
+	WexprExpression* update; // key -> patch, if any
+	WexprExpression* remove; // keys, if any
+} PrivateMapDiff;
 
-WexprExpressionType wexpr_Expression_type (WexprExpression* self)
+// for each key in the new map: a patch if its value changed, or a replace if its new
+// NOLINTNEXTLINE(misc-no-recursion)
+static int s_mapDiffNewPair (any_t userData, any_t data)
 {
-	return self->m_type;
+	PrivateMapDiff* ud = userData;
+	WexprExpressionPrivateMapElement* elem = data;
+	
+	WexprExpressionPrivateMapElement* oldElem = NULL;
+	WexprExpression* childPatch = NULL;
+	
+	if (hashmap_get(ud->other->m_map.hash, elem->key, (void**)&oldElem) == MAP_OK && oldElem)
+	{ childPatch = s_Expression_diff(oldElem->value, elem->value, ud->state); }
+	else
+	{ childPatch = s_Patch_createReplace(elem->value); }
+	
+	if (childPatch)
+	{ s_Patch_addToMap(&ud->update, elem->key, childPatch); }
+	
+	return MAP_OK;
 }
 
-void wexpr_Expression_changeType (WexprExpression* self, WexprExpressionType type)
+// for each key in the old map: removed if its not in the new one
+static int s_mapDiffOldPair (any_t userData, any_t data)
 {
-	// first destroy
-	if (self->m_type == WexprExpressionTypeValue)
-	{
-		free (self->m_value.data);
-	}
-	
-	else if (self->m_type == WexprExpressionTypeBinaryData)
-	{
-		free(self->m_binaryData.data);
-		self->m_binaryData.size = 0;
-	}
+	PrivateMapDiff* ud = userData;
+	WexprExpressionPrivateMapElement* elem = data;
 	
-	else if (self->m_type == WexprExpressionTypeArray)
+	WexprExpressionPrivateMapElement* newElem = NULL;
+	if (hashmap_get(ud->other->m_map.hash, elem->key, (void**)&newElem) != MAP_OK || !newElem)
 	{
-		struct sglib_WexprExpressionPrivateArrayElement_iterator it;
-		for (WexprExpressionPrivateArrayElement* list = sglib_WexprExpressionPrivateArrayElement_it_init(&it, self->m_array.list);
-			 list != NULL; list = sglib_WexprExpressionPrivateArrayElement_it_next(&it))
+		if (!ud->remove)
 		{
-			wexpr_Expression_destroy (list->expression);
-			free (list);
+			ud->remove = wexpr_Expression_createNull();
+			wexpr_Expression_changeType(ud->remove, WexprExpressionTypeArray);
 		}
-		self->m_array.listCount = 0;
-	}
-	
-	else if (self->m_type == WexprExpressionTypeMap)
-	{
-		hashmap_iterate(self->m_map.hash, &s_freeHashData, NULL);
 		
-		hashmap_free (self->m_map.hash);
+		wexpr_Expression_arrayAddElementToEnd(ud->remove, wexpr_Expression_createValue(elem->key));
 	}
 	
-	// then set
-	self->m_type = type;
+	return MAP_OK;
+}
+
+// NOLINTNEXTLINE(misc-no-recursion)
+static WexprExpression* s_Expression_diffMap (WexprExpression* from, WexprExpression* to, PrivateDiffState* state)
+{
+	PrivateMapDiff ud;
+	ud.state = state;
+	ud.update = NULL;
+	ud.remove = NULL;
 	
-	// then init
-	if (self->m_type == WexprExpressionTypeValue)
-	{
-		self->m_value.data = NULL;
-	}
+	ud.other = from;
+	hashmap_iterate(to->m_map.hash, &s_mapDiffNewPair, &ud);
 	
-	else if (self->m_type == WexprExpressionTypeBinaryData)
-	{
-		self->m_binaryData.data = NULL;
-		self->m_binaryData.size = 0;
-	}
+	ud.other = to;
+	hashmap_iterate(from->m_map.hash, &s_mapDiffOldPair, &ud);
 	
-	else if (self->m_type == WexprExpressionTypeArray)
-	{
-		self->m_array.list = NULL;
-		self->m_array.listCount = 0;
-	}
+	WexprExpression* changes = NULL;
 	
-	else if (self->m_type == WexprExpressionTypeMap)
-	{
-		self->m_map.hash = hashmap_new();
-	}
+	if (ud.update)
+	{ s_Patch_addToMap(&changes, "update", ud.update); }
+	
+	if (ud.remove)
+	{ s_Patch_addToMap(&changes, "remove", ud.remove); }
+	
+	return s_Patch_wrap("map", changes);
 }
 
-char* wexpr_Expression_createStringRepresentation (WexprExpression* self, size_t indent, WexprWriteFlags flags)
+// #(<index> <count>) or similar
+static WexprExpression* s_Patch_createIndexPair (size_t index, WexprExpression* second)
 {
-	PrivateStringRef ref = p_wexpr_Expression_appendStringRepresentationToAllocatedBuffer (self, flags,
-		/*indent*/ indent,
-		/*buffer*/ s_StringRef_createInvalid()
-	);
+	char indexStr[32];
+	snprintf (indexStr, sizeof(indexStr), "%zu", index);
 	
-	// reallocate the for the null
-	char* buf = realloc( (void*)ref.ptr, ref.size+1);
-	buf[ref.size] = 0;
+	WexprExpression* pair = wexpr_Expression_createNull();
+	wexpr_Expression_changeType(pair, WexprExpressionTypeArray);
+	wexpr_Expression_arrayAddElementToEnd(pair, wexpr_Expression_createValue(indexStr));
+	wexpr_Expression_arrayAddElementToEnd(pair, second);
 	
-	return buf;
+	return pair;
 }
 
-WexprMutableBuffer wexpr_Expression_createBinaryRepresentation (WexprExpression* self)
+// Arrays keep their common start and end, pair up whats left in the middle (patching each),
+// and insert or remove the rest. So inserting/removing a run anywhere, or changing elements in place, are small.
+// NOLINTNEXTLINE(misc-no-recursion)
+static WexprExpression* s_Expression_diffArray (WexprExpression* from, WexprExpression* to, PrivateDiffState* state)
 {
-	WexprMutableBuffer buf;
-	buf.byteSize = 0;
-	buf.data = 0;
+	size_t fromCount = from->m_array.listCount;
+	size_t toCount = to->m_array.listCount;
 	
-	WexprExpressionType type = wexpr_Expression_type(self);
-	
-	#define BUFCAST(buf, position, type) ((type)((uint8_t*)buf+(position)))
-	
-	if (type == WexprExpressionTypeNull)
+	WexprExpression** fromElements = malloc((fromCount + toCount + 1) * sizeof(WexprExpression*));
+	if (!fromElements)
 	{
-		size_t sizeSize = wexpr_uvlq64_bytesize(0);
-		
-		// data is 0x0
-		buf.byteSize = sizeSize + sizeof(uint8_t);
-		buf.data = realloc(buf.data, buf.byteSize);
-		
-		wexpr_uvlq64_write ( (uint8_t*)(buf.data) + 0, sizeSize, 0);
-		*BUFCAST (buf.data, sizeSize, uint8_t*) = 0x00;
+		state->failed = true;
+		return NULL;
 	}
 	
-	else if (type == WexprExpressionTypeValue)
-	{
-		const char* val = wexpr_Expression_value(self);
-		size_t valLength = strlen(val);
-		
-		size_t sizeSize = wexpr_uvlq64_bytesize(valLength);
-		
-		buf.byteSize = sizeSize + sizeof(uint8_t) + valLength;
-		buf.data = realloc(buf.data, buf.byteSize);
-		
-		wexpr_uvlq64_write ((uint8_t*)(buf.data) + 0, sizeSize, valLength);
-		*BUFCAST (buf.data, sizeSize, uint8_t*) = 0x01;
-		memcpy ((uint8_t*)buf.data + sizeSize + 1, val, valLength);
-	}
+	WexprExpression** toElements = fromElements + fromCount;
 	
-	else if (type == WexprExpressionTypeArray)
+	size_t i = 0;
+	for (WexprExpressionPrivateArrayElement* list = from->m_array.list; list != NULL; list = list->next)
+	{ fromElements[i++] = list->expression; }
+	
+	i = 0;
+	for (WexprExpressionPrivateArrayElement* list = to->m_array.list; list != NULL; list = list->next)
+	{ toElements[i++] = list->expression; }
+	
+	size_t common = (fromCount < toCount) ? fromCount : toCount;
+	
+	size_t prefix = 0;
+	while (prefix < common && s_Expression_structurallyEquals(fromElements[prefix], toElements[prefix], state))
+	{ ++prefix; }
+	
+	size_t suffix = 0;
+	while (suffix < common - prefix
+		&& s_Expression_structurallyEquals(fromElements[fromCount - 1 - suffix], toElements[toCount - 1 - suffix], state))
+	{ ++suffix; }
+	
+	size_t fromMiddle = fromCount - prefix - suffix;
+	size_t toMiddle = toCount - prefix - suffix;
+	size_t paired = (fromMiddle < toMiddle) ? fromMiddle : toMiddle;
+	
+	WexprExpression* changes = NULL;
+	WexprExpression* update = NULL;
+	
+	for (i = prefix; i < prefix + paired; ++i)
 	{
-		// first pass, figure out the total size
-		size_t sizeOfArrayContents = 0;
-		const size_t len = wexpr_Expression_arrayCount(self);
-		for (size_t i=0; i < len; ++i)
-		{
-			// TODO: dont create the entire representation twice - ability to ask for size
-			WexprMutableBuffer childBuffer = wexpr_Expression_createBinaryRepresentation(
-				wexpr_Expression_arrayAt(self, i)
-			);
-			
-			sizeOfArrayContents += childBuffer.byteSize;
-			free (childBuffer.data);
-		}
-		
-		size_t sizeSize = wexpr_uvlq64_bytesize(sizeOfArrayContents);
-		
-		// header
-		buf.byteSize = sizeSize + sizeof(uint8_t) + sizeOfArrayContents;
-		buf.data = realloc(buf.data, buf.byteSize);
+		WexprExpression* childPatch = s_Expression_diff(fromElements[i], toElements[i], state);
 		
-		wexpr_uvlq64_write ((uint8_t*)(buf.data) + 0, sizeSize, sizeOfArrayContents);
-		*BUFCAST (buf.data, sizeSize, uint8_t*) = 0x02; // write the array buffer
-		
-		// data
-		size_t curPos = sizeSize+1;
-		for (size_t i=0; i < len; ++i)
+		if (childPatch)
 		{
-			WexprMutableBuffer childBuffer = wexpr_Expression_createBinaryRepresentation(
-				wexpr_Expression_arrayAt(self, i)
-			);
+			char indexStr[32];
+			snprintf (indexStr, sizeof(indexStr), "%zu", i);
 			
-			memcpy ((uint8_t*)buf.data + curPos, childBuffer.data, childBuffer.byteSize);
-			
-			free (childBuffer.data);
-			curPos += childBuffer.byteSize;
+			s_Patch_addToMap(&update, indexStr, childPatch);
 		}
-		
-		// done
 	}
 	
-	else if (type == WexprExpressionTypeMap)
+	if (update)
+	{ s_Patch_addToMap(&changes, "update", update); }
+	
+	if (fromMiddle > toMiddle)
 	{
-		// first pass, figure out total size
-		size_t sizeOfMapContents = 0;
-		const size_t len = wexpr_Expression_mapCount(self);
-		
-		for (size_t i=0; i < len; ++i)
-		{
-			// TODO: dont create the entire representation twice - ability to ask for sizes
-			const char* mapKey = wexpr_Expression_mapKeyAt(self, i);
-			size_t mapKeyLen = strlen(mapKey);
-			
-			// write the map key as a new value
-			size_t keySizeSize = wexpr_uvlq64_bytesize(mapKeyLen);
-			size_t keySize = keySizeSize + sizeof(uint8_t) + mapKeyLen;
-			sizeOfMapContents += keySize;
-			
-			// write the map value
-			WexprExpression* mapValue = wexpr_Expression_mapValueAt(self, i);
-			WexprMutableBuffer childBuffer = wexpr_Expression_createBinaryRepresentation(
-				mapValue
-			);
-			sizeOfMapContents += childBuffer.byteSize;
-			free (childBuffer.data);
-		}
+		char countStr[32];
+		snprintf (countStr, sizeof(countStr), "%zu", fromMiddle - toMiddle);
 		
-		// second pass, write the header and pairs
-		
-		size_t sizeSize = wexpr_uvlq64_bytesize(sizeOfMapContents);
-		
-		// key value pairs
-		buf.byteSize = sizeSize + sizeof(uint8_t) + sizeOfMapContents;
-		buf.data = realloc(buf.data, buf.byteSize);
-		wexpr_uvlq64_write ((uint8_t*)(buf.data) + 0, sizeSize, sizeOfMapContents);
-		*BUFCAST (buf.data, sizeSize, uint8_t*) = 0x03; // write the map buffer
-		
-		size_t curPos = sizeSize+1;
-		for (size_t i=0; i < len; ++i)
-		{
-			const char* mapKey = wexpr_Expression_mapKeyAt(self, i);
-			size_t mapKeyLen = strlen(mapKey);
-			
-			// write the map key as a new value
-			size_t keySizeSize = wexpr_uvlq64_bytesize(mapKeyLen);
-			size_t keySize = keySizeSize + sizeof(uint8_t) + mapKeyLen;
-			
-			wexpr_uvlq64_write ((uint8_t*)(buf.data) + curPos, keySizeSize, mapKeyLen);
-			*BUFCAST (buf.data, curPos + keySizeSize, uint8_t*) = 0x01;
-			memcpy ((uint8_t*)buf.data + curPos + keySizeSize + 1, mapKey, mapKeyLen);
-		
-			curPos += keySize;
-			
-			// write the map value
-			WexprExpression* mapValue = wexpr_Expression_mapValueAt(self, i);
-			WexprMutableBuffer childBuffer = wexpr_Expression_createBinaryRepresentation(
-				mapValue
-			);
-			
-			memcpy ((uint8_t*)buf.data + curPos, childBuffer.data, childBuffer.byteSize);
-			
-			free (childBuffer.data);
-			curPos += childBuffer.byteSize;
-		}
-		
-		// done
+		s_Patch_addToMap(&changes, "remove", s_Patch_createIndexPair(prefix + paired, wexpr_Expression_createValue(countStr)));
 	}
 	
-	else if (type == WexprExpressionTypeBinaryData)
+	else if (toMiddle > fromMiddle)
 	{
-		const void* data = wexpr_Expression_binaryData_data(self);
-		size_t dataSize = wexpr_Expression_binaryData_size(self);
+		WexprExpression* inserted = wexpr_Expression_createNull();
+		wexpr_Expression_changeType(inserted, WexprExpressionTypeArray);
 		
-		size_t sizeSize = wexpr_uvlq64_bytesize(dataSize+1); // 1 byte for compression method
+		for (i = prefix + paired; i < prefix + toMiddle; ++i)
+		{ wexpr_Expression_arrayAddElementToEnd(inserted, wexpr_Expression_createCopy(toElements[i])); }
 		
-		buf.byteSize = sizeSize + sizeof(uint8_t) + sizeof(uint8_t) + dataSize;
-		buf.data = realloc(buf.data, buf.byteSize);
-		
-		wexpr_uvlq64_write ((uint8_t*)(buf.data) + 0, sizeSize, dataSize+1);
-		
-		*BUFCAST (buf.data, sizeSize, uint8_t*) = 0x04;
-		*BUFCAST (buf.data, sizeSize+1, uint8_t*) = 0x00; // for now, only raw (no compression)
-		memcpy ((uint8_t*)buf.data + sizeSize+1+1, data, dataSize);
+		s_Patch_addToMap(&changes, "insert", s_Patch_createIndexPair(prefix + paired, inserted));
 	}
 	
-	#undef BUFCAST
-
-	return buf;
+	free (fromElements);
+	
+	return s_Patch_wrap("array", changes);
 }
 
-// --- Value
-
-const char* wexpr_Expression_value (WexprExpression* self)
+// Patch turning from into to, or null if they're the same.
+// NOLINTNEXTLINE(misc-no-recursion)
+static WexprExpression* s_Expression_diff (WexprExpression* from, WexprExpression* to, PrivateDiffState* state)
 {
-	if (self->m_type != WexprExpressionTypeValue)
+	if (s_Expression_structurallyEquals(from, to, state))
 	{ return NULL; }
 	
-	return self->m_value.data;
+	if (from->m_type == to->m_type && to->m_type == WexprExpressionTypeMap)
+	{ return s_Expression_diffMap(from, to, state); }
+	
+	if (from->m_type == to->m_type && to->m_type == WexprExpressionTypeArray)
+	{ return s_Expression_diffArray(from, to, state); }
+	
+	return s_Patch_createReplace(to);
 }
 
-void wexpr_Expression_valueSet (WexprExpression* self, const char* str)
+// --- applying
+
+typedef struct PrivatePatchState
 {
-	if (self->m_type != WexprExpressionTypeValue)
-	{ return; }
-	
-	free (self->m_value.data);
-	self->m_value.data = strdup(str);
-}
+	bool apply; // false to only check the patch
+	WexprError* error;
+} PrivatePatchState;
 
-void wexpr_Expression_valueSetLengthString (WexprExpression* self, const char* str, size_t length)
+static bool s_Patch_fail (PrivatePatchState* state, const char* message)
 {
-	if (self->m_type != WexprExpressionTypeValue)
-	{ return; }
-	
-	free (self->m_value.data);
-	self->m_value.data = malloc(length+1);
-	memcpy (self->m_value.data, str, length);
-	self->m_value.data[length] = 0;
+	if (state->error && state->error->code == WexprErrorCodeNone)
+	{
+		state->error->code = WexprErrorCodeInvalidPatch;
+		state->error->message = strdup(message);
+	}
+	
+	return false;
 }
 
-// --- BinaryData
+// read a decimal index from a value
+static bool s_Patch_readIndex (const char* str, size_t* index)
+{
+	int64_t value = 0;
+	
+	// digits only, and no leading zeros so each index has one spelling
+	if (!str || str[0] < '0' || str[0] > '9' || (str[0] == '0' && str[1] != '\0'))
+	{ return false; }
+	
+	if (!wexpr_PrivateTypedValue_parseInt64(str, strlen(str), &value) || value < 0)
+	{ return false; }
+	
+	*index = (size_t)value;
+	return true;
+}
 
-const void* wexpr_Expression_binaryData_data (WexprExpression* self)
+// value for the key in a patch, without detaching it (patches are only read)
+static WexprExpression* s_Patch_valueForKey (WexprExpression* self, const char* key)
 {
-	if (self->m_type != WexprExpressionTypeBinaryData)
+	WexprExpressionPrivateMapElement* elem = NULL;
+	
+	if (hashmap_get(self->m_map.hash, (char*)key, (void**)&elem) != MAP_OK || !elem)
 	{ return NULL; }
 	
-	return self->m_binaryData.data;
+	return elem->value;
 }
 
-size_t wexpr_Expression_binaryData_size (WexprExpression* self)
+// read #(<index> <second>)
+static bool s_Patch_readIndexPair (WexprExpression* pair, size_t* index, WexprExpression** second)
 {
-	if (self->m_type != WexprExpressionTypeBinaryData)
-	{ return 0; }
+	if (pair->m_type != WexprExpressionTypeArray || pair->m_array.listCount != 2)
+	{ return false; }
 	
-	return self->m_binaryData.size;
+	*second = pair->m_array.list->next->expression;
+	return s_Patch_readIndex(wexpr_Expression_value(pair->m_array.list->expression), index);
 }
 
-void wexpr_Expression_binaryData_setValue (WexprExpression* self, const void* buffer, size_t byteSize)
+// replace the content of self with a copy of expr
+static void s_Expression_replaceWithCopy (WexprExpression* self, WexprExpression* expr)
 {
-	if (self->m_type != WexprExpressionTypeBinaryData)
-	{ return; }
+	WexprExpression* copy = wexpr_Expression_createCopy(expr); // first, in case expr is within self
 	
-	free(self->m_binaryData.data);
-	self->m_binaryData.size = byteSize;
-	self->m_binaryData.data = malloc(byteSize);
-	if (!self->m_binaryData.data)
-	{ return; } // unable to allocate
+	wexpr_Expression_changeType(self, WexprExpressionTypeNull);
+	s_Expression_shareInto(self, copy);
 	
-	memcpy (self->m_binaryData.data, buffer, byteSize);
+	wexpr_Expression_destroy(copy);
 }
 
-// --- Array
+static bool s_Expression_applyPatch (WexprExpression* self, WexprExpression* patch, PrivatePatchState* state);
 
-size_t wexpr_Expression_arrayCount (WexprExpression* self)
+typedef struct PrivateMapPatch
 {
-	if (self->m_type != WexprExpressionTypeArray)
-	{ return 0; }
-	
-	return self->m_array.listCount;
-}
+	WexprExpression* self;
+	PrivatePatchState* state;
+	bool success;
+} PrivateMapPatch;
 
-WexprExpression* wexpr_Expression_arrayAt (WexprExpression* self, size_t index)
+// NOLINTNEXTLINE(misc-no-recursion)
+static int s_mapApplyUpdate (any_t userData, any_t data)
 {
-	if (self->m_type != WexprExpressionTypeArray)
-	{ return NULL; }
+	PrivateMapPatch* ud = userData;
+	WexprExpressionPrivateMapElement* patchElem = data;
 	
-	for (WexprExpressionPrivateArrayElement* list = self->m_array.list;
-		 list != NULL; list = list->next)
+	WexprExpressionPrivateMapElement* elem = NULL;
+	if (hashmap_get(ud->self->m_map.hash, patchElem->key, (void**)&elem) == MAP_OK && elem)
 	{
-		if (index == 0)
-		{ return list->expression; }
+		WexprExpression* child = ud->state->apply ? s_Expression_detach(&(elem->value)) : elem->value;
+		ud->success = s_Expression_applyPatch(child, patchElem->value, ud->state);
+	}
+	
+	else
+	{
+		// a new key, which has to be a replace
+		WexprExpression* replacement = (patchElem->value->m_type == WexprExpressionTypeMap)
+			? s_Patch_valueForKey(patchElem->value, "replace")
+			: NULL;
 		
-		--index;
+		if (!replacement || hashmap_length(patchElem->value->m_map.hash) != 1)
+		{ ud->success = s_Patch_fail(ud->state, "Patch changes a key which isn't in the map"); }
+		
+		else if (ud->state->apply)
+		{ wexpr_Expression_mapSetValueForKey(ud->self, patchElem->key, wexpr_Expression_createCopy(replacement)); }
 	}
 	
-	// Couldnt find, out of range.
-	return NULL;
+	return ud->success ? MAP_OK : !MAP_OK;
 }
 
-void wexpr_Expression_arrayAddElementToEnd (WexprExpression* self, WexprExpression* element)
+// NOLINTNEXTLINE(misc-no-recursion)
+static bool s_Expression_applyMapPatch (WexprExpression* self, WexprExpression* changes, PrivatePatchState* state)
 {
-	if (self->m_type != WexprExpressionTypeArray)
-	{ return; }
+	if (self->m_type != WexprExpressionTypeMap)
+	{ return s_Patch_fail(state, "Map patch for an expression which isn't a map"); }
 	
-	WexprExpressionPrivateArrayElement* elem = malloc(sizeof(WexprExpressionPrivateArrayElement));
-	elem->expression = element;
-	elem->next = NULL;
+	WexprExpression* update = s_Patch_valueForKey(changes, "update");
+	WexprExpression* remove = s_Patch_valueForKey(changes, "remove");
 	
-	if (self->m_array.listCount == 0)
+	if ((update && update->m_type != WexprExpressionTypeMap) || (remove && remove->m_type != WexprExpressionTypeArray))
+	{ return s_Patch_fail(state, "Invalid map patch"); }
+	
+	if (remove)
 	{
-		self->m_array.list = elem;
+		for (WexprExpressionPrivateArrayElement* list = remove->m_array.list; list != NULL; list = list->next)
+		{
+			WexprExpressionPrivateMapElement* elem = NULL;
+			const char* key = wexpr_Expression_value(list->expression);
+			
+			bool found = key && hashmap_get(self->m_map.hash, (char*)key, (void**)&elem) == MAP_OK && elem;
+			
+			if (!state->apply)
+			{
+				if (!found)
+				{ return s_Patch_fail(state, "Patch removes a key which isn't in the map"); }
+				
+				if (update && s_Patch_valueForKey(update, key))
+				{ return s_Patch_fail(state, "Patch removes and changes the same key"); }
+			}
+			
+			else if (found) // already removed if listed twice
+			{
+				hashmap_remove(self->m_map.hash, elem->key);
+				s_freeHashData(NULL, elem);
+			}
+		}
 	}
-	else
+	
+	if (update)
 	{
-		WexprExpressionPrivateArrayElement* head = self->m_array.list;
+		PrivateMapPatch ud;
+		ud.self = self;
+		ud.state = state;
+		ud.success = true;
 		
-		while (head->next != NULL) { head = head->next; }
+		hashmap_iterate(update->m_map.hash, &s_mapApplyUpdate, &ud);
 		
-		head->next = elem;
+		if (!ud.success)
+		{ return false; }
 	}
 	
-	++(self->m_array.listCount);
-}
-
-// --- Map
-
-size_t wexpr_Expression_mapCount (WexprExpression* self)
-{
-	if (self->m_type != WexprExpressionTypeMap)
-	{ return 0; }
-	
-	return hashmap_length(self->m_map.hash);
+	return true;
 }
 
-typedef struct PrivateGetKeyValueAtIndex
+typedef struct PrivateArrayPatch
 {
-	size_t index; // the index we're requesting
-	void* result; // will be null if not found, or a value if found.
-} PrivateGetKeyValueAtIndex;
+	WexprExpressionPrivateArrayElement** elements; // by index
+	size_t count;
+	PrivatePatchState* state;
+	bool success;
+} PrivateArrayPatch;
 
-static int s_getKeyAtIndex (any_t userData, any_t data)
+// NOLINTNEXTLINE(misc-no-recursion)
+static int s_arrayApplyUpdate (any_t userData, any_t data)
 {
-	PrivateGetKeyValueAtIndex* ud = userData;
-	WexprExpressionPrivateMapElement* elem = data;
+	PrivateArrayPatch* ud = userData;
+	WexprExpressionPrivateMapElement* patchElem = data;
+	
+	size_t index = 0;
+	
+	if (!s_Patch_readIndex(patchElem->key, &index) || index >= ud->count)
+	{ ud->success = s_Patch_fail(ud->state, "Patch changes an index which isn't in the array"); }
 	
-	if (ud->index == 0)
-	{
-		ud->result = elem->key;
-		return !MAP_OK; // exit
-	}
 	else
 	{
-		ud->index -= 1;
+		WexprExpressionPrivateArrayElement* elem = ud->elements[index];
+		WexprExpression* child = ud->state->apply ? s_Expression_detach(&(elem->expression)) : elem->expression;
+		
+		ud->success = s_Expression_applyPatch(child, patchElem->value, ud->state);
 	}
 	
-	return MAP_OK;
+	return ud->success ? MAP_OK : !MAP_OK;
 }
 
-static int s_getValueAtIndex (any_t userData, any_t data)
+// NOLINTNEXTLINE(misc-no-recursion)
+static bool s_Expression_applyArrayPatch (WexprExpression* self, WexprExpression* changes, PrivatePatchState* state)
 {
-	PrivateGetKeyValueAtIndex* ud = userData;
-	WexprExpressionPrivateMapElement* elem = data;
+	if (self->m_type != WexprExpressionTypeArray)
+	{ return s_Patch_fail(state, "Array patch for an expression which isn't an array"); }
 	
-	if (ud->index == 0)
+	WexprExpression* update = s_Patch_valueForKey(changes, "update");
+	WexprExpression* remove = s_Patch_valueForKey(changes, "remove");
+	WexprExpression* insert = s_Patch_valueForKey(changes, "insert");
+	
+	size_t count = self->m_array.listCount;
+	
+	size_t removeIndex = 0;
+	WexprExpression* removeCountExpr = NULL;
+	size_t removeCount = 0;
+	
+	size_t insertIndex = 0;
+	WexprExpression* inserted = NULL;
+	
+	if ((update && update->m_type != WexprExpressionTypeMap)
+		|| (remove && (!s_Patch_readIndexPair(remove, &removeIndex, &removeCountExpr) || !s_Patch_readIndex(wexpr_Expression_value(removeCountExpr), &removeCount)))
+		|| (insert && (!s_Patch_readIndexPair(insert, &insertIndex, &inserted) || inserted->m_type != WexprExpressionTypeArray)))
+	{ return s_Patch_fail(state, "Invalid array patch"); }
+	
+	// updates are by the original index, then the remove, then the insert
+	if (update && hashmap_length(update->m_map.hash) != 0)
 	{
-		ud->result = elem->value;
-		return !MAP_OK; // exit
+		PrivateArrayPatch ud;
+		ud.elements = malloc(count * sizeof(WexprExpressionPrivateArrayElement*));
+		ud.count = count;
+		ud.state = state;
+		ud.success = true;
+		
+		if (!ud.elements)
+		{ return s_Patch_fail(state, "Out of memory"); }
+		
+		size_t i = 0;
+		for (WexprExpressionPrivateArrayElement* list = self->m_array.list; list != NULL; list = list->next)
+		{ ud.elements[i++] = list; }
+		
+		hashmap_iterate(update->m_map.hash, &s_arrayApplyUpdate, &ud);
+		free (ud.elements);
+		
+		if (!ud.success)
+		{ return false; }
 	}
-	else
+	
+	if (remove)
 	{
-		ud->index -= 1;
+		if (removeIndex > count || removeCount > count - removeIndex)
+		{ return s_Patch_fail(state, "Patch removes elements which aren't in the array"); }
+		
+		if (state->apply)
+		{
+			WexprExpressionPrivateArrayElement** slot = &self->m_array.list;
+			for (size_t i=0; i < removeIndex; ++i)
+			{ slot = &((*slot)->next); }
+			
+			for (size_t i=0; i < removeCount; ++i)
+			{
+				WexprExpressionPrivateArrayElement* removed = *slot;
+				*slot = removed->next;
+				
+				wexpr_Expression_destroy(removed->expression);
+				free (removed);
+			}
+			
+			self->m_array.listCount -= removeCount;
+		}
+		
+		count -= removeCount;
 	}
 	
-	return MAP_OK;
+	if (insert)
+	{
+		if (insertIndex > count)
+		{ return s_Patch_fail(state, "Patch inserts past the end of the array"); }
+		
+		if (state->apply)
+		{
+			WexprExpressionPrivateArrayElement** slot = &self->m_array.list;
+			for (size_t i=0; i < insertIndex; ++i)
+			{ slot = &((*slot)->next); }
+			
+			for (WexprExpressionPrivateArrayElement* list = inserted->m_array.list; list != NULL; list = list->next)
+			{
+				WexprExpressionPrivateArrayElement* lelem = malloc(sizeof(WexprExpressionPrivateArrayElement));
+				lelem->expression = wexpr_Expression_createCopy(list->expression);
+				lelem->next = *slot;
+				
+				*slot = lelem;
+				slot = &lelem->next;
+			}
+			
+			self->m_array.listCount += inserted->m_array.listCount;
+		}
+	}
+	
+	return true;
 }
 
-const char* wexpr_Expression_mapKeyAt (WexprExpression* self, size_t index)
+// NOLINTNEXTLINE(misc-no-recursion)
+static bool s_Expression_applyPatch (WexprExpression* self, WexprExpression* patch, PrivatePatchState* state)
 {
-	if (!self || self->m_type != WexprExpressionTypeMap)
-	{ return NULL; } // not a map
+	if (patch->m_type != WexprExpressionTypeMap || hashmap_length(patch->m_map.hash) > 1)
+	{ return s_Patch_fail(state, "A patch must be a map with one operation"); }
 	
-	PrivateGetKeyValueAtIndex val;
-	val.index = index;
-	val.result = NULL;
+	if (hashmap_length(patch->m_map.hash) == 0)
+	{ return true; } // no change
 	
-	hashmap_iterate (self->m_map.hash, &s_getKeyAtIndex, &val);
+	WexprExpressionPrivateMapElement* operation = s_Expression_mapElementAt(patch, 0);
 	
-	return val.result;
-}
-
-WexprExpression* wexpr_Expression_mapValueAt (WexprExpression* self, size_t index)
-{
-	if (!self || self->m_type != WexprExpressionTypeMap)
-	{ return NULL; } // not a map
+	if (strcmp(operation->key, "replace") == 0)
+	{
+		if (state->apply)
+		{ s_Expression_replaceWithCopy(self, operation->value); }
 		
-	PrivateGetKeyValueAtIndex val;
-	val.index = index;
-	val.result = NULL;
+		return true;
+	}
 	
-	hashmap_iterate (self->m_map.hash, &s_getValueAtIndex, &val);
+	if (operation->value->m_type != WexprExpressionTypeMap)
+	{ return s_Patch_fail(state, "Invalid patch operation"); }
 	
-	return val.result;
+	if (strcmp(operation->key, "map") == 0)
+	{ return s_Expression_applyMapPatch(self, operation->value, state); }
+	
+	if (strcmp(operation->key, "array") == 0)
+	{ return s_Expression_applyArrayPatch(self, operation->value, state); }
+	
+	return s_Patch_fail(state, "Unknown patch operation");
 }
 
-WexprExpression* wexpr_Expression_mapValueForKey (WexprExpression* self, const char* key)
+WexprExpression* wexpr_Expression_createDiff (WexprExpression* from, WexprExpression* to)
 {
-	if (!self || self->m_type != WexprExpressionTypeMap)
-	{ return NULL; } // not a map
+	PrivateDiffState state;
+	state.hashes = wexpr_PrivateHashTable_create();
+	state.failed = (state.hashes == NULL);
 	
-	WexprExpressionPrivateMapElement* elem = NULL;
-	int res = hashmap_get (self->m_map.hash, (char*) key, (void**) &elem);
+	WexprExpression* patch = NULL;
 	
-	if (res == MAP_OK && elem)
+	if (!state.failed)
+	{ patch = s_Expression_diff(from, to, &state); }
+	
+	wexpr_PrivateHashTable_destroy(state.hashes);
+	
+	if (state.failed)
 	{
-		return elem->value;
+		wexpr_Expression_destroy(patch);
+		return NULL;
 	}
 	
-	return NULL;
+	if (!patch)
+	{
+		// the same, so an empty patch
+		patch = wexpr_Expression_createNull();
+		wexpr_Expression_changeType(patch, WexprExpressionTypeMap);
+	}
+	
+	return patch;
 }
 
-WexprExpression* wexpr_Expression_mapValueForLengthKey (WexprExpression* self, const char* key, size_t length)
+bool wexpr_Expression_applyPatch (WexprExpression* self, WexprExpression* patch, WexprError* error)
 {
-	// key has to be 0 terminated for our hash
-	// TODO: use stack functions for this if its short? then we dont have to hit memory
-	char* newKey = malloc(length+1);
-	memcpy (newKey, key, length);
-	newKey[length] = 0; // end terminator
+	PrivatePatchState state;
+	state.apply = false;
+	state.error = error;
 	
-	WexprExpression* res = wexpr_Expression_mapValueForKey (self, newKey);
-	free (newKey);
+	// check it all first, so a bad patch doesnt leave it half changed
+	if (!s_Expression_applyPatch(self, patch, &state))
+	{ return false; }
 	
-	return res;
+	state.apply = true;
+	return s_Expression_applyPatch(self, patch, &state);
 }
 
-void wexpr_Expression_mapSetValueForKey (WexprExpression* self, const char* key, WexprExpression* value)
+// --- Path
+// Evaluated here since it needs the expression internals. Compiled in Path.c.
+
+typedef struct PrivatePathResults
 {
-	if (!self || self->m_type != WexprExpressionTypeMap)
-	{ return; }
+	const WexprPath* path;
+	WexprExpression** results;
+	size_t capacity;
+	size_t count; // total found
+	bool stopAtFirst;
+} PrivatePathResults;
+
+static bool s_Path_evaluateStep (PrivatePathResults* state, size_t stepIndex, WexprExpression* expr);
+
+typedef struct PrivatePathAnyValue
+{
+	PrivatePathResults* state;
+	size_t stepIndex; // of the step after
+} PrivatePathAnyValue;
+
+// NOLINTNEXTLINE(misc-no-recursion)
+static int s_pathAnyValue (any_t userData, any_t data)
+{
+	PrivatePathAnyValue* ud = userData;
+	WexprExpressionPrivateMapElement* elem = data;
 	
-	WexprExpressionPrivateMapElement* elem = malloc (sizeof(WexprExpressionPrivateMapElement));
-	elem->key = strdup(key);
-	elem->value = value;
+	return s_Path_evaluateStep(ud->state, ud->stepIndex, s_Expression_detach(&(elem->value))) ? MAP_OK : !MAP_OK;
+}
+
+// Match the steps from stepIndex on against expr. Returns false to stop.
+// NOLINTNEXTLINE(misc-no-recursion)
+static bool s_Path_evaluateStep (PrivatePathResults* state, size_t stepIndex, WexprExpression* expr)
+{
+	if (stepIndex == state->path->stepCount)
+	{
+		if (state->count < state->capacity)
+		{ state->results[state->count] = expr; }
+		
+		++state->count;
+		return !state->stopAtFirst;
+	}
 	
-	hashmap_put(self->m_map.hash, elem->key, elem);
+	const WexprPrivatePathStep* step = &state->path->steps[stepIndex];
+	
+	switch (step->type)
+	{
+		case WexprPrivatePathStepTypeKey:
+		{
+			WexprExpressionPrivateMapElement* elem = NULL;
+			
+			if (expr->m_type == WexprExpressionTypeMap
+				&& hashmap_get_prehashed(expr->m_map.hash, step->key, step->keyHash, (void**)&elem) == MAP_OK && elem)
+			{ return s_Path_evaluateStep(state, stepIndex + 1, s_Expression_detach(&(elem->value))); }
+			
+			return true;
+		}
+		
+		case WexprPrivatePathStepTypeIndex:
+		{
+			WexprExpressionPrivateArrayElement* elem = (expr->m_type == WexprExpressionTypeArray)
+				? s_Expression_arrayElementAt(expr, step->index)
+				: NULL;
+			
+			if (elem)
+			{ return s_Path_evaluateStep(state, stepIndex + 1, s_Expression_detach(&(elem->expression))); }
+			
+			return true;
+		}
+		
+		case WexprPrivatePathStepTypeAnyValue:
+		{
+			if (expr->m_type != WexprExpressionTypeMap)
+			{ return true; }
+			
+			PrivatePathAnyValue ud;
+			ud.state = state;
+			ud.stepIndex = stepIndex + 1;
+			
+			return hashmap_iterate(expr->m_map.hash, &s_pathAnyValue, &ud) == MAP_OK;
+		}
+		
+		case WexprPrivatePathStepTypeAnyElement:
+		{
+			if (expr->m_type != WexprExpressionTypeArray)
+			{ return true; }
+			
+			for (WexprExpressionPrivateArrayElement* list = expr->m_array.list; list != NULL; list = list->next)
+			{
+				if (!s_Path_evaluateStep(state, stepIndex + 1, s_Expression_detach(&(list->expression))))
+				{ return false; }
+			}
+			
+			return true;
+		}
+		
+		default:
+			return true;
+	}
 }
 
-void wexpr_Expression_mapSetValueForKeyLengthString (WexprExpression* self, const char* key, size_t length, WexprExpression* value)
+size_t wexpr_Path_evaluate (const WexprPath* self, WexprExpression* expr, WexprExpression** results, size_t resultCapacity)
 {
-	if (!self || self->m_type != WexprExpressionTypeMap)
-	{ return; }
+	PrivatePathResults state;
+	state.path = self;
+	state.results = results;
+	state.capacity = results ? resultCapacity : 0;
+	state.count = 0;
+	state.stopAtFirst = false;
 	
-	WexprExpressionPrivateMapElement* elem = malloc (sizeof(WexprExpressionPrivateMapElement));
-	elem->value = value;
-	elem->key = malloc(length+1);
-	memcpy (elem->key, key, length);
-	elem->key[length] = 0;
+	if (self && expr)
+	{ s_Path_evaluateStep(&state, 0, expr); }
 	
-	hashmap_put(self->m_map.hash, elem->key, elem);
+	return state.count;
+}
+
+WexprExpression* wexpr_Path_evaluateFirst (const WexprPath* self, WexprExpression* expr)
+{
+	WexprExpression* result = NULL;
+	
+	PrivatePathResults state;
+	state.path = self;
+	state.results = &result;
+	state.capacity = 1;
+	state.count = 0;
+	state.stopAtFirst = true;
+	
+	if (self && expr)
+	{ s_Path_evaluateStep(&state, 0, expr); }
+	
+	return result;
 }
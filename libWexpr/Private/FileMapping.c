@@ -0,0 +1,181 @@
+//
+/// \file libWexpr/FileMapping.c
+/// \brief Read only view of a file's contents, mapped when possible
+//
+// #LICENSE_BEGIN:MIT#
+// 
+// Copyright (c) 2017-2020, Kenneth Perry (thothonegan)
+// 
+// Permission is hereby granted, free of charge, to any person obtaining
+// a copy of this software and associated documentation files (the
+// "Software"), to deal in the Software without restriction, including
+// without limitation the rights to use, copy, modify, merge, publish,
+// distribute, sublicense, and/or sell copies of the Software, and to
+// permit persons to whom the Software is furnished to do so, subject to
+// the following conditions:
+// 
+// The above copyright notice and this permission notice shall be
+// included in all copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+// MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+// NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+// LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+// OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+// WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+// 
+// SPDX-License-Identifier: MIT
+// #LICENSE_END#
+//
+
+#include "FileMapping.h"
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#if !defined(_WIN32)
+	#include <fcntl.h>
+	#include <sys/mman.h>
+	#include <sys/stat.h>
+	#include <unistd.h>
+#endif
+
+// --- private
+
+// read the rest of the file into an allocated buffer. Works for anything (pipes, etc), just slower.
+static bool s_fileMapping_readAll (WexprPrivateFileMapping* self, FILE* file)
+{
+	char* buffer = NULL;
+	size_t size = 0;
+	size_t capacity = 0;
+	
+	for (;;)
+	{
+		if (size == capacity)
+		{
+			size_t newCapacity = capacity ? capacity * 2 : 64 * 1024;
+			char* newBuffer = realloc(buffer, newCapacity);
+			if (!newBuffer)
+			{
+				free (buffer);
+				errno = ENOMEM;
+				return false;
+			}
+			
+			buffer = newBuffer;
+			capacity = newCapacity;
+		}
+		
+		size_t amountRead = fread(buffer + size, 1, capacity - size, file);
+		size += amountRead;
+		
+		if (amountRead == 0)
+		{
+			if (ferror(file))
+			{
+				free (buffer);
+				errno = EIO;
+				return false;
+			}
+			
+			break; // eof
+		}
+	}
+	
+	self->data = buffer;
+	self->size = size;
+	self->isMapped = false;
+	
+	return true;
+}
+
+#if !defined(_WIN32)
+
+// try mapping a regular file. Returns false if it cant be mapped (but might be readable).
+static bool s_fileMapping_map (WexprPrivateFileMapping* self, int fd)
+{
+	struct stat info;
+	if (fstat(fd, &info) != 0 || !S_ISREG(info.st_mode) || info.st_size <= 0)
+	{ return false; } // empty files cant be mapped, and others aren't seekable
+	
+	size_t size = (size_t)info.st_size;
+	
+	void* data = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+	if (data == MAP_FAILED)
+	{ return false; }
+	
+#if defined(MADV_SEQUENTIAL)
+	// we parse front to back, so let the kernel read ahead aggressively
+	madvise (data, size, MADV_SEQUENTIAL);
+#endif
+	
+	self->data = data;
+	self->size = size;
+	self->isMapped = true;
+	
+	return true;
+}
+
+#endif // !_WIN32
+
+// --- public
+
+bool wexpr_PrivateFileMapping_open (WexprPrivateFileMapping* self, const char* path)
+{
+	self->data = NULL;
+	self->size = 0;
+	self->isMapped = false;
+	
+#if !defined(_WIN32)
+	int fd = open(path, O_RDONLY);
+	if (fd < 0)
+	{ return false; }
+	
+	if (s_fileMapping_map(self, fd))
+	{
+		close (fd); // the mapping stays valid
+		return true;
+	}
+	
+	FILE* file = fdopen(fd, "rb");
+	if (!file)
+	{
+		int savedErrno = errno;
+		close (fd);
+		errno = savedErrno;
+		return false;
+	}
+#else
+	FILE* file = fopen(path, "rb");
+	if (!file)
+	{ return false; }
+#endif
+	
+	bool success = s_fileMapping_readAll(self, file);
+	
+	int savedErrno = errno;
+	fclose (file);
+	errno = savedErrno;
+	
+	return success;
+}
+
+void wexpr_PrivateFileMapping_close (WexprPrivateFileMapping* self)
+{
+#if !defined(_WIN32)
+	if (self->isMapped)
+	{
+		munmap ((void*)self->data, self->size);
+	}
+	else
+#endif
+	{
+		free ((void*)self->data);
+	}
+	
+	self->data = NULL;
+	self->size = 0;
+	self->isMapped = false;
+}
@@ -0,0 +1,66 @@
+//
+/// \file libWexpr/FileMapping.h
+/// \brief Read only view of a file's contents, mapped when possible
+//
+// #LICENSE_BEGIN:MIT#
+// 
+// Copyright (c) 2017-2020, Kenneth Perry (thothonegan)
+// 
+// Permission is hereby granted, free of charge, to any person obtaining
+// a copy of this software and associated documentation files (the
+// "Software"), to deal in the Software without restriction, including
+// without limitation the rights to use, copy, modify, merge, publish,
+// distribute, sublicense, and/or sell copies of the Software, and to
+// permit persons to whom the Software is furnished to do so, subject to
+// the following conditions:
+// 
+// The above copyright notice and this permission notice shall be
+// included in all copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+// MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+// NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+// LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+// OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+// WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+// 
+// SPDX-License-Identifier: MIT
+// #LICENSE_END#
+//
+
+#ifndef LIBWEXPR_FILEMAPPING_H
+#define LIBWEXPR_FILEMAPPING_H
+
+#include <libWexpr/Macros.h>
+
+#include <stdbool.h>
+#include <stddef.h>
+
+LIBWEXPR_EXTERN_C_BEGIN()
+
+//
+/// \brief The contents of a file. Memory mapped when the platform and file allow it,
+/// otherwise read into an allocated buffer.
+//
+typedef struct WexprPrivateFileMapping
+{
+	const void* data; ///< The contents. Not null terminated.
+	size_t size; ///< Size of data in bytes
+	bool isMapped; ///< data is a mapping (vs allocated)
+} WexprPrivateFileMapping;
+
+//
+/// \brief Open the file at path and make its contents available.
+/// \return true on success. On failure, errno is set to the reason.
+//
+bool wexpr_PrivateFileMapping_open (WexprPrivateFileMapping* self, const char* path);
+
+//
+/// \brief Release the contents. data is invalid after this.
+//
+void wexpr_PrivateFileMapping_close (WexprPrivateFileMapping* self);
+
+LIBWEXPR_EXTERN_C_END()
+
+#endif // LIBWEXPR_FILEMAPPING_H
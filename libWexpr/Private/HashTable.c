@@ -0,0 +1,233 @@
+//
+/// \file libWexpr/HashTable.c
+/// \brief Small open addressing hash table used internally
+//
+// #LICENSE_BEGIN:MIT#
+// 
+// Copyright (c) 2017-2020, Kenneth Perry (thothonegan)
+// 
+// Permission is hereby granted, free of charge, to any person obtaining
+// a copy of this software and associated documentation files (the
+// "Software"), to deal in the Software without restriction, including
+// without limitation the rights to use, copy, modify, merge, publish,
+// distribute, sublicense, and/or sell copies of the Software, and to
+// permit persons to whom the Software is furnished to do so, subject to
+// the following conditions:
+// 
+// The above copyright notice and this permission notice shall be
+// included in all copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+// MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+// NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+// LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+// OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+// WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+// 
+// SPDX-License-Identifier: MIT
+// #LICENSE_END#
+//
+
+#include "HashTable.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+// --- structures
+
+typedef struct WexprPrivateHashTableEntry
+{
+	uint64_t hash;
+	const void* key; // null if the slot is empty
+	void* value;
+} WexprPrivateHashTableEntry;
+
+struct WexprPrivateHashTable
+{
+	WexprPrivateHashTableEntry* m_entries;
+	size_t m_capacity; // always a power of two
+	size_t m_count;
+};
+
+static const size_t s_initialCapacity = 16;
+
+static const uint64_t s_fnvOffsetBasis = 14695981039346656037ULL;
+static const uint64_t s_fnvPrime = 1099511628211ULL;
+
+// --- private
+
+static bool s_hashTable_keysEqual (const void* lhs, const void* rhs, WexprPrivateHashTableEqualsCallback equals)
+{
+	if (lhs == rhs)
+	{ return true; }
+	
+	return (equals != LIBWEXPR_NULLPTR && equals(lhs, rhs));
+}
+
+static WexprPrivateHashTableEntry* s_hashTable_findEntry (WexprPrivateHashTable* self, uint64_t hash, const void* key, WexprPrivateHashTableEqualsCallback equals)
+{
+	size_t mask = self->m_capacity - 1;
+	
+	// linear probing, the table is never more than half full so this always ends
+	for (size_t i = (size_t)hash & mask; ; i = (i + 1) & mask)
+	{
+		WexprPrivateHashTableEntry* entry = &(self->m_entries[i]);
+		
+		if (entry->key == LIBWEXPR_NULLPTR)
+		{ return LIBWEXPR_NULLPTR; } // empty slot - not found
+		
+		if (entry->hash == hash && s_hashTable_keysEqual(entry->key, key, equals))
+		{ return entry; }
+	}
+}
+
+static void s_hashTable_place (WexprPrivateHashTableEntry* entries, size_t capacity, WexprPrivateHashTableEntry entry)
+{
+	size_t mask = capacity - 1;
+	size_t i = (size_t)entry.hash & mask;
+	
+	while (entries[i].key != LIBWEXPR_NULLPTR)
+	{ i = (i + 1) & mask; }
+	
+	entries[i] = entry;
+}
+
+static bool s_hashTable_grow (WexprPrivateHashTable* self)
+{
+	size_t newCapacity = self->m_capacity * 2;
+	WexprPrivateHashTableEntry* newEntries = calloc(newCapacity, sizeof(WexprPrivateHashTableEntry));
+	if (!newEntries)
+	{ return false; }
+	
+	for (size_t i=0; i < self->m_capacity; ++i)
+	{
+		if (self->m_entries[i].key != LIBWEXPR_NULLPTR)
+		{ s_hashTable_place(newEntries, newCapacity, self->m_entries[i]); }
+	}
+	
+	free (self->m_entries);
+	self->m_entries = newEntries;
+	self->m_capacity = newCapacity;
+	
+	return true;
+}
+
+// --- Construction/Destruction
+
+WexprPrivateHashTable* wexpr_PrivateHashTable_create (void)
+{
+	WexprPrivateHashTable* self = malloc(sizeof(WexprPrivateHashTable));
+	if (!self)
+	{ return LIBWEXPR_NULLPTR; }
+	
+	self->m_entries = calloc(s_initialCapacity, sizeof(WexprPrivateHashTableEntry));
+	self->m_capacity = s_initialCapacity;
+	self->m_count = 0;
+	
+	if (!self->m_entries)
+	{
+		free (self);
+		return LIBWEXPR_NULLPTR;
+	}
+	
+	return self;
+}
+
+void wexpr_PrivateHashTable_destroy (WexprPrivateHashTable* self)
+{
+	if (!self)
+	{ return; }
+	
+	free (self->m_entries);
+	free (self);
+}
+
+void wexpr_PrivateHashTable_clear (WexprPrivateHashTable* self)
+{
+	memset (self->m_entries, 0, self->m_capacity * sizeof(WexprPrivateHashTableEntry));
+	self->m_count = 0;
+}
+
+// --- Entries
+
+void* wexpr_PrivateHashTable_find (WexprPrivateHashTable* self, uint64_t hash, const void* key, WexprPrivateHashTableEqualsCallback equals)
+{
+	WexprPrivateHashTableEntry* entry = s_hashTable_findEntry(self, hash, key, equals);
+	
+	return entry ? entry->value : LIBWEXPR_NULLPTR;
+}
+
+void** wexpr_PrivateHashTable_findSlot (WexprPrivateHashTable* self, uint64_t hash, const void* key, WexprPrivateHashTableEqualsCallback equals)
+{
+	WexprPrivateHashTableEntry* entry = s_hashTable_findEntry(self, hash, key, equals);
+	
+	return entry ? &(entry->value) : LIBWEXPR_NULLPTR;
+}
+
+bool wexpr_PrivateHashTable_insert (WexprPrivateHashTable* self, uint64_t hash, const void* key, void* value)
+{
+	// keep at most half full so probes stay short
+	if ((self->m_count + 1) * 2 > self->m_capacity)
+	{
+		if (!s_hashTable_grow(self))
+		{ return false; }
+	}
+	
+	WexprPrivateHashTableEntry entry;
+	entry.hash = hash;
+	entry.key = key;
+	entry.value = value;
+	
+	s_hashTable_place(self->m_entries, self->m_capacity, entry);
+	++(self->m_count);
+	
+	return true;
+}
+
+size_t wexpr_PrivateHashTable_count (WexprPrivateHashTable* self)
+{
+	return self->m_count;
+}
+
+void wexpr_PrivateHashTable_iterate (WexprPrivateHashTable* self, WexprPrivateHashTableIterateCallback callback, void* userData)
+{
+	for (size_t i=0; i < self->m_capacity; ++i)
+	{
+		WexprPrivateHashTableEntry* entry = &(self->m_entries[i]);
+		
+		if (entry->key != LIBWEXPR_NULLPTR)
+		{ callback(userData, entry->key, entry->value); }
+	}
+}
+
+// --- Hashing
+
+uint64_t wexpr_PrivateHashTable_hashBytes (const void* data, size_t byteSize)
+{
+	return wexpr_PrivateHashTable_hashBytesContinue(s_fnvOffsetBasis, data, byteSize);
+}
+
+uint64_t wexpr_PrivateHashTable_hashBytesContinue (uint64_t hash, const void* data, size_t byteSize)
+{
+	const uint8_t* bytes = data;
+	
+	for (size_t i=0; i < byteSize; ++i)
+	{
+		hash ^= bytes[i];
+		hash *= s_fnvPrime;
+	}
+	
+	return hash;
+}
+
+uint64_t wexpr_PrivateHashTable_hashPointer (const void* ptr)
+{
+	// splitmix64 finalizer - pointers are aligned so the low bits alone are bad hashes
+	uint64_t x = (uint64_t)(uintptr_t)ptr;
+	x ^= x >> 30; x *= 0xbf58476d1ce4e5b9ULL;
+	x ^= x >> 27; x *= 0x94d049bb133111ebULL;
+	x ^= x >> 31;
+	
+	return x;
+}
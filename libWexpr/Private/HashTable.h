@@ -0,0 +1,139 @@
+//
+/// \file libWexpr/HashTable.h
+/// \brief Small open addressing hash table used internally
+//
+// #LICENSE_BEGIN:MIT#
+// 
+// Copyright (c) 2017-2020, Kenneth Perry (thothonegan)
+// 
+// Permission is hereby granted, free of charge, to any person obtaining
+// a copy of this software and associated documentation files (the
+// "Software"), to deal in the Software without restriction, including
+// without limitation the rights to use, copy, modify, merge, publish,
+// distribute, sublicense, and/or sell copies of the Software, and to
+// permit persons to whom the Software is furnished to do so, subject to
+// the following conditions:
+// 
+// The above copyright notice and this permission notice shall be
+// included in all copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+// MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+// NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+// LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+// OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+// WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+// 
+// SPDX-License-Identifier: MIT
+// #LICENSE_END#
+//
+
+#ifndef LIBWEXPR_HASHTABLE_H
+#define LIBWEXPR_HASHTABLE_H
+
+#include <libWexpr/Macros.h>
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+LIBWEXPR_EXTERN_C_BEGIN()
+
+//
+/// \brief A hash table where the caller provides the hash and the equality check.
+///
+/// Unlike c_hashmap this isn't limited to string keys, so it can be used for pointers
+/// or for content (eg. interning expressions). The table never owns keys or values.
+//
+typedef struct WexprPrivateHashTable WexprPrivateHashTable;
+
+//
+/// \brief Returns true if the two keys are equal
+//
+typedef bool (*WexprPrivateHashTableEqualsCallback) (const void* lhs, const void* rhs);
+
+//
+/// \brief Called for each entry when iterating
+//
+typedef void (*WexprPrivateHashTableIterateCallback) (void* userData, const void* key, void* value);
+
+/// \name Construction/Destruction
+/// \relates WexprPrivateHashTable
+/// \{
+
+//
+/// \brief Create an empty table. Returns null if allocation fails.
+//
+WexprPrivateHashTable* wexpr_PrivateHashTable_create (void);
+
+//
+/// \brief Destroy the table. Keys and values are not touched.
+//
+void wexpr_PrivateHashTable_destroy (WexprPrivateHashTable* self);
+
+//
+/// \brief Remove all entries, keeping the memory around for reuse.
+//
+void wexpr_PrivateHashTable_clear (WexprPrivateHashTable* self);
+
+/// \}
+
+/// \name Entries
+/// \relates WexprPrivateHashTable
+/// \{
+
+//
+/// \brief Find the entry for the given key.
+/// \param equals Used to compare keys with the same hash. If null, keys are compared by pointer.
+/// \return The entry's value, or null if not found.
+//
+void* wexpr_PrivateHashTable_find (WexprPrivateHashTable* self, uint64_t hash, const void* key, WexprPrivateHashTableEqualsCallback equals);
+
+//
+/// \brief Find the entry for the given key, returning a pointer to the value slot so it can be updated in place.
+/// \return The slot, or null if not found. Invalidated by the next insert.
+//
+void** wexpr_PrivateHashTable_findSlot (WexprPrivateHashTable* self, uint64_t hash, const void* key, WexprPrivateHashTableEqualsCallback equals);
+
+//
+/// \brief Insert a new entry. Does not check for an existing one - use find first if needed.
+/// \return true on success, false if out of memory.
+//
+bool wexpr_PrivateHashTable_insert (WexprPrivateHashTable* self, uint64_t hash, const void* key, void* value);
+
+//
+/// \brief Return the number of entries in the table.
+//
+size_t wexpr_PrivateHashTable_count (WexprPrivateHashTable* self);
+
+//
+/// \brief Call the callback for every entry in the table.
+//
+void wexpr_PrivateHashTable_iterate (WexprPrivateHashTable* self, WexprPrivateHashTableIterateCallback callback, void* userData);
+
+/// \}
+
+/// \name Hashing
+/// \{
+
+//
+/// \brief FNV-1a 64bit hash of the given bytes.
+//
+uint64_t wexpr_PrivateHashTable_hashBytes (const void* data, size_t byteSize);
+
+//
+/// \brief Continue an FNV-1a hash with more bytes.
+//
+uint64_t wexpr_PrivateHashTable_hashBytesContinue (uint64_t hash, const void* data, size_t byteSize);
+
+//
+/// \brief Hash a pointer value.
+//
+uint64_t wexpr_PrivateHashTable_hashPointer (const void* ptr);
+
+/// \}
+
+LIBWEXPR_EXTERN_C_END()
+
+#endif // LIBWEXPR_HASHTABLE_H
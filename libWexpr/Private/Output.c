@@ -0,0 +1,200 @@
+//
+/// \file libWexpr/Output.c
+/// \brief Output buffer used by the writers
+//
+// #LICENSE_BEGIN:MIT#
+// 
+// Copyright (c) 2017-2020, Kenneth Perry (thothonegan)
+// 
+// Permission is hereby granted, free of charge, to any person obtaining
+// a copy of this software and associated documentation files (the
+// "Software"), to deal in the Software without restriction, including
+// without limitation the rights to use, copy, modify, merge, publish,
+// distribute, sublicense, and/or sell copies of the Software, and to
+// permit persons to whom the Software is furnished to do so, subject to
+// the following conditions:
+// 
+// The above copyright notice and this permission notice shall be
+// included in all copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+// MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+// NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+// LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+// OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+// WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+// 
+// SPDX-License-Identifier: MIT
+// #LICENSE_END#
+//
+
+#include "Output.h"
+
+#include <stdlib.h>
+
+// --- private
+
+// send the buffer to the sink
+static void s_output_flush (WexprPrivateOutput* self)
+{
+	if (self->size == 0)
+	{ return; }
+	
+	if (!self->failed && !wexpr_Sink_write(self->sink, self->buffer, self->size))
+	{ self->failed = true; }
+	
+	self->flushedSize += self->size;
+	self->size = 0;
+}
+
+// make room for at least byteSize more bytes. Returns false if we can't (and marks as failed).
+static bool s_output_reserve (WexprPrivateOutput* self, size_t byteSize)
+{
+	if (self->failed)
+	{ return false; }
+	
+	if (self->mode != WexprPrivateOutputModeGrowable)
+	{
+		if (self->mode == WexprPrivateOutputModeFixed)
+		{ self->failed = true; } // out of room
+		
+		return false;
+	}
+	
+	// grow geometrically so appends are amortized constant
+	size_t newCapacity = self->capacity ? self->capacity : 64;
+	while (newCapacity - self->size < byteSize)
+	{ newCapacity *= 2; }
+	
+	char* newBuffer = realloc(self->buffer, newCapacity);
+	if (!newBuffer)
+	{
+		self->failed = true;
+		return false;
+	}
+	
+	self->buffer = newBuffer;
+	self->capacity = newCapacity;
+	
+	return true;
+}
+
+// --- Construction/Destruction
+
+void wexpr_PrivateOutput_initGrowable (WexprPrivateOutput* self, size_t initialCapacity)
+{
+	self->buffer = initialCapacity ? malloc(initialCapacity) : NULL;
+	self->size = 0;
+	self->capacity = self->buffer ? initialCapacity : 0;
+	self->mode = WexprPrivateOutputModeGrowable;
+	self->failed = false;
+	self->sink = NULL;
+	self->flushedSize = 0;
+}
+
+void wexpr_PrivateOutput_initFixed (WexprPrivateOutput* self, void* buffer, size_t capacity)
+{
+	self->buffer = buffer;
+	self->size = 0;
+	self->capacity = buffer ? capacity : 0;
+	self->mode = WexprPrivateOutputModeFixed;
+	self->failed = false;
+	self->sink = NULL;
+	self->flushedSize = 0;
+}
+
+void wexpr_PrivateOutput_initCount (WexprPrivateOutput* self)
+{
+	self->buffer = NULL;
+	self->size = 0;
+	self->capacity = 0;
+	self->mode = WexprPrivateOutputModeCount;
+	self->failed = false;
+	self->sink = NULL;
+	self->flushedSize = 0;
+}
+
+void wexpr_PrivateOutput_initSink (WexprPrivateOutput* self, WexprSink* sink, void* buffer, size_t capacity)
+{
+	self->buffer = buffer;
+	self->size = 0;
+	self->capacity = capacity;
+	self->mode = WexprPrivateOutputModeSink;
+	self->failed = (buffer == NULL || capacity == 0);
+	self->sink = sink;
+	self->flushedSize = 0;
+}
+
+bool wexpr_PrivateOutput_finish (WexprPrivateOutput* self)
+{
+	if (self->mode == WexprPrivateOutputModeSink)
+	{ s_output_flush(self); }
+	
+	return !self->failed;
+}
+
+// --- Writing
+
+void wexpr_PrivateOutput_writeSlow (WexprPrivateOutput* self, const void* data, size_t byteSize)
+{
+	if (self->mode == WexprPrivateOutputModeSink)
+	{
+		s_output_flush(self);
+		
+		if (byteSize >= self->capacity)
+		{
+			// too big to be worth buffering, send it directly
+			if (!self->failed && !wexpr_Sink_write(self->sink, data, byteSize))
+			{ self->failed = true; }
+			
+			self->flushedSize += byteSize;
+		}
+		else
+		{
+			memcpy (self->buffer, data, byteSize);
+			self->size = byteSize;
+		}
+		
+		return;
+	}
+	
+	if (s_output_reserve(self, byteSize))
+	{
+		memcpy (self->buffer + self->size, data, byteSize);
+	}
+	
+	self->size += byteSize;
+}
+
+void wexpr_PrivateOutput_writeRepeatedSlow (WexprPrivateOutput* self, char c, size_t count)
+{
+	if (self->mode == WexprPrivateOutputModeSink)
+	{
+		if (self->capacity == 0)
+		{
+			self->flushedSize += count; // failed already, just count
+			return;
+		}
+		
+		// fill and flush the buffer as many times as needed
+		while (count > 0)
+		{
+			s_output_flush(self);
+			
+			size_t amount = (count < self->capacity) ? count : self->capacity;
+			memset (self->buffer, c, amount);
+			self->size = amount;
+			count -= amount;
+		}
+		
+		return;
+	}
+	
+	if (s_output_reserve(self, count))
+	{
+		memset (self->buffer + self->size, c, count);
+	}
+	
+	self->size += count;
+}
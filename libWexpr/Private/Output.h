@@ -0,0 +1,175 @@
+//
+/// \file libWexpr/Output.h
+/// \brief Output buffer used by the writers
+//
+// #LICENSE_BEGIN:MIT#
+// 
+// Copyright (c) 2017-2020, Kenneth Perry (thothonegan)
+// 
+// Permission is hereby granted, free of charge, to any person obtaining
+// a copy of this software and associated documentation files (the
+// "Software"), to deal in the Software without restriction, including
+// without limitation the rights to use, copy, modify, merge, publish,
+// distribute, sublicense, and/or sell copies of the Software, and to
+// permit persons to whom the Software is furnished to do so, subject to
+// the following conditions:
+// 
+// The above copyright notice and this permission notice shall be
+// included in all copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+// MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+// NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+// LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+// OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+// WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+// 
+// SPDX-License-Identifier: MIT
+// #LICENSE_END#
+//
+
+#ifndef LIBWEXPR_OUTPUT_H
+#define LIBWEXPR_OUTPUT_H
+
+#include <libWexpr/Macros.h>
+#include <libWexpr/Sink.h>
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <string.h>
+
+LIBWEXPR_EXTERN_C_BEGIN()
+
+//
+/// \brief How much the streaming writers buffer before handing it to the sink
+//
+#define WEXPR_PRIVATE_OUTPUT_SINKBUFFERSIZE (64 * 1024)
+
+//
+/// \brief How a WexprPrivateOutput stores what is written
+//
+typedef enum WexprPrivateOutputMode
+{
+	WexprPrivateOutputModeGrowable, ///< Buffer is owned and grows geometrically as needed
+	WexprPrivateOutputModeFixed, ///< Buffer is provided by the caller. Stops writing once full, but keeps counting.
+	WexprPrivateOutputModeCount, ///< No buffer, only counts the bytes
+	WexprPrivateOutputModeSink ///< Buffer is flushed to a sink whenever it fills up
+} WexprPrivateOutputMode;
+
+//
+/// \brief Destination for the writers. Writes are appended to the buffer, with the slow path
+/// only taken when it's full.
+//
+typedef struct WexprPrivateOutput
+{
+	char* buffer; ///< Where we're writing. Null for counting.
+	size_t size; ///< Bytes written to the buffer so far. Keeps counting even if they no longer fit (fixed).
+	size_t capacity; ///< Bytes available in buffer
+	WexprPrivateOutputMode mode;
+	bool failed; ///< Ran out of room or memory, or the sink failed. Output is incomplete.
+	
+	WexprSink* sink; ///< For sink mode, where to flush to
+	size_t flushedSize; ///< For sink mode, bytes already sent to the sink. Total is flushedSize + size.
+} WexprPrivateOutput;
+
+/// \name Construction/Destruction
+/// \relates WexprPrivateOutput
+/// \{
+
+//
+/// \brief Start a growable output, which will allocate as needed. Free the buffer with free() when done.
+//
+void wexpr_PrivateOutput_initGrowable (WexprPrivateOutput* self, size_t initialCapacity);
+
+//
+/// \brief Start an output writing into the given buffer.
+//
+void wexpr_PrivateOutput_initFixed (WexprPrivateOutput* self, void* buffer, size_t capacity);
+
+//
+/// \brief Start an output which only counts the bytes written.
+//
+void wexpr_PrivateOutput_initCount (WexprPrivateOutput* self);
+
+//
+/// \brief Start an output which sends everything to the sink, using buffer to batch up writes.
+/// Call wexpr_PrivateOutput_finish() when done to flush the rest.
+//
+void wexpr_PrivateOutput_initSink (WexprPrivateOutput* self, WexprSink* sink, void* buffer, size_t capacity);
+
+//
+/// \brief Flush anything remaining to the sink (if any).
+/// \return true if everything was written successfully.
+//
+bool wexpr_PrivateOutput_finish (WexprPrivateOutput* self);
+
+/// \}
+
+/// \name Writing
+/// \relates WexprPrivateOutput
+/// \{
+
+//
+/// \brief Slow path of wexpr_PrivateOutput_write() for when the data doesn't fit in the buffer.
+//
+void wexpr_PrivateOutput_writeSlow (WexprPrivateOutput* self, const void* data, size_t byteSize);
+
+//
+/// \brief Slow path of wexpr_PrivateOutput_writeRepeated().
+//
+void wexpr_PrivateOutput_writeRepeatedSlow (WexprPrivateOutput* self, char c, size_t count);
+
+//
+/// \brief Append the data to the output.
+//
+static inline void wexpr_PrivateOutput_write (WexprPrivateOutput* self, const void* data, size_t byteSize)
+{
+	if (self->size + byteSize <= self->capacity)
+	{
+		memcpy (self->buffer + self->size, data, byteSize);
+		self->size += byteSize;
+	}
+	else
+	{
+		wexpr_PrivateOutput_writeSlow(self, data, byteSize);
+	}
+}
+
+//
+/// \brief Append a single character to the output.
+//
+static inline void wexpr_PrivateOutput_writeChar (WexprPrivateOutput* self, char c)
+{
+	if (self->size < self->capacity)
+	{
+		self->buffer[self->size] = c;
+		self->size += 1;
+	}
+	else
+	{
+		wexpr_PrivateOutput_writeSlow(self, &c, 1);
+	}
+}
+
+//
+/// \brief Append a character repeated count times (eg. indents).
+//
+static inline void wexpr_PrivateOutput_writeRepeated (WexprPrivateOutput* self, char c, size_t count)
+{
+	if (self->size + count <= self->capacity)
+	{
+		memset (self->buffer + self->size, c, count);
+		self->size += count;
+	}
+	else
+	{
+		wexpr_PrivateOutput_writeRepeatedSlow(self, c, count);
+	}
+}
+
+/// \}
+
+LIBWEXPR_EXTERN_C_END()
+
+#endif // LIBWEXPR_OUTPUT_H
@@ -0,0 +1,190 @@
+//
+/// \file libWexpr/Path.c
+/// \brief Compiled paths for finding expressions within a tree
+//
+// #LICENSE_BEGIN:MIT#
+// 
+// Copyright (c) 2017-2020, Kenneth Perry (thothonegan)
+// 
+// Permission is hereby granted, free of charge, to any person obtaining
+// a copy of this software and associated documentation files (the
+// "Software"), to deal in the Software without restriction, including
+// without limitation the rights to use, copy, modify, merge, publish,
+// distribute, sublicense, and/or sell copies of the Software, and to
+// permit persons to whom the Software is furnished to do so, subject to
+// the following conditions:
+// 
+// The above copyright notice and this permission notice shall be
+// included in all copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+// MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+// NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+// LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+// OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+// WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+// 
+// SPDX-License-Identifier: MIT
+// #LICENSE_END#
+//
+
+#include <libWexpr/Path.h>
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "PathFormat.h"
+
+#include "ThirdParty/c_hashmap/hashmap.h"
+
+static WexprPath* s_Path_fail (WexprPath* self, size_t position, const char* message, WexprError* error)
+{
+	if (error)
+	{
+		error->code = WexprErrorCodeInvalidPath;
+		error->message = strdup(message);
+		error->line = 1;
+		error->column = (WexprColumnNumber)(position + 1);
+	}
+	
+	wexpr_Path_destroy(self);
+	return NULL;
+}
+
+// parse the index within [], returning false if it isnt one
+static bool s_Path_parseIndex (const char* str, size_t length, size_t* index)
+{
+	if (length == 0 || (str[0] == '0' && length > 1))
+	{ return false; }
+	
+	size_t value = 0;
+	for (size_t i=0; i < length; ++i)
+	{
+		if (str[i] < '0' || str[i] > '9')
+		{ return false; }
+		
+		size_t digit = (size_t)(str[i] - '0');
+		if (value > (SIZE_MAX - digit) / 10)
+		{ return false; } // overflow
+		
+		value = value * 10 + digit;
+	}
+	
+	*index = value;
+	return true;
+}
+
+WexprPath* wexpr_Path_compile (const char* path, WexprError* error)
+{
+	size_t length = strlen(path);
+	
+	WexprPath* self = calloc(1, sizeof(WexprPath));
+	if (!self)
+	{ return NULL; }
+	
+	self->source = strdup(path);
+	self->keys = malloc(length + 1);
+	self->steps = malloc((length + 1) * sizeof(WexprPrivatePathStep)); // each step is at least one character
+	
+	if (!self->source || !self->keys || !self->steps)
+	{ return s_Path_fail(self, 0, "Out of memory", error); }
+	
+	if (path[0] != '/')
+	{ return s_Path_fail(self, 0, "Path must start with /", error); }
+	
+	char* keyOut = self->keys;
+	size_t pos = 1;
+	
+	// "/" alone is the root
+	while (pos < length)
+	{
+		WexprPrivatePathStep* step = &self->steps[self->stepCount];
+		memset (step, 0, sizeof(WexprPrivatePathStep));
+		
+		size_t start = pos;
+		
+		if (path[pos] == '[')
+		{
+			const char* end = strchr(path + pos, ']');
+			if (!end)
+			{ return s_Path_fail(self, pos, "Index is missing the ending ]", error); }
+			
+			const char* inside = path + pos + 1;
+			size_t insideLength = (size_t)(end - inside);
+			
+			if (insideLength == 1 && inside[0] == '*')
+			{ step->type = WexprPrivatePathStepTypeAnyElement; }
+			else if (s_Path_parseIndex(inside, insideLength, &step->index))
+			{ step->type = WexprPrivatePathStepTypeIndex; }
+			else
+			{ return s_Path_fail(self, pos, "Index must be a number or *", error); }
+			
+			pos = (size_t)(end - path) + 1;
+		}
+		
+		else if (path[pos] == '*' && (pos + 1 == length || path[pos+1] == '/'))
+		{
+			step->type = WexprPrivatePathStepTypeAnyValue;
+			pos += 1;
+		}
+		
+		else
+		{
+			step->type = WexprPrivatePathStepTypeKey;
+			step->key = keyOut;
+			
+			while (pos < length && path[pos] != '/')
+			{
+				if (path[pos] == '\\')
+				{
+					++pos;
+					if (pos == length)
+					{ return s_Path_fail(self, pos - 1, "Nothing to escape at the end of the path", error); }
+				}
+				
+				*keyOut++ = path[pos++];
+			}
+			
+			*keyOut++ = '\0';
+			
+			if (pos == start)
+			{ return s_Path_fail(self, pos, "Path has an empty step", error); }
+			
+			step->keyHash = hashmap_prehash(step->key);
+		}
+		
+		++self->stepCount;
+		
+		if (pos < length)
+		{
+			if (path[pos] != '/')
+			{ return s_Path_fail(self, pos, "Expected / after the step", error); }
+			
+			++pos;
+			
+			if (pos == length)
+			{ return s_Path_fail(self, pos, "Path can't end with /", error); }
+		}
+	}
+	
+	return self;
+}
+
+void wexpr_Path_destroy (WexprPath* self)
+{
+	if (!self)
+	{ return; }
+	
+	free (self->steps);
+	free (self->keys);
+	free (self->source);
+	free (self);
+}
+
+const char* wexpr_Path_string (const WexprPath* self)
+{
+	return self->source;
+}
@@ -0,0 +1,73 @@
+//
+/// \file libWexpr/PathFormat.h
+/// \brief Layout of a compiled WexprPath
+//
+// #LICENSE_BEGIN:MIT#
+// 
+// Copyright (c) 2017-2020, Kenneth Perry (thothonegan)
+// 
+// Permission is hereby granted, free of charge, to any person obtaining
+// a copy of this software and associated documentation files (the
+// "Software"), to deal in the Software without restriction, including
+// without limitation the rights to use, copy, modify, merge, publish,
+// distribute, sublicense, and/or sell copies of the Software, and to
+// permit persons to whom the Software is furnished to do so, subject to
+// the following conditions:
+// 
+// The above copyright notice and this permission notice shall be
+// included in all copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+// MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+// NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+// LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+// OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+// WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+// 
+// SPDX-License-Identifier: MIT
+// #LICENSE_END#
+//
+
+#ifndef LIBWEXPR_PATHFORMAT_H
+#define LIBWEXPR_PATHFORMAT_H
+
+#include <libWexpr/Macros.h>
+#include <libWexpr/Path.h>
+
+#include <stddef.h>
+#include <stdint.h>
+
+LIBWEXPR_EXTERN_C_BEGIN()
+
+// Compiled in Path.c, and evaluated in Expression.c since it needs the expression internals.
+
+typedef uint8_t WexprPrivatePathStepType;
+
+enum
+{
+	WexprPrivatePathStepTypeKey, ///< Value for the key in a map
+	WexprPrivatePathStepTypeIndex, ///< Element at the index in an array
+	WexprPrivatePathStepTypeAnyValue, ///< Every value in a map (*)
+	WexprPrivatePathStepTypeAnyElement ///< Every element in an array ([*])
+};
+
+typedef struct WexprPrivatePathStep
+{
+	WexprPrivatePathStepType type;
+	char* key; // for keys, unescaped and null terminated
+	unsigned long keyHash; // for keys, hashmap_prehash() of the key
+	size_t index; // for indices
+} WexprPrivatePathStep;
+
+struct WexprPath
+{
+	char* source; // the path it was compiled from
+	char* keys; // storage for the step keys
+	WexprPrivatePathStep* steps;
+	size_t stepCount;
+};
+
+LIBWEXPR_EXTERN_C_END()
+
+#endif // LIBWEXPR_PATHFORMAT_H
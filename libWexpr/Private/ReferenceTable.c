@@ -33,24 +33,49 @@
 
 #include <libWexpr/Expression.h>
 #include "ThirdParty/c_hashmap/hashmap.h"
+#include "HashTable.h"
+#include "Thread.h"
 
+#include <stdint.h>
 #include <stdlib.h>
 #include <string.h>
 
-// privates to WexprReferenceTable
-struct WexprReferenceTable
-{
-	map_t m_hash;
-	
-	WexprReferenceTableCreateUnknownKeyCallback m_callback;
-};
+// keys up to this size are terminated on the stack instead of allocating when looking them up
+#define LIBWEXPR_PRIVATE_REFERENCETABLE_STACKKEYSIZE 128
 
 typedef struct WexprReferenceTablePrivateMapElement
 {
 	char* key; // strdup, we own
 	WexprExpression* value; // we own
+	size_t index; // once frozen, the index of the element
 } WexprReferenceTablePrivateMapElement;
 
+// an entry in a bucket of a concurrent table. Never changes once published, so it can be read without locking.
+typedef struct WexprReferenceTablePrivateConcurrentEntry
+{
+	struct WexprReferenceTablePrivateConcurrentEntry* next; // the older entry in the bucket
+	uint64_t hash;
+	char* key; // we own
+	size_t keyLength;
+	WexprExpression* value; // we own. Null if the key was removed.
+} WexprReferenceTablePrivateConcurrentEntry;
+
+// privates to WexprReferenceTable
+struct WexprReferenceTable
+{
+	map_t m_hash; // unused if concurrent
+	
+	WexprReferenceTableCreateUnknownKeyCallback m_callback;
+	
+	bool m_frozen;
+	WexprReferenceTablePrivateMapElement** m_frozenElements; // once frozen, every element by index. Null if concurrent.
+	size_t m_frozenCount;
+	
+	// concurrent tables
+	void** m_buckets; // newest entry of each bucket, read and written atomically. Null if not concurrent.
+	size_t m_bucketMask;
+};
+
 static int s_refTable_freeHashData (any_t userData, any_t data)
 {
 	(void)userData;
@@ -149,6 +174,205 @@ static int s_getIndexOfKey (any_t userData, any_t data)
 	return MAP_OK;
 }
 
+// --- concurrent tables
+// Each bucket is a list of entries, newest first. Entries are only ever pushed onto the front (with a compare
+// exchange), and never change once published, so lookups load the head and walk the list without locking.
+// Setting a key pushes a new entry which hides the older ones, and removing pushes one with a null value.
+// Hidden entries are only freed when the table is destroyed, since other threads may still be reading them.
+
+// the newest entry for the key from the given one, or null if none
+static WexprReferenceTablePrivateConcurrentEntry* s_concurrent_find (
+	WexprReferenceTablePrivateConcurrentEntry* entry,
+	uint64_t hash, const char* key, size_t keyLength
+)
+{
+	for (; entry != NULL; entry = entry->next)
+	{
+		if (entry->hash == hash && entry->keyLength == keyLength && memcmp(entry->key, key, keyLength) == 0)
+		{ return entry; }
+	}
+	
+	return NULL;
+}
+
+static WexprReferenceTablePrivateConcurrentEntry* s_concurrent_createEntry (
+	uint64_t hash, const char* key, size_t keyLength,
+	WexprExpression* value
+)
+{
+	WexprReferenceTablePrivateConcurrentEntry* entry = malloc(sizeof(WexprReferenceTablePrivateConcurrentEntry));
+	entry->next = NULL;
+	entry->hash = hash;
+	entry->key = malloc(keyLength+1);
+	memcpy (entry->key, key, keyLength);
+	entry->key[keyLength] = 0;
+	entry->keyLength = keyLength;
+	entry->value = value;
+	
+	return entry;
+}
+
+static void s_concurrent_destroyEntry (WexprReferenceTablePrivateConcurrentEntry* entry)
+{
+	free (entry->key);
+	wexpr_Expression_destroy (entry->value);
+	free (entry);
+}
+
+// Push the entry onto its bucket. If onlyIfMissing and the key was added by someone else first,
+// returns their entry instead without pushing.
+static WexprReferenceTablePrivateConcurrentEntry* s_concurrent_push (
+	WexprReferenceTable* self,
+	WexprReferenceTablePrivateConcurrentEntry* entry,
+	bool onlyIfMissing
+)
+{
+	void** bucket = &self->m_buckets[entry->hash & self->m_bucketMask];
+	WexprReferenceTablePrivateConcurrentEntry* head = wexpr_PrivateThread_atomicLoadPointer(bucket);
+	
+	for (;;)
+	{
+		if (onlyIfMissing)
+		{
+			WexprReferenceTablePrivateConcurrentEntry* existing = s_concurrent_find(head, entry->hash, entry->key, entry->keyLength);
+			if (existing && existing->value)
+			{ return existing; }
+		}
+		
+		entry->next = head;
+		if (wexpr_PrivateThread_atomicCompareExchangePointer(bucket, head, entry))
+		{ return entry; }
+		
+		// someone else pushed first, try again with theirs
+		head = wexpr_PrivateThread_atomicLoadPointer(bucket);
+	}
+}
+
+// the live entry for the key, or null
+static WexprReferenceTablePrivateConcurrentEntry* s_concurrent_entryForKey (
+	WexprReferenceTable* self,
+	uint64_t hash, const char* key, size_t keyLength
+)
+{
+	WexprReferenceTablePrivateConcurrentEntry* entry = s_concurrent_find(
+		wexpr_PrivateThread_atomicLoadPointer(&self->m_buckets[hash & self->m_bucketMask]),
+		hash, key, keyLength
+	);
+	
+	return (entry && entry->value) ? entry : NULL;
+}
+
+static WexprExpression* s_concurrent_expressionForKey (
+	WexprReferenceTable* self,
+	const char* key, size_t keyLength
+)
+{
+	uint64_t hash = wexpr_PrivateHashTable_hashBytes(key, keyLength);
+	
+	WexprReferenceTablePrivateConcurrentEntry* entry = s_concurrent_entryForKey(self, hash, key, keyLength);
+	if (entry)
+	{ return entry->value; }
+	
+	if (!self->m_callback || self->m_frozen)
+	{ return NULL; }
+	
+	// create it without holding anything, then keep whichever got there first
+	entry = s_concurrent_createEntry(hash, key, keyLength, NULL);
+	entry->value = self->m_callback(entry->key);
+	
+	if (!entry->value)
+	{
+		s_concurrent_destroyEntry (entry);
+		return NULL;
+	}
+	
+	WexprReferenceTablePrivateConcurrentEntry* kept = s_concurrent_push(self, entry, true);
+	if (kept != entry)
+	{ s_concurrent_destroyEntry (entry); }
+	
+	return kept->value;
+}
+
+// Called for each live entry. Return false to stop.
+typedef bool (*PrivateConcurrentIterateCallback) (void* userData, WexprReferenceTablePrivateConcurrentEntry* entry);
+
+// Calls the callback for each live entry in order, returning the one it stopped at (or null)
+static WexprReferenceTablePrivateConcurrentEntry* s_concurrent_iterate (
+	WexprReferenceTable* self,
+	PrivateConcurrentIterateCallback callback, void* userData
+)
+{
+	for (size_t i=0; i <= self->m_bucketMask; ++i)
+	{
+		WexprReferenceTablePrivateConcurrentEntry* head = wexpr_PrivateThread_atomicLoadPointer(&self->m_buckets[i]);
+		
+		for (WexprReferenceTablePrivateConcurrentEntry* entry = head; entry != NULL; entry = entry->next)
+		{
+			// hidden by a newer one
+			if (!entry->value || s_concurrent_find(head, entry->hash, entry->key, entry->keyLength) != entry)
+			{ continue; }
+			
+			if (!callback(userData, entry))
+			{ return entry; }
+		}
+	}
+	
+	return NULL;
+}
+
+static bool s_concurrent_count (void* userData, WexprReferenceTablePrivateConcurrentEntry* entry)
+{
+	(void)entry;
+	
+	++(*(size_t*)userData);
+	return true;
+}
+
+static bool s_concurrent_isAtIndex (void* userData, WexprReferenceTablePrivateConcurrentEntry* entry)
+{
+	(void)entry;
+	
+	size_t* index = userData;
+	if (*index == 0)
+	{ return false; }
+	
+	--(*index);
+	return true;
+}
+
+static bool s_concurrent_getIndexOfKey (void* userData, WexprReferenceTablePrivateConcurrentEntry* entry)
+{
+	PrivateGetIndexOfKey* ud = userData;
+	
+	if (strcmp (ud->key, entry->key) == 0)
+	{
+		ud->result = ud->tempIndex;
+		return false;
+	}
+	
+	ud->tempIndex++;
+	return true;
+}
+
+// --- frozen tables
+
+typedef struct PrivateFreezeElements
+{
+	WexprReferenceTablePrivateMapElement** elements; // where to store them
+	size_t count; // how many so far
+} PrivateFreezeElements;
+
+static int s_refTable_freezeElement (any_t userData, any_t data)
+{
+	PrivateFreezeElements* ud = userData;
+	WexprReferenceTablePrivateMapElement* elem = data;
+	
+	elem->index = ud->count;
+	ud->elements[(ud->count)++] = elem;
+	
+	return MAP_OK;
+}
+
 // --- public Construction/Destruction
 
 WexprReferenceTable* wexpr_ReferenceTable_create ()
@@ -156,17 +380,63 @@ WexprReferenceTable* wexpr_ReferenceTable_create ()
 	WexprReferenceTable* ref = malloc (sizeof(WexprReferenceTable));
 	ref->m_hash = hashmap_new();
 	ref->m_callback = LIBWEXPR_NULLPTR;
+	ref->m_frozen = false;
+	ref->m_frozenElements = LIBWEXPR_NULLPTR;
+	ref->m_frozenCount = 0;
+	ref->m_buckets = LIBWEXPR_NULLPTR;
+	ref->m_bucketMask = 0;
+	
+	return ref;
+}
+
+WexprReferenceTable* wexpr_ReferenceTable_createConcurrent (
+	size_t expectedKeyCount,
+	WexprReferenceTableCreateUnknownKeyCallback callback
+)
+{
+	// about one entry per bucket
+	size_t bucketCount = 16;
+	while (bucketCount < expectedKeyCount && bucketCount < ((size_t)1 << (sizeof(size_t)*8 - 2)))
+	{ bucketCount *= 2; }
+	
+	WexprReferenceTable* ref = malloc (sizeof(WexprReferenceTable));
+	ref->m_hash = LIBWEXPR_NULLPTR;
+	ref->m_callback = callback;
+	ref->m_frozen = false;
+	ref->m_frozenElements = LIBWEXPR_NULLPTR;
+	ref->m_frozenCount = 0;
+	ref->m_buckets = calloc (bucketCount, sizeof(void*));
+	ref->m_bucketMask = bucketCount - 1;
 	
 	return ref;
 }
 
 void wexpr_ReferenceTable_destroy (WexprReferenceTable* self)
 {
-	// cleanup our hash
-	hashmap_iterate (self->m_hash, &s_refTable_freeHashData, NULL);
-	hashmap_free (self->m_hash);
+	if (self->m_buckets)
+	{
+		for (size_t i=0; i <= self->m_bucketMask; ++i)
+		{
+			WexprReferenceTablePrivateConcurrentEntry* entry = self->m_buckets[i];
+			while (entry)
+			{
+				WexprReferenceTablePrivateConcurrentEntry* next = entry->next;
+				s_concurrent_destroyEntry (entry);
+				entry = next;
+			}
+		}
+		
+		free (self->m_buckets);
+	}
+	else
+	{
+		// cleanup our hash
+		hashmap_iterate (self->m_hash, &s_refTable_freeHashData, NULL);
+		hashmap_free (self->m_hash);
+	}
 	
 	// cleanup our memory
+	free (self->m_frozenElements);
 	free (self);
 }
 
@@ -178,11 +448,7 @@ void wexpr_ReferenceTable_setExpressionForKey (
 	WexprExpression* expression
 )
 {
-	WexprReferenceTablePrivateMapElement* elem = malloc (sizeof(WexprReferenceTablePrivateMapElement));
-	elem->key = strdup (key);
-	elem->value = expression;
-	
-	hashmap_put(self->m_hash, elem->key, elem);
+	wexpr_ReferenceTable_setExpressionForLengthKey(self, key, strlen(key), expression);
 }
 
 void wexpr_ReferenceTable_setExpressionForLengthKey (
@@ -191,6 +457,22 @@ void wexpr_ReferenceTable_setExpressionForLengthKey (
 	WexprExpression* expression
 )
 {
+	if (self->m_frozen)
+	{
+		wexpr_Expression_destroy (expression);
+		return;
+	}
+	
+	if (self->m_buckets)
+	{
+		s_concurrent_push (self,
+			s_concurrent_createEntry(wexpr_PrivateHashTable_hashBytes(key, keyLength), key, keyLength, expression),
+			false
+		);
+		
+		return;
+	}
+	
 	WexprReferenceTablePrivateMapElement* elem = malloc (sizeof(WexprReferenceTablePrivateMapElement));
 	elem->value = expression;
 	elem->key = malloc(keyLength+1);
@@ -205,6 +487,9 @@ WexprExpression* wexpr_ReferenceTable_expressionForKey (
 	const char* key
 )
 {
+	if (self->m_buckets)
+	{ return s_concurrent_expressionForKey(self, key, strlen(key)); }
+	
 	WexprReferenceTablePrivateMapElement* elem = NULL;
 	int res = hashmap_get (self->m_hash, (char*)key, (void**) &elem);
 	
@@ -213,7 +498,7 @@ WexprExpression* wexpr_ReferenceTable_expressionForKey (
 		return elem->value;
 	}
 	
-	if (self->m_callback)
+	if (self->m_callback && !self->m_frozen)
 	{
 		WexprExpression* val = self->m_callback(key);
 		if (val)
@@ -231,14 +516,19 @@ WexprExpression* wexpr_ReferenceTable_expressionForLengthKey (
 	const char* key, size_t keyLength
 )
 {
-	// key has to be 0 terminated for our hash
-	// TODO: use stack functions for this if its short? then we dont have to hit memory
-	char* newKey = malloc(keyLength+1);
+	if (self->m_buckets)
+	{ return s_concurrent_expressionForKey(self, key, keyLength); }
+	
+	// key has to be 0 terminated for our hash. Short ones (most of them) dont need to hit the allocator.
+	char stackKey[LIBWEXPR_PRIVATE_REFERENCETABLE_STACKKEYSIZE];
+	char* newKey = (keyLength < sizeof(stackKey)) ? stackKey : malloc(keyLength+1);
 	memcpy (newKey, key, keyLength);
 	newKey[keyLength] = 0; // end terminator
 	
 	WexprExpression* res = wexpr_ReferenceTable_expressionForKey (self, newKey);
-	free (newKey);
+	
+	if (newKey != stackKey)
+	{ free (newKey); }
 	
 	return res;
 }
@@ -248,6 +538,19 @@ void wexpr_ReferenceTable_removeKey (
 	const char* key
 )
 {
+	if (self->m_frozen)
+	{ return; }
+	
+	if (self->m_buckets)
+	{
+		// hide it with an empty entry
+		uint64_t hash = wexpr_PrivateHashTable_hashBytes(key, strlen(key));
+		if (s_concurrent_entryForKey(self, hash, key, strlen(key)))
+		{ s_concurrent_push (self, s_concurrent_createEntry(hash, key, strlen(key), NULL), false); }
+		
+		return;
+	}
+	
 	size_t index = wexpr_ReferenceTable_indexOfKey(self, key);
 	
 	// we test against not because we used that to early return 
@@ -263,18 +566,29 @@ void wexpr_ReferenceTable_removeLengthKey (
 )
 {
 	// key has to be 0 terminated for our hash
-	// TODO: use stack functions for this if its short? then we dont have to hit memory
-	char* newKey = malloc(keyLength+1);
+	char stackKey[LIBWEXPR_PRIVATE_REFERENCETABLE_STACKKEYSIZE];
+	char* newKey = (keyLength < sizeof(stackKey)) ? stackKey : malloc(keyLength+1);
 	memcpy (newKey, key, keyLength);
 	newKey[keyLength] = 0; // end terminator
 	
 	wexpr_ReferenceTable_removeKey(self, newKey);
+	
+	if (newKey != stackKey)
+	{ free (newKey); }
 }
 
 size_t wexpr_ReferenceTable_count (
 	WexprReferenceTable* self
 )
 {
+	if (self->m_buckets)
+	{
+		size_t count = 0;
+		s_concurrent_iterate(self, &s_concurrent_count, &count);
+		
+		return count;
+	}
+	
 	return hashmap_length (self->m_hash);
 }
 
@@ -283,12 +597,25 @@ size_t wexpr_ReferenceTable_indexOfKey (
 	const char* key
 )
 {
+	if (self->m_frozenElements)
+	{
+		WexprReferenceTablePrivateMapElement* elem = NULL;
+		if (hashmap_get (self->m_hash, (char*)key, (void**) &elem) == MAP_OK && elem)
+		{ return elem->index; }
+		
+		return wexpr_ReferenceTable_count(self);
+	}
+	
 	PrivateGetIndexOfKey priv;
 	priv.result = wexpr_ReferenceTable_count(self);
 	priv.key = key;
 	priv.tempIndex = 0;
 	
-	hashmap_iterate(self->m_hash, &s_getIndexOfKey, &priv);
+	if (self->m_buckets)
+	{ s_concurrent_iterate(self, &s_concurrent_getIndexOfKey, &priv); }
+	else
+	{ hashmap_iterate(self->m_hash, &s_getIndexOfKey, &priv); }
+	
 	return priv.result;
 }
 
@@ -297,6 +624,17 @@ const char* wexpr_ReferenceTable_keyAtIndex (
 	size_t index
 )
 {
+	if (self->m_frozenElements)
+	{
+		return (index < self->m_frozenCount) ? self->m_frozenElements[index]->key : NULL;
+	}
+	
+	if (self->m_buckets)
+	{
+		WexprReferenceTablePrivateConcurrentEntry* entry = s_concurrent_iterate(self, &s_concurrent_isAtIndex, &index);
+		return entry ? entry->key : NULL;
+	}
+	
 	PrivateRefTableGetKeyValueAtIndex val;
 	val.index = index;
 	val.result = NULL;
@@ -311,6 +649,17 @@ WexprExpression* wexpr_ReferenceTable_expressionAtIndex (
 	size_t index
 )
 {
+	if (self->m_frozenElements)
+	{
+		return (index < self->m_frozenCount) ? self->m_frozenElements[index]->value : NULL;
+	}
+	
+	if (self->m_buckets)
+	{
+		WexprReferenceTablePrivateConcurrentEntry* entry = s_concurrent_iterate(self, &s_concurrent_isAtIndex, &index);
+		return entry ? entry->value : NULL;
+	}
+	
 	PrivateRefTableGetKeyValueAtIndex val;
 	val.index = index;
 	val.result = NULL;
@@ -327,3 +676,40 @@ void wexpr_ReferenceTable_setCreateUnknownKeyCallback (
 {
 	self->m_callback = callback;
 }
+
+// --- public Sharing between threads
+
+void wexpr_ReferenceTable_freeze (
+	WexprReferenceTable* self
+)
+{
+	if (self->m_frozen)
+	{ return; }
+	
+	self->m_frozen = true;
+	
+	// concurrent tables can already be read without locking
+	if (self->m_buckets)
+	{ return; }
+	
+	// index everything so the index functions dont have to walk the hash. If it fails, they still can.
+	size_t count = wexpr_ReferenceTable_count(self);
+	self->m_frozenElements = malloc((count ? count : 1) * sizeof(WexprReferenceTablePrivateMapElement*));
+	
+	if (self->m_frozenElements)
+	{
+		PrivateFreezeElements freeze;
+		freeze.elements = self->m_frozenElements;
+		freeze.count = 0;
+		
+		hashmap_iterate (self->m_hash, &s_refTable_freezeElement, &freeze);
+		self->m_frozenCount = freeze.count;
+	}
+}
+
+bool wexpr_ReferenceTable_isFrozen (
+	WexprReferenceTable* self
+)
+{
+	return self->m_frozen;
+}
@@ -0,0 +1,111 @@
+//
+/// \file libWexpr/Sink.c
+/// \brief Destinations for streaming output
+//
+// #LICENSE_BEGIN:MIT#
+// 
+// Copyright (c) 2017-2020, Kenneth Perry (thothonegan)
+// 
+// Permission is hereby granted, free of charge, to any person obtaining
+// a copy of this software and associated documentation files (the
+// "Software"), to deal in the Software without restriction, including
+// without limitation the rights to use, copy, modify, merge, publish,
+// distribute, sublicense, and/or sell copies of the Software, and to
+// permit persons to whom the Software is furnished to do so, subject to
+// the following conditions:
+// 
+// The above copyright notice and this permission notice shall be
+// included in all copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+// MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+// NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+// LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+// OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+// WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+// 
+// SPDX-License-Identifier: MIT
+// #LICENSE_END#
+//
+
+#include <libWexpr/Sink.h>
+
+#include <errno.h>
+#include <stdint.h>
+
+#if defined(_WIN32)
+	#include <io.h>
+#else
+	#include <unistd.h>
+#endif
+
+// --- private
+
+static bool s_sink_writeFile (void* userData, const void* data, size_t byteSize)
+{
+	FILE* file = userData;
+	
+	return fwrite(data, 1, byteSize, file) == byteSize;
+}
+
+static bool s_sink_writeFileDescriptor (void* userData, const void* data, size_t byteSize)
+{
+	int fd = (int)(intptr_t)userData;
+	const char* ptr = data;
+	
+	// write() can be partial, so keep going till its all out
+	while (byteSize > 0)
+	{
+#if defined(_WIN32)
+		unsigned int amount = (byteSize > 0x40000000) ? 0x40000000 : (unsigned int)byteSize;
+		int res = _write(fd, ptr, amount);
+#else
+		ssize_t res = write(fd, ptr, byteSize);
+#endif
+		
+		if (res < 0)
+		{
+			if (errno == EINTR)
+			{ continue; } // interrupted, try again
+			
+			return false;
+		}
+		
+		ptr += res;
+		byteSize -= (size_t)res;
+	}
+	
+	return true;
+}
+
+// --- Construction
+
+WexprSink wexpr_Sink_forCallback (WexprSinkWriteCallback callback, void* userData)
+{
+	WexprSink sink;
+	sink.write = callback;
+	sink.userData = userData;
+	
+	return sink;
+}
+
+WexprSink wexpr_Sink_forFile (FILE* file)
+{
+	return wexpr_Sink_forCallback(&s_sink_writeFile, file);
+}
+
+WexprSink wexpr_Sink_forFileDescriptor (int fileDescriptor)
+{
+	return wexpr_Sink_forCallback(&s_sink_writeFileDescriptor, (void*)(intptr_t)fileDescriptor);
+}
+
+// --- Writing
+
+bool wexpr_Sink_write (WexprSink* self, const void* data, size_t byteSize)
+{
+	if (byteSize == 0)
+	{ return true; }
+	
+	return self->write(self->userData, data, byteSize);
+}
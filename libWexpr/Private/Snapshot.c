@@ -0,0 +1,185 @@
+//
+/// \file libWexpr/Snapshot.c
+/// \brief Sharing an expression with many reading threads while replacing it
+//
+// #LICENSE_BEGIN:MIT#
+// 
+// Copyright (c) 2017-2020, Kenneth Perry (thothonegan)
+// 
+// Permission is hereby granted, free of charge, to any person obtaining
+// a copy of this software and associated documentation files (the
+// "Software"), to deal in the Software without restriction, including
+// without limitation the rights to use, copy, modify, merge, publish,
+// distribute, sublicense, and/or sell copies of the Software, and to
+// permit persons to whom the Software is furnished to do so, subject to
+// the following conditions:
+// 
+// The above copyright notice and this permission notice shall be
+// included in all copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+// MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+// NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+// LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+// OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+// WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+// 
+// SPDX-License-Identifier: MIT
+// #LICENSE_END#
+//
+
+#include <libWexpr/Snapshot.h>
+
+#include <libWexpr/Expression.h>
+#include "Thread.h"
+
+#include <stdlib.h>
+
+// --- private
+// Each published expression is a version with its own reference count: one for the snapshot while it's
+// current, plus one per reader. Readers count themselves in the version they load, but between loading
+// m_current and counting themselves the version could be replaced and released. So while doing that they're
+// also counted in m_acquiring, and publishing waits for those counts to drain before releasing the old version.
+// There are two counts (picked by the epoch) so new readers go to the other one while one drains.
+
+typedef struct WexprSnapshotPrivateVersion
+{
+	WexprExpression* expression; // we own
+	size_t references; // changed atomically
+} WexprSnapshotPrivateVersion;
+
+// privates to WexprSnapshot
+struct WexprSnapshot
+{
+	void* m_current; // the current WexprSnapshotPrivateVersion, read and swapped atomically. Null if none.
+	
+	size_t m_epoch; // its lowest bit is which m_acquiring new readers count themselves in
+	size_t m_acquiring[2]; // readers in the middle of acquiring
+	
+	void* m_publisher; // set while publishing, so only one publish waits on readers at a time
+};
+
+static void s_version_release (WexprSnapshotPrivateVersion* version)
+{
+	if (version && wexpr_PrivateThread_sequentialDecrement(&version->references) == 0)
+	{
+		wexpr_Expression_destroy(version->expression);
+		free (version);
+	}
+}
+
+// Wait until every reader which might have loaded the old version has counted itself in it.
+static void s_Snapshot_waitForAcquiring (WexprSnapshot* self)
+{
+	// move new readers to the other count, then wait for this one to drain. Do it for both, since readers
+	// which read the epoch before can still count themselves in the other one.
+	for (size_t i=0; i < 2; ++i)
+	{
+		size_t* acquiring = &self->m_acquiring[(wexpr_PrivateThread_sequentialIncrement(&self->m_epoch) - 1) & 1];
+		
+		while (wexpr_PrivateThread_sequentialLoad(acquiring) != 0)
+		{ wexpr_PrivateThread_yield(); }
+	}
+}
+
+// --- public Construction/Destruction
+
+WexprSnapshot* wexpr_Snapshot_create (WexprExpression* expression)
+{
+	WexprSnapshot* self = malloc(sizeof(WexprSnapshot));
+	if (!self)
+	{
+		wexpr_Expression_destroy(expression);
+		return LIBWEXPR_NULLPTR;
+	}
+	
+	self->m_current = LIBWEXPR_NULLPTR;
+	self->m_epoch = 0;
+	self->m_acquiring[0] = 0;
+	self->m_acquiring[1] = 0;
+	self->m_publisher = LIBWEXPR_NULLPTR;
+	
+	if (!wexpr_Snapshot_publish(self, expression))
+	{
+		free (self);
+		return LIBWEXPR_NULLPTR;
+	}
+	
+	return self;
+}
+
+void wexpr_Snapshot_destroy (WexprSnapshot* self)
+{
+	if (!self)
+	{ return; }
+	
+	// readers still holding it keep it alive
+	s_version_release(self->m_current);
+	
+	free (self);
+}
+
+// --- public Publishing
+
+bool wexpr_Snapshot_publish (WexprSnapshot* self, WexprExpression* expression)
+{
+	WexprSnapshotPrivateVersion* version = LIBWEXPR_NULLPTR;
+	
+	if (expression)
+	{
+		version = malloc(sizeof(WexprSnapshotPrivateVersion));
+		if (!version)
+		{
+			wexpr_Expression_destroy(expression);
+			return false;
+		}
+		
+		// readers only read, so make sure reading never changes it
+		wexpr_Expression_unshare(expression);
+		
+		version->expression = expression;
+		version->references = 1; // ours
+	}
+	
+	while (wexpr_PrivateThread_sequentialExchangePointer(&self->m_publisher, self) != LIBWEXPR_NULLPTR)
+	{ wexpr_PrivateThread_yield(); }
+	
+	WexprSnapshotPrivateVersion* old = wexpr_PrivateThread_sequentialExchangePointer(&self->m_current, version);
+	s_Snapshot_waitForAcquiring(self);
+	
+	wexpr_PrivateThread_sequentialExchangePointer(&self->m_publisher, LIBWEXPR_NULLPTR);
+	
+	// readers which have it are all counted now, so the last one out destroys it
+	s_version_release(old);
+	
+	return true;
+}
+
+// --- public Reading
+
+WexprSnapshotReader wexpr_Snapshot_acquire (WexprSnapshot* self)
+{
+	size_t* acquiring = &self->m_acquiring[wexpr_PrivateThread_sequentialLoad(&self->m_epoch) & 1];
+	wexpr_PrivateThread_sequentialIncrement(acquiring);
+	
+	WexprSnapshotPrivateVersion* version = wexpr_PrivateThread_sequentialLoadPointer(&self->m_current);
+	if (version)
+	{ wexpr_PrivateThread_sequentialIncrement(&version->references); }
+	
+	wexpr_PrivateThread_sequentialDecrement(acquiring);
+	
+	WexprSnapshotReader reader;
+	reader.expression = version ? version->expression : LIBWEXPR_NULLPTR;
+	reader.m_version = version;
+	
+	return reader;
+}
+
+void wexpr_SnapshotReader_release (WexprSnapshotReader* self)
+{
+	s_version_release(self->m_version);
+	
+	self->expression = LIBWEXPR_NULLPTR;
+	self->m_version = LIBWEXPR_NULLPTR;
+}
@@ -0,0 +1,265 @@
+//
+/// \file libWexpr/TextFormat.c
+/// \brief Character classes and writing helpers for the text wexpr format
+//
+// #LICENSE_BEGIN:MIT#
+// 
+// Copyright (c) 2017-2020, Kenneth Perry (thothonegan)
+// 
+// Permission is hereby granted, free of charge, to any person obtaining
+// a copy of this software and associated documentation files (the
+// "Software"), to deal in the Software without restriction, including
+// without limitation the rights to use, copy, modify, merge, publish,
+// distribute, sublicense, and/or sell copies of the Software, and to
+// permit persons to whom the Software is furnished to do so, subject to
+// the following conditions:
+// 
+// The above copyright notice and this permission notice shall be
+// included in all copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+// MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+// NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+// LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+// OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+// WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+// 
+// SPDX-License-Identifier: MIT
+// #LICENSE_END#
+//
+
+#include "TextFormat.h"
+
+#include "Base64.h"
+
+#include <stdint.h>
+
+#if defined(__SSE2__)
+	#include <emmintrin.h>
+#endif
+
+// --- private
+
+#define NEWLINE WexprPrivateTextFormatClassNewline
+#define WHITESPACE WexprPrivateTextFormatClassWhitespace
+#define NOTBAREWORD WexprPrivateTextFormatClassNotBarewordSafe
+#define ESCAPE WexprPrivateTextFormatClassRequiresEscape
+
+// we put '\r' in whitespace and not newline so its counted as a column instead of a line, cause windows.
+// we dont support classic macos style newlines properly as a side effect.
+const uint8_t wexpr_PrivateTextFormat_charClass[256] = {
+	['\n'] = NEWLINE | WHITESPACE | NOTBAREWORD | ESCAPE,
+	['\r'] = WHITESPACE | NOTBAREWORD | ESCAPE,
+	['\t'] = WHITESPACE | NOTBAREWORD | ESCAPE,
+	[' ']  = WHITESPACE | NOTBAREWORD,
+	['"']  = NOTBAREWORD | ESCAPE,
+	['\\'] = ESCAPE,
+	['*']  = NOTBAREWORD,
+	['#']  = NOTBAREWORD,
+	['@']  = NOTBAREWORD,
+	['(']  = NOTBAREWORD, [')'] = NOTBAREWORD,
+	['[']  = NOTBAREWORD, [']'] = NOTBAREWORD,
+	['^']  = NOTBAREWORD,
+	['<']  = NOTBAREWORD, ['>'] = NOTBAREWORD,
+	[';']  = NOTBAREWORD
+};
+
+#undef NEWLINE
+#undef WHITESPACE
+#undef NOTBAREWORD
+#undef ESCAPE
+
+typedef struct PrivateWexprValueStringProperties
+{
+	bool isBarewordSafe;
+	size_t escapeCount; // characters which need an escape if quoted
+	size_t firstEscape; // index of the first one, or the length if none
+} PrivateWexprValueStringProperties;
+
+#if defined(__SSE2__)
+
+static unsigned s_popcount16 (unsigned mask)
+{
+#if defined(__GNUC__)
+	return (unsigned)__builtin_popcount(mask);
+#else
+	unsigned count = 0;
+	for (; mask; mask &= mask - 1)
+	{ ++count; }
+	return count;
+#endif
+}
+
+static unsigned s_lowestBit16 (unsigned mask)
+{
+#if defined(__GNUC__)
+	return (unsigned)__builtin_ctz(mask);
+#else
+	unsigned index = 0;
+	while (!(mask & 1)) { mask >>= 1; ++index; }
+	return index;
+#endif
+}
+
+// classifies 16 bytes at a time, returning how far it got. The rest is done by the scalar loop.
+static size_t s_wexprValueStringPropertiesSSE2 (const char* string, size_t len, PrivateWexprValueStringProperties* props)
+{
+	const __m128i quote = _mm_set1_epi8('"');
+	const __m128i backslash = _mm_set1_epi8('\\');
+	const __m128i newline = _mm_set1_epi8('\n');
+	const __m128i carriageReturn = _mm_set1_epi8('\r');
+	const __m128i tab = _mm_set1_epi8('\t');
+	
+	size_t i = 0;
+	for (; i + 16 <= len; i += 16)
+	{
+		__m128i chunk = _mm_loadu_si128((const __m128i*)(string + i));
+		
+		// the escaped characters are also not bareword safe, except backslash
+		__m128i notBareword = _mm_or_si128(
+			_mm_or_si128(_mm_cmpeq_epi8(chunk, quote), _mm_cmpeq_epi8(chunk, newline)),
+			_mm_or_si128(_mm_cmpeq_epi8(chunk, carriageReturn), _mm_cmpeq_epi8(chunk, tab))
+		);
+		
+		unsigned escapeMask = (unsigned)_mm_movemask_epi8(_mm_or_si128(notBareword, _mm_cmpeq_epi8(chunk, backslash)));
+		
+		if (escapeMask)
+		{
+			if (props->escapeCount == 0)
+			{ props->firstEscape = i + s_lowestBit16(escapeMask); }
+			
+			props->escapeCount += s_popcount16(escapeMask);
+		}
+		
+		// once we know it needs quotes, we only care about the escapes
+		if (props->isBarewordSafe)
+		{
+			notBareword = _mm_or_si128(notBareword, _mm_or_si128(
+				_mm_or_si128(
+					_mm_or_si128(_mm_cmpeq_epi8(chunk, _mm_set1_epi8(' ')), _mm_cmpeq_epi8(chunk, _mm_set1_epi8('*'))),
+					_mm_or_si128(_mm_cmpeq_epi8(chunk, _mm_set1_epi8('#')), _mm_cmpeq_epi8(chunk, _mm_set1_epi8('@')))
+				),
+				_mm_or_si128(
+					_mm_or_si128(
+						_mm_or_si128(_mm_cmpeq_epi8(chunk, _mm_set1_epi8('(')), _mm_cmpeq_epi8(chunk, _mm_set1_epi8(')'))),
+						_mm_or_si128(_mm_cmpeq_epi8(chunk, _mm_set1_epi8('[')), _mm_cmpeq_epi8(chunk, _mm_set1_epi8(']')))
+					),
+					_mm_or_si128(
+						_mm_or_si128(_mm_cmpeq_epi8(chunk, _mm_set1_epi8('<')), _mm_cmpeq_epi8(chunk, _mm_set1_epi8('>'))),
+						_mm_or_si128(_mm_cmpeq_epi8(chunk, _mm_set1_epi8('^')), _mm_cmpeq_epi8(chunk, _mm_set1_epi8(';')))
+					)
+				)
+			));
+			
+			if (_mm_movemask_epi8(notBareword))
+			{ props->isBarewordSafe = false; }
+		}
+	}
+	
+	return i;
+}
+
+#endif // __SSE2__
+
+// one pass over the string to find if it needs quotes, and how many escapes it needs if so
+static PrivateWexprValueStringProperties s_wexprValueStringProperties (const char* string, size_t len)
+{
+	PrivateWexprValueStringProperties props;
+	
+	props.isBarewordSafe = (len != 0); // empty string is not safe, since that will be nothing
+	props.escapeCount = 0;
+	props.firstEscape = len;
+	
+	size_t i = 0;
+	
+#if defined(__SSE2__)
+	i = s_wexprValueStringPropertiesSSE2(string, len, &props);
+#endif
+	
+	uint8_t classes = 0;
+	for (; i < len; ++i)
+	{
+		uint8_t charClass = wexpr_PrivateTextFormat_charClass[(uint8_t)string[i]];
+		classes |= charClass;
+		
+		if (charClass & WexprPrivateTextFormatClassRequiresEscape)
+		{
+			if (props.escapeCount == 0)
+			{ props.firstEscape = i; }
+			
+			props.escapeCount += 1;
+		}
+	}
+	
+	if (classes & WexprPrivateTextFormatClassNotBarewordSafe)
+	{ props.isBarewordSafe = false; }
+	
+	return props;
+}
+
+// --- public
+
+void wexpr_PrivateTextFormat_writeValue (WexprPrivateOutput* out, const char* string, size_t stringLength)
+{
+	PrivateWexprValueStringProperties props = s_wexprValueStringProperties(string, stringLength);
+	
+	if (out->mode == WexprPrivateOutputModeCount)
+	{
+		// props already knows the size
+		out->size += stringLength + props.escapeCount + (props.isBarewordSafe ? 0 : 2);
+		return;
+	}
+	
+	if (!props.isBarewordSafe)
+	{ wexpr_PrivateOutput_writeChar(out, '\"'); }
+	
+	// copy runs of characters which dont need escaping in one go, stopping once all the escapes are out
+	size_t runStart = 0;
+	size_t escapesLeft = props.escapeCount;
+	
+	for (size_t i=props.firstEscape; escapesLeft != 0; ++i)
+	{
+		char c = string[i];
+		
+		if (wexpr_PrivateTextFormat_requiresEscape(c))
+		{
+			wexpr_PrivateOutput_write(out, string+runStart, i-runStart);
+			
+			// write it out as an escape
+			char escape[2] = { '\\', wexpr_PrivateTextFormat_escapeForValue(c) };
+			wexpr_PrivateOutput_write(out, escape, 2);
+			
+			runStart = i+1;
+			escapesLeft -= 1;
+		}
+	}
+	
+	wexpr_PrivateOutput_write(out, string+runStart, stringLength-runStart);
+	
+	if (!props.isBarewordSafe)
+	{ wexpr_PrivateOutput_writeChar(out, '\"'); } // add quotes
+}
+
+void wexpr_PrivateTextFormat_writeBase64 (WexprPrivateOutput* out, const void* data, size_t byteSize)
+{
+	if (out->mode == WexprPrivateOutputModeCount)
+	{
+		out->size += base64_encodedSize(byteSize);
+		return;
+	}
+	
+	// encode in pieces so we dont need a buffer for all of it
+	const size_t pieceSize = 768; // multiple of 3, so only the last piece gets padding
+	char encoded[1024]; // base64_encodedSize(pieceSize)
+	
+	for (size_t offset = 0; offset < byteSize; offset += pieceSize)
+	{
+		Base64IBuffer ibuf;
+		ibuf.buffer = (const uint8_t*)data + offset;
+		ibuf.size = (byteSize - offset < pieceSize) ? (byteSize - offset) : pieceSize;
+		
+		size_t encodedSize = base64_encodeInto(ibuf, encoded);
+		wexpr_PrivateOutput_write(out, encoded, encodedSize);
+	}
+}
@@ -0,0 +1,115 @@
+//
+/// \file libWexpr/TextFormat.h
+/// \brief Character classes and writing helpers for the text wexpr format
+//
+// #LICENSE_BEGIN:MIT#
+// 
+// Copyright (c) 2017-2020, Kenneth Perry (thothonegan)
+// 
+// Permission is hereby granted, free of charge, to any person obtaining
+// a copy of this software and associated documentation files (the
+// "Software"), to deal in the Software without restriction, including
+// without limitation the rights to use, copy, modify, merge, publish,
+// distribute, sublicense, and/or sell copies of the Software, and to
+// permit persons to whom the Software is furnished to do so, subject to
+// the following conditions:
+// 
+// The above copyright notice and this permission notice shall be
+// included in all copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+// MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+// NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+// LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+// OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+// WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+// 
+// SPDX-License-Identifier: MIT
+// #LICENSE_END#
+//
+
+#ifndef LIBWEXPR_TEXTFORMAT_H
+#define LIBWEXPR_TEXTFORMAT_H
+
+#include <libWexpr/Macros.h>
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "Output.h"
+
+LIBWEXPR_EXTERN_C_BEGIN()
+
+/// \name Character classes
+/// \{
+
+//
+/// \brief Bits in wexpr_PrivateTextFormat_charClass
+//
+enum
+{
+	WexprPrivateTextFormatClassNewline = (1 << 0U),
+	WexprPrivateTextFormatClassWhitespace = (1 << 1U), ///< includes newlines
+	WexprPrivateTextFormatClassNotBarewordSafe = (1 << 2U), ///< means a value with it must be quoted
+	WexprPrivateTextFormatClassRequiresEscape = (1 << 3U) ///< must be escaped inside a quoted value
+};
+
+//
+/// \brief The classes of every byte, so checks are a single lookup.
+//
+extern const uint8_t wexpr_PrivateTextFormat_charClass[256];
+
+static inline bool wexpr_PrivateTextFormat_isNewline (char c)
+{
+	return (wexpr_PrivateTextFormat_charClass[(uint8_t)c] & WexprPrivateTextFormatClassNewline) != 0;
+}
+
+static inline bool wexpr_PrivateTextFormat_isWhitespace (char c)
+{
+	return (wexpr_PrivateTextFormat_charClass[(uint8_t)c] & WexprPrivateTextFormatClassWhitespace) != 0;
+}
+
+static inline bool wexpr_PrivateTextFormat_isNotBarewordSafe (char c)
+{
+	return (wexpr_PrivateTextFormat_charClass[(uint8_t)c] & WexprPrivateTextFormatClassNotBarewordSafe) != 0;
+}
+
+static inline bool wexpr_PrivateTextFormat_requiresEscape (char c)
+{
+	return (wexpr_PrivateTextFormat_charClass[(uint8_t)c] & WexprPrivateTextFormatClassRequiresEscape) != 0;
+}
+
+static inline char wexpr_PrivateTextFormat_escapeForValue (char c)
+{
+	// only returns the escape part
+	if (c == '"')  { return '"'; }
+	if (c == '\r') { return 'r'; }
+	if (c == '\n') { return 'n'; }
+	if (c == '\t') { return 't'; }
+	if (c == '\\') { return '\\'; }
+	
+	return 0; // invalid
+}
+
+/// \}
+
+/// \name Writing
+/// \{
+
+//
+/// \brief Write a value (or map key), adding quotes and escapes as needed.
+//
+void wexpr_PrivateTextFormat_writeValue (WexprPrivateOutput* out, const char* string, size_t stringLength);
+
+//
+/// \brief Write binary data as base64, without the surrounding <>.
+//
+void wexpr_PrivateTextFormat_writeBase64 (WexprPrivateOutput* out, const void* data, size_t byteSize);
+
+/// \}
+
+LIBWEXPR_EXTERN_C_END()
+
+#endif // LIBWEXPR_TEXTFORMAT_H
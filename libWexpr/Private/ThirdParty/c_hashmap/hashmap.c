@@ -162,9 +162,10 @@ static unsigned long crc32(const unsigned char *s, unsigned int len)
 }
 
 /*
- * Hashing function for a string
+ * Hash of a string before it's fit to a table size, so it can be
+ * computed once and used with any map (libWexpr addition)
  */
-unsigned int hashmap_hash_int(hashmap_map * m, char* keystring){
+unsigned long hashmap_prehash(char* keystring){
 
     unsigned long key = crc32((unsigned char*)(keystring), (unsigned int) strlen(keystring));
 
@@ -181,7 +182,15 @@ unsigned int hashmap_hash_int(hashmap_map * m, char* keystring){
 	/* Knuth's Multiplicative Method */
 	key = (key >> 3) * 2654435761;
 
-	return key % m->table_size;
+	return key;
+}
+
+/*
+ * Hashing function for a string
+ */
+unsigned int hashmap_hash_int(hashmap_map * m, char* keystring){
+
+	return hashmap_prehash(keystring) % m->table_size;
 }
 
 /*
@@ -287,6 +296,15 @@ int hashmap_put(map_t in, char* key, any_t value){
  * Get your pointer out of the hashmap with a key
  */
 int hashmap_get(map_t in, char* key, any_t *arg){
+
+	return hashmap_get_prehashed(in, key, hashmap_prehash(key), arg);
+}
+
+/*
+ * Get your pointer out of the hashmap with a key and its hashmap_prehash()
+ * (libWexpr addition)
+ */
+int hashmap_get_prehashed(map_t in, char* key, unsigned long prehash, any_t *arg){
 	int curr;
 	int i;
 	hashmap_map* m;
@@ -295,7 +313,7 @@ int hashmap_get(map_t in, char* key, any_t *arg){
 	m = (hashmap_map *) in;
 
 	/* Find data location */
-	curr = hashmap_hash_int(m, key);
+	curr = prehash % m->table_size;
 
 	/* Linear probing, if necessary */
 	for(i = 0; i<MAX_CHAIN_LENGTH; i++){
@@ -57,6 +57,18 @@ extern int hashmap_put(map_t in, char* key, any_t value);
  */
 extern int hashmap_get(map_t in, char* key, any_t *arg);
 
+/*
+ * Hash of a key which can be used with any map, so repeated lookups of
+ * the same key only hash it once (libWexpr addition).
+ */
+extern unsigned long hashmap_prehash(char* key);
+
+/*
+ * Get an element from the hashmap using the key's hashmap_prehash().
+ * Return MAP_OK or MAP_MISSING (libWexpr addition).
+ */
+extern int hashmap_get_prehashed(map_t in, char* key, unsigned long prehash, any_t *arg);
+
 /*
  * Remove an element from the hashmap. Return MAP_OK or MAP_MISSING.
  */
@@ -0,0 +1,260 @@
+//
+/// \file libWexpr/Thread.c
+/// \brief Running work on multiple threads
+//
+// #LICENSE_BEGIN:MIT#
+// 
+// Copyright (c) 2017-2020, Kenneth Perry (thothonegan)
+// 
+// Permission is hereby granted, free of charge, to any person obtaining
+// a copy of this software and associated documentation files (the
+// "Software"), to deal in the Software without restriction, including
+// without limitation the rights to use, copy, modify, merge, publish,
+// distribute, sublicense, and/or sell copies of the Software, and to
+// permit persons to whom the Software is furnished to do so, subject to
+// the following conditions:
+// 
+// The above copyright notice and this permission notice shall be
+// included in all copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+// MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+// NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+// LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+// OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+// WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+// 
+// SPDX-License-Identifier: MIT
+// #LICENSE_END#
+//
+
+#include "Thread.h"
+
+#include <stdbool.h>
+#include <stdlib.h>
+
+#if defined(_WIN32)
+	#define WIN32_LEAN_AND_MEAN
+	#include <windows.h>
+#else
+	#include <pthread.h>
+	#include <sched.h>
+	#include <unistd.h>
+#endif
+
+// --- private
+
+// Every thread takes the next index from a shared counter until they're gone, so if some
+// take longer than others (eg. documents of different sizes) the rest of the threads pick up the slack.
+typedef struct PrivateParallelForWorker
+{
+	size_t next; // next index to take, only changed atomically
+	size_t count;
+	WexprPrivateThreadParallelForFunction function;
+	void* userData;
+} PrivateParallelForWorker;
+
+static void s_parallelFor_run (PrivateParallelForWorker* worker)
+{
+	for (;;)
+	{
+		size_t i = wexpr_PrivateThread_atomicFetchAdd(&worker->next, 1);
+		if (i >= worker->count)
+		{ break; }
+		
+		worker->function(worker->userData, i);
+	}
+}
+
+#if defined(_WIN32)
+
+typedef HANDLE PrivateThreadHandle;
+
+static DWORD WINAPI s_parallelFor_threadMain (LPVOID param)
+{
+	s_parallelFor_run(param);
+	return 0;
+}
+
+static bool s_thread_start (PrivateThreadHandle* thread, PrivateParallelForWorker* worker)
+{
+	*thread = CreateThread(NULL, 0, &s_parallelFor_threadMain, worker, 0, NULL);
+	return *thread != NULL;
+}
+
+static void s_thread_join (PrivateThreadHandle thread)
+{
+	WaitForSingleObject (thread, INFINITE);
+	CloseHandle (thread);
+}
+
+#else
+
+typedef pthread_t PrivateThreadHandle;
+
+static void* s_parallelFor_threadMain (void* param)
+{
+	s_parallelFor_run(param);
+	return NULL;
+}
+
+static bool s_thread_start (PrivateThreadHandle* thread, PrivateParallelForWorker* worker)
+{
+	return pthread_create(thread, NULL, &s_parallelFor_threadMain, worker) == 0;
+}
+
+static void s_thread_join (PrivateThreadHandle thread)
+{
+	pthread_join (thread, NULL);
+}
+
+#endif
+
+// --- public
+
+size_t wexpr_PrivateThread_hardwareConcurrency (void)
+{
+#if defined(_WIN32)
+	SYSTEM_INFO info;
+	GetSystemInfo (&info);
+	
+	return (info.dwNumberOfProcessors > 0) ? (size_t)info.dwNumberOfProcessors : 1;
+#else
+	long count = sysconf(_SC_NPROCESSORS_ONLN);
+	
+	return (count > 0) ? (size_t)count : 1;
+#endif
+}
+
+void wexpr_PrivateThread_parallelFor (size_t count, size_t maxThreads,
+	WexprPrivateThreadParallelForFunction function, void* userData
+)
+{
+	size_t threadCount = maxThreads ? maxThreads : wexpr_PrivateThread_hardwareConcurrency();
+	if (threadCount > count)
+	{ threadCount = count; }
+	
+	PrivateThreadHandle* threads = (threadCount > 1) ? malloc(threadCount * sizeof(PrivateThreadHandle)) : NULL;
+	
+	if (!threads)
+	{
+		// not worth it (or cant), so just do it here
+		for (size_t i=0; i < count; ++i)
+		{ function(userData, i); }
+		
+		return;
+	}
+	
+	PrivateParallelForWorker worker;
+	worker.next = 0;
+	worker.count = count;
+	worker.function = function;
+	worker.userData = userData;
+	
+	// the caller works too, and if a thread couldnt start the others just take its share
+	bool* started = calloc(threadCount, sizeof(bool));
+	
+	for (size_t t=1; t < threadCount && started; ++t)
+	{ started[t] = s_thread_start(&threads[t], &worker); }
+	
+	s_parallelFor_run(&worker);
+	
+	for (size_t t=1; t < threadCount && started; ++t)
+	{
+		if (started[t])
+		{ s_thread_join(threads[t]); }
+	}
+	
+	free (started);
+	free (threads);
+}
+
+void* wexpr_PrivateThread_atomicLoadPointer (void* const* pointer)
+{
+#if defined(_WIN32)
+	return ReadPointerAcquire ((PVOID const volatile*)pointer);
+#else
+	return __atomic_load_n (pointer, __ATOMIC_ACQUIRE);
+#endif
+}
+
+size_t wexpr_PrivateThread_atomicFetchAdd (size_t* value, size_t amount)
+{
+#if defined(_WIN64)
+	return (size_t)InterlockedExchangeAdd64 ((LONG64 volatile*)value, (LONG64)amount);
+#elif defined(_WIN32)
+	return (size_t)InterlockedExchangeAdd ((LONG volatile*)value, (LONG)amount);
+#else
+	return __atomic_fetch_add (value, amount, __ATOMIC_RELAXED);
+#endif
+}
+
+bool wexpr_PrivateThread_atomicCompareExchangePointer (void** pointer, void* expected, void* desired)
+{
+#if defined(_WIN32)
+	return InterlockedCompareExchangePointer ((PVOID volatile*)pointer, desired, expected) == expected;
+#else
+	return __atomic_compare_exchange_n (pointer, &expected, desired, false, __ATOMIC_RELEASE, __ATOMIC_RELAXED);
+#endif
+}
+
+size_t wexpr_PrivateThread_sequentialLoad (size_t* value)
+{
+#if defined(_WIN64)
+	return (size_t)InterlockedCompareExchange64 ((LONG64 volatile*)value, 0, 0);
+#elif defined(_WIN32)
+	return (size_t)InterlockedCompareExchange ((LONG volatile*)value, 0, 0);
+#else
+	return __atomic_load_n (value, __ATOMIC_SEQ_CST);
+#endif
+}
+
+size_t wexpr_PrivateThread_sequentialIncrement (size_t* value)
+{
+#if defined(_WIN64)
+	return (size_t)InterlockedIncrement64 ((LONG64 volatile*)value);
+#elif defined(_WIN32)
+	return (size_t)InterlockedIncrement ((LONG volatile*)value);
+#else
+	return __atomic_add_fetch (value, 1, __ATOMIC_SEQ_CST);
+#endif
+}
+
+size_t wexpr_PrivateThread_sequentialDecrement (size_t* value)
+{
+#if defined(_WIN64)
+	return (size_t)InterlockedDecrement64 ((LONG64 volatile*)value);
+#elif defined(_WIN32)
+	return (size_t)InterlockedDecrement ((LONG volatile*)value);
+#else
+	return __atomic_sub_fetch (value, 1, __ATOMIC_SEQ_CST);
+#endif
+}
+
+void* wexpr_PrivateThread_sequentialLoadPointer (void* const* pointer)
+{
+#if defined(_WIN32)
+	return InterlockedCompareExchangePointer ((PVOID volatile*)pointer, NULL, NULL);
+#else
+	return __atomic_load_n (pointer, __ATOMIC_SEQ_CST);
+#endif
+}
+
+void* wexpr_PrivateThread_sequentialExchangePointer (void** pointer, void* desired)
+{
+#if defined(_WIN32)
+	return InterlockedExchangePointer ((PVOID volatile*)pointer, desired);
+#else
+	return __atomic_exchange_n (pointer, desired, __ATOMIC_SEQ_CST);
+#endif
+}
+
+void wexpr_PrivateThread_yield (void)
+{
+#if defined(_WIN32)
+	SwitchToThread ();
+#else
+	sched_yield ();
+#endif
+}
@@ -0,0 +1,121 @@
+//
+/// \file libWexpr/Thread.h
+/// \brief Running work on multiple threads
+//
+// #LICENSE_BEGIN:MIT#
+// 
+// Copyright (c) 2017-2020, Kenneth Perry (thothonegan)
+// 
+// Permission is hereby granted, free of charge, to any person obtaining
+// a copy of this software and associated documentation files (the
+// "Software"), to deal in the Software without restriction, including
+// without limitation the rights to use, copy, modify, merge, publish,
+// distribute, sublicense, and/or sell copies of the Software, and to
+// permit persons to whom the Software is furnished to do so, subject to
+// the following conditions:
+// 
+// The above copyright notice and this permission notice shall be
+// included in all copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+// MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+// NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+// LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+// OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+// WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+// 
+// SPDX-License-Identifier: MIT
+// #LICENSE_END#
+//
+
+#ifndef LIBWEXPR_THREAD_H
+#define LIBWEXPR_THREAD_H
+
+#include <libWexpr/Macros.h>
+
+#include <stdbool.h>
+#include <stddef.h>
+
+LIBWEXPR_EXTERN_C_BEGIN()
+
+//
+/// \brief Called for each index by wexpr_PrivateThread_parallelFor().
+//
+typedef void (*WexprPrivateThreadParallelForFunction) (void* userData, size_t index);
+
+//
+/// \brief Number of threads the hardware can run at once. At least 1.
+//
+size_t wexpr_PrivateThread_hardwareConcurrency (void);
+
+//
+/// \brief Call function for every index in [0, count), spread over up to maxThreads threads (including the caller).
+/// Returns once all are done. Each index is called exactly once, but in no particular order.
+/// Threads take the next index as they finish, so uneven work is balanced.
+/// If threads cant be created, the remaining work is done on the calling thread.
+/// \param count Number of indexes
+/// \param maxThreads Most threads to use. 0 uses wexpr_PrivateThread_hardwareConcurrency().
+/// \param function The function to call
+/// \param userData Passed to function
+//
+void wexpr_PrivateThread_parallelFor (size_t count, size_t maxThreads,
+	WexprPrivateThreadParallelForFunction function, void* userData
+);
+
+//
+/// \brief Load a pointer which other threads may be setting, with acquire ordering.
+/// Anything written before it was stored (with wexpr_PrivateThread_atomicCompareExchangePointer()) is visible afterwards.
+//
+void* wexpr_PrivateThread_atomicLoadPointer (void* const* pointer);
+
+//
+/// \brief Add amount to *value, returning what it was before. Relaxed ordering, so only for counters.
+//
+size_t wexpr_PrivateThread_atomicFetchAdd (size_t* value, size_t amount);
+
+//
+/// \brief Set *pointer to desired if it's still expected, with release ordering on success.
+/// \return true if it was set, false if another thread changed it first
+//
+bool wexpr_PrivateThread_atomicCompareExchangePointer (void** pointer, void* expected, void* desired);
+
+// Sequentially consistent operations, for when the order between different variables matters
+// (eg. a reader counting itself then loading a pointer, while a writer swaps the pointer then checks the count).
+
+//
+/// \brief Load a size which other threads may be changing, sequentially consistent.
+//
+size_t wexpr_PrivateThread_sequentialLoad (size_t* value);
+
+//
+/// \brief Add 1 to *value, sequentially consistent.
+/// \return The new value
+//
+size_t wexpr_PrivateThread_sequentialIncrement (size_t* value);
+
+//
+/// \brief Subtract 1 from *value, sequentially consistent.
+/// \return The new value
+//
+size_t wexpr_PrivateThread_sequentialDecrement (size_t* value);
+
+//
+/// \brief Load a pointer which other threads may be setting, sequentially consistent.
+//
+void* wexpr_PrivateThread_sequentialLoadPointer (void* const* pointer);
+
+//
+/// \brief Set *pointer to desired, sequentially consistent.
+/// \return What it was before
+//
+void* wexpr_PrivateThread_sequentialExchangePointer (void** pointer, void* desired);
+
+//
+/// \brief Let other threads run before continuing, while waiting on them.
+//
+void wexpr_PrivateThread_yield (void);
+
+LIBWEXPR_EXTERN_C_END()
+
+#endif // LIBWEXPR_THREAD_H
@@ -0,0 +1,281 @@
+//
+/// \file libWexpr/TypedValue.c
+/// \brief Numbers and booleans stored as their type instead of text
+//
+// #LICENSE_BEGIN:MIT#
+// 
+// Copyright (c) 2017-2020, Kenneth Perry (thothonegan)
+// 
+// Permission is hereby granted, free of charge, to any person obtaining
+// a copy of this software and associated documentation files (the
+// "Software"), to deal in the Software without restriction, including
+// without limitation the rights to use, copy, modify, merge, publish,
+// distribute, sublicense, and/or sell copies of the Software, and to
+// permit persons to whom the Software is furnished to do so, subject to
+// the following conditions:
+// 
+// The above copyright notice and this permission notice shall be
+// included in all copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+// MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+// NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+// LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+// OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+// WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+// 
+// SPDX-License-Identifier: MIT
+// #LICENSE_END#
+//
+
+#include "TypedValue.h"
+
+#include <inttypes.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// --- private
+
+static bool s_isDigit (char c)
+{
+	return (c >= '0' && c <= '9');
+}
+
+// true if the text could only be a number without a decimal point, so the locale doesnt matter
+static bool s_isPlainNumberText (const char* str, size_t length)
+{
+	for (size_t i=0; i < length; ++i)
+	{
+		if (!s_isDigit(str[i]) && !strchr("+-eE", str[i]))
+		{ return false; }
+	}
+	
+	return true;
+}
+
+// the decimal point printf and strtod use for the current LC_NUMERIC (which can be more than one byte), returning its length.
+// asked of printf rather than localeconv(), since thats safe to use on multiple threads.
+static size_t s_localeDecimalPoint (char point[8])
+{
+	char half[16];
+	int length = snprintf(half, sizeof(half), "%.1f", 0.5); // 0<point>5
+	
+	if (length < 3 || length - 2 >= 8)
+	{
+		point[0] = '.';
+		return 1;
+	}
+	
+	memcpy (point, half + 1, (size_t)length - 2);
+	return (size_t)length - 2;
+}
+
+// replace the locale's decimal point in the zero terminated text with '.', returning the new length
+static size_t s_decimalPointFromLocale (char* buffer, size_t length)
+{
+	if (s_isPlainNumberText(buffer, length))
+	{ return length; }
+	
+	char point[9] = { 0 };
+	size_t pointLength = s_localeDecimalPoint(point);
+	
+	char* found = strstr(buffer, point);
+	if (!found || (pointLength == 1 && point[0] == '.'))
+	{ return length; }
+	
+	*found = '.';
+	memmove (found + 1, found + pointLength, length - (size_t)(found - buffer) - pointLength + 1); // with the terminator
+	
+	return length - (pointLength - 1);
+}
+
+// --- public
+
+size_t wexpr_PrivateTypedValue_format (const WexprPrivateTypedValue* value, char buffer[WEXPR_PRIVATE_TYPEDVALUE_TEXTBUFFERSIZE])
+{
+	int length = 0;
+	
+	switch (value->kind)
+	{
+		case WexprPrivateTypedValueKindInt64:
+			length = snprintf(buffer, WEXPR_PRIVATE_TYPEDVALUE_TEXTBUFFERSIZE, "%" PRId64, value->int64Value);
+			break;
+		
+		case WexprPrivateTypedValueKindFloat64:
+		{
+			// the shortest which reads back exactly, 17 digits always does. Always with '.', whatever the locale.
+			for (int precision = 15; precision <= 17; ++precision)
+			{
+				length = snprintf(buffer, WEXPR_PRIVATE_TYPEDVALUE_TEXTBUFFERSIZE, "%.*g", precision, value->float64Value);
+				
+				if (length <= 0 || length >= WEXPR_PRIVATE_TYPEDVALUE_TEXTBUFFERSIZE)
+				{ break; }
+				
+				length = (int)s_decimalPointFromLocale(buffer, (size_t)length);
+				
+				double readBack = 0;
+				if (wexpr_PrivateTypedValue_parseFloat64(buffer, (size_t)length, &readBack) && readBack == value->float64Value)
+				{ break; }
+			}
+			break;
+		}
+		
+		case WexprPrivateTypedValueKindBoolean:
+			length = snprintf(buffer, WEXPR_PRIVATE_TYPEDVALUE_TEXTBUFFERSIZE, "%s", value->booleanValue ? "true" : "false");
+			break;
+		
+		default:
+			buffer[0] = 0;
+	}
+	
+	return (length > 0) ? (size_t)length : 0;
+}
+
+bool wexpr_PrivateTypedValue_fromCanonicalText (const char* str, size_t length, WexprPrivateTypedValue* value)
+{
+	// most values arent numbers or booleans, so rule them out before parsing
+	if (length == 0 || length >= WEXPR_PRIVATE_TYPEDVALUE_TEXTBUFFERSIZE)
+	{ return false; }
+	
+	char first = str[0];
+	
+	if (first == 't' || first == 'f')
+	{
+		value->kind = WexprPrivateTypedValueKindBoolean;
+		return wexpr_PrivateTypedValue_parseBoolean(str, length, &value->booleanValue);
+	}
+	
+	if (!s_isDigit(first) && first != '-')
+	{ return false; }
+	
+	if (wexpr_PrivateTypedValue_parseInt64(str, length, &value->int64Value))
+	{
+		value->kind = WexprPrivateTypedValueKindInt64;
+	}
+	else if (wexpr_PrivateTypedValue_parseFloat64(str, length, &value->float64Value) && isfinite(value->float64Value))
+	{
+		value->kind = WexprPrivateTypedValueKindFloat64;
+	}
+	else
+	{ return false; }
+	
+	// only if the text would come back the same (so not 007, 1.50, 1e3, ...)
+	char canonical[WEXPR_PRIVATE_TYPEDVALUE_TEXTBUFFERSIZE];
+	size_t canonicalLength = wexpr_PrivateTypedValue_format(value, canonical);
+	
+	return (canonicalLength == length && memcmp(canonical, str, length) == 0);
+}
+
+bool wexpr_PrivateTypedValue_parseInt64 (const char* str, size_t length, int64_t* result)
+{
+	size_t pos = 0;
+	bool negative = false;
+	
+	if (length > 0 && (str[0] == '-' || str[0] == '+'))
+	{
+		negative = (str[0] == '-');
+		pos = 1;
+	}
+	
+	if (pos == length)
+	{ return false; }
+	
+	// accumulate as negative, since it has the larger range
+	int64_t value = 0;
+	
+	for (; pos < length; ++pos)
+	{
+		if (!s_isDigit(str[pos]))
+		{ return false; }
+		
+		int digit = str[pos] - '0';
+		
+		if (value < (INT64_MIN + digit) / 10)
+		{ return false; } // overflow
+		
+		value = value * 10 - digit;
+	}
+	
+	if (!negative)
+	{
+		if (value == INT64_MIN)
+		{ return false; }
+		
+		value = -value;
+	}
+	
+	*result = value;
+	return true;
+}
+
+bool wexpr_PrivateTypedValue_parseFloat64 (const char* str, size_t length, double* result)
+{
+	// strtod skips leading whitespace, which wouldnt be the whole text
+	if (length == 0 || (!s_isDigit(str[0]) && str[0] != '-' && str[0] != '+' && str[0] != '.'))
+	{ return false; }
+	
+	// strtod uses the locale's decimal point, so swap '.' for it - and the locale's own point isnt one of ours
+	char point[8] = { '.' };
+	size_t pointLength = 1;
+	
+	if (!s_isPlainNumberText(str, length))
+	{ pointLength = s_localeDecimalPoint(point); }
+	
+	bool localePoint = !(pointLength == 1 && point[0] == '.');
+	const char* dot = memchr(str, '.', length);
+	
+	if (localePoint && memchr(str, point[0], length))
+	{ return false; }
+	
+	// strtod needs it zero terminated
+	size_t copyLength = (localePoint && dot) ? length + pointLength - 1 : length;
+	
+	char small[WEXPR_PRIVATE_TYPEDVALUE_TEXTBUFFERSIZE];
+	char* copy = (copyLength < sizeof(small)) ? small : malloc(copyLength + 1);
+	
+	if (!copy)
+	{ return false; }
+	
+	if (localePoint && dot)
+	{
+		size_t before = (size_t)(dot - str);
+		
+		memcpy (copy, str, before);
+		memcpy (copy + before, point, pointLength);
+		memcpy (copy + before + pointLength, dot + 1, length - before - 1);
+	}
+	else
+	{ memcpy (copy, str, length); }
+	
+	copy[copyLength] = 0;
+	
+	char* end = NULL;
+	*result = strtod(copy, &end);
+	
+	bool success = (end == copy + copyLength);
+	
+	if (copy != small)
+	{ free (copy); }
+	
+	return success;
+}
+
+bool wexpr_PrivateTypedValue_parseBoolean (const char* str, size_t length, bool* result)
+{
+	if (length == 4 && memcmp(str, "true", 4) == 0)
+	{
+		*result = true;
+		return true;
+	}
+	
+	if (length == 5 && memcmp(str, "false", 5) == 0)
+	{
+		*result = false;
+		return true;
+	}
+	
+	return false;
+}
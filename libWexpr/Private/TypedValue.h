@@ -0,0 +1,116 @@
+//
+/// \file libWexpr/TypedValue.h
+/// \brief Numbers and booleans stored as their type instead of text
+//
+// #LICENSE_BEGIN:MIT#
+// 
+// Copyright (c) 2017-2020, Kenneth Perry (thothonegan)
+// 
+// Permission is hereby granted, free of charge, to any person obtaining
+// a copy of this software and associated documentation files (the
+// "Software"), to deal in the Software without restriction, including
+// without limitation the rights to use, copy, modify, merge, publish,
+// distribute, sublicense, and/or sell copies of the Software, and to
+// permit persons to whom the Software is furnished to do so, subject to
+// the following conditions:
+// 
+// The above copyright notice and this permission notice shall be
+// included in all copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+// MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+// NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+// LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+// OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+// WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+// 
+// SPDX-License-Identifier: MIT
+// #LICENSE_END#
+//
+
+#ifndef LIBWEXPR_TYPEDVALUE_H
+#define LIBWEXPR_TYPEDVALUE_H
+
+#include <libWexpr/Macros.h>
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+LIBWEXPR_EXTERN_C_BEGIN()
+
+// Values are always text, but ones which are numbers or booleans can also be stored as their type (see
+// Documentation/BinaryTypedValues.md). A typed value always has one canonical text, so the text can be
+// recreated exactly from the type.
+
+//
+/// \brief What a typed value holds.
+//
+enum
+{
+	WexprPrivateTypedValueKindNone = 0, ///< Not typed, only text
+	WexprPrivateTypedValueKindInt64,
+	WexprPrivateTypedValueKindFloat64,
+	WexprPrivateTypedValueKindBoolean
+};
+
+//
+/// \brief A value as its type.
+//
+typedef struct WexprPrivateTypedValue
+{
+	uint8_t kind; // WexprPrivateTypedValueKind*
+	union
+	{
+		int64_t int64Value;
+		double float64Value;
+		bool booleanValue;
+	};
+} WexprPrivateTypedValue;
+
+//
+/// \brief Enough for the text of any typed value, including the terminator.
+//
+#define WEXPR_PRIVATE_TYPEDVALUE_TEXTBUFFERSIZE 32
+
+//
+/// \brief Write the canonical text of a typed value.
+/// Floats use the shortest of 15, 16 or 17 significant digits which reads back exactly, always with '.' whatever the locale.
+/// \param value The value, which must be typed
+/// \param buffer Filled with the zero terminated text
+/// \return The length of the text
+//
+size_t wexpr_PrivateTypedValue_format (const WexprPrivateTypedValue* value, char buffer[WEXPR_PRIVATE_TYPEDVALUE_TEXTBUFFERSIZE]);
+
+//
+/// \brief Find the typed value for text, if the text is exactly its canonical form (so storing the type loses nothing).
+/// \param str The text
+/// \param length The length of str
+/// \param value Filled in if it can be typed
+/// \return true if it can be typed
+//
+bool wexpr_PrivateTypedValue_fromCanonicalText (const char* str, size_t length, WexprPrivateTypedValue* value);
+
+//
+/// \brief Parse text as a base 10 integer, with an optional sign. The whole text must be the number.
+/// \return false if not an integer or out of range
+//
+bool wexpr_PrivateTypedValue_parseInt64 (const char* str, size_t length, int64_t* result);
+
+//
+/// \brief Parse text as a floating point number (as strtod, but always with '.' for the decimal point whatever the locale).
+/// The whole text must be the number.
+/// \return false if not a number
+//
+bool wexpr_PrivateTypedValue_parseFloat64 (const char* str, size_t length, double* result);
+
+//
+/// \brief Parse "true" or "false".
+/// \return false if neither
+//
+bool wexpr_PrivateTypedValue_parseBoolean (const char* str, size_t length, bool* result);
+
+LIBWEXPR_EXTERN_C_END()
+
+#endif // LIBWEXPR_TYPEDVALUE_H
@@ -0,0 +1,512 @@
+//
+/// \file libWexpr/Writer.c
+/// \brief Writes wexpr documents from a stream of events, without building a tree
+//
+// #LICENSE_BEGIN:MIT#
+// 
+// Copyright (c) 2017-2020, Kenneth Perry (thothonegan)
+// 
+// Permission is hereby granted, free of charge, to any person obtaining
+// a copy of this software and associated documentation files (the
+// "Software"), to deal in the Software without restriction, including
+// without limitation the rights to use, copy, modify, merge, publish,
+// distribute, sublicense, and/or sell copies of the Software, and to
+// permit persons to whom the Software is furnished to do so, subject to
+// the following conditions:
+// 
+// The above copyright notice and this permission notice shall be
+// included in all copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+// MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+// NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+// LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+// OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+// WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+// 
+// SPDX-License-Identifier: MIT
+// #LICENSE_END#
+//
+
+#include <libWexpr/Writer.h>
+
+#include <libWexpr/ExpressionType.h>
+#include <libWexpr/Sink.h>
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "BinaryFormat.h"
+#include "Output.h"
+#include "TextFormat.h"
+
+// --- private
+
+// an open array or map
+typedef struct PrivateWriterLevel
+{
+	WexprExpressionType type; // array or map
+	size_t count; // elements (or map values) written so far
+	bool hasKey; // map: a key was written and is waiting for its value
+	
+	// binary
+	size_t patchIndex; // where our chunk header goes
+	size_t contentSize; // size of everything written inside us so far
+} PrivateWriterLevel;
+
+// binary: a chunk header to insert into the pending buffer once we know its size
+typedef struct PrivateWriterPatch
+{
+	size_t offset; // in the pending buffer
+	uint8_t header[WEXPR_PRIVATE_BINARYFORMAT_MAXCHUNKHEADERSIZE];
+	size_t headerSize;
+} PrivateWriterPatch;
+
+struct WexprWriter
+{
+	bool isBinary;
+	WexprWriteFlags flags;
+	bool failed; // out of place event, out of memory, or the sink failed
+	bool wroteRoot;
+	
+	WexprSink sink;
+	char* sinkBuffer;
+	WexprPrivateOutput out;
+	
+	PrivateWriterLevel* levels; // open arrays/maps, innermost last
+	size_t levelCount;
+	size_t levelCapacity;
+	
+	// binary: everything inside the root array/map, and the headers to insert into it.
+	// Patches are added when a container begins, so they're already sorted by offset with
+	// outer containers first.
+	WexprPrivateOutput pending;
+	PrivateWriterPatch* patches;
+	size_t patchCount;
+	size_t patchCapacity;
+};
+
+// grow an array to fit one more element. Returns false if out of memory.
+static bool s_reserveOneMore (void** array, size_t* capacity, size_t count, size_t elementSize)
+{
+	if (count < *capacity)
+	{ return true; }
+	
+	size_t newCapacity = *capacity ? *capacity * 2 : 16;
+	void* newArray = realloc(*array, newCapacity * elementSize);
+	if (!newArray)
+	{ return false; }
+	
+	*array = newArray;
+	*capacity = newCapacity;
+	return true;
+}
+
+static bool s_Writer_fail (WexprWriter* self)
+{
+	self->failed = true;
+	return false;
+}
+
+static bool s_Writer_isHumanReadable (WexprWriter* self)
+{
+	return ((self->flags & WexprWriteFlagHumanReadable) == WexprWriteFlagHumanReadable);
+}
+
+static PrivateWriterLevel* s_Writer_top (WexprWriter* self)
+{
+	return self->levelCount ? &self->levels[self->levelCount-1] : NULL;
+}
+
+// binary: where the next chunk goes
+static WexprPrivateOutput* s_Writer_binaryOutput (WexprWriter* self)
+{
+	return self->levelCount ? &self->pending : &self->out;
+}
+
+// check an expression can go here, and write what comes before it
+static bool s_Writer_beginItem (WexprWriter* self)
+{
+	if (self->failed)
+	{ return false; }
+	
+	PrivateWriterLevel* top = s_Writer_top(self);
+	
+	if (!top)
+	{
+		if (self->wroteRoot)
+		{ return s_Writer_fail(self); } // only one root
+		
+		return true;
+	}
+	
+	if (top->type == WexprExpressionTypeMap)
+	{
+		if (!top->hasKey)
+		{ return s_Writer_fail(self); } // need a key first
+		
+		return true; // the key wrote the seperator
+	}
+	
+	if (!self->isBinary)
+	{
+		// array : human readable we'll write each one on its own line.
+		if (s_Writer_isHumanReadable(self))
+		{
+			if (top->count == 0)
+			{ wexpr_PrivateOutput_writeChar(&self->out, '\n'); }
+			
+			wexpr_PrivateOutput_writeRepeated(&self->out, '\t', self->levelCount);
+		}
+		else if (top->count != 0)
+		{
+			wexpr_PrivateOutput_writeChar(&self->out, ' '); // we need a space
+		}
+	}
+	
+	return true;
+}
+
+// an expression was completed, with the given binary chunk size
+static bool s_Writer_endItem (WexprWriter* self, size_t chunkSize)
+{
+	PrivateWriterLevel* top = s_Writer_top(self);
+	
+	if (!top)
+	{
+		self->wroteRoot = true;
+	}
+	else
+	{
+		top->count += 1;
+		top->hasKey = false;
+		top->contentSize += chunkSize;
+		
+		if (!self->isBinary && s_Writer_isHumanReadable(self))
+		{ wexpr_PrivateOutput_writeChar(&self->out, '\n'); }
+	}
+	
+	if (self->out.failed || self->pending.failed)
+	{ return s_Writer_fail(self); }
+	
+	return true;
+}
+
+// binary: write a chunk header, returning its size
+static size_t s_Writer_writeChunkHeader (WexprWriter* self, size_t contentSize, WexprExpressionType type)
+{
+	uint8_t header[WEXPR_PRIVATE_BINARYFORMAT_MAXCHUNKHEADERSIZE];
+	size_t headerSize = wexpr_PrivateBinaryFormat_encodeChunkHeader(header, contentSize, (uint8_t)type);
+	
+	wexpr_PrivateOutput_write(s_Writer_binaryOutput(self), header, headerSize);
+	
+	return headerSize;
+}
+
+// binary: the root array/map is complete, so send it with all of the headers inserted
+static void s_Writer_flushPending (WexprWriter* self)
+{
+	size_t position = 0;
+	
+	for (size_t i=0; i < self->patchCount; ++i)
+	{
+		PrivateWriterPatch* patch = &self->patches[i];
+		
+		if (patch->offset != position)
+		{ wexpr_PrivateOutput_write(&self->out, self->pending.buffer + position, patch->offset - position); }
+		
+		wexpr_PrivateOutput_write(&self->out, patch->header, patch->headerSize);
+		
+		position = patch->offset;
+	}
+	
+	if (self->pending.size != position)
+	{ wexpr_PrivateOutput_write(&self->out, self->pending.buffer + position, self->pending.size - position); }
+	
+	self->pending.size = 0;
+	self->patchCount = 0;
+}
+
+static bool s_Writer_beginContainer (WexprWriter* self, WexprExpressionType type)
+{
+	if (!s_Writer_beginItem(self))
+	{ return false; }
+	
+	if (!s_reserveOneMore((void**)&self->levels, &self->levelCapacity, self->levelCount, sizeof(PrivateWriterLevel)))
+	{ return s_Writer_fail(self); }
+	
+	PrivateWriterLevel level;
+	level.type = type;
+	level.count = 0;
+	level.hasKey = false;
+	level.patchIndex = 0;
+	level.contentSize = 0;
+	
+	if (self->isBinary)
+	{
+		if (!s_reserveOneMore((void**)&self->patches, &self->patchCapacity, self->patchCount, sizeof(PrivateWriterPatch)))
+		{ return s_Writer_fail(self); }
+		
+		// header gets filled in when we end
+		PrivateWriterPatch* patch = &self->patches[self->patchCount];
+		patch->offset = self->pending.size;
+		patch->headerSize = 0;
+		
+		level.patchIndex = (self->patchCount)++;
+	}
+	else
+	{
+		wexpr_PrivateOutput_write(&self->out, (type == WexprExpressionTypeArray) ? "#(" : "@(", 2);
+	}
+	
+	self->levels[(self->levelCount)++] = level;
+	return true;
+}
+
+static bool s_Writer_endContainer (WexprWriter* self, WexprExpressionType type)
+{
+	if (self->failed)
+	{ return false; }
+	
+	PrivateWriterLevel* top = s_Writer_top(self);
+	if (!top || top->type != type || top->hasKey)
+	{ return s_Writer_fail(self); }
+	
+	size_t chunkSize = 0;
+	
+	if (self->isBinary)
+	{
+		PrivateWriterPatch* patch = &self->patches[top->patchIndex];
+		patch->headerSize = wexpr_PrivateBinaryFormat_encodeChunkHeader(patch->header, top->contentSize, (uint8_t)type);
+		
+		chunkSize = patch->headerSize + top->contentSize;
+	}
+	else
+	{
+		// if human readable, indent and add the end
+		if (s_Writer_isHumanReadable(self) && top->count != 0)
+		{ wexpr_PrivateOutput_writeRepeated(&self->out, '\t', self->levelCount-1); }
+		
+		wexpr_PrivateOutput_writeChar(&self->out, ')');
+	}
+	
+	self->levelCount -= 1;
+	
+	if (self->isBinary && self->levelCount == 0)
+	{ s_Writer_flushPending(self); }
+	
+	return s_Writer_endItem(self, chunkSize);
+}
+
+static WexprWriter* s_Writer_create (WexprSink* sink, WexprWriteFlags flags, bool isBinary)
+{
+	WexprWriter* self = calloc(1, sizeof(WexprWriter));
+	if (!self)
+	{ return NULL; }
+	
+	self->sinkBuffer = malloc(WEXPR_PRIVATE_OUTPUT_SINKBUFFERSIZE);
+	if (!self->sinkBuffer)
+	{
+		free (self);
+		return NULL;
+	}
+	
+	self->isBinary = isBinary;
+	self->flags = flags;
+	self->sink = *sink;
+	
+	wexpr_PrivateOutput_initSink(&self->out, &self->sink, self->sinkBuffer, WEXPR_PRIVATE_OUTPUT_SINKBUFFERSIZE);
+	wexpr_PrivateOutput_initGrowable(&self->pending, 0);
+	
+	return self;
+}
+
+// --- Construction/Destruction
+
+WexprWriter* wexpr_Writer_createText (WexprSink* sink, WexprWriteFlags flags)
+{
+	return s_Writer_create(sink, flags, false);
+}
+
+WexprWriter* wexpr_Writer_createBinary (WexprSink* sink, WexprWriteFlags flags)
+{
+	WexprWriter* self = s_Writer_create(sink, flags, true);
+	
+	if (self && (flags & WexprWriteFlagBinaryFileHeader))
+	{
+		uint8_t header[WEXPR_PRIVATE_BINARYFORMAT_HEADERSIZE];
+		wexpr_PrivateBinaryFormat_writeHeader(header);
+		
+		// currently we have no aux chunks
+		wexpr_PrivateOutput_write(&self->out, header, sizeof(header));
+	}
+	
+	return self;
+}
+
+void wexpr_Writer_destroy (WexprWriter* self)
+{
+	if (!self)
+	{ return; }
+	
+	free (self->sinkBuffer);
+	free (self->levels);
+	free (self->pending.buffer);
+	free (self->patches);
+	free (self);
+}
+
+bool wexpr_Writer_finish (WexprWriter* self)
+{
+	if (self->failed)
+	{ return false; }
+	
+	if (self->levelCount != 0 || !self->wroteRoot)
+	{ return s_Writer_fail(self); } // incomplete
+	
+	if (!wexpr_PrivateOutput_finish(&self->out))
+	{ return s_Writer_fail(self); }
+	
+	return true;
+}
+
+// --- Values
+
+bool wexpr_Writer_null (WexprWriter* self)
+{
+	if (!s_Writer_beginItem(self))
+	{ return false; }
+	
+	size_t chunkSize = 0;
+	
+	if (self->isBinary)
+	{ chunkSize = s_Writer_writeChunkHeader(self, 0, WexprExpressionTypeNull); }
+	else
+	{ wexpr_PrivateOutput_write(&self->out, "null", 4); }
+	
+	return s_Writer_endItem(self, chunkSize);
+}
+
+bool wexpr_Writer_value (WexprWriter* self, const char* value)
+{
+	return wexpr_Writer_valueLengthString(self, value, strlen(value));
+}
+
+bool wexpr_Writer_valueLengthString (WexprWriter* self, const char* value, size_t length)
+{
+	if (!s_Writer_beginItem(self))
+	{ return false; }
+	
+	size_t chunkSize = 0;
+	
+	if (self->isBinary)
+	{
+		chunkSize = s_Writer_writeChunkHeader(self, length, WexprExpressionTypeValue) + length;
+		wexpr_PrivateOutput_write(s_Writer_binaryOutput(self), value, length);
+	}
+	else
+	{
+		wexpr_PrivateTextFormat_writeValue(&self->out, value, length);
+	}
+	
+	return s_Writer_endItem(self, chunkSize);
+}
+
+bool wexpr_Writer_binaryData (WexprWriter* self, const void* data, size_t byteSize)
+{
+	if (!s_Writer_beginItem(self))
+	{ return false; }
+	
+	size_t chunkSize = 0;
+	
+	if (self->isBinary)
+	{
+		WexprPrivateOutput* out = s_Writer_binaryOutput(self);
+		
+		chunkSize = s_Writer_writeChunkHeader(self, byteSize + 1, WexprExpressionTypeBinaryData) + byteSize + 1; // 1 byte for compression method
+		wexpr_PrivateOutput_writeChar(out, 0x00); // for now, only raw (no compression)
+		wexpr_PrivateOutput_write(out, data, byteSize);
+	}
+	else
+	{
+		// binary data - encode as Base64
+		wexpr_PrivateOutput_writeChar(&self->out, '<');
+		wexpr_PrivateTextFormat_writeBase64(&self->out, data, byteSize);
+		wexpr_PrivateOutput_writeChar(&self->out, '>');
+	}
+	
+	return s_Writer_endItem(self, chunkSize);
+}
+
+// --- Arrays
+
+bool wexpr_Writer_beginArray (WexprWriter* self)
+{
+	return s_Writer_beginContainer(self, WexprExpressionTypeArray);
+}
+
+bool wexpr_Writer_endArray (WexprWriter* self)
+{
+	return s_Writer_endContainer(self, WexprExpressionTypeArray);
+}
+
+// --- Maps
+
+bool wexpr_Writer_beginMap (WexprWriter* self)
+{
+	return s_Writer_beginContainer(self, WexprExpressionTypeMap);
+}
+
+bool wexpr_Writer_key (WexprWriter* self, const char* key)
+{
+	return wexpr_Writer_keyLengthString(self, key, strlen(key));
+}
+
+bool wexpr_Writer_keyLengthString (WexprWriter* self, const char* key, size_t length)
+{
+	if (self->failed)
+	{ return false; }
+	
+	PrivateWriterLevel* top = s_Writer_top(self);
+	if (!top || top->type != WexprExpressionTypeMap || top->hasKey)
+	{ return s_Writer_fail(self); }
+	
+	if (self->isBinary)
+	{
+		// the map key is written as a value
+		top->contentSize += s_Writer_writeChunkHeader(self, length, WexprExpressionTypeValue) + length;
+		wexpr_PrivateOutput_write(&self->pending, key, length);
+	}
+	else
+	{
+		// if human readable, each pair is on its own line: indent, key, space, value, newline
+		if (s_Writer_isHumanReadable(self))
+		{
+			if (top->count == 0)
+			{ wexpr_PrivateOutput_writeChar(&self->out, '\n'); }
+			
+			wexpr_PrivateOutput_writeRepeated(&self->out, '\t', self->levelCount);
+		}
+		else if (top->count != 0)
+		{
+			wexpr_PrivateOutput_writeChar(&self->out, ' '); // we need a space
+		}
+		
+		wexpr_PrivateTextFormat_writeValue(&self->out, key, length);
+		wexpr_PrivateOutput_writeChar(&self->out, ' ');
+	}
+	
+	top->hasKey = true;
+	
+	if (self->out.failed || self->pending.failed)
+	{ return s_Writer_fail(self); }
+	
+	return true;
+}
+
+bool wexpr_Writer_endMap (WexprWriter* self)
+{
+	return s_Writer_endContainer(self, WexprExpressionTypeMap);
+}
@@ -0,0 +1,187 @@
+//
+/// \file libWexpr/AlignedView.h
+/// \brief Read only view into aligned binary wexpr files, which needs no parsing
+//
+// #LICENSE_BEGIN:MIT#
+// 
+// Copyright (c) 2017-2020, Kenneth Perry (thothonegan)
+// 
+// Permission is hereby granted, free of charge, to any person obtaining
+// a copy of this software and associated documentation files (the
+// "Software"), to deal in the Software without restriction, including
+// without limitation the rights to use, copy, modify, merge, publish,
+// distribute, sublicense, and/or sell copies of the Software, and to
+// permit persons to whom the Software is furnished to do so, subject to
+// the following conditions:
+// 
+// The above copyright notice and this permission notice shall be
+// included in all copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+// MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+// NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+// LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+// OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+// WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+// 
+// SPDX-License-Identifier: MIT
+// #LICENSE_END#
+//
+
+#ifndef LIBWEXPR_ALIGNEDVIEW_H
+#define LIBWEXPR_ALIGNEDVIEW_H
+
+#include "Error.h"
+#include "ExpressionType.h"
+#include "Macros.h"
+
+#include <stdbool.h>
+#include <stddef.h> // size_t
+#include <stdint.h>
+
+LIBWEXPR_EXTERN_C_BEGIN()
+
+//
+/// \struct WexprAlignedView
+/// \brief A read only view of a node in an aligned binary wexpr file (written with WexprWriteFlagBinaryAligned).
+///
+/// The aligned layout is made to be used in place: everything is little endian and 8 byte aligned, arrays
+/// have a table of child offsets, and maps have their keys pre-hashed and sorted. So with a memory mapped file
+/// nothing is parsed - arrayAt() and count() are constant time, finding a key is O(log n), and values are
+/// zero terminated in the file.
+///
+/// Like WexprBinaryView, views are small values which dont own anything, and every step is bounds checked so
+/// malformed data gives an invalid view. The file must stay valid while they are used.
+//
+typedef struct WexprAlignedView
+{
+	const uint8_t* file; ///< Start of the file
+	uint64_t fileSize; ///< Size of the file from its prologue
+	uint64_t offset; ///< Offset of the node in the file
+	
+	WexprExpressionType type; ///< Type of the node, or WexprExpressionTypeInvalid if the view is invalid
+	uint64_t count; ///< Bytes for values and binary data, elements for arrays, pairs for maps
+	const uint8_t* payload; ///< Start of the data after the node header
+	uint32_t extra; ///< Compression for binary data
+} WexprAlignedView;
+
+/// \name Construction
+/// \relates WexprAlignedView
+/// \{
+
+//
+/// \brief Create a view of the root of an aligned binary file. The header and prologue are validated.
+/// \param data The whole file. Reading is fastest if it's 8 byte aligned, which memory mapped files are.
+/// \param length The size of data
+/// \param error Error information if any occurs.
+/// \return The view of the root. Invalid if the file is bad (including a file in the chunked layout).
+//
+LIBWEXPR_PUBLIC WexprAlignedView wexpr_AlignedView_createFromFile (const void* data, size_t length, WexprError* error);
+
+/// \}
+
+/// \name Information
+/// \relates WexprAlignedView
+/// \{
+
+//
+/// \brief Return true if the view refers to a node.
+/// \param self The view
+//
+LIBWEXPR_PUBLIC bool wexpr_AlignedView_isValid (const WexprAlignedView* self);
+
+//
+/// \brief Return the type of the node, or WexprExpressionTypeInvalid if the view is invalid.
+/// \param self The view
+//
+LIBWEXPR_PUBLIC WexprExpressionType wexpr_AlignedView_type (const WexprAlignedView* self);
+
+/// \}
+
+/// \name Values
+/// \relates WexprAlignedView
+/// \{
+
+//
+/// \brief Return the value in the file. It's zero terminated, so can be used as a C string.
+/// \param self The view
+/// \param length If not null, set to the length of the value
+/// \return The value, or null if not a value.
+//
+LIBWEXPR_PUBLIC const char* wexpr_AlignedView_value (const WexprAlignedView* self, size_t* length);
+
+//
+/// \brief Return true if the view is a value equal to the given string.
+/// \param self The view
+/// \param str The string to compare to
+/// \param length The length of str
+//
+LIBWEXPR_PUBLIC bool wexpr_AlignedView_valueEquals (const WexprAlignedView* self, const char* str, size_t length);
+
+//
+/// \brief Return the binary data in the file.
+/// \param self The view
+/// \param byteSize Set to the size of the data
+/// \return The data, or null if not binary data or it's compressed.
+//
+LIBWEXPR_PUBLIC const void* wexpr_AlignedView_binaryData (const WexprAlignedView* self, size_t* byteSize);
+
+/// \}
+
+/// \name Arrays/Maps
+/// \relates WexprAlignedView
+/// \{
+
+//
+/// \brief Return the number of elements in an array, or pairs in a map.
+/// \param self The view
+//
+LIBWEXPR_PUBLIC size_t wexpr_AlignedView_count (const WexprAlignedView* self);
+
+//
+/// \brief Return the element at the given index in an array.
+/// \param self The view
+/// \param index The index
+/// \return The element, or an invalid view if out of range or not an array.
+//
+LIBWEXPR_PUBLIC WexprAlignedView wexpr_AlignedView_arrayAt (const WexprAlignedView* self, size_t index);
+
+//
+/// \brief Return the key of the pair at the given index in a map. Pairs are in order of their key hash.
+/// \param self The view
+/// \param index The index
+/// \return The key (a value), or an invalid view if out of range or not a map.
+//
+LIBWEXPR_PUBLIC WexprAlignedView wexpr_AlignedView_mapKeyAt (const WexprAlignedView* self, size_t index);
+
+//
+/// \brief Return the value of the pair at the given index in a map.
+/// \param self The view
+/// \param index The index
+/// \return The value, or an invalid view if out of range or not a map.
+//
+LIBWEXPR_PUBLIC WexprAlignedView wexpr_AlignedView_mapValueAt (const WexprAlignedView* self, size_t index);
+
+//
+/// \brief Find the value for a key in a map, with a binary search of the key hashes.
+/// \param self The view
+/// \param key The key to find
+/// \param keyLength The length of key
+/// \return The value, or an invalid view if not found or not a map.
+//
+LIBWEXPR_PUBLIC WexprAlignedView wexpr_AlignedView_mapValueForLengthKey (const WexprAlignedView* self, const char* key, size_t keyLength);
+
+//
+/// \brief Find the value for a zero terminated key in a map.
+/// \param self The view
+/// \param key The key to find
+/// \return The value, or an invalid view if not found or not a map.
+//
+LIBWEXPR_PUBLIC WexprAlignedView wexpr_AlignedView_mapValueForKey (const WexprAlignedView* self, const char* key);
+
+/// \}
+
+LIBWEXPR_EXTERN_C_END()
+
+#endif // LIBWEXPR_ALIGNEDVIEW_H
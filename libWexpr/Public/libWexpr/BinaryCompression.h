@@ -0,0 +1,94 @@
+//
+/// \file libWexpr/BinaryCompression.h
+/// \brief Compression of binary data in the binary format
+//
+// #LICENSE_BEGIN:MIT#
+// 
+// Copyright (c) 2017-2020, Kenneth Perry (thothonegan)
+// 
+// Permission is hereby granted, free of charge, to any person obtaining
+// a copy of this software and associated documentation files (the
+// "Software"), to deal in the Software without restriction, including
+// without limitation the rights to use, copy, modify, merge, publish,
+// distribute, sublicense, and/or sell copies of the Software, and to
+// permit persons to whom the Software is furnished to do so, subject to
+// the following conditions:
+// 
+// The above copyright notice and this permission notice shall be
+// included in all copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+// MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+// NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+// LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+// OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+// WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+// 
+// SPDX-License-Identifier: MIT
+// #LICENSE_END#
+//
+
+#ifndef LIBWEXPR_BINARYCOMPRESSION_H
+#define LIBWEXPR_BINARYCOMPRESSION_H
+
+#include "Executor.h"
+#include "Macros.h"
+#include "WriteFlags.h"
+
+#include <stdbool.h>
+#include <stddef.h> // size_t
+#include <stdint.h>
+
+LIBWEXPR_EXTERN_C_BEGIN()
+
+//
+/// \brief Methods binary data can be compressed with in the binary format.
+/// Which are available depends on the libraries libWexpr was built with, see wexpr_BinaryCompression_isSupported().
+//
+typedef uint8_t WexprBinaryCompression;
+
+enum
+{
+	WexprBinaryCompressionNone = 0x00, ///< Stored raw
+	WexprBinaryCompressionZlib = 0x01, ///< INFLATE/zlib, as defined by the spec
+	WexprBinaryCompressionZstd = 0x80, ///< zstd. Experimental, so other readers might not know it.
+};
+
+//
+/// \brief Options for writing binary. Initialize with WEXPR_BINARYWRITEOPTIONS_INIT().
+//
+typedef struct WexprBinaryWriteOptions
+{
+	WexprWriteFlags flags; ///< Flags, as for the functions which only take flags
+	WexprBinaryCompression compression; ///< How to compress binary data. If not supported, it's stored raw.
+	int compressionLevel; ///< Level for the compression method, or 0 for its default
+	size_t compressionThreshold; ///< Binary data smaller than this is stored raw, since it wont compress well
+	
+	/// For files (WexprWriteFlagBinaryFileHeader), compress everything after the header as independent blocks,
+	/// which can be decompressed on multiple threads when reading. Uses compressionLevel.
+	/// Readers which dont know it will fail to find the expression. If not supported, it's written uncompressed.
+	/// When reading, every block is decompressed into memory before any is parsed, so loading needs room for
+	/// the whole uncompressed file.
+	WexprBinaryCompression blockCompression;
+	size_t blockSize; ///< Size of each block before compression, or 0 for the default (1 MiB). At most 64 MiB.
+	
+	/// If set, the children of a wide root array or map are written on multiple threads with it, then joined.
+	/// The output is the same as writing on one thread. Not used with the index, string table, or aligned layout.
+	const WexprExecutor* executor;
+} WexprBinaryWriteOptions;
+
+//
+/// \brief Options which write with the given flags, no compression, and on the calling thread.
+//
+#define WEXPR_BINARYWRITEOPTIONS_INIT(writeFlags) { (writeFlags), WexprBinaryCompressionNone, 0, 0, WexprBinaryCompressionNone, 0, LIBWEXPR_NULLPTR }
+
+//
+/// \brief Return true if this build of libWexpr can read and write the compression method.
+/// Raw is always supported.
+//
+LIBWEXPR_PUBLIC bool wexpr_BinaryCompression_isSupported (WexprBinaryCompression compression);
+
+LIBWEXPR_EXTERN_C_END()
+
+#endif // LIBWEXPR_BINARYCOMPRESSION_H
@@ -0,0 +1,251 @@
+//
+/// \file libWexpr/BinaryView.h
+/// \brief Read only view into binary wexpr data, without creating expressions
+//
+// #LICENSE_BEGIN:MIT#
+// 
+// Copyright (c) 2017-2020, Kenneth Perry (thothonegan)
+// 
+// Permission is hereby granted, free of charge, to any person obtaining
+// a copy of this software and associated documentation files (the
+// "Software"), to deal in the Software without restriction, including
+// without limitation the rights to use, copy, modify, merge, publish,
+// distribute, sublicense, and/or sell copies of the Software, and to
+// permit persons to whom the Software is furnished to do so, subject to
+// the following conditions:
+// 
+// The above copyright notice and this permission notice shall be
+// included in all copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+// MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+// NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+// LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+// OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+// WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+// 
+// SPDX-License-Identifier: MIT
+// #LICENSE_END#
+//
+
+#ifndef LIBWEXPR_BINARYVIEW_H
+#define LIBWEXPR_BINARYVIEW_H
+
+#include "Error.h"
+#include "ExpressionType.h"
+#include "Macros.h"
+
+#include <stdbool.h>
+#include <stddef.h> // size_t
+#include <stdint.h>
+
+LIBWEXPR_EXTERN_C_BEGIN()
+
+//
+/// \struct WexprBinaryView
+/// \brief A read only view of a chunk in binary wexpr data.
+///
+/// Views point directly into the buffer (which can be memory mapped) and never allocate or copy,
+/// so you can read a few fields out of a huge document without loading it. Every chunk stores
+/// its size, so skipping over a child is constant time no matter how big it is.
+///
+/// Views are small values and dont own anything. The buffer must stay valid while they are used.
+/// Each step is bounds checked against its parent, so malformed data gives an invalid view instead of reading past the buffer.
+///
+/// If a file was written with WexprWriteFlagBinaryIndex, views created from it use the index chunk to access
+/// large arrays/maps without scanning: arrayAt() and count() become constant time, and finding a key O(log n).
+/// If it was written with WexprWriteFlagBinaryStringTable, references to the string table are seen as values.
+/// Typed chunks (WexprWriteFlagBinaryTypedValues) are also seen as values, read with the valueAs functions.
+//
+typedef struct WexprBinaryView
+{
+	const uint8_t* content; ///< Start of the chunk's content
+	size_t contentSize; ///< Size of the content in bytes
+	size_t chunkSize; ///< Size of the whole chunk (header and content)
+	WexprExpressionType type; ///< Type of the chunk, or WexprExpressionTypeInvalid if the view is invalid
+	uint8_t typedChunkType; ///< For a value stored as a typed chunk (WexprWriteFlagBinaryTypedValues), the chunk type. Otherwise 0 and the content is the text.
+	
+	const uint8_t* root; ///< Start of the expression chunk, which index offsets are relative to
+	const uint8_t* index; ///< Content of the index chunk, or null if there isnt one
+	size_t indexSize; ///< Size of the index content
+	const uint8_t* strings; ///< Content of the string table chunk, or null if there isnt one
+	size_t stringsSize; ///< Size of the string table content
+} WexprBinaryView;
+
+//
+/// \struct WexprBinaryViewIterator
+/// \brief Walks the children of an array or map view in order.
+//
+typedef struct WexprBinaryViewIterator
+{
+	const uint8_t* position; ///< Start of the next child
+	const uint8_t* end; ///< End of the parent's content
+	
+	const uint8_t* root; ///< Passed on to the children
+	const uint8_t* index; ///< Passed on to the children
+	size_t indexSize; ///< Passed on to the children
+	const uint8_t* strings; ///< Passed on to the children
+	size_t stringsSize; ///< Passed on to the children
+} WexprBinaryViewIterator;
+
+/// \name Construction
+/// \relates WexprBinaryView
+/// \{
+
+//
+/// \brief Create a view of a binary chunk (such as from wexpr_Expression_createBinaryRepresentation()).
+/// \param data The data, starting with the chunk
+/// \param length The size of data
+/// \param error Error information if any occurs.
+/// \return The view. Invalid if the chunk header is bad.
+//
+LIBWEXPR_PUBLIC WexprBinaryView wexpr_BinaryView_createFromChunk (const void* data, size_t length, WexprError* error);
+
+//
+/// \brief Create a view of the expression in a whole binary file. The header is validated, and auxiliary chunks skipped except for the index.
+/// \param data The whole file
+/// \param length The size of data
+/// \param error Error information if any occurs.
+/// \return The view of the expression chunk. Invalid if the file is bad.
+//
+LIBWEXPR_PUBLIC WexprBinaryView wexpr_BinaryView_createFromFile (const void* data, size_t length, WexprError* error);
+
+/// \}
+
+/// \name Information
+/// \relates WexprBinaryView
+/// \{
+
+//
+/// \brief Return true if the view refers to a chunk.
+/// \param self The view
+//
+LIBWEXPR_PUBLIC bool wexpr_BinaryView_isValid (const WexprBinaryView* self);
+
+//
+/// \brief Return the type of the chunk, or WexprExpressionTypeInvalid if the view is invalid.
+/// \param self The view
+//
+LIBWEXPR_PUBLIC WexprExpressionType wexpr_BinaryView_type (const WexprBinaryView* self);
+
+/// \}
+
+/// \name Values
+/// \relates WexprBinaryView
+/// \{
+
+//
+/// \brief Return the value in the buffer. This is NOT null terminated.
+/// \param self The view
+/// \param length Set to the length of the value
+/// \return The value, or null if not a value. Also null for values stored as a typed chunk, which have no text in the buffer (see wexpr_BinaryView_valueAsInt64() and friends).
+//
+LIBWEXPR_PUBLIC const char* wexpr_BinaryView_value (const WexprBinaryView* self, size_t* length);
+
+//
+/// \brief Return true if the view is a value equal to the given string.
+/// \param self The view
+/// \param str The string to compare to
+/// \param length The length of str
+//
+LIBWEXPR_PUBLIC bool wexpr_BinaryView_valueEquals (const WexprBinaryView* self, const char* str, size_t length);
+
+//
+/// \brief Get the value as an integer, as wexpr_Expression_valueAsInt64(). Typed chunks are read directly.
+/// \param self The view
+/// \param result Set to the integer
+/// \return true if the value is an integer
+//
+LIBWEXPR_PUBLIC bool wexpr_BinaryView_valueAsInt64 (const WexprBinaryView* self, int64_t* result);
+
+//
+/// \brief Get the value as a floating point number (integers included), as wexpr_Expression_valueAsDouble().
+/// \param self The view
+/// \param result Set to the number
+/// \return true if the value is a number
+//
+LIBWEXPR_PUBLIC bool wexpr_BinaryView_valueAsDouble (const WexprBinaryView* self, double* result);
+
+//
+/// \brief Get the value as a boolean, as wexpr_Expression_valueAsBool().
+/// \param self The view
+/// \param result Set to the boolean
+/// \return true if the value is a boolean
+//
+LIBWEXPR_PUBLIC bool wexpr_BinaryView_valueAsBool (const WexprBinaryView* self, bool* result);
+
+//
+/// \brief Return the binary data in the buffer.
+/// \param self The view
+/// \param byteSize Set to the size of the data
+/// \return The data, or null if not binary data or it's compressed.
+//
+LIBWEXPR_PUBLIC const void* wexpr_BinaryView_binaryData (const WexprBinaryView* self, size_t* byteSize);
+
+//
+/// \brief Return a copy of the binary data, decompressing it if needed. Owned by you, must be destroyed with free.
+/// \param self The view
+/// \param byteSize Set to the size of the data
+/// \param error Error information if any occurs.
+/// \return The data, or null if not binary data or it couldn't be decompressed.
+//
+LIBWEXPR_PUBLIC void* wexpr_BinaryView_createBinaryData (const WexprBinaryView* self, size_t* byteSize, WexprError* error);
+
+/// \}
+
+/// \name Arrays/Maps
+/// \relates WexprBinaryView
+/// \{
+
+//
+/// \brief Start iterating the children of an array or map. For maps, the children alternate between key and value.
+/// \param self The view
+/// \return The iterator. Will have no children if not an array or map.
+//
+LIBWEXPR_PUBLIC WexprBinaryViewIterator wexpr_BinaryView_iterate (const WexprBinaryView* self);
+
+//
+/// \brief Get the next child, skipping over the previous one using its size.
+/// \param self The iterator
+/// \param child Set to the child
+/// \return true if there was a child, false at the end (or if the data is malformed).
+//
+LIBWEXPR_PUBLIC bool wexpr_BinaryViewIterator_next (WexprBinaryViewIterator* self, WexprBinaryView* child);
+
+//
+/// \brief Return the number of elements in an array, or pairs in a map. Skips through the children unless indexed.
+/// \param self The view
+//
+LIBWEXPR_PUBLIC size_t wexpr_BinaryView_count (const WexprBinaryView* self);
+
+//
+/// \brief Return the element at the given index in an array. Skips over the elements before it unless indexed.
+/// \param self The view
+/// \param index The index
+/// \return The element, or an invalid view if out of range or not an array.
+//
+LIBWEXPR_PUBLIC WexprBinaryView wexpr_BinaryView_arrayAt (const WexprBinaryView* self, size_t index);
+
+//
+/// \brief Find the value for a key in a map by scanning the keys, skipping over the values. Uses a binary search of the key hashes if indexed.
+/// \param self The view
+/// \param key The key to find
+/// \param keyLength The length of key
+/// \return The value, or an invalid view if not found or not a map.
+//
+LIBWEXPR_PUBLIC WexprBinaryView wexpr_BinaryView_mapValueForLengthKey (const WexprBinaryView* self, const char* key, size_t keyLength);
+
+//
+/// \brief Find the value for a key (cstring) in a map.
+/// \param self The view
+/// \param key The key to find
+/// \return The value, or an invalid view if not found or not a map.
+//
+LIBWEXPR_PUBLIC WexprBinaryView wexpr_BinaryView_mapValueForKey (const WexprBinaryView* self, const char* key);
+
+/// \}
+
+LIBWEXPR_EXTERN_C_END()
+
+#endif // LIBWEXPR_BINARYVIEW_H
@@ -200,6 +200,62 @@ static inline uint64_t wexpr_bigUInt64ToNative (uint64_t v)
 	#endif
 }
 
+//
+/// \brief Convert a native uint32 to little
+/// \param v The value to convert as native
+/// \return The value converted as little endian.
+//
+static inline uint32_t wexpr_uint32ToLittle (uint32_t v)
+{
+	#if LIBWEXPR_ENDIAN_ISBIG
+		return wexpr_uint32Swap(v);
+	#else
+		return v;
+	#endif
+}
+
+//
+/// \brief Convert a little uint32 to native
+/// \param v The value to convert, in little endian.
+/// \return The converted value as native
+//
+static inline uint32_t wexpr_littleUInt32ToNative (uint32_t v)
+{
+	#if LIBWEXPR_ENDIAN_ISBIG
+		return wexpr_uint32Swap(v);
+	#else
+		return v;
+	#endif
+}
+
+//
+/// \brief Convert a native uint64 to little
+/// \param v The value to convert as native
+/// \return The value converted as little endian.
+//
+static inline uint64_t wexpr_uint64ToLittle (uint64_t v)
+{
+	#if LIBWEXPR_ENDIAN_ISBIG
+		return wexpr_uint64Swap(v);
+	#else
+		return v;
+	#endif
+}
+
+//
+/// \brief Convert a little uint64 to native
+/// \param v The value to convert, in little endian.
+/// \return The converted value as native
+//
+static inline uint64_t wexpr_littleUInt64ToNative (uint64_t v)
+{
+	#if LIBWEXPR_ENDIAN_ISBIG
+		return wexpr_uint64Swap(v);
+	#else
+		return v;
+	#endif
+}
+
 #undef WEXPR_REINTERP_CAST
 
 #endif // LIBWEXPR_ENDIAN_H
@@ -72,7 +72,17 @@ enum
 	WexprErrorCodeBinaryMultipleExpressions, ///< Found multiple expression chunks
 	WexprErrorCodeBinaryChunkBiggerThanData, ///< The chunk size said to expand past the buffer size
 	WexprErrorCodeBinaryChunkNotBigEnough, ///< The length of buffer given wasnt't big enough for a valid chunk.
-	WexprErrorCodeBinaryUnknownCompression ///< Unknown compression method received
+	WexprErrorCodeBinaryUnknownCompression, ///< Unknown compression method received
+	
+	WexprErrorCodeUnableToReadFile, ///< The file couldn't be opened or read
+	WexprErrorCodeBinaryInvalidCompressedData, ///< Compressed binary data couldn't be decompressed
+	WexprErrorCodeBinaryInvalidStringReference, ///< A string reference didn't match the string table
+	WexprErrorCodeBinaryInvalidNode, ///< A node in an aligned binary file was out of place or didn't fit
+	WexprErrorCodeBinaryInvalidTypedValue, ///< A typed value chunk was the wrong size
+	WexprErrorCodeInvalidPatch, ///< A patch was malformed or didn't match the expression it was applied to
+	WexprErrorCodeInvalidPath, ///< A path couldn't be compiled
+	WexprErrorCodeUnknownDocumentFormat, ///< A document was given in a format that wasn't known
+	WexprErrorCodeBinaryMissingExpression ///< A binary file had no expression chunk
 };
 
 typedef uint32_t WexprLineNumber;
@@ -0,0 +1,110 @@
+//
+/// \file libWexpr/Executor.h
+/// \brief Runs work for libWexpr on multiple threads
+//
+// #LICENSE_BEGIN:MIT#
+// 
+// Copyright (c) 2017-2020, Kenneth Perry (thothonegan)
+// 
+// Permission is hereby granted, free of charge, to any person obtaining
+// a copy of this software and associated documentation files (the
+// "Software"), to deal in the Software without restriction, including
+// without limitation the rights to use, copy, modify, merge, publish,
+// distribute, sublicense, and/or sell copies of the Software, and to
+// permit persons to whom the Software is furnished to do so, subject to
+// the following conditions:
+// 
+// The above copyright notice and this permission notice shall be
+// included in all copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+// MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+// NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+// LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+// OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+// WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+// 
+// SPDX-License-Identifier: MIT
+// #LICENSE_END#
+//
+
+#ifndef LIBWEXPR_EXECUTOR_H
+#define LIBWEXPR_EXECUTOR_H
+
+#include "Macros.h"
+
+#include <stddef.h>
+
+LIBWEXPR_EXTERN_C_BEGIN()
+
+//
+/// \brief A piece of work given to an executor.
+/// \param taskData The taskData given with the work
+/// \param index Which piece of the work to do
+//
+typedef void (*WexprExecutorTask) (void* taskData, size_t index);
+
+//
+/// \brief Called by an executor to run work.
+/// Must call task for every index in [0, count) exactly once, and only return once they're all done.
+/// They can be run on any threads, in any order.
+/// \param userData The userData given to the executor
+/// \param count The number of indexes
+/// \param task The task to run for each index
+/// \param taskData Passed to task
+//
+typedef void (*WexprExecutorParallelForCallback) (void* userData, size_t count, WexprExecutorTask task, void* taskData);
+
+//
+/// \struct WexprExecutor
+/// \brief Runs work on multiple threads for functions which can split it up (eg. wexpr_Expression_createFromBatch()).
+///
+/// By default libWexpr starts its own threads for each call. If you already have a thread pool, give an
+/// executor for it instead so everything shares the same threads.
+/// Executors are small values and dont own anything, so they dont need to be destroyed.
+//
+typedef struct WexprExecutor
+{
+	WexprExecutorParallelForCallback parallelFor; ///< Runs the work, or null to use libWexpr's own threads
+	void* userData; ///< Passed to parallelFor
+	size_t threadCount; ///< When using libWexpr's own threads, the most to use including the caller. 0 for one per hardware thread.
+} WexprExecutor;
+
+/// \name Construction
+/// \relates WexprExecutor
+/// \{
+
+//
+/// \brief Create an executor which uses libWexpr's own threads.
+/// \param threadCount The most threads to use, including the calling thread. 0 for one per hardware thread, 1 to not use any others.
+//
+LIBWEXPR_PUBLIC WexprExecutor wexpr_Executor_forThreads (size_t threadCount);
+
+//
+/// \brief Create an executor which calls the given callback to run work.
+/// \param callback The callback which runs the work (on your own thread pool, etc)
+/// \param userData Passed to the callback
+//
+LIBWEXPR_PUBLIC WexprExecutor wexpr_Executor_forCallback (WexprExecutorParallelForCallback callback, void* userData);
+
+/// \}
+
+/// \name Running
+/// \relates WexprExecutor
+/// \{
+
+//
+/// \brief Run task for every index in [0, count) with the executor, returning once they're all done.
+/// \param self The executor, or null to use libWexpr's own threads (one per hardware thread)
+/// \param count The number of indexes
+/// \param task The task to run for each index
+/// \param taskData Passed to task
+//
+LIBWEXPR_PUBLIC void wexpr_Executor_parallelFor (const WexprExecutor* self, size_t count, WexprExecutorTask task, void* taskData);
+
+/// \}
+
+LIBWEXPR_EXTERN_C_END()
+
+#endif // LIBWEXPR_EXECUTOR_H
@@ -32,19 +32,27 @@
 #ifndef LIBWEXPR_EXPRESSION_H
 #define LIBWEXPR_EXPRESSION_H
 
+#include "BinaryCompression.h"
 #include "Error.h"
+#include "Executor.h"
 #include "ExpressionType.h"
 #include "Macros.h"
 #include "ParseFlags.h"
+#include "Path.h"
 #include "WriteFlags.h"
 
+#include <stdbool.h>
 #include <stddef.h> // size_t
+#include <stdint.h>
 
 LIBWEXPR_EXTERN_C_BEGIN()
 
 // ReferenceTable.h
 struct WexprReferenceTable;
 
+// Sink.h
+struct WexprSink;
+
 //
 /// \struct WexprExpression
 /// \brief A wexpr expression
@@ -86,6 +94,37 @@ typedef struct WexprBuffer
 	size_t byteSize; ///< Size of the buffer
 } WexprBuffer;
 
+//
+/// \brief Statistics about how the nodes of a tree are stored. See wexpr_Expression_nodeStats().
+//
+typedef struct WexprExpressionNodeStats
+{
+	size_t nodeCount; ///< Number of expressions in the tree, counting shared ones every time they appear
+	size_t uniqueNodeCount; ///< Number of expressions actually allocated. nodeCount / uniqueNodeCount is the dedup ratio.
+} WexprExpressionNodeStats;
+
+//
+/// \brief The format of a document given to wexpr_Expression_createFromBatch().
+//
+typedef uint8_t WexprDocumentFormat;
+
+enum
+{
+	WexprDocumentFormatText = 0x00, ///< Text, as for wexpr_Expression_createFromLengthString()
+	WexprDocumentFormatBinaryChunk = 0x01, ///< An expression chunk, as for wexpr_Expression_createFromBinaryChunkWithFlags()
+	WexprDocumentFormatBinaryFile = 0x02 ///< A whole binary file, as for wexpr_Expression_createFromBinaryFile()
+};
+
+//
+/// \brief A document to parse with wexpr_Expression_createFromBatch().
+//
+typedef struct WexprDocument
+{
+	const void* data; ///< The document, which we dont own
+	size_t length; ///< Size of data in bytes
+	WexprDocumentFormat format; ///< What data contains
+} WexprDocument;
+
 /// \name Construction/Destruction
 /// \relates WexprExpression
 /// \{
@@ -144,6 +183,28 @@ LIBWEXPR_PUBLIC WexprExpression* wexpr_Expression_createFromLengthStringWithExte
 	WexprError* error
 );
 
+//
+/// \brief Creates an expression from a string, only building the parts selected by the paths. You own and must destroy.
+///
+/// Everything else is skipped without being built, so reading a few values from a large document is quick.
+/// Maps only contain the keys selected, and array elements which weren't selected are null (so indices are kept),
+/// which means evaluating the paths on the result finds the same expressions as on the whole document.
+/// Skipped parts are only checked for structure. Reference definitions are always built in full, since selected parts can
+/// insert them.
+/// \param str The string, must be UTF-8 safe/compatible.
+/// \param length The length of str in bytes
+/// \param flags Flags about parsing.
+/// \param paths The paths to build. Only the root is built if none are given.
+/// \param pathCount Number of paths
+/// \param error Will store error information if any occurs.
+/// \return The created expression, or nullptr if none/error occurred.
+//
+LIBWEXPR_PUBLIC WexprExpression* wexpr_Expression_createFromLengthStringWithProjection (
+	const char* str, size_t length, WexprParseFlags flags,
+	WexprPath* const* paths, size_t pathCount,
+	WexprError* error
+);
+
 //
 /// \brief Creates an expression from a binary chunk. You own and must destroy.
 /// \param data The data
@@ -155,6 +216,97 @@ LIBWEXPR_PUBLIC WexprExpression* wexpr_Expression_createFromBinaryChunk (
 	const void* data, size_t length, WexprError* error
 );
 
+//
+/// \brief Creates an expression from a binary chunk. You own and must destroy.
+/// \param data The data
+/// \param length The length of the data
+/// \param flags Flags about parsing.
+/// \param error Error information if any occurs.
+/// \return The created expression, or nullptr if none/error occurred.
+//
+LIBWEXPR_PUBLIC WexprExpression* wexpr_Expression_createFromBinaryChunkWithFlags (
+	const void* data, size_t length, WexprParseFlags flags, WexprError* error
+);
+
+//
+/// \brief Creates an expression from a binary chunk, only building the parts selected by the paths. You own and must destroy.
+/// See wexpr_Expression_createFromLengthStringWithProjection(). Skipped chunks aren't read or decompressed.
+/// \param data The data
+/// \param length The length of the data
+/// \param flags Flags about parsing.
+/// \param paths The paths to build
+/// \param pathCount Number of paths
+/// \param error Error information if any occurs.
+/// \return The created expression, or nullptr if none/error occurred.
+//
+LIBWEXPR_PUBLIC WexprExpression* wexpr_Expression_createFromBinaryChunkWithProjection (
+	const void* data, size_t length, WexprParseFlags flags,
+	WexprPath* const* paths, size_t pathCount,
+	WexprError* error
+);
+
+//
+/// \brief Creates an expression from a whole binary file (the header followed by chunks). You own and must destroy.
+/// The header is validated, and auxiliary chunks which aren't understood are skipped.
+/// \param data The data
+/// \param length The length of the data
+/// \param flags Flags about parsing.
+/// \param error Error information if any occurs.
+/// \return The created expression, or nullptr if none/error occurred.
+//
+LIBWEXPR_PUBLIC WexprExpression* wexpr_Expression_createFromBinaryFile (
+	const void* data, size_t length, WexprParseFlags flags, WexprError* error
+);
+
+//
+/// \brief Creates an expression from a whole binary file, only building the parts selected by the paths. You own and must destroy.
+/// See wexpr_Expression_createFromLengthStringWithProjection(). Skipped chunks aren't read or decompressed.
+/// \param data The data
+/// \param length The length of the data
+/// \param flags Flags about parsing.
+/// \param paths The paths to build
+/// \param pathCount Number of paths
+/// \param error Error information if any occurs.
+/// \return The created expression, or nullptr if none/error occurred.
+//
+LIBWEXPR_PUBLIC WexprExpression* wexpr_Expression_createFromBinaryFileWithProjection (
+	const void* data, size_t length, WexprParseFlags flags,
+	WexprPath* const* paths, size_t pathCount,
+	WexprError* error
+);
+
+//
+/// \brief Creates an expression from the file at path, which can be text or a binary file. You own and must destroy.
+/// The file is memory mapped and parsed in place when possible, otherwise it's read in.
+/// \param path The path of the file
+/// \param flags Flags about parsing.
+/// \param error Error information if any occurs.
+/// \return The created expression, or nullptr if none/error occurred.
+//
+LIBWEXPR_PUBLIC WexprExpression* wexpr_Expression_createFromFile (
+	const char* path, WexprParseFlags flags, WexprError* error
+);
+
+//
+/// \brief Creates an expression from each of many independent documents, parsing them in parallel.
+/// \param documents The documents to parse
+/// \param count The number of documents
+/// \param flags Flags about parsing, used for all of them.
+/// \param results Filled in with count expressions, each of which is null if it failed. You own and must destroy them.
+/// \param errors If not null, count errors (initialized with WEXPR_ERROR_INIT()) filled in for the ones which failed.
+/// \param executor Runs the work, or null to use libWexpr's own threads (one per hardware thread).
+/// \return The number of documents which parsed.
+///
+/// The documents are split into groups which are parsed as separate pieces of work, so scratch memory
+/// is reused between the documents in a group and threads dont have to wait on each other.
+/// Each result is the same as parsing that document alone.
+//
+LIBWEXPR_PUBLIC size_t wexpr_Expression_createFromBatch (
+	const WexprDocument* documents, size_t count, WexprParseFlags flags,
+	WexprExpression** results, WexprError* errors,
+	const WexprExecutor* executor
+);
+
 //
 /// \brief Creates an empty invalid expression. You own and must destroy.
 /// \return A newly created invalid expression, or null if it fails.
@@ -220,6 +372,42 @@ LIBWEXPR_PUBLIC void wexpr_Expression_changeType (WexprExpression* self, WexprEx
 //
 LIBWEXPR_PUBLIC char* wexpr_Expression_createStringRepresentation (WexprExpression* self, size_t indent, WexprWriteFlags flags);
 
+//
+/// \brief Create a string which represents the expression, writing the children of a wide root array or map on multiple threads.
+/// The string is the same as wexpr_Expression_createStringRepresentation().
+/// \param self The expression to operate on
+/// \param indent The starting indent level, generally 0. Will use tabs to indent.
+/// \param flags Flags to use when writing the string
+/// \param executor Runs the work (see wexpr_Executor_forThreads()), or null to write it all on the calling thread
+/// \return String with the representation in wexpr text format. You own and must free().
+//
+LIBWEXPR_PUBLIC char* wexpr_Expression_createStringRepresentationWithExecutor (WexprExpression* self, size_t indent, WexprWriteFlags flags,
+	const WexprExecutor* executor
+);
+
+//
+/// \brief Return the size of the string representation in bytes, not including the null terminator.
+/// \param self The expression to operate on
+/// \param indent The starting indent level, generally 0.
+/// \param flags Flags to use when writing the string
+/// \return The size wexpr_Expression_writeStringInto() will write, without the null terminator.
+//
+LIBWEXPR_PUBLIC size_t wexpr_Expression_stringRepresentationSize (WexprExpression* self, size_t indent, WexprWriteFlags flags);
+
+//
+/// \brief Write the string representation into your own buffer, followed by a null terminator.
+/// \param self The expression to operate on
+/// \param indent The starting indent level, generally 0.
+/// \param flags Flags to use when writing the string
+/// \param buffer The buffer to write to
+/// \param capacity The size of buffer in bytes. Must have room for the null terminator.
+/// \param written If not null, set to the length of the string (without the null terminator). If the buffer was too small, this is the length it needed.
+/// \return true on success, false if the buffer was too small (contents are then incomplete).
+//
+LIBWEXPR_PUBLIC bool wexpr_Expression_writeStringInto (WexprExpression* self, size_t indent, WexprWriteFlags flags,
+	char* buffer, size_t capacity, size_t* written
+);
+
 //
 /// \brief Create binary data which represents the expression. This contains of an expression chunk and all of its child chunks, but NOT the file header. Owned by you, must be destroyed with free.
 /// \param self The expression to operate on
@@ -227,6 +415,102 @@ LIBWEXPR_PUBLIC char* wexpr_Expression_createStringRepresentation (WexprExpressi
 //
 LIBWEXPR_PUBLIC WexprMutableBuffer wexpr_Expression_createBinaryRepresentation (WexprExpression* self);
 
+//
+/// \brief Create binary data which represents the expression. Owned by you, must be destroyed with free.
+/// \param self The expression to operate on
+/// \param flags Flags to use when writing. WexprWriteFlagBinaryFileHeader includes the file header, which makes it a complete binary file.
+/// \return Binary data in bwexpr format. Will return a null buffer on errors.
+//
+LIBWEXPR_PUBLIC WexprMutableBuffer wexpr_Expression_createBinaryRepresentationWithFlags (WexprExpression* self, WexprWriteFlags flags);
+
+//
+/// \brief Create binary data which represents the expression, with options such as compressing binary data. Owned by you, must be destroyed with free.
+/// \param self The expression to operate on
+/// \param options Options to use when writing
+/// \return Binary data in bwexpr format. Will return a null buffer on errors.
+//
+LIBWEXPR_PUBLIC WexprMutableBuffer wexpr_Expression_createBinaryRepresentationWithOptions (WexprExpression* self, const WexprBinaryWriteOptions* options);
+
+//
+/// \brief Return the exact size of the binary representation in bytes.
+/// \param self The expression to operate on
+/// \param flags Flags to use when writing. WexprWriteFlagBinaryFileHeader includes the file header.
+/// \return The size wexpr_Expression_writeBinaryInto() will write, or 0 if the expression can't be written.
+//
+LIBWEXPR_PUBLIC size_t wexpr_Expression_binaryRepresentationSize (WexprExpression* self, WexprWriteFlags flags);
+
+//
+/// \brief Write the binary representation into your own buffer.
+/// \param self The expression to operate on
+/// \param flags Flags to use when writing. WexprWriteFlagBinaryFileHeader writes the file header first, making it a complete binary file.
+/// \param buffer The buffer to write to
+/// \param capacity The size of buffer in bytes
+/// \param written If not null, set to the number of bytes written. If the buffer was too small, this is the size it needed (nothing is written).
+/// \return true on success, false if the buffer was too small or the expression can't be written.
+//
+LIBWEXPR_PUBLIC bool wexpr_Expression_writeBinaryInto (WexprExpression* self, WexprWriteFlags flags,
+	void* buffer, size_t capacity, size_t* written
+);
+
+//
+/// \brief Write the text representation to a sink, without building it all in memory first.
+/// \param self The expression to operate on
+/// \param indent The starting indent level, generally 0. Will use tabs to indent.
+/// \param flags Flags to use when writing the string
+/// \param sink Where to write. No null terminator is written.
+/// \return true on success, false if the sink failed or out of memory.
+//
+LIBWEXPR_PUBLIC bool wexpr_Expression_writeText (WexprExpression* self, size_t indent, WexprWriteFlags flags, struct WexprSink* sink);
+
+//
+/// \brief Write the text representation to a sink, writing the children of a wide root array or map on multiple threads.
+/// The children are written into memory first, then sent to the sink in order. The text is the same as wexpr_Expression_writeText().
+/// \param self The expression to operate on
+/// \param indent The starting indent level, generally 0. Will use tabs to indent.
+/// \param flags Flags to use when writing the string
+/// \param executor Runs the work (see wexpr_Executor_forThreads()), or null to write it all on the calling thread
+/// \param sink Where to write. No null terminator is written.
+/// \return true on success, false if the sink failed or out of memory.
+//
+LIBWEXPR_PUBLIC bool wexpr_Expression_writeTextWithExecutor (WexprExpression* self, size_t indent, WexprWriteFlags flags,
+	const WexprExecutor* executor, struct WexprSink* sink
+);
+
+//
+/// \brief Write the binary chunk (same as wexpr_Expression_createBinaryRepresentation()) to a sink, without building it all in memory first.
+/// \param self The expression to operate on
+/// \param flags Flags to use when writing. WexprWriteFlagBinaryFileHeader writes the file header first.
+/// \param sink Where to write.
+/// \return true on success, false if the sink failed or out of memory.
+//
+LIBWEXPR_PUBLIC bool wexpr_Expression_writeBinary (WexprExpression* self, WexprWriteFlags flags, struct WexprSink* sink);
+
+//
+/// \brief Write the binary to a sink, with options such as compressing binary data.
+/// \param self The expression to operate on
+/// \param options Options to use when writing
+/// \param sink Where to write.
+/// \return true on success, false if the sink failed or out of memory.
+//
+LIBWEXPR_PUBLIC bool wexpr_Expression_writeBinaryWithOptions (WexprExpression* self, const WexprBinaryWriteOptions* options, struct WexprSink* sink);
+
+//
+/// \brief Count the nodes in the tree, and how many are actually allocated. They only differ if parsed with WexprParseFlagDeduplicate.
+/// \param self The expression to operate on
+/// \return The node statistics.
+//
+LIBWEXPR_PUBLIC WexprExpressionNodeStats wexpr_Expression_nodeStats (WexprExpression* self);
+
+//
+/// \brief Give every node in the tree its own copy, so reading it never changes it.
+/// \param self The expression to operate on
+///
+/// Nodes shared by WexprParseFlagDeduplicate (or a binary string table) are copied on write, which the accessors
+/// do as they hand them out, so reading such a tree changes it. Once unshared, any number of threads can read the
+/// tree at once, as long as none of them change it. Does nothing to nodes which aren't shared.
+//
+LIBWEXPR_PUBLIC void wexpr_Expression_unshare (WexprExpression* self);
+
 /// \}
 
 /// \name Values
@@ -254,6 +538,51 @@ LIBWEXPR_PUBLIC void wexpr_Expression_valueSet (WexprExpression* self, const cha
 //
 LIBWEXPR_PUBLIC void wexpr_Expression_valueSetLengthString (WexprExpression* self, const char* str, size_t length);
 
+//
+/// \brief Get the value as an integer. Values from typed binary chunks (WexprWriteFlagBinaryTypedValues) arent parsed again.
+/// \param self The expression to operate on
+/// \param result Set to the integer
+/// \return true if the value is a base 10 integer which fits in an int64_t, false otherwise or if not a value.
+//
+LIBWEXPR_PUBLIC bool wexpr_Expression_valueAsInt64 (WexprExpression* self, int64_t* result);
+
+//
+/// \brief Get the value as a floating point number (integers included).
+/// \param self The expression to operate on
+/// \param result Set to the number
+/// \return true if the value is a number, false otherwise or if not a value.
+//
+LIBWEXPR_PUBLIC bool wexpr_Expression_valueAsDouble (WexprExpression* self, double* result);
+
+//
+/// \brief Get the value as a boolean.
+/// \param self The expression to operate on
+/// \param result Set to the boolean
+/// \return true if the value is "true" or "false", false otherwise or if not a value.
+//
+LIBWEXPR_PUBLIC bool wexpr_Expression_valueAsBool (WexprExpression* self, bool* result);
+
+//
+/// \brief Set the value to an integer. The value is its text, but is written as a typed chunk with WexprWriteFlagBinaryTypedValues.
+/// \param self The expression to operate on
+/// \param value The integer
+//
+LIBWEXPR_PUBLIC void wexpr_Expression_valueSetInt64 (WexprExpression* self, int64_t value);
+
+//
+/// \brief Set the value to a floating point number, as the shortest text which reads back exactly.
+/// \param self The expression to operate on
+/// \param value The number
+//
+LIBWEXPR_PUBLIC void wexpr_Expression_valueSetDouble (WexprExpression* self, double value);
+
+//
+/// \brief Set the value to "true" or "false".
+/// \param self The expression to operate on
+/// \param value The boolean
+//
+LIBWEXPR_PUBLIC void wexpr_Expression_valueSetBool (WexprExpression* self, bool value);
+
 /// \}
 
 /// \name Binary Data
@@ -372,6 +701,31 @@ LIBWEXPR_PUBLIC void wexpr_Expression_mapSetValueForKeyLengthString (WexprExpres
 
 /// \}
 
+/// \name Diff
+/// \{
+
+//
+/// \brief Create a patch which turns one expression into another, see Documentation/Diff.md.
+/// The patch is itself an expression, so it can be written and read like any other.
+/// Subtrees which are the same in both are skipped without walking them twice.
+/// \param from The original expression
+/// \param to The expression to change it into
+/// \return The patch, which you own. It's an empty map if they're the same. NULL if out of memory.
+//
+LIBWEXPR_PUBLIC WexprExpression* wexpr_Expression_createDiff (WexprExpression* from, WexprExpression* to);
+
+//
+/// \brief Apply a patch from wexpr_Expression_createDiff() to the expression, changing it in place.
+/// The patch is checked first, so if it fails the expression is left unchanged.
+/// \param self The expression to change
+/// \param patch The patch to apply
+/// \param error Set to WexprErrorCodeInvalidPatch if the patch is malformed or doesn't fit the expression. Can be NULL.
+/// \return true if the patch was applied
+//
+LIBWEXPR_PUBLIC bool wexpr_Expression_applyPatch (WexprExpression* self, WexprExpression* patch, WexprError* error);
+
+/// \}
+
 LIBWEXPR_EXTERN_C_END()
 
 #endif // LIBWEXPR_EXPRESSION_H
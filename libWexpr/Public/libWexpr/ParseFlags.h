@@ -46,7 +46,18 @@ typedef uint8_t WexprParseFlags;
 enum
 {
 	WexprParseFlagNone = 0, ///< No special flags
-	// flags are bitflags (0 << 1), (0 << 2), etc
+	
+	/// Share identical subtrees (values, arrays, maps) instead of allocating each occurrence.
+	/// Saves memory on repetitive documents. Children fetched through the accessors are
+	/// detached (copied) first if shared, so mutating them is still safe - but this means
+	/// the accessors may modify the tree, so dont read the same tree from multiple threads
+	/// (unless it's unshared first, see wexpr_Expression_unshare()).
+	/// Binary files with a string table (WexprWriteFlagBinaryStringTable) are always loaded this way,
+	/// with or without this flag: each repeated value is one shared node, and map keys use its data.
+	/// See wexpr_Expression_nodeStats() for how much was shared.
+	WexprParseFlagDeduplicate = (1 << 0U),
+	
+	// flags are bitflags (1 << 0), (1 << 1), etc
 };
 
 LIBWEXPR_EXTERN_C_END()
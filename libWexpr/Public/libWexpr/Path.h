@@ -0,0 +1,130 @@
+//
+/// \file libWexpr/Path.h
+/// \brief Compiled paths for finding expressions within a tree
+//
+// #LICENSE_BEGIN:MIT#
+// 
+// Copyright (c) 2017-2020, Kenneth Perry (thothonegan)
+// 
+// Permission is hereby granted, free of charge, to any person obtaining
+// a copy of this software and associated documentation files (the
+// "Software"), to deal in the Software without restriction, including
+// without limitation the rights to use, copy, modify, merge, publish,
+// distribute, sublicense, and/or sell copies of the Software, and to
+// permit persons to whom the Software is furnished to do so, subject to
+// the following conditions:
+// 
+// The above copyright notice and this permission notice shall be
+// included in all copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+// MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+// NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+// LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+// OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+// WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+// 
+// SPDX-License-Identifier: MIT
+// #LICENSE_END#
+//
+
+#ifndef LIBWEXPR_PATH_H
+#define LIBWEXPR_PATH_H
+
+#include "Error.h"
+#include "Macros.h"
+
+#include <stddef.h>
+
+LIBWEXPR_EXTERN_C_BEGIN()
+
+// Expression.h
+struct WexprExpression;
+
+//
+/// \struct WexprPath
+/// \brief A path to expressions within a tree, compiled so it can be used repeatedly.
+///
+/// A path is a list of steps starting with /, such as `/servers/[3]/port` :
+/// - `name` : the value for the key in a map.
+/// - `[3]` : the element at the index in an array.
+/// - `*` : every value in a map.
+/// - `[*]` : every element in an array.
+///
+/// `/` alone is the expression itself. Use \ to escape a character in a key (such as `\/` or `\*`).
+/// Keys are hashed when compiled, so lookups dont rehash them. A compiled path isn't changed by using it,
+/// so one path can be used with any number of expressions and on any number of threads at once. Evaluating can
+/// change the expression though (see wexpr_Path_evaluate()), so to evaluate on several threads against the same
+/// tree, call wexpr_Expression_unshare() on it first.
+//
+struct WexprPath;
+
+typedef struct WexprPath WexprPath;
+
+/// \name Construction/Destruction
+/// \relates WexprPath
+/// \{
+
+//
+/// \brief Compile a path
+/// \param path The path string, as described in WexprPath
+/// \param error Set to WexprErrorCodeInvalidPath if the path is invalid, with the column it failed at.
+/// \return The compiled path, or NULL if invalid. Destroy with wexpr_Path_destroy().
+//
+LIBWEXPR_PUBLIC WexprPath* wexpr_Path_compile (const char* path, WexprError* error);
+
+//
+/// \brief Destroy a path
+/// \param self The path to destroy
+//
+LIBWEXPR_PUBLIC void wexpr_Path_destroy (WexprPath* self);
+
+/// \}
+
+/// \name Information
+/// \relates WexprPath
+/// \{
+
+//
+/// \brief Return the path string the path was compiled from
+/// \param self The path
+//
+LIBWEXPR_PUBLIC const char* wexpr_Path_string (const WexprPath* self);
+
+/// \}
+
+/// \name Evaluation
+/// \relates WexprPath
+/// \{
+
+//
+/// \brief Find every expression matching the path.
+/// Like the other accessors, shared parts of the tree along the way are copied (detached) so the results can be
+/// changed, which allocates and changes expr. Nothing is allocated if expr has nothing shared, such as after
+/// wexpr_Expression_unshare(), and then any number of threads can evaluate against it at once.
+/// \param self The path
+/// \param expr The expression to start from
+/// \param results Filled in with up to resultCapacity matches, in the order found. Can be NULL if resultCapacity is 0.
+/// \param resultCapacity Size of results
+/// \return The total number of matches, which can be more than resultCapacity.
+//
+LIBWEXPR_PUBLIC size_t wexpr_Path_evaluate (
+	const WexprPath* self, struct WexprExpression* expr,
+	struct WexprExpression** results, size_t resultCapacity
+);
+
+//
+/// \brief Find the first expression matching the path
+/// Shared parts of the tree along the way are copied, as with wexpr_Path_evaluate().
+/// \param self The path
+/// \param expr The expression to start from
+/// \return The first match, or NULL if none.
+//
+LIBWEXPR_PUBLIC struct WexprExpression* wexpr_Path_evaluateFirst (const WexprPath* self, struct WexprExpression* expr);
+
+/// \}
+
+LIBWEXPR_EXTERN_C_END()
+
+#endif // LIBWEXPR_PATH_H
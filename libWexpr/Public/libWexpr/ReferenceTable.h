@@ -34,6 +34,7 @@
 
 #include "Macros.h"
 
+#include <stdbool.h>
 #include <stddef.h>
 
 LIBWEXPR_EXTERN_C_BEGIN()
@@ -48,6 +49,10 @@ struct WexprExpression;
 /// Stores a list of expressions with a given name, allowing you to pull them out.
 /// Generally used as a list of references, which allows '*[asdf]' in wexpr to pull out
 /// an expression.
+///
+/// A table isn't safe to use from multiple threads by default. To share one between parsers on
+/// different threads, either freeze it first (wexpr_ReferenceTable_freeze()), or create it with
+/// wexpr_ReferenceTable_createConcurrent() if it should keep filling itself in with the callback.
 //
 struct WexprReferenceTable;
 
@@ -69,6 +74,25 @@ typedef struct WexprExpression* (*WexprReferenceTableCreateUnknownKeyCallback) (
 //
 LIBWEXPR_PUBLIC WexprReferenceTable* wexpr_ReferenceTable_create();
 
+//
+/// \brief Creates an empty reference table which any number of threads can use at once.
+/// \param expectedKeyCount About how many keys the table will hold, used to size it
+/// \param callback Called (possibly on several threads at once) to create unknown keys, or null
+/// \return The newly created table
+///
+/// Lookups dont lock, so a key that's already there is found without waiting on other threads.
+/// An unknown key is created with the callback outside of any lock; if two threads create the same key
+/// at once, one of them is kept and the other destroyed, so the callback should be deterministic.
+///
+/// Expressions which are replaced or removed are kept until the table is destroyed, since other threads may
+/// still be reading them. The index functions (wexpr_ReferenceTable_keyAtIndex() etc) and
+/// wexpr_ReferenceTable_count() only see a consistent table when nothing is being added.
+//
+LIBWEXPR_PUBLIC WexprReferenceTable* wexpr_ReferenceTable_createConcurrent (
+	size_t expectedKeyCount,
+	WexprReferenceTableCreateUnknownKeyCallback callback
+);
+
 //
 /// \brief Destroy a reference table
 /// \param self The referencetable to destroy
@@ -204,6 +228,33 @@ LIBWEXPR_PUBLIC void wexpr_ReferenceTable_setCreateUnknownKeyCallback (
 
 /// \}
 
+/// \name Sharing between threads
+/// \{
+
+//
+/// \brief Freeze the table so it can no longer change.
+/// \param self The reference table
+///
+/// Removing keys does nothing afterwards, setting them just destroys the expression given, and the
+/// unknown key callback is no longer called.
+/// Since nothing changes, any number of threads can look up keys (and parse using the table as an external
+/// reference table) at once without locking. Freeze before sharing the table with other threads.
+/// The index functions become constant time.
+//
+LIBWEXPR_PUBLIC void wexpr_ReferenceTable_freeze (
+	WexprReferenceTable* self
+);
+
+//
+/// \brief Return true if the table has been frozen
+/// \param self The reference table
+//
+LIBWEXPR_PUBLIC bool wexpr_ReferenceTable_isFrozen (
+	WexprReferenceTable* self
+);
+
+/// \}
+
 LIBWEXPR_EXTERN_C_END()
 
 #endif // LIBWEXPR_REFERENCETABLE_H
@@ -0,0 +1,107 @@
+//
+/// \file libWexpr/Sink.h
+/// \brief Destinations for streaming output
+//
+// #LICENSE_BEGIN:MIT#
+// 
+// Copyright (c) 2017-2020, Kenneth Perry (thothonegan)
+// 
+// Permission is hereby granted, free of charge, to any person obtaining
+// a copy of this software and associated documentation files (the
+// "Software"), to deal in the Software without restriction, including
+// without limitation the rights to use, copy, modify, merge, publish,
+// distribute, sublicense, and/or sell copies of the Software, and to
+// permit persons to whom the Software is furnished to do so, subject to
+// the following conditions:
+// 
+// The above copyright notice and this permission notice shall be
+// included in all copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+// MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+// NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+// LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+// OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+// WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+// 
+// SPDX-License-Identifier: MIT
+// #LICENSE_END#
+//
+
+#ifndef LIBWEXPR_SINK_H
+#define LIBWEXPR_SINK_H
+
+#include "Macros.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdio.h> // FILE
+
+LIBWEXPR_EXTERN_C_BEGIN()
+
+//
+/// \brief Called by a sink with each piece of output.
+/// \param userData The userData given to the sink
+/// \param data The data to write
+/// \param byteSize The size of the data in bytes
+/// \return true if all of the data was written, false on error (which stops the writer).
+//
+typedef bool (*WexprSinkWriteCallback) (void* userData, const void* data, size_t byteSize);
+
+//
+/// \struct WexprSink
+/// \brief A destination that the streaming writers (eg. wexpr_Expression_writeText()) send their output to.
+///
+/// Sinks are small values and dont own anything, so they dont need to be destroyed.
+/// The writers buffer a bounded amount internally, so memory use doesn't depend on the size of the document.
+//
+typedef struct WexprSink
+{
+	WexprSinkWriteCallback write; ///< Called with each piece of output
+	void* userData; ///< Passed to write
+} WexprSink;
+
+/// \name Construction
+/// \relates WexprSink
+/// \{
+
+//
+/// \brief Create a sink which calls the given callback.
+/// \param callback The callback to call with the output
+/// \param userData Passed to the callback
+//
+LIBWEXPR_PUBLIC WexprSink wexpr_Sink_forCallback (WexprSinkWriteCallback callback, void* userData);
+
+//
+/// \brief Create a sink which writes to a FILE using fwrite(). Does not close or flush the file.
+/// \param file The file to write to. Must stay open while the sink is used.
+//
+LIBWEXPR_PUBLIC WexprSink wexpr_Sink_forFile (FILE* file);
+
+//
+/// \brief Create a sink which writes to a file descriptor using write(). Does not close the descriptor.
+/// \param fileDescriptor The descriptor to write to. Must stay open while the sink is used.
+//
+LIBWEXPR_PUBLIC WexprSink wexpr_Sink_forFileDescriptor (int fileDescriptor);
+
+/// \}
+
+/// \name Writing
+/// \relates WexprSink
+/// \{
+
+//
+/// \brief Write data to the sink directly.
+/// \param self The sink to write to
+/// \param data The data to write
+/// \param byteSize The size of the data in bytes
+/// \return true on success, false if the sink failed.
+//
+LIBWEXPR_PUBLIC bool wexpr_Sink_write (WexprSink* self, const void* data, size_t byteSize);
+
+/// \}
+
+LIBWEXPR_EXTERN_C_END()
+
+#endif // LIBWEXPR_SINK_H
@@ -0,0 +1,136 @@
+//
+/// \file libWexpr/Snapshot.h
+/// \brief Sharing an expression with many reading threads while replacing it
+//
+// #LICENSE_BEGIN:MIT#
+// 
+// Copyright (c) 2017-2020, Kenneth Perry (thothonegan)
+// 
+// Permission is hereby granted, free of charge, to any person obtaining
+// a copy of this software and associated documentation files (the
+// "Software"), to deal in the Software without restriction, including
+// without limitation the rights to use, copy, modify, merge, publish,
+// distribute, sublicense, and/or sell copies of the Software, and to
+// permit persons to whom the Software is furnished to do so, subject to
+// the following conditions:
+// 
+// The above copyright notice and this permission notice shall be
+// included in all copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+// MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+// NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+// LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+// OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+// WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+// 
+// SPDX-License-Identifier: MIT
+// #LICENSE_END#
+//
+
+#ifndef LIBWEXPR_SNAPSHOT_H
+#define LIBWEXPR_SNAPSHOT_H
+
+#include "Macros.h"
+
+#include <stdbool.h>
+
+LIBWEXPR_EXTERN_C_BEGIN()
+
+// Expression.h
+struct WexprExpression;
+
+//
+/// \struct WexprSnapshot
+/// \brief Holds the current version of an expression (such as a configuration), which can be replaced while
+/// other threads are reading it.
+///
+/// Readers acquire the current expression, read it, then release it. Publishing a new expression swaps it in
+/// atomically: readers which already have the old one keep reading it, and it's destroyed once the last of them
+/// releases it. Readers never wait on each other or on publishing.
+///
+/// To reload a configuration file, load it (eg. with wexpr_Expression_createFromFile()) and publish it.
+//
+struct WexprSnapshot;
+
+typedef struct WexprSnapshot WexprSnapshot;
+
+//
+/// \brief A version of an expression acquired from a snapshot. Release with wexpr_SnapshotReader_release().
+//
+typedef struct WexprSnapshotReader
+{
+	/// The expression, or null if none was published. Only read it: it's shared with other threads.
+	struct WexprExpression* expression;
+	
+	void* m_version; // private
+} WexprSnapshotReader;
+
+/// \name Construction/Destruction
+/// \relates WexprSnapshot
+/// \{
+
+//
+/// \brief Create a snapshot.
+/// \param expression The first expression to publish, or null for none. We will take ownership of it.
+/// \return The snapshot, or null if out of memory (expression is destroyed).
+//
+LIBWEXPR_PUBLIC WexprSnapshot* wexpr_Snapshot_create (struct WexprExpression* expression);
+
+//
+/// \brief Destroy a snapshot. Nothing can be acquiring or publishing at the time.
+/// \param self The snapshot
+///
+/// Readers which are still reading keep their expression, and it's destroyed when they release it.
+//
+LIBWEXPR_PUBLIC void wexpr_Snapshot_destroy (WexprSnapshot* self);
+
+/// \}
+
+/// \name Publishing
+/// \relates WexprSnapshot
+/// \{
+
+//
+/// \brief Replace the snapshot's expression. Safe to call while other threads acquire, release, or publish.
+/// \param self The snapshot
+/// \param expression The expression to publish, or null for none. We will take ownership of it.
+/// \return true if published, false if out of memory (expression is destroyed and the old one kept).
+///
+/// The expression is unshared first (see wexpr_Expression_unshare()) so readers can't change it by reading.
+/// Readers acquiring afterwards get the new expression. The old one is destroyed once the last reader which
+/// acquired it releases it (here, if there are none). Publishing only waits for readers in the middle of
+/// wexpr_Snapshot_acquire(), never for ones reading.
+//
+LIBWEXPR_PUBLIC bool wexpr_Snapshot_publish (WexprSnapshot* self, struct WexprExpression* expression);
+
+/// \}
+
+/// \name Reading
+/// \relates WexprSnapshot
+/// \{
+
+//
+/// \brief Acquire the current expression to read it. Safe to call from any number of threads at once.
+/// \param self The snapshot
+/// \return The reader, which must be released with wexpr_SnapshotReader_release().
+///
+/// Wait-free: takes a fixed number of atomic operations, no matter what other threads are doing.
+/// The expression stays valid (and unchanged) until released, even if a new one is published.
+//
+LIBWEXPR_PUBLIC WexprSnapshotReader wexpr_Snapshot_acquire (WexprSnapshot* self);
+
+//
+/// \brief Release an expression acquired with wexpr_Snapshot_acquire(). Can be called after the snapshot is destroyed.
+/// \param self The reader. Its expression is set to null.
+///
+/// If a newer expression was published and this was the last reader of the old one, destroys it.
+//
+LIBWEXPR_PUBLIC void wexpr_SnapshotReader_release (WexprSnapshotReader* self);
+
+/// \}
+
+LIBWEXPR_EXTERN_C_END()
+
+#endif // LIBWEXPR_SNAPSHOT_H
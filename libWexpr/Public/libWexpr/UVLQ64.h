@@ -35,6 +35,7 @@
 #include "Endian.h"
 #include "Macros.h"
 
+#include <stddef.h> // size_t
 #include <stdint.h>
 
 LIBWEXPR_EXTERN_C_BEGIN()
@@ -47,6 +47,11 @@ enum
 {
 	WexprWriteFlagNone = 0, ///< No special flags
 	WexprWriteFlagHumanReadable = (1 << 0U), ///< Instead of trying to compress down, will add newlines and indentation to make it more readable.
+	WexprWriteFlagBinaryFileHeader = (1 << 1U), ///< For binary, write the file header before the expression chunk so the output is a complete binary file.
+	WexprWriteFlagBinaryIndex = (1 << 2U), ///< For binary files (with WexprWriteFlagBinaryFileHeader), also write an index chunk so large arrays/maps can be accessed randomly by WexprBinaryView. Readers that dont know it ignore it.
+	WexprWriteFlagBinaryStringTable = (1 << 3U), ///< For binary files (with WexprWriteFlagBinaryFileHeader), write repeated keys/values once in a string table chunk and refer to them by index. This is experimental, so only libWexpr can read these files.
+	WexprWriteFlagBinaryAligned = (1 << 4U), ///< For binary, write the aligned layout (version 0.2.0) instead, which WexprAlignedView can read in place. It always has a header, and the other binary flags and compression options are ignored.
+	WexprWriteFlagBinaryTypedValues = (1 << 5U), ///< For binary, write values which are integers, floating point numbers, or booleans (in exactly their canonical text) as typed chunks, so loading doesnt parse them again. This is experimental, so only libWexpr can read these.
 };
 
 LIBWEXPR_EXTERN_C_END()
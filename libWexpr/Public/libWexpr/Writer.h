@@ -0,0 +1,215 @@
+//
+/// \file libWexpr/Writer.h
+/// \brief Writes wexpr documents from a stream of events, without building a tree
+//
+// #LICENSE_BEGIN:MIT#
+// 
+// Copyright (c) 2017-2020, Kenneth Perry (thothonegan)
+// 
+// Permission is hereby granted, free of charge, to any person obtaining
+// a copy of this software and associated documentation files (the
+// "Software"), to deal in the Software without restriction, including
+// without limitation the rights to use, copy, modify, merge, publish,
+// distribute, sublicense, and/or sell copies of the Software, and to
+// permit persons to whom the Software is furnished to do so, subject to
+// the following conditions:
+// 
+// The above copyright notice and this permission notice shall be
+// included in all copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+// MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+// NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+// LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+// OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+// WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+// 
+// SPDX-License-Identifier: MIT
+// #LICENSE_END#
+//
+
+#ifndef LIBWEXPR_WRITER_H
+#define LIBWEXPR_WRITER_H
+
+#include "Macros.h"
+#include "WriteFlags.h"
+
+#include <stdbool.h>
+#include <stddef.h> // size_t
+
+LIBWEXPR_EXTERN_C_BEGIN()
+
+// Sink.h
+struct WexprSink;
+
+//
+/// \struct WexprWriter
+/// \brief Writes a document to a sink as you describe it, without creating a WexprExpression tree.
+///
+/// The events follow the structure of the document:
+/// \code{.c}
+///
+/// WexprSink sink = wexpr_Sink_forFile(stdout);
+/// WexprWriter* writer = wexpr_Writer_createText(&sink, WexprWriteFlagHumanReadable);
+///
+/// wexpr_Writer_beginMap(writer);
+///   wexpr_Writer_key(writer, "name");
+///   wexpr_Writer_value(writer, "wexpr");
+///   wexpr_Writer_key(writer, "list");
+///   wexpr_Writer_beginArray(writer);
+///     wexpr_Writer_value(writer, "a");
+///     wexpr_Writer_null(writer);
+///   wexpr_Writer_endArray(writer);
+/// wexpr_Writer_endMap(writer);
+///
+/// bool success = wexpr_Writer_finish(writer);
+/// wexpr_Writer_destroy(writer);
+///
+/// \endcode
+///
+/// The output is the same as writing the equivalent expression. Text is written as it goes.
+/// Binary needs the size of each array/map before its contents, so everything under the root array/map
+/// is buffered until it ends. A root value is written directly.
+///
+/// If an event is out of place (eg. a value where a map needs a key, or ending an array when a map is open)
+/// or the sink fails, the writer stops and every later call returns false. Duplicate map keys are not detected.
+//
+struct WexprWriter;
+
+typedef struct WexprWriter WexprWriter;
+
+/// \name Construction/Destruction
+/// \relates WexprWriter
+/// \{
+
+//
+/// \brief Create a writer which writes the text format.
+/// \param sink Where to write. The sink is copied.
+/// \param flags Flags to use when writing
+/// \return The writer, or null if out of memory.
+//
+LIBWEXPR_PUBLIC WexprWriter* wexpr_Writer_createText (struct WexprSink* sink, WexprWriteFlags flags);
+
+//
+/// \brief Create a writer which writes the binary format.
+/// \param sink Where to write. The sink is copied.
+/// \param flags Flags to use when writing. WexprWriteFlagBinaryFileHeader writes the file header first.
+/// \return The writer, or null if out of memory.
+//
+LIBWEXPR_PUBLIC WexprWriter* wexpr_Writer_createBinary (struct WexprSink* sink, WexprWriteFlags flags);
+
+//
+/// \brief Destroy the writer. Anything not finished is discarded.
+/// \param self The writer to destroy
+//
+LIBWEXPR_PUBLIC void wexpr_Writer_destroy (WexprWriter* self);
+
+//
+/// \brief Flush everything to the sink. Call once the root expression is complete.
+/// \param self The writer
+/// \return true if a complete document was written, false if it was incomplete or anything failed.
+//
+LIBWEXPR_PUBLIC bool wexpr_Writer_finish (WexprWriter* self);
+
+/// \}
+
+/// \name Values
+/// \relates WexprWriter
+/// \{
+
+//
+/// \brief Write a null expression
+/// \param self The writer
+/// \return true on success, false if out of place or the writer has failed.
+//
+LIBWEXPR_PUBLIC bool wexpr_Writer_null (WexprWriter* self);
+
+//
+/// \brief Write a value (cstring), quoting and escaping as needed.
+/// \param self The writer
+/// \param value The value to write
+/// \return true on success, false if out of place or the writer has failed.
+//
+LIBWEXPR_PUBLIC bool wexpr_Writer_value (WexprWriter* self, const char* value);
+
+//
+/// \brief Write a value with the given length, quoting and escaping as needed.
+/// \param self The writer
+/// \param value The value to write
+/// \param length The size of value
+/// \return true on success, false if out of place or the writer has failed.
+//
+LIBWEXPR_PUBLIC bool wexpr_Writer_valueLengthString (WexprWriter* self, const char* value, size_t length);
+
+//
+/// \brief Write binary data
+/// \param self The writer
+/// \param data The data to write
+/// \param byteSize The size of data in bytes
+/// \return true on success, false if out of place or the writer has failed.
+//
+LIBWEXPR_PUBLIC bool wexpr_Writer_binaryData (WexprWriter* self, const void* data, size_t byteSize);
+
+/// \}
+
+/// \name Arrays
+/// \relates WexprWriter
+/// \{
+
+//
+/// \brief Start an array. Following expressions are its elements until wexpr_Writer_endArray().
+/// \param self The writer
+/// \return true on success, false if out of place or the writer has failed.
+//
+LIBWEXPR_PUBLIC bool wexpr_Writer_beginArray (WexprWriter* self);
+
+//
+/// \brief End the current array
+/// \param self The writer
+/// \return true on success, false if an array isn't open or the writer has failed.
+//
+LIBWEXPR_PUBLIC bool wexpr_Writer_endArray (WexprWriter* self);
+
+/// \}
+
+/// \name Maps
+/// \relates WexprWriter
+/// \{
+
+//
+/// \brief Start a map. Following are pairs of wexpr_Writer_key() and an expression until wexpr_Writer_endMap().
+/// \param self The writer
+/// \return true on success, false if out of place or the writer has failed.
+//
+LIBWEXPR_PUBLIC bool wexpr_Writer_beginMap (WexprWriter* self);
+
+//
+/// \brief Write the key for the next map value (cstring)
+/// \param self The writer
+/// \param key The key to write
+/// \return true on success, false if a map isn't waiting for a key or the writer has failed.
+//
+LIBWEXPR_PUBLIC bool wexpr_Writer_key (WexprWriter* self, const char* key);
+
+//
+/// \brief Write the key for the next map value with the given length
+/// \param self The writer
+/// \param key The key to write
+/// \param length The size of key
+/// \return true on success, false if a map isn't waiting for a key or the writer has failed.
+//
+LIBWEXPR_PUBLIC bool wexpr_Writer_keyLengthString (WexprWriter* self, const char* key, size_t length);
+
+//
+/// \brief End the current map
+/// \param self The writer
+/// \return true on success, false if a map isn't open, a key has no value, or the writer has failed.
+//
+LIBWEXPR_PUBLIC bool wexpr_Writer_endMap (WexprWriter* self);
+
+/// \}
+
+LIBWEXPR_EXTERN_C_END()
+
+#endif // LIBWEXPR_WRITER_H
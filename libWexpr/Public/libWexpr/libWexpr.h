@@ -32,14 +32,23 @@
 #ifndef LIBWEXPR_LIBWEXPR_H
 #define LIBWEXPR_LIBWEXPR_H
 
+#include "AlignedView.h"
+#include "BinaryCompression.h"
+#include "BinaryView.h"
 #include "Endian.h"
 #include "Error.h"
+#include "Executor.h"
 #include "Expression.h"
 #include "ExpressionType.h"
 #include "Macros.h"
 #include "ParseFlags.h"
+#include "Path.h"
+#include "ReferenceTable.h"
+#include "Sink.h"
+#include "Snapshot.h"
 #include "UVLQ64.h"
 #include "WriteFlags.h"
+#include "Writer.h"
 
 #define LIBWEXPR_VERSION_MAJOR 1
 #define LIBWEXPR_VERSION_MINOR 1
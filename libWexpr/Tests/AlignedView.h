@@ -0,0 +1,254 @@
+//
+/// \file AlignedView.h
+/// \brief AlignedView tests
+//
+// #LICENSE_BEGIN:MIT#
+// 
+// Copyright (c) 2017-2020, Kenneth Perry (thothonegan)
+// 
+// Permission is hereby granted, free of charge, to any person obtaining
+// a copy of this software and associated documentation files (the
+// "Software"), to deal in the Software without restriction, including
+// without limitation the rights to use, copy, modify, merge, publish,
+// distribute, sublicense, and/or sell copies of the Software, and to
+// permit persons to whom the Software is furnished to do so, subject to
+// the following conditions:
+// 
+// The above copyright notice and this permission notice shall be
+// included in all copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+// MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+// NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+// LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+// OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+// WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+// 
+// SPDX-License-Identifier: MIT
+// #LICENSE_END#
+//
+
+#ifndef WEXPR_TESTS_ALIGNEDVIEW_H
+#define WEXPR_TESTS_ALIGNEDVIEW_H
+
+#include <libWexpr/AlignedView.h>
+#include <libWexpr/Expression.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "UnitTest.h"
+
+WEXPR_UNITTEST_BEGIN (AlignedViewCanNavigate)
+	WexprError err = WEXPR_ERROR_INIT();
+	WexprExpression* expr = wexpr_Expression_createFromString(
+		"@(name wexpr list #(a #(skipped nested) c) data <aGVsbG8=> nothing null)",
+		WexprParseFlagNone, &err
+	);
+	
+	WEXPR_UNITTEST_ASSERT (expr, "Cannot create expression");
+	
+	WexprMutableBuffer file = wexpr_Expression_createBinaryRepresentationWithFlags(expr, WexprWriteFlagBinaryAligned);
+	WEXPR_UNITTEST_ASSERT (file.data, "Should write it");
+	WEXPR_UNITTEST_ASSERT (file.byteSize == wexpr_Expression_binaryRepresentationSize(expr, WexprWriteFlagBinaryAligned), "Should be the size given");
+	WEXPR_UNITTEST_ASSERT (file.byteSize % 8 == 0, "Should be aligned");
+	
+	WexprAlignedView root = wexpr_AlignedView_createFromFile(file.data, file.byteSize, &err);
+	WEXPR_UNITTEST_ASSERT (wexpr_AlignedView_type(&root) == WexprExpressionTypeMap, "Root should be a map");
+	WEXPR_UNITTEST_ASSERT (wexpr_AlignedView_count(&root) == 4, "Should have 4 pairs");
+	
+	WexprAlignedView name = wexpr_AlignedView_mapValueForKey(&root, "name");
+	size_t length = 0;
+	WEXPR_UNITTEST_ASSERT (strcmp(wexpr_AlignedView_value(&name, &length), "wexpr") == 0 && length == 5, "Should find name as a C string");
+	
+	WexprAlignedView list = wexpr_AlignedView_mapValueForKey(&root, "list");
+	WEXPR_UNITTEST_ASSERT (wexpr_AlignedView_count(&list) == 3, "List should have 3 elements");
+	
+	WexprAlignedView c = wexpr_AlignedView_arrayAt(&list, 2);
+	WEXPR_UNITTEST_ASSERT (wexpr_AlignedView_valueEquals(&c, "c", 1), "Should index directly");
+	
+	WexprAlignedView nested = wexpr_AlignedView_arrayAt(&list, 1);
+	WexprAlignedView nestedEnd = wexpr_AlignedView_arrayAt(&nested, 1);
+	WEXPR_UNITTEST_ASSERT (wexpr_AlignedView_valueEquals(&nestedEnd, "nested", 6), "Should read nested arrays");
+	
+	WexprAlignedView outOfRange = wexpr_AlignedView_arrayAt(&list, 3);
+	WEXPR_UNITTEST_ASSERT (!wexpr_AlignedView_isValid(&outOfRange), "Out of range is invalid");
+	
+	WexprAlignedView data = wexpr_AlignedView_mapValueForKey(&root, "data");
+	size_t dataSize = 0;
+	const void* bytes = wexpr_AlignedView_binaryData(&data, &dataSize);
+	WEXPR_UNITTEST_ASSERT (dataSize == 5 && memcmp(bytes, "hello", 5) == 0, "Should read binary data in place");
+	
+	WexprAlignedView nothing = wexpr_AlignedView_mapValueForKey(&root, "nothing");
+	WEXPR_UNITTEST_ASSERT (wexpr_AlignedView_type(&nothing) == WexprExpressionTypeNull, "Should read null");
+	
+	WexprAlignedView missing = wexpr_AlignedView_mapValueForKey(&root, "missing");
+	WEXPR_UNITTEST_ASSERT (!wexpr_AlignedView_isValid(&missing), "Missing key is invalid");
+	
+	// keys are in hash order, and each can be found
+	for (size_t i=0; i < wexpr_AlignedView_count(&root); ++i)
+	{
+		WexprAlignedView key = wexpr_AlignedView_mapKeyAt(&root, i);
+		WexprAlignedView value = wexpr_AlignedView_mapValueForKey(&root, wexpr_AlignedView_value(&key, NULL));
+		WexprAlignedView valueAt = wexpr_AlignedView_mapValueAt(&root, i);
+		
+		WEXPR_UNITTEST_ASSERT (value.offset == valueAt.offset, "Should find every key");
+	}
+	
+	// loading it gives the same expression
+	char* expected = wexpr_Expression_createStringRepresentation(expr, 0, WexprWriteFlagNone);
+	
+	WexprExpression* read = wexpr_Expression_createFromBinaryFile(file.data, file.byteSize, WexprParseFlagNone, &err);
+	WEXPR_UNITTEST_ASSERT (read, "Should read the file");
+	
+	char* actual = wexpr_Expression_createStringRepresentation(read, 0, WexprWriteFlagNone);
+	WEXPR_UNITTEST_ASSERT (strcmp(actual, expected) == 0, "Should match the original");
+	
+	// the chunked layout isnt aligned
+	WexprMutableBuffer chunked = wexpr_Expression_createBinaryRepresentationWithFlags(read, WexprWriteFlagBinaryFileHeader);
+	WexprAlignedView notAligned = wexpr_AlignedView_createFromFile(chunked.data, chunked.byteSize, &err);
+	WEXPR_UNITTEST_ASSERT (!wexpr_AlignedView_isValid(&notAligned) && err.code == WexprErrorCodeBinaryUnknownVersion, "Should only view the aligned layout");
+	WEXPR_ERROR_FREE (err);
+	
+	free (chunked.data);
+	free (actual);
+	free (expected);
+	wexpr_Expression_destroy(read);
+	free (file.data);
+	wexpr_Expression_destroy(expr);
+	WEXPR_ERROR_FREE (err);
+WEXPR_UNITTEST_END ()
+
+WEXPR_UNITTEST_BEGIN (AlignedViewHandlesMalformedData)
+	WexprError err = WEXPR_ERROR_INIT();
+	WexprExpression* expr = wexpr_Expression_createFromString("#(a)", WexprParseFlagNone, &err);
+	
+	// prologue (40), the value (24), then the array (24)
+	WexprMutableBuffer file = wexpr_Expression_createBinaryRepresentationWithFlags(expr, WexprWriteFlagBinaryAligned);
+	WEXPR_UNITTEST_ASSERT (file.byteSize == 88, "Should be the expected size");
+	
+	uint8_t* bytes = file.data;
+	
+	// truncated
+	WexprAlignedView view = wexpr_AlignedView_createFromFile(bytes, file.byteSize - 8, &err);
+	WEXPR_UNITTEST_ASSERT (!wexpr_AlignedView_isValid(&view), "Should be invalid");
+	WEXPR_UNITTEST_ASSERT (err.code == WexprErrorCodeBinaryChunkBiggerThanData, "Should say why");
+	WEXPR_ERROR_FREE (err);
+	
+	// child pointing at its parent can't loop
+	bytes[80] = 64;
+	view = wexpr_AlignedView_createFromFile(bytes, file.byteSize, &err);
+	WEXPR_UNITTEST_ASSERT (wexpr_AlignedView_type(&view) == WexprExpressionTypeArray, "Root is fine");
+	
+	WexprAlignedView child = wexpr_AlignedView_arrayAt(&view, 0);
+	WEXPR_UNITTEST_ASSERT (!wexpr_AlignedView_isValid(&child), "Child should be invalid");
+	
+	WexprExpression* read = wexpr_Expression_createFromBinaryFile(bytes, file.byteSize, WexprParseFlagNone, &err);
+	WEXPR_UNITTEST_ASSERT (!read && err.code == WexprErrorCodeBinaryInvalidNode, "Should fail to load");
+	WEXPR_ERROR_FREE (err);
+	
+	// misaligned child
+	bytes[80] = 44;
+	child = wexpr_AlignedView_arrayAt(&view, 0);
+	WEXPR_UNITTEST_ASSERT (!wexpr_AlignedView_isValid(&child), "Child should be invalid");
+	
+	// value missing its terminator
+	bytes[80] = 40;
+	bytes[57] = 'b';
+	child = wexpr_AlignedView_arrayAt(&view, 0);
+	WEXPR_UNITTEST_ASSERT (!wexpr_AlignedView_isValid(&child), "Child should be invalid");
+	
+	free (file.data);
+	wexpr_Expression_destroy(expr);
+	WEXPR_ERROR_FREE (err);
+WEXPR_UNITTEST_END ()
+
+// Write little endian values into an aligned file being built by hand
+static void s_alignedViewTest_write32 (uint8_t* pos, uint32_t value)
+{
+	for (size_t i=0; i < 4; ++i)
+	{ pos[i] = (uint8_t)(value >> (i * 8)); }
+}
+
+static void s_alignedViewTest_write64 (uint8_t* pos, uint64_t value)
+{
+	for (size_t i=0; i < 8; ++i)
+	{ pos[i] = (uint8_t)(value >> (i * 8)); }
+}
+
+static void s_alignedViewTest_writeNodeHeader (uint8_t* pos, WexprExpressionType type, uint64_t count)
+{
+	s_alignedViewTest_write32(pos, (uint32_t)type);
+	s_alignedViewTest_write32(pos + 4, 0);
+	s_alignedViewTest_write64(pos + 8, count);
+}
+
+WEXPR_UNITTEST_BEGIN (AlignedViewLoadRefusesSharedNodes)
+	WexprError err = WEXPR_ERROR_INIT();
+	WexprExpression* expr = wexpr_Expression_createFromString("#(a)", WexprParseFlagNone, &err);
+	WexprMutableBuffer written = wexpr_Expression_createBinaryRepresentationWithFlags(expr, WexprWriteFlagBinaryAligned);
+	
+	// the value "a", then arrays of two children which both point at the node before.
+	// as a tree thats 2^levels values, which has to be refused rather than built.
+	const size_t levels = 40;
+	size_t fileSize = 40 + 24 + levels * 32;
+	uint8_t* file = calloc(fileSize, 1);
+	
+	memcpy (file, written.data, 24); // header and the start of the prologue
+	
+	s_alignedViewTest_writeNodeHeader(file + 40, WexprExpressionTypeValue, 1);
+	file[56] = 'a';
+	
+	uint64_t previous = 40;
+	for (size_t i=0; i < levels; ++i)
+	{
+		uint8_t* node = file + 64 + i * 32;
+		s_alignedViewTest_writeNodeHeader(node, WexprExpressionTypeArray, 2);
+		s_alignedViewTest_write64(node + 16, previous);
+		s_alignedViewTest_write64(node + 24, previous);
+		
+		previous = (uint64_t)(node - file);
+	}
+	
+	s_alignedViewTest_write64(file + 24, previous); // root
+	s_alignedViewTest_write64(file + 32, fileSize);
+	
+	// a view only looks at what it's asked, so it can still follow it
+	WexprAlignedView view = wexpr_AlignedView_createFromFile(file, fileSize, &err);
+	WEXPR_UNITTEST_ASSERT (wexpr_AlignedView_count(&view) == 2, "View should read the root");
+	
+	WexprAlignedView second = wexpr_AlignedView_arrayAt(&view, 1);
+	WEXPR_UNITTEST_ASSERT (wexpr_AlignedView_count(&second) == 2, "View should follow a shared child");
+	
+	WexprExpression* read = wexpr_Expression_createFromBinaryFile(file, fileSize, WexprParseFlagNone, &err);
+	WEXPR_UNITTEST_ASSERT (!read && err.code == WexprErrorCodeBinaryInvalidNode, "Should refuse to load shared nodes");
+	WEXPR_ERROR_FREE (err);
+	
+	// just one level is refused too, since the value is used twice
+	s_alignedViewTest_write64(file + 24, 64);
+	read = wexpr_Expression_createFromBinaryFile(file, fileSize, WexprParseFlagNone, &err);
+	WEXPR_UNITTEST_ASSERT (!read && err.code == WexprErrorCodeBinaryInvalidNode, "Should refuse a child used twice");
+	WEXPR_ERROR_FREE (err);
+	
+	// and is fine once it's only used once
+	s_alignedViewTest_write64(file + 72, 1);
+	
+	read = wexpr_Expression_createFromBinaryFile(file, fileSize, WexprParseFlagNone, &err);
+	WEXPR_UNITTEST_ASSERT (read && wexpr_Expression_arrayCount(read) == 1, "Should load a tree");
+	
+	wexpr_Expression_destroy(read);
+	free (file);
+	free (written.data);
+	wexpr_Expression_destroy(expr);
+	WEXPR_ERROR_FREE (err);
+WEXPR_UNITTEST_END ()
+
+WEXPR_UNITTEST_SUITE_BEGIN (AlignedView)
+	WEXPR_UNITTEST_SUITE_ADDTEST (AlignedView, AlignedViewCanNavigate);
+	WEXPR_UNITTEST_SUITE_ADDTEST (AlignedView, AlignedViewHandlesMalformedData);
+	WEXPR_UNITTEST_SUITE_ADDTEST (AlignedView, AlignedViewLoadRefusesSharedNodes);
+WEXPR_UNITTEST_SUITE_END ()
+
+#endif // WEXPR_TESTS_ALIGNEDVIEW_H
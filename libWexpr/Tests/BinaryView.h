@@ -0,0 +1,174 @@
+//
+/// \file BinaryView.h
+/// \brief BinaryView tests
+//
+// #LICENSE_BEGIN:MIT#
+// 
+// Copyright (c) 2017-2020, Kenneth Perry (thothonegan)
+// 
+// Permission is hereby granted, free of charge, to any person obtaining
+// a copy of this software and associated documentation files (the
+// "Software"), to deal in the Software without restriction, including
+// without limitation the rights to use, copy, modify, merge, publish,
+// distribute, sublicense, and/or sell copies of the Software, and to
+// permit persons to whom the Software is furnished to do so, subject to
+// the following conditions:
+// 
+// The above copyright notice and this permission notice shall be
+// included in all copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+// MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+// NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+// LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+// OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+// WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+// 
+// SPDX-License-Identifier: MIT
+// #LICENSE_END#
+//
+
+#ifndef WEXPR_TESTS_BINARYVIEW_H
+#define WEXPR_TESTS_BINARYVIEW_H
+
+#include <libWexpr/BinaryView.h>
+#include <libWexpr/Expression.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "UnitTest.h"
+
+WEXPR_UNITTEST_BEGIN (BinaryViewCanNavigate)
+	WexprError err = WEXPR_ERROR_INIT();
+	WexprExpression* expr = wexpr_Expression_createFromString(
+		"@(name wexpr list #(a #(skipped nested) c) data <aGVsbG8=> nothing null)",
+		WexprParseFlagNone, &err
+	);
+	
+	WEXPR_UNITTEST_ASSERT (expr, "Cannot create expression");
+	
+	WexprMutableBuffer file = wexpr_Expression_createBinaryRepresentationWithFlags(expr, WexprWriteFlagBinaryFileHeader);
+	
+	WexprBinaryView root = wexpr_BinaryView_createFromFile(file.data, file.byteSize, &err);
+	WEXPR_UNITTEST_ASSERT (wexpr_BinaryView_type(&root) == WexprExpressionTypeMap, "Root should be a map");
+	WEXPR_UNITTEST_ASSERT (wexpr_BinaryView_count(&root) == 4, "Should have 4 pairs");
+	
+	WexprBinaryView name = wexpr_BinaryView_mapValueForKey(&root, "name");
+	WEXPR_UNITTEST_ASSERT (wexpr_BinaryView_valueEquals(&name, "wexpr", 5), "Should find name");
+	
+	WexprBinaryView list = wexpr_BinaryView_mapValueForKey(&root, "list");
+	WEXPR_UNITTEST_ASSERT (wexpr_BinaryView_count(&list) == 3, "List should have 3 elements");
+	
+	size_t length = 0;
+	WexprBinaryView third = wexpr_BinaryView_arrayAt(&list, 2);
+	const char* value = wexpr_BinaryView_value(&third, &length);
+	WEXPR_UNITTEST_ASSERT (value && length == 1 && value[0] == 'c', "Should skip over the nested array");
+	
+	WexprBinaryView outOfRange = wexpr_BinaryView_arrayAt(&list, 3);
+	WEXPR_UNITTEST_ASSERT (!wexpr_BinaryView_isValid(&outOfRange), "Out of range should be invalid");
+	
+	WexprBinaryView data = wexpr_BinaryView_mapValueForKey(&root, "data");
+	size_t byteSize = 0;
+	const void* bytes = wexpr_BinaryView_binaryData(&data, &byteSize);
+	WEXPR_UNITTEST_ASSERT (bytes && byteSize == 5 && memcmp(bytes, "hello", 5) == 0, "Should find the binary data");
+	
+	void* copy = wexpr_BinaryView_createBinaryData(&data, &byteSize, &err);
+	WEXPR_UNITTEST_ASSERT (copy && byteSize == 5 && memcmp(copy, "hello", 5) == 0, "Should copy the binary data");
+	free (copy);
+	
+	WexprBinaryView nothing = wexpr_BinaryView_mapValueForKey(&root, "nothing");
+	WEXPR_UNITTEST_ASSERT (wexpr_BinaryView_type(&nothing) == WexprExpressionTypeNull, "Should find null");
+	
+	WexprBinaryView missing = wexpr_BinaryView_mapValueForKey(&root, "missing");
+	WEXPR_UNITTEST_ASSERT (!wexpr_BinaryView_isValid(&missing), "Missing key should be invalid");
+	
+	free (file.data);
+	wexpr_Expression_destroy(expr);
+	WEXPR_ERROR_FREE (err);
+WEXPR_UNITTEST_END ()
+
+WEXPR_UNITTEST_BEGIN (BinaryViewUsesIndex)
+	WexprError err = WEXPR_ERROR_INIT();
+	
+	// big enough that both the map and the array get indexed
+	char str[4096] = "@(list #(";
+	for (int i=0; i < 100; ++i)
+	{ sprintf (str + strlen(str), "%d ", i); }
+	strcat (str, ")");
+	for (int i=0; i < 100; ++i)
+	{ sprintf (str + strlen(str), " key%d %d", i, i * 2); }
+	strcat (str, ")");
+	
+	WexprExpression* expr = wexpr_Expression_createFromString(str, WexprParseFlagNone, &err);
+	WEXPR_UNITTEST_ASSERT (expr, "Cannot create expression");
+	
+	WexprWriteFlags flags = WexprWriteFlagBinaryFileHeader | WexprWriteFlagBinaryIndex;
+	WexprMutableBuffer file = wexpr_Expression_createBinaryRepresentationWithFlags(expr, flags);
+	WEXPR_UNITTEST_ASSERT (file.byteSize == wexpr_Expression_binaryRepresentationSize(expr, flags), "Size should match");
+	WEXPR_UNITTEST_ASSERT (file.byteSize > wexpr_Expression_binaryRepresentationSize(expr, WexprWriteFlagBinaryFileHeader), "Should have an index");
+	
+	WexprBinaryView root = wexpr_BinaryView_createFromFile(file.data, file.byteSize, &err);
+	WEXPR_UNITTEST_ASSERT (root.index != NULL, "Should find the index");
+	WEXPR_UNITTEST_ASSERT (wexpr_BinaryView_count(&root) == 101, "Should have 101 pairs");
+	
+	char key[16];
+	char value[16];
+	for (int i=0; i < 100; ++i)
+	{
+		sprintf (key, "key%d", i);
+		sprintf (value, "%d", i * 2);
+		
+		WexprBinaryView found = wexpr_BinaryView_mapValueForKey(&root, key);
+		WEXPR_UNITTEST_ASSERT (wexpr_BinaryView_valueEquals(&found, value, strlen(value)), "Should find every key");
+	}
+	
+	WexprBinaryView missing = wexpr_BinaryView_mapValueForKey(&root, "key100");
+	WEXPR_UNITTEST_ASSERT (!wexpr_BinaryView_isValid(&missing), "Missing key should be invalid");
+	
+	WexprBinaryView list = wexpr_BinaryView_mapValueForKey(&root, "list");
+	WEXPR_UNITTEST_ASSERT (wexpr_BinaryView_count(&list) == 100, "List should have 100 elements");
+	
+	WexprBinaryView last = wexpr_BinaryView_arrayAt(&list, 99);
+	WEXPR_UNITTEST_ASSERT (wexpr_BinaryView_valueEquals(&last, "99", 2), "Should find the last element");
+	
+	WexprBinaryView outOfRange = wexpr_BinaryView_arrayAt(&list, 100);
+	WEXPR_UNITTEST_ASSERT (!wexpr_BinaryView_isValid(&outOfRange), "Out of range should be invalid");
+	
+	// readers that dont use the index skip it
+	WexprExpression* readBack = wexpr_Expression_createFromBinaryFile(file.data, file.byteSize, WexprParseFlagNone, &err);
+	WEXPR_UNITTEST_ASSERT (readBack && wexpr_Expression_mapCount(readBack) == 101, "Should ignore the index");
+	
+	wexpr_Expression_destroy(readBack);
+	free (file.data);
+	wexpr_Expression_destroy(expr);
+	WEXPR_ERROR_FREE (err);
+WEXPR_UNITTEST_END ()
+
+WEXPR_UNITTEST_BEGIN (BinaryViewHandlesMalformedData)
+	WexprError err = WEXPR_ERROR_INIT();
+	
+	// array claims 5 bytes, but the child inside claims more than that
+	const uint8_t badChild[] = { 0x05, 0x02, 0x09, 0x01, 'a', 'b', 'c' };
+	WexprBinaryView view = wexpr_BinaryView_createFromChunk(badChild, sizeof(badChild), &err);
+	
+	WEXPR_UNITTEST_ASSERT (wexpr_BinaryView_type(&view) == WexprExpressionTypeArray, "Outer chunk is fine");
+	WEXPR_UNITTEST_ASSERT (wexpr_BinaryView_count(&view) == 0, "Bad child should stop iteration");
+	
+	// chunk bigger than the data
+	view = wexpr_BinaryView_createFromChunk(badChild, 4, &err);
+	WEXPR_UNITTEST_ASSERT (!wexpr_BinaryView_isValid(&view), "Should be invalid");
+	WEXPR_UNITTEST_ASSERT (err.code == WexprErrorCodeBinaryChunkBiggerThanData, "Should say why");
+	
+	WEXPR_ERROR_FREE (err);
+WEXPR_UNITTEST_END ()
+
+WEXPR_UNITTEST_SUITE_BEGIN (BinaryView)
+	WEXPR_UNITTEST_SUITE_ADDTEST (BinaryView, BinaryViewCanNavigate);
+	WEXPR_UNITTEST_SUITE_ADDTEST (BinaryView, BinaryViewUsesIndex);
+	WEXPR_UNITTEST_SUITE_ADDTEST (BinaryView, BinaryViewHandlesMalformedData);
+WEXPR_UNITTEST_SUITE_END ()
+
+#endif // WEXPR_TESTS_BINARYVIEW_H
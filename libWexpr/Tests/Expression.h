@@ -32,9 +32,12 @@
 #ifndef WEXPR_TESTS_EXPRESSION_H
 #define WEXPR_TESTS_EXPRESSION_H
 
+#include <libWexpr/BinaryView.h>
 #include <libWexpr/Expression.h>
 #include <libWexpr/ReferenceTable.h>
+#include <libWexpr/UVLQ64.h>
 
+#include <locale.h>
 #include <stdbool.h>
 
 #include "UnitTest.h"
@@ -105,6 +108,94 @@ WEXPR_UNITTEST_BEGIN (ExpressionCanEncodeEscapedValue)
 
 WEXPR_UNITTEST_END ()
 
+// Write a value one byte at a time, for checking the vectorized writer against
+static void s_expressionTest_writeValueByteByByte (const char* value, size_t length, char* out)
+{
+	const char* notBareword = "\n\r\t \"*#@()[]^<>;";
+	
+	bool needsQuotes = (length == 0);
+	for (size_t i=0; i < length; ++i)
+	{
+		if (strchr(notBareword, value[i]))
+		{ needsQuotes = true; }
+	}
+	
+	if (needsQuotes)
+	{ *out++ = '"'; }
+	
+	for (size_t i=0; i < length; ++i)
+	{
+		switch (value[i])
+		{
+			case '"':  *out++ = '\\'; *out++ = '"'; break;
+			case '\\': *out++ = '\\'; *out++ = '\\'; break;
+			case '\n': *out++ = '\\'; *out++ = 'n'; break;
+			case '\r': *out++ = '\\'; *out++ = 'r'; break;
+			case '\t': *out++ = '\\'; *out++ = 't'; break;
+			default: *out++ = value[i];
+		}
+	}
+	
+	if (needsQuotes)
+	{ *out++ = '"'; }
+	
+	*out = '\0';
+}
+
+WEXPR_UNITTEST_BEGIN (ExpressionCanEncodeAcrossVectorBoundaries)
+	// values are classified 16 bytes at a time where possible, so put each special character
+	// at, and across, the edges of those blocks
+	const size_t lengths[] = { 1, 15, 16, 17, 31, 32, 33, 47, 48, 49, 64 };
+	const char* specials[] = { " ", "\"", "\\", "\n", "\r", "\t", "\x01", "#", ";", "\xC3\xA9", "\xE2\x82\xAC" };
+	
+	char value[80];
+	char expected[200];
+	
+	for (size_t l=0; l < sizeof(lengths)/sizeof(lengths[0]); ++l)
+	{
+		size_t length = lengths[l];
+		
+		for (size_t s=0; s < sizeof(specials)/sizeof(specials[0]); ++s)
+		{
+			size_t specialLength = strlen(specials[s]);
+			
+			for (size_t at=0; at + specialLength <= length; ++at)
+			{
+				// a second special in the last block, so escapes are found in more than one
+				memset (value, 'a', length);
+				memcpy (value + at, specials[s], specialLength);
+				
+				if (length > 16 && at + specialLength < length - 1)
+				{ value[length-1] = (s % 2) ? '"' : 'z'; }
+				
+				value[length] = '\0';
+				
+				WexprExpression* expr = wexpr_Expression_createValue(value);
+				char* written = wexpr_Expression_createStringRepresentation(expr, 0, WexprWriteFlagNone);
+				
+				s_expressionTest_writeValueByteByByte(value, length, expected);
+				WEXPR_UNITTEST_ASSERT (written && strcmp(written, expected) == 0, "Quoting and escaping should match writing byte by byte");
+				WEXPR_UNITTEST_ASSERT (wexpr_Expression_stringRepresentationSize(expr, 0, WexprWriteFlagNone) == strlen(expected), "Size should match too");
+				
+				// barewords arent unescaped when read, so a lone backslash doesnt come back the same
+				if (expected[0] == '"' || !strchr(value, '\\'))
+				{
+					WexprExpression* readBack = wexpr_Expression_createFromString(written, WexprParseFlagNone, LIBWEXPR_NULLPTR);
+					WEXPR_UNITTEST_ASSERT (readBack && wexpr_Expression_value(readBack) && strcmp(wexpr_Expression_value(readBack), value) == 0,
+						"Value should read back the same"
+					);
+					
+					wexpr_Expression_destroy(readBack);
+				}
+				
+				wexpr_Expression_destroy(expr);
+				free (written);
+			}
+		}
+	}
+	
+WEXPR_UNITTEST_END ()
+
 WEXPR_UNITTEST_BEGIN (ExpressionCanCreateNumber)
 	WexprError err = WEXPR_ERROR_INIT();
 	WexprExpression* valueExpr = wexpr_Expression_createFromString("2.45", WexprParseFlagNone, &err);
@@ -362,6 +453,192 @@ WEXPR_UNITTEST_BEGIN (ExpressionCanCreateString)
 	WEXPR_ERROR_FREE (err);
 WEXPR_UNITTEST_END()
 
+WEXPR_UNITTEST_BEGIN(ExpressionCanWriteStringInto)
+	WexprError err = WEXPR_ERROR_INIT();
+	WexprExpression* expr = wexpr_Expression_createFromString(
+		"#(\"quote\\\"d\" @(\"key\\twith tab\" <aGVsbG8=>) null #())",
+		WexprParseFlagNone, &err
+	);
+	
+	WEXPR_UNITTEST_ASSERT (expr, "Cannot create expression");
+	
+	for (int i=0; i < 2; ++i)
+	{
+		WexprWriteFlags flags = (i == 0) ? WexprWriteFlagNone : WexprWriteFlagHumanReadable;
+		
+		char* created = wexpr_Expression_createStringRepresentation(expr, 0, flags);
+		size_t size = wexpr_Expression_stringRepresentationSize(expr, 0, flags);
+		
+		WEXPR_UNITTEST_ASSERT (size == strlen(created), "Size should match the created string");
+		
+		// too small
+		char smallBuffer[8];
+		size_t written = 0;
+		WEXPR_UNITTEST_ASSERT (!wexpr_Expression_writeStringInto(expr, 0, flags, smallBuffer, sizeof(smallBuffer), &written), "Should fail with a small buffer");
+		WEXPR_UNITTEST_ASSERT (written == size, "Should report the size needed");
+		
+		// exact size
+		char* buffer = malloc(size+1);
+		WEXPR_UNITTEST_ASSERT (wexpr_Expression_writeStringInto(expr, 0, flags, buffer, size+1, &written), "Should fit exactly");
+		WEXPR_UNITTEST_ASSERT (written == size, "Should report the size written");
+		WEXPR_UNITTEST_ASSERT (strcmp(buffer, created) == 0, "Should match the created string");
+		
+		free (buffer);
+		free (created);
+	}
+	
+	wexpr_Expression_destroy(expr);
+	WEXPR_ERROR_FREE (err);
+	
+WEXPR_UNITTEST_END()
+
+WEXPR_UNITTEST_BEGIN(ExpressionCanWriteBinaryInto)
+	WexprError err = WEXPR_ERROR_INIT();
+	WexprExpression* expr = wexpr_Expression_createFromString(
+		"#(a @(b c) <aGVsbG8=> null)", WexprParseFlagNone, &err
+	);
+	
+	WEXPR_UNITTEST_ASSERT (expr, "Cannot create expression");
+	
+	WexprMutableBuffer created = wexpr_Expression_createBinaryRepresentation(expr);
+	size_t size = wexpr_Expression_binaryRepresentationSize(expr, WexprWriteFlagNone);
+	size_t fileSize = wexpr_Expression_binaryRepresentationSize(expr, WexprWriteFlagBinaryFileHeader);
+	
+	WEXPR_UNITTEST_ASSERT (size == created.byteSize, "Size should match the created buffer");
+	WEXPR_UNITTEST_ASSERT (fileSize == size + 20, "File header should be 20 bytes");
+	
+	// too small
+	uint8_t smallBuffer[8];
+	size_t written = 0;
+	WEXPR_UNITTEST_ASSERT (!wexpr_Expression_writeBinaryInto(expr, WexprWriteFlagNone, smallBuffer, sizeof(smallBuffer), &written), "Should fail with a small buffer");
+	WEXPR_UNITTEST_ASSERT (written == size, "Should report the size needed");
+	
+	// with the header
+	uint8_t* buffer = malloc(fileSize);
+	WEXPR_UNITTEST_ASSERT (wexpr_Expression_writeBinaryInto(expr, WexprWriteFlagBinaryFileHeader, buffer, fileSize, &written), "Should fit exactly");
+	WEXPR_UNITTEST_ASSERT (written == fileSize, "Should report the size written");
+	WEXPR_UNITTEST_ASSERT (buffer[0] == 0x83 && memcmp(buffer+1, "BWEXPR\n", 7) == 0, "Should start with the magic");
+	WEXPR_UNITTEST_ASSERT (memcmp(buffer+20, created.data, size) == 0, "Chunk should follow the header");
+	
+	free (buffer);
+	free (created.data);
+	wexpr_Expression_destroy(expr);
+	WEXPR_ERROR_FREE (err);
+	
+WEXPR_UNITTEST_END()
+
+WEXPR_UNITTEST_BEGIN(ExpressionCanReadBinaryFile)
+	WexprError err = WEXPR_ERROR_INIT();
+	WexprExpression* expr = wexpr_Expression_createFromString(
+		"#(a @(b c) <aGVsbG8=> null)", WexprParseFlagNone, &err
+	);
+	
+	WEXPR_UNITTEST_ASSERT (expr, "Cannot create expression");
+	
+	WexprMutableBuffer file = wexpr_Expression_createBinaryRepresentationWithFlags(expr, WexprWriteFlagBinaryFileHeader);
+	WEXPR_UNITTEST_ASSERT (file.byteSize == wexpr_Expression_binaryRepresentationSize(expr, WexprWriteFlagBinaryFileHeader), "Should include the header");
+	
+	char* expected = wexpr_Expression_createStringRepresentation(expr, 0, WexprWriteFlagNone);
+	
+	// round trip
+	WexprExpression* read = wexpr_Expression_createFromBinaryFile(file.data, file.byteSize, WexprParseFlagNone, &err);
+	WEXPR_UNITTEST_ASSERT (read, "Should read the file");
+	
+	char* actual = wexpr_Expression_createStringRepresentation(read, 0, WexprWriteFlagNone);
+	WEXPR_UNITTEST_ASSERT (strcmp(actual, expected) == 0, "Should match the original");
+	free (actual);
+	wexpr_Expression_destroy(read);
+	
+	// an unknown auxiliary chunk before the expression is skipped
+	const uint8_t auxChunk[] = { 0x03, 0x42, 'a', 'u', 'x' };
+	uint8_t* withAux = malloc(file.byteSize + sizeof(auxChunk));
+	memcpy (withAux, file.data, 20);
+	memcpy (withAux + 20, auxChunk, sizeof(auxChunk));
+	memcpy (withAux + 20 + sizeof(auxChunk), (uint8_t*)file.data + 20, file.byteSize - 20);
+	
+	read = wexpr_Expression_createFromBinaryFile(withAux, file.byteSize + sizeof(auxChunk), WexprParseFlagNone, &err);
+	WEXPR_UNITTEST_ASSERT (read, "Should skip the auxiliary chunk");
+	
+	actual = wexpr_Expression_createStringRepresentation(read, 0, WexprWriteFlagNone);
+	WEXPR_UNITTEST_ASSERT (strcmp(actual, expected) == 0, "Should match the original");
+	free (actual);
+	wexpr_Expression_destroy(read);
+	
+	// truncated
+	read = wexpr_Expression_createFromBinaryFile(file.data, file.byteSize - 1, WexprParseFlagNone, &err);
+	WEXPR_UNITTEST_ASSERT (!read && err.code == WexprErrorCodeBinaryChunkBiggerThanData, "Should fail on a truncated chunk");
+	WEXPR_ERROR_FREE (err);
+	
+	// only the auxiliary chunk
+	read = wexpr_Expression_createFromBinaryFile(withAux, 20 + sizeof(auxChunk), WexprParseFlagNone, &err);
+	WEXPR_UNITTEST_ASSERT (!read && err.code == WexprErrorCodeBinaryMissingExpression, "Should fail without an expression chunk");
+	WEXPR_ERROR_FREE (err);
+	
+	// bad version
+	((uint8_t*)file.data)[11] = 0xFF;
+	read = wexpr_Expression_createFromBinaryFile(file.data, file.byteSize, WexprParseFlagNone, &err);
+	WEXPR_UNITTEST_ASSERT (!read && err.code == WexprErrorCodeBinaryUnknownVersion, "Should fail on an unknown version");
+	WEXPR_ERROR_FREE (err);
+	
+	// bad magic
+	((uint8_t*)file.data)[1] = 'X';
+	read = wexpr_Expression_createFromBinaryFile(file.data, file.byteSize, WexprParseFlagNone, &err);
+	WEXPR_UNITTEST_ASSERT (!read && err.code == WexprErrorCodeBinaryInvalidHeader, "Should fail on invalid magic");
+	WEXPR_ERROR_FREE (err);
+	
+	free (withAux);
+	free (expected);
+	free (file.data);
+	wexpr_Expression_destroy(expr);
+	WEXPR_ERROR_FREE (err);
+	
+WEXPR_UNITTEST_END()
+
+WEXPR_UNITTEST_BEGIN(ExpressionCanCreateFromFile)
+	WexprError err = WEXPR_ERROR_INIT();
+	const char* path = "libWexprTests_ExpressionCanCreateFromFile.tmp";
+	
+	// text, exactly one page so reading past the end of a mapping would crash
+	char text[4096];
+	memset (text, 'a', sizeof(text));
+	memcpy (text, "#( ", 3);
+	text[sizeof(text)-1] = ')';
+	
+	FILE* file = fopen(path, "wb");
+	WEXPR_UNITTEST_ASSERT (file, "Cannot create the file");
+	fwrite (text, 1, sizeof(text), file);
+	fclose (file);
+	
+	WexprExpression* expr = wexpr_Expression_createFromFile(path, WexprParseFlagNone, &err);
+	WEXPR_UNITTEST_ASSERT (expr, "Should load text");
+	WEXPR_UNITTEST_ASSERT (wexpr_Expression_arrayCount(expr) == 1, "Should have one element");
+	WEXPR_UNITTEST_ASSERT (strlen(wexpr_Expression_value(wexpr_Expression_arrayAt(expr, 0))) == sizeof(text)-4, "Should have the whole value");
+	
+	// binary
+	WexprMutableBuffer binary = wexpr_Expression_createBinaryRepresentationWithFlags(expr, WexprWriteFlagBinaryFileHeader);
+	
+	file = fopen(path, "wb");
+	WEXPR_UNITTEST_ASSERT (file, "Cannot create the file");
+	fwrite (binary.data, 1, binary.byteSize, file);
+	fclose (file);
+	
+	WexprExpression* binaryExpr = wexpr_Expression_createFromFile(path, WexprParseFlagNone, &err);
+	WEXPR_UNITTEST_ASSERT (binaryExpr, "Should load binary");
+	WEXPR_UNITTEST_ASSERT (strcmp(wexpr_Expression_value(wexpr_Expression_arrayAt(binaryExpr, 0)), wexpr_Expression_value(wexpr_Expression_arrayAt(expr, 0))) == 0, "Should match");
+	
+	remove (path);
+	
+	// missing
+	WEXPR_UNITTEST_ASSERT (!wexpr_Expression_createFromFile(path, WexprParseFlagNone, &err), "Should fail on a missing file");
+	WEXPR_UNITTEST_ASSERT (err.code == WexprErrorCodeUnableToReadFile, "Should say why");
+	
+	free (binary.data);
+	wexpr_Expression_destroy(binaryExpr);
+	wexpr_Expression_destroy(expr);
+	WEXPR_ERROR_FREE (err);
+	
+WEXPR_UNITTEST_END()
+
 WEXPR_UNITTEST_BEGIN(ExpressionCanChangeType)
 	WexprExpression* expr = wexpr_Expression_createNull();
 	wexpr_Expression_changeType(expr, WexprExpressionTypeValue);
@@ -463,6 +740,803 @@ WEXPR_UNITTEST_BEGIN(ExpressionCanHandleBinaryExpression)
 	
 WEXPR_UNITTEST_END()
 
+WEXPR_UNITTEST_BEGIN(ExpressionCanCompressBinaryData)
+	WexprError err = WEXPR_ERROR_INIT();
+	
+	// compressible, and a small one under the threshold
+	uint8_t data[4096];
+	for (size_t i=0; i < sizeof(data); ++i)
+	{ data[i] = (uint8_t)(i % 16); }
+	
+	WexprExpression* expr = wexpr_Expression_createNull();
+	wexpr_Expression_changeType(expr, WexprExpressionTypeArray);
+	
+	WexprExpression* big = wexpr_Expression_createNull();
+	wexpr_Expression_changeType(big, WexprExpressionTypeBinaryData);
+	wexpr_Expression_binaryData_setValue(big, data, sizeof(data));
+	wexpr_Expression_arrayAddElementToEnd(expr, big);
+	
+	WexprExpression* small = wexpr_Expression_createNull();
+	wexpr_Expression_changeType(small, WexprExpressionTypeBinaryData);
+	wexpr_Expression_binaryData_setValue(small, data, 16);
+	wexpr_Expression_arrayAddElementToEnd(expr, small);
+	
+	WexprMutableBuffer raw = wexpr_Expression_createBinaryRepresentation(expr);
+	
+	const WexprBinaryCompression methods[] = { WexprBinaryCompressionZlib, WexprBinaryCompressionZstd };
+	for (size_t m=0; m < sizeof(methods)/sizeof(methods[0]); ++m)
+	{
+		if (!wexpr_BinaryCompression_isSupported(methods[m]))
+		{ continue; } // not built with it
+		
+		WexprBinaryWriteOptions options = WEXPR_BINARYWRITEOPTIONS_INIT(WexprWriteFlagNone);
+		options.compression = methods[m];
+		options.compressionThreshold = 64;
+		
+		WexprMutableBuffer buf = wexpr_Expression_createBinaryRepresentationWithOptions(expr, &options);
+		WEXPR_UNITTEST_ASSERT (buf.data && buf.byteSize < raw.byteSize, "Should be smaller compressed");
+		
+		WexprExpression* loaded = wexpr_Expression_createFromBinaryChunk(buf.data, buf.byteSize, &err);
+		WEXPR_UNITTEST_ASSERT (loaded && wexpr_Expression_arrayCount(loaded) == 2, "Should read it back");
+		
+		WexprExpression* loadedBig = wexpr_Expression_arrayAt(loaded, 0);
+		WEXPR_UNITTEST_ASSERT (wexpr_Expression_binaryData_size(loadedBig) == sizeof(data), "Should decompress to the same size");
+		WEXPR_UNITTEST_ASSERT (memcmp(wexpr_Expression_binaryData_data(loadedBig), data, sizeof(data)) == 0, "Should decompress to the same data");
+		
+		WexprExpression* loadedSmall = wexpr_Expression_arrayAt(loaded, 1);
+		WEXPR_UNITTEST_ASSERT (wexpr_Expression_binaryData_size(loadedSmall) == 16, "Small data should be kept");
+		
+		wexpr_Expression_destroy(loaded);
+		free (buf.data);
+	}
+	
+	// methods we dont know
+	const uint8_t unknownMethod[] = { 0x03, 0x04, 0x7F, 'a', 'b' };
+	WexprExpression* bad = wexpr_Expression_createFromBinaryChunk(unknownMethod, sizeof(unknownMethod), &err);
+	WEXPR_UNITTEST_ASSERT (!bad && err.code == WexprErrorCodeBinaryUnknownCompression, "Unknown method should fail");
+	WEXPR_ERROR_FREE (err);
+	
+	// supported methods with bad data
+	if (wexpr_BinaryCompression_isSupported(WexprBinaryCompressionZlib))
+	{
+		const uint8_t badData[] = { 0x05, 0x04, WexprBinaryCompressionZlib, 'j', 'u', 'n', 'k' };
+		err = (WexprError)WEXPR_ERROR_INIT();
+		
+		bad = wexpr_Expression_createFromBinaryChunk(badData, sizeof(badData), &err);
+		WEXPR_UNITTEST_ASSERT (!bad && err.code == WexprErrorCodeBinaryInvalidCompressedData, "Bad data should fail");
+		WEXPR_ERROR_FREE (err);
+		
+		// "hello", then with a byte after the end of the stream
+		uint8_t hello[] = { 0x0E, 0x04, WexprBinaryCompressionZlib,
+			0x78, 0x9C, 0xCB, 0x48, 0xCD, 0xC9, 0xC9, 0x07, 0x00, 0x06, 0x2C, 0x02, 0x15,
+			0x00
+		};
+		
+		WexprExpression* good = wexpr_Expression_createFromBinaryChunk(hello, sizeof(hello) - 1, &err);
+		WEXPR_UNITTEST_ASSERT (good && wexpr_Expression_binaryData_size(good) == 5, "Should read the whole stream");
+		wexpr_Expression_destroy(good);
+		
+		hello[0] += 1;
+		bad = wexpr_Expression_createFromBinaryChunk(hello, sizeof(hello), &err);
+		WEXPR_UNITTEST_ASSERT (!bad && err.code == WexprErrorCodeBinaryInvalidCompressedData, "Extra data after the stream should fail");
+		WEXPR_ERROR_FREE (err);
+	}
+	
+	if (wexpr_BinaryCompression_isSupported(WexprBinaryCompressionZstd))
+	{
+		// "hello", whose frame says its 5 bytes
+		uint8_t hello[] = { 0x0F, 0x04, WexprBinaryCompressionZstd,
+			0x28, 0xB5, 0x2F, 0xFD, 0x20, 0x05, 0x29, 0x00, 0x00, 0x68, 0x65, 0x6C, 0x6C, 0x6F,
+			0x00
+		};
+		
+		WexprExpression* good = wexpr_Expression_createFromBinaryChunk(hello, sizeof(hello) - 1, &err);
+		WEXPR_UNITTEST_ASSERT (good && wexpr_Expression_binaryData_size(good) == 5, "Should read the whole frame");
+		wexpr_Expression_destroy(good);
+		
+		hello[0] += 1;
+		bad = wexpr_Expression_createFromBinaryChunk(hello, sizeof(hello), &err);
+		WEXPR_UNITTEST_ASSERT (!bad && err.code == WexprErrorCodeBinaryInvalidCompressedData, "Extra data after the frame should fail");
+		WEXPR_ERROR_FREE (err);
+		
+		hello[0] -= 1;
+		hello[8] = 0x06;
+		bad = wexpr_Expression_createFromBinaryChunk(hello, sizeof(hello) - 1, &err);
+		WEXPR_UNITTEST_ASSERT (!bad && err.code == WexprErrorCodeBinaryInvalidCompressedData, "A frame size which doesnt match should fail");
+		WEXPR_ERROR_FREE (err);
+		
+		// the same, but claiming to be 2 TiB. This has to fail without trying to allocate that.
+		const uint8_t huge[] = { 0x16, 0x04, WexprBinaryCompressionZstd,
+			0x28, 0xB5, 0x2F, 0xFD, 0xE0, 0x00, 0x00, 0x00, 0x00, 0x00, 0x02, 0x00, 0x00,
+			0x29, 0x00, 0x00, 0x68, 0x65, 0x6C, 0x6C, 0x6F
+		};
+		
+		bad = wexpr_Expression_createFromBinaryChunk(huge, sizeof(huge), &err);
+		WEXPR_UNITTEST_ASSERT (!bad && err.code == WexprErrorCodeBinaryInvalidCompressedData, "A forged frame size should fail");
+		WEXPR_ERROR_FREE (err);
+	}
+	
+	free (raw.data);
+	wexpr_Expression_destroy(expr);
+	
+WEXPR_UNITTEST_END()
+
+// Write a file with a compressed blocks chunk (zlib) with the given header, sizes and blocks, returning its size
+static size_t s_expressionTest_writeBlocksFile (uint8_t* file, const uint8_t* fileHeader,
+	uint64_t blockSize, uint64_t totalSize, const uint64_t* storedSizes, size_t blockCount,
+	const uint8_t* blocks, size_t blocksSize
+)
+{
+	size_t contentSize = 1 + wexpr_uvlq64_bytesize(blockSize) + wexpr_uvlq64_bytesize(totalSize) + blocksSize;
+	for (size_t i=0; i < blockCount; ++i)
+	{ contentSize += wexpr_uvlq64_bytesize(storedSizes[i]); }
+	
+	uint8_t* pos = file;
+	memcpy (pos, fileHeader, 20);
+	pos += 20;
+	
+	wexpr_uvlq64_write(pos, wexpr_uvlq64_bytesize(contentSize), contentSize);
+	pos += wexpr_uvlq64_bytesize(contentSize);
+	*pos++ = 0x81;
+	*pos++ = WexprBinaryCompressionZlib;
+	
+	wexpr_uvlq64_write(pos, wexpr_uvlq64_bytesize(blockSize), blockSize);
+	pos += wexpr_uvlq64_bytesize(blockSize);
+	wexpr_uvlq64_write(pos, wexpr_uvlq64_bytesize(totalSize), totalSize);
+	pos += wexpr_uvlq64_bytesize(totalSize);
+	
+	for (size_t i=0; i < blockCount; ++i)
+	{
+		wexpr_uvlq64_write(pos, wexpr_uvlq64_bytesize(storedSizes[i]), storedSizes[i]);
+		pos += wexpr_uvlq64_bytesize(storedSizes[i]);
+	}
+	
+	memcpy (pos, blocks, blocksSize);
+	pos += blocksSize;
+	
+	return (size_t)(pos - file);
+}
+
+WEXPR_UNITTEST_BEGIN(ExpressionCanReadBlockCompressedFile)
+	// without zlib, its written uncompressed
+	bool supported = wexpr_BinaryCompression_isSupported(WexprBinaryCompressionZlib);
+	
+	WexprError err = WEXPR_ERROR_INIT();
+	
+	WexprExpression* expr = wexpr_Expression_createNull();
+	wexpr_Expression_changeType(expr, WexprExpressionTypeArray);
+	
+	for (size_t i=0; i < 2000; ++i)
+	{ wexpr_Expression_arrayAddElementToEnd(expr, wexpr_Expression_createValue((i % 2) ? "repeated" : "values")); }
+	
+	// small blocks so there are several to decompress in parallel
+	WexprBinaryWriteOptions options = WEXPR_BINARYWRITEOPTIONS_INIT(WexprWriteFlagBinaryFileHeader);
+	options.blockCompression = WexprBinaryCompressionZlib;
+	options.blockSize = 1024;
+	
+	WexprMutableBuffer file = wexpr_Expression_createBinaryRepresentationWithOptions(expr, &options);
+	WEXPR_UNITTEST_ASSERT (file.data, "Should write it");
+	WEXPR_UNITTEST_ASSERT (!supported || file.byteSize < wexpr_Expression_binaryRepresentationSize(expr, WexprWriteFlagBinaryFileHeader), "Should be smaller");
+	
+	WexprExpression* loaded = wexpr_Expression_createFromBinaryFile(file.data, file.byteSize, WexprParseFlagNone, &err);
+	WEXPR_UNITTEST_ASSERT (loaded && wexpr_Expression_arrayCount(loaded) == 2000, "Should read it back");
+	WEXPR_UNITTEST_ASSERT (strcmp(wexpr_Expression_value(wexpr_Expression_arrayAt(loaded, 1999)), "repeated") == 0, "Should have the same values");
+	wexpr_Expression_destroy(loaded);
+	
+	// break the last block
+	if (supported)
+	{
+		((uint8_t*)file.data)[file.byteSize - 2] ^= 0xFF;
+		
+		loaded = wexpr_Expression_createFromBinaryFile(file.data, file.byteSize, WexprParseFlagNone, &err);
+		WEXPR_UNITTEST_ASSERT (!loaded && err.code == WexprErrorCodeBinaryInvalidCompressedData, "Should fail on bad blocks");
+		WEXPR_ERROR_FREE (err);
+	}
+	
+	// forged headers, which have to fail before allocating what they claim
+	if (supported)
+	{
+		uint8_t* forged = malloc(8192);
+		uint64_t storedSizes[1024];
+		uint8_t blocks[1024];
+		
+		const uint8_t hello[] = { 0x78, 0x9C, 0xCB, 0x48, 0xCD, 0xC9, 0xC9, 0x07, 0x00, 0x06, 0x2C, 0x02, 0x15 };
+		
+		// blocks bigger than allowed
+		storedSizes[0] = sizeof(hello);
+		size_t forgedSize = s_expressionTest_writeBlocksFile(forged, file.data, 1024ull * 1024 * 1024, 1024ull * 1024 * 1024,
+			storedSizes, 1, hello, sizeof(hello)
+		);
+		
+		loaded = wexpr_Expression_createFromBinaryFile(forged, forgedSize, WexprParseFlagNone, &err);
+		WEXPR_UNITTEST_ASSERT (!loaded && err.code == WexprErrorCodeBinaryInvalidCompressedData, "Should fail on a huge block size");
+		WEXPR_ERROR_FREE (err);
+		
+		// 1 GiB from 1 KiB of blocks, which zlib couldnt have compressed that much
+		for (size_t i=0; i < 1024; ++i)
+		{ storedSizes[i] = 1; blocks[i] = 0; }
+		
+		forgedSize = s_expressionTest_writeBlocksFile(forged, file.data, 1024 * 1024, 1024ull * 1024 * 1024,
+			storedSizes, 1024, blocks, 1024
+		);
+		
+		loaded = wexpr_Expression_createFromBinaryFile(forged, forgedSize, WexprParseFlagNone, &err);
+		WEXPR_UNITTEST_ASSERT (!loaded && err.code == WexprErrorCodeBinaryInvalidCompressedData, "Should fail on a total bigger than the blocks could be");
+		WEXPR_ERROR_FREE (err);
+		
+		// a block which decompresses to less than its size
+		storedSizes[0] = sizeof(hello);
+		forgedSize = s_expressionTest_writeBlocksFile(forged, file.data, 64, 20, storedSizes, 1, hello, sizeof(hello));
+		
+		loaded = wexpr_Expression_createFromBinaryFile(forged, forgedSize, WexprParseFlagNone, &err);
+		WEXPR_UNITTEST_ASSERT (!loaded && err.code == WexprErrorCodeBinaryInvalidCompressedData, "Should fail on a block of the wrong size");
+		WEXPR_ERROR_FREE (err);
+		
+		// stored bigger than it decompresses to, which compressing never writes
+		forgedSize = s_expressionTest_writeBlocksFile(forged, file.data, 64, 5, storedSizes, 1, hello, sizeof(hello));
+		
+		loaded = wexpr_Expression_createFromBinaryFile(forged, forgedSize, WexprParseFlagNone, &err);
+		WEXPR_UNITTEST_ASSERT (!loaded && err.code == WexprErrorCodeBinaryInvalidCompressedData, "Should fail on a block stored bigger than its size");
+		WEXPR_ERROR_FREE (err);
+		
+		free (forged);
+	}
+	
+	free (file.data);
+	wexpr_Expression_destroy(expr);
+	WEXPR_ERROR_FREE (err);
+	
+WEXPR_UNITTEST_END()
+
+WEXPR_UNITTEST_BEGIN(ExpressionCanUseStringTable)
+	WexprError err = WEXPR_ERROR_INIT();
+	
+	// records with the same keys and a few repeated values
+	WexprExpression* expr = wexpr_Expression_createNull();
+	wexpr_Expression_changeType(expr, WexprExpressionTypeArray);
+	
+	for (size_t i=0; i < 200; ++i)
+	{
+		WexprExpression* record = wexpr_Expression_createNull();
+		wexpr_Expression_changeType(record, WexprExpressionTypeMap);
+		
+		char id[16];
+		sprintf (id, "%d", (int)i);
+		
+		wexpr_Expression_mapSetValueForKey(record, "identifier", wexpr_Expression_createValue(id));
+		wexpr_Expression_mapSetValueForKey(record, "description", wexpr_Expression_createValue((i % 2) ? "an odd record" : "an even record"));
+		wexpr_Expression_arrayAddElementToEnd(expr, record);
+	}
+	
+	WexprWriteFlags flags = WexprWriteFlagBinaryFileHeader | WexprWriteFlagBinaryStringTable;
+	WexprMutableBuffer file = wexpr_Expression_createBinaryRepresentationWithFlags(expr, flags);
+	WEXPR_UNITTEST_ASSERT (file.data && file.byteSize == wexpr_Expression_binaryRepresentationSize(expr, flags), "Size should match");
+	WEXPR_UNITTEST_ASSERT (file.byteSize < wexpr_Expression_binaryRepresentationSize(expr, WexprWriteFlagBinaryFileHeader) / 2, "Should be much smaller");
+	
+	WexprExpression* loaded = wexpr_Expression_createFromBinaryFile(file.data, file.byteSize, WexprParseFlagNone, &err);
+	WEXPR_UNITTEST_ASSERT (loaded && wexpr_Expression_arrayCount(loaded) == 200, "Should read it back");
+	
+	char* expected = wexpr_Expression_createStringRepresentation(expr, 0, WexprWriteFlagNone);
+	char* actual = wexpr_Expression_createStringRepresentation(loaded, 0, WexprWriteFlagNone);
+	WEXPR_UNITTEST_ASSERT (strcmp(expected, actual) == 0, "Should be the same");
+	free (expected);
+	free (actual);
+	
+	// keys from the table share their storage
+	WexprExpression* first = wexpr_Expression_arrayAt(loaded, 0);
+	WexprExpression* last = wexpr_Expression_arrayAt(loaded, 199);
+	WEXPR_UNITTEST_ASSERT (wexpr_Expression_mapKeyAt(first, 0) == wexpr_Expression_mapKeyAt(last, 0), "Keys should be shared");
+	
+	// shared values are still copied on write
+	wexpr_Expression_valueSet(wexpr_Expression_mapValueForKey(first, "description"), "changed");
+	WexprExpression* third = wexpr_Expression_arrayAt(loaded, 2);
+	WEXPR_UNITTEST_ASSERT (strcmp(wexpr_Expression_value(wexpr_Expression_mapValueForKey(third, "description")), "an even record") == 0, "Others shouldnt change");
+	
+	// and views see references as values
+	WexprBinaryView view = wexpr_BinaryView_createFromFile(file.data, file.byteSize, &err);
+	WexprBinaryView record = wexpr_BinaryView_arrayAt(&view, 199);
+	WexprBinaryView description = wexpr_BinaryView_mapValueForKey(&record, "description");
+	WEXPR_UNITTEST_ASSERT (wexpr_BinaryView_valueEquals(&description, "an odd record", strlen("an odd record")), "View should resolve references");
+	
+	wexpr_Expression_destroy(loaded);
+	free (file.data);
+	wexpr_Expression_destroy(expr);
+	WEXPR_ERROR_FREE (err);
+	
+WEXPR_UNITTEST_END()
+
+WEXPR_UNITTEST_BEGIN(ExpressionCanUseTypedValues)
+	WexprError err = WEXPR_ERROR_INIT();
+	WexprExpression* expr = wexpr_Expression_createFromString(
+		"@(count 42 offset -7 largest 9223372036854775807 ratio 0.1 on true off false padded 007 exponent 1e3 name hello)",
+		WexprParseFlagNone, &err
+	);
+	
+	WEXPR_UNITTEST_ASSERT (expr, "Cannot create expression");
+	
+	WexprWriteFlags flags = WexprWriteFlagBinaryFileHeader | WexprWriteFlagBinaryTypedValues;
+	WexprMutableBuffer file = wexpr_Expression_createBinaryRepresentationWithFlags(expr, flags);
+	WEXPR_UNITTEST_ASSERT (file.data && file.byteSize == wexpr_Expression_binaryRepresentationSize(expr, flags), "Size should match");
+	WEXPR_UNITTEST_ASSERT (file.byteSize < wexpr_Expression_binaryRepresentationSize(expr, WexprWriteFlagBinaryFileHeader), "Should be smaller");
+	
+	// values keep their exact text
+	WexprExpression* loaded = wexpr_Expression_createFromBinaryFile(file.data, file.byteSize, WexprParseFlagNone, &err);
+	WEXPR_UNITTEST_ASSERT (loaded, "Should read it back");
+	
+	char* expected = wexpr_Expression_createStringRepresentation(expr, 0, WexprWriteFlagNone);
+	char* actual = wexpr_Expression_createStringRepresentation(loaded, 0, WexprWriteFlagNone);
+	WEXPR_UNITTEST_ASSERT (strcmp(expected, actual) == 0, "Should be the same");
+	free (expected);
+	free (actual);
+	
+	int64_t integer = 0;
+	double number = 0;
+	bool boolean = false;
+	
+	WEXPR_UNITTEST_ASSERT (wexpr_Expression_valueAsInt64(wexpr_Expression_mapValueForKey(loaded, "largest"), &integer) && integer == INT64_MAX, "Should read integers");
+	WEXPR_UNITTEST_ASSERT (wexpr_Expression_valueAsInt64(wexpr_Expression_mapValueForKey(loaded, "offset"), &integer) && integer == -7, "Should read negative integers");
+	WEXPR_UNITTEST_ASSERT (wexpr_Expression_valueAsDouble(wexpr_Expression_mapValueForKey(loaded, "ratio"), &number) && number == 0.1, "Should read floats");
+	WEXPR_UNITTEST_ASSERT (wexpr_Expression_valueAsBool(wexpr_Expression_mapValueForKey(loaded, "on"), &boolean) && boolean, "Should read booleans");
+	WEXPR_UNITTEST_ASSERT (!wexpr_Expression_valueAsInt64(wexpr_Expression_mapValueForKey(loaded, "ratio"), &integer), "Float isnt an integer");
+	WEXPR_UNITTEST_ASSERT (!wexpr_Expression_valueAsBool(wexpr_Expression_mapValueForKey(loaded, "name"), &boolean), "Text isnt a boolean");
+	
+	// not canonical, so stored as text but still readable
+	WEXPR_UNITTEST_ASSERT (wexpr_Expression_valueAsInt64(wexpr_Expression_mapValueForKey(loaded, "padded"), &integer) && integer == 7, "Should parse text");
+	WEXPR_UNITTEST_ASSERT (wexpr_Expression_valueAsDouble(wexpr_Expression_mapValueForKey(loaded, "exponent"), &number) && number == 1000, "Should parse text");
+	
+	// setters write the canonical text
+	WexprExpression* value = wexpr_Expression_mapValueForKey(loaded, "name");
+	wexpr_Expression_valueSetDouble(value, 1.0 / 3.0);
+	WEXPR_UNITTEST_ASSERT (wexpr_Expression_valueAsDouble(value, &number) && number == 1.0 / 3.0, "Should keep the number");
+	WEXPR_UNITTEST_ASSERT (strtod(wexpr_Expression_value(value), NULL) == 1.0 / 3.0, "Text should read back exactly");
+	
+	wexpr_Expression_valueSetInt64(value, -12);
+	WEXPR_UNITTEST_ASSERT (strcmp(wexpr_Expression_value(value), "-12") == 0, "Should set the text");
+	
+	wexpr_Expression_valueSet(value, "plain");
+	WEXPR_UNITTEST_ASSERT (!wexpr_Expression_valueAsInt64(value, &integer), "Setting text should forget the type");
+	
+	// views read them directly
+	WexprBinaryView view = wexpr_BinaryView_createFromFile(file.data, file.byteSize, &err);
+	WexprBinaryView count = wexpr_BinaryView_mapValueForKey(&view, "count");
+	size_t length = 0;
+	
+	WEXPR_UNITTEST_ASSERT (wexpr_BinaryView_type(&count) == WexprExpressionTypeValue, "Typed chunks are values");
+	WEXPR_UNITTEST_ASSERT (wexpr_BinaryView_valueAsInt64(&count, &integer) && integer == 42, "View should read integers");
+	WEXPR_UNITTEST_ASSERT (wexpr_BinaryView_valueEquals(&count, "42", 2), "View should compare the text");
+	WEXPR_UNITTEST_ASSERT (!wexpr_BinaryView_value(&count, &length), "There's no text in the buffer");
+	
+	// the root can be a typed value too
+	const char* roots[] = { "5", "-0.25", "true" };
+	for (size_t i=0; i < sizeof(roots)/sizeof(roots[0]); ++i)
+	{
+		WexprExpression* root = wexpr_Expression_createValue(roots[i]);
+		
+		WexprMutableBuffer rootFile = wexpr_Expression_createBinaryRepresentationWithFlags(root, flags);
+		
+		WexprExpression* rootLoaded = wexpr_Expression_createFromBinaryFile(rootFile.data, rootFile.byteSize, WexprParseFlagNone, &err);
+		WEXPR_UNITTEST_ASSERT (rootLoaded && strcmp(wexpr_Expression_value(rootLoaded), roots[i]) == 0, "Root should read back from a file");
+		wexpr_Expression_destroy(rootLoaded);
+		free (rootFile.data);
+		
+		WexprMutableBuffer rootChunk = wexpr_Expression_createBinaryRepresentationWithFlags(root, WexprWriteFlagBinaryTypedValues);
+		WEXPR_UNITTEST_ASSERT (((uint8_t*)rootChunk.data)[1] >= 0x84 && ((uint8_t*)rootChunk.data)[1] <= 0x86, "Root should be a typed chunk");
+		
+		rootLoaded = wexpr_Expression_createFromBinaryChunk(rootChunk.data, rootChunk.byteSize, &err);
+		WEXPR_UNITTEST_ASSERT (rootLoaded && strcmp(wexpr_Expression_value(rootLoaded), roots[i]) == 0, "Root should read back from a chunk");
+		wexpr_Expression_destroy(rootLoaded);
+		free (rootChunk.data);
+		
+		wexpr_Expression_destroy(root);
+	}
+	
+	// wrong size for a float
+	const uint8_t badFloat[] = { 0x02, 0x85, 0x00, 0x00 };
+	WexprExpression* bad = wexpr_Expression_createFromBinaryChunk(badFloat, sizeof(badFloat), &err);
+	WEXPR_UNITTEST_ASSERT (!bad && err.code == WexprErrorCodeBinaryInvalidTypedValue, "Should fail on a bad typed chunk");
+	
+	wexpr_Expression_destroy(loaded);
+	free (file.data);
+	wexpr_Expression_destroy(expr);
+	WEXPR_ERROR_FREE (err);
+	
+WEXPR_UNITTEST_END()
+
+WEXPR_UNITTEST_BEGIN(ExpressionTypedValuesIgnoreLocale)
+	// only if theres a locale with a comma for the decimal point to try
+	const char* commaLocales[] = { "de_DE.UTF-8", "de_DE.utf8", "de_DE", "fr_FR.UTF-8", "fr_FR.utf8", "fr_FR", "German", "French" };
+	
+	char* previous = strdup(setlocale(LC_NUMERIC, NULL));
+	bool found = false;
+	
+	for (size_t i=0; !found && i < sizeof(commaLocales)/sizeof(commaLocales[0]); ++i)
+	{
+		found = setlocale(LC_NUMERIC, commaLocales[i]) && strcmp(localeconv()->decimal_point, ",") == 0;
+	}
+	
+	if (found)
+	{
+		WexprExpression* value = wexpr_Expression_createValue("1.5");
+		double number = 0;
+		
+		bool readsDot = wexpr_Expression_valueAsDouble(value, &number) && number == 1.5;
+		
+		wexpr_Expression_valueSet(value, "1,5");
+		bool refusesComma = !wexpr_Expression_valueAsDouble(value, &number);
+		
+		wexpr_Expression_valueSetDouble(value, 0.25);
+		bool writesDot = (strcmp(wexpr_Expression_value(value), "0.25") == 0);
+		
+		// and stored as a float, then back to the same text
+		WexprWriteFlags flags = WexprWriteFlagBinaryFileHeader | WexprWriteFlagBinaryTypedValues;
+		wexpr_Expression_valueSet(value, "0.1");
+		
+		WexprMutableBuffer file = wexpr_Expression_createBinaryRepresentationWithFlags(value, flags);
+		WexprExpression* loaded = wexpr_Expression_createFromBinaryFile(file.data, file.byteSize, WexprParseFlagNone, NULL);
+		
+		bool roundTrips = (((uint8_t*)file.data)[21] == 0x85) // a float chunk, after the header and its size
+			&& loaded && strcmp(wexpr_Expression_value(loaded), "0.1") == 0;
+		
+		wexpr_Expression_destroy(loaded);
+		free (file.data);
+		wexpr_Expression_destroy(value);
+		
+		setlocale(LC_NUMERIC, previous);
+		free (previous);
+		previous = NULL;
+		
+		WEXPR_UNITTEST_ASSERT (readsDot, "Should read '.' whatever the locale");
+		WEXPR_UNITTEST_ASSERT (refusesComma, "Should not read the locale's decimal point");
+		WEXPR_UNITTEST_ASSERT (writesDot, "Should write '.' whatever the locale");
+		WEXPR_UNITTEST_ASSERT (roundTrips, "Should store and read back floats whatever the locale");
+	}
+	
+	if (previous)
+	{
+		setlocale(LC_NUMERIC, previous);
+		free (previous);
+	}
+	
+WEXPR_UNITTEST_END()
+
+WEXPR_UNITTEST_BEGIN(ExpressionCanWriteDeeplyNestedBinary)
+	// #(a #(a #(a ...))) - writing used to be O(nodes * depth), so this was very slow
+	const size_t depth = 3000;
+	
+	WexprExpression* root = wexpr_Expression_createNull();
+	wexpr_Expression_changeType(root, WexprExpressionTypeArray);
+	
+	WexprExpression* cur = root;
+	for (size_t i=0; i < depth; ++i)
+	{
+		WexprExpression* child = wexpr_Expression_createNull();
+		wexpr_Expression_changeType(child, WexprExpressionTypeArray);
+		
+		wexpr_Expression_arrayAddElementToEnd(cur, wexpr_Expression_createValue("a"));
+		wexpr_Expression_arrayAddElementToEnd(cur, child);
+		cur = child;
+	}
+	
+	WexprMutableBuffer buf = wexpr_Expression_createBinaryRepresentation(root);
+	WEXPR_UNITTEST_ASSERT (buf.data, "Should write binary");
+	
+	WexprError err = WEXPR_ERROR_INIT();
+	WexprExpression* loaded = wexpr_Expression_createFromBinaryChunk(buf.data, buf.byteSize, &err);
+	WEXPR_UNITTEST_ASSERT (loaded, "Should read back the binary");
+	
+	// walk down and make sure everything is there
+	size_t loadedDepth = 0;
+	for (WexprExpression* e = loaded; wexpr_Expression_arrayCount(e) == 2; e = wexpr_Expression_arrayAt(e, 1))
+	{
+		++loadedDepth;
+	}
+	
+	WEXPR_UNITTEST_ASSERT (loadedDepth == depth, "Should have the same depth");
+	
+	free (buf.data);
+	wexpr_Expression_destroy(loaded);
+	wexpr_Expression_destroy(root);
+	WEXPR_ERROR_FREE (err);
+	
+WEXPR_UNITTEST_END()
+
+WEXPR_UNITTEST_BEGIN(ExpressionCanDeduplicate)
+	WexprError err = WEXPR_ERROR_INIT();
+	const char* str = "#( @(a 1 b #(x y)) @(b #(x y) a 1) [ref] @(a 1 b #(x y)) *[ref] )";
+	
+	WexprExpression* expr = wexpr_Expression_createFromString(str, WexprParseFlagDeduplicate, &err);
+	WEXPR_UNITTEST_ASSERT (expr, "Cannot create deduplicated expression");
+	
+	// all four maps are the same : each is map + 1 + #(x y) + x + y, plus the root
+	WexprExpressionNodeStats stats = wexpr_Expression_nodeStats(expr);
+	WEXPR_UNITTEST_ASSERT (stats.nodeCount == 1 + 4*5, "Node count should count every occurrence");
+	WEXPR_UNITTEST_ASSERT (stats.uniqueNodeCount == 6, "Identical subtrees should be shared");
+	
+	// mutating through the api must only affect the one we got
+	WexprExpression* second = wexpr_Expression_arrayAt(expr, 1);
+	WexprExpression* secondArray = wexpr_Expression_mapValueForKey(second, "b");
+	wexpr_Expression_arrayAddElementToEnd(secondArray, wexpr_Expression_createValue("z"));
+	
+	WEXPR_UNITTEST_ASSERT (wexpr_Expression_arrayCount(secondArray) == 3, "Array should have been modified");
+	WEXPR_UNITTEST_ASSERT (wexpr_Expression_arrayCount(
+		wexpr_Expression_mapValueForKey(wexpr_Expression_arrayAt(expr, 0), "b")
+	) == 2, "Other shared copies should be unchanged");
+	
+	WexprExpression* nonDedup = wexpr_Expression_createFromString(str, WexprParseFlagNone, &err);
+	WexprExpressionNodeStats nonDedupStats = wexpr_Expression_nodeStats(nonDedup);
+	WEXPR_UNITTEST_ASSERT (nonDedupStats.nodeCount == nonDedupStats.uniqueNodeCount, "Should not share without the flag");
+	
+	wexpr_Expression_destroy(nonDedup);
+	wexpr_Expression_destroy(expr);
+	WEXPR_ERROR_FREE (err);
+	
+WEXPR_UNITTEST_END()
+
+WEXPR_UNITTEST_BEGIN(ExpressionCanDeduplicateBinary)
+	WexprError err = WEXPR_ERROR_INIT();
+	WexprExpression* expr = wexpr_Expression_createFromString("#(#(a <aGVsbG8=>) #(a <aGVsbG8=>) a)", WexprParseFlagNone, &err);
+	WexprMutableBuffer buf = wexpr_Expression_createBinaryRepresentation(expr);
+	
+	WexprExpression* loaded = wexpr_Expression_createFromBinaryChunkWithFlags(buf.data, buf.byteSize, WexprParseFlagDeduplicate, &err);
+	WEXPR_UNITTEST_ASSERT (loaded, "Cannot load deduplicated binary");
+	
+	WexprExpressionNodeStats stats = wexpr_Expression_nodeStats(loaded);
+	WEXPR_UNITTEST_ASSERT (stats.nodeCount == 8, "Node count should count every occurrence");
+	WEXPR_UNITTEST_ASSERT (stats.uniqueNodeCount == 4, "Identical subtrees should be shared");
+	
+	// writing a shared tree should match the original
+	char* origStr = wexpr_Expression_createStringRepresentation(expr, 0, WexprWriteFlagNone);
+	char* loadedStr = wexpr_Expression_createStringRepresentation(loaded, 0, WexprWriteFlagNone);
+	WEXPR_UNITTEST_ASSERT (strcmp(origStr, loadedStr) == 0, "Deduplicated tree should write the same");
+	
+	free (origStr);
+	free (loadedStr);
+	free (buf.data);
+	wexpr_Expression_destroy(loaded);
+	wexpr_Expression_destroy(expr);
+	WEXPR_ERROR_FREE (err);
+	
+WEXPR_UNITTEST_END()
+
+
+WEXPR_UNITTEST_BEGIN(ExpressionCanDiffAndPatch)
+	WexprError err = WEXPR_ERROR_INIT();
+	
+	const char* pairs[][2] = {
+		{ "@(a 1 b #(x y z) c @(d 2) e <aGVsbG8=>)", "@(a 1 b #(x q z w) c @(d 3 f 4) g 5)" }, // change, add, remove in maps
+		{ "#(1 2 3 4 5)", "#(1 2 9 9 9 4 5)" }, // insert in the middle
+		{ "#(1 2 3 4 5)", "#(1 5)" }, // remove from the middle
+		{ "#(@(a 1) @(a 2) @(a 3))", "#(@(a 1) @(a 20) @(a 3))" }, // change in place
+		{ "#(a b)", "@(a b)" }, // different types
+		{ "#(a b)", "#()" },
+		{ "hello", "world" }
+	};
+	
+	for (size_t i=0; i < sizeof(pairs)/sizeof(pairs[0]); ++i)
+	{
+		WexprExpression* from = wexpr_Expression_createFromString(pairs[i][0], WexprParseFlagNone, &err);
+		WexprExpression* to = wexpr_Expression_createFromString(pairs[i][1], WexprParseFlagNone, &err);
+		WEXPR_UNITTEST_ASSERT (from && to, "Cannot create expressions");
+		
+		WexprExpression* patch = wexpr_Expression_createDiff(from, to);
+		WEXPR_UNITTEST_ASSERT (patch && wexpr_Expression_mapCount(patch) == 1, "Should have a change");
+		
+		// patches are expressions, so should survive being written out
+		char* patchStr = wexpr_Expression_createStringRepresentation(patch, 0, WexprWriteFlagNone);
+		WexprExpression* readPatch = wexpr_Expression_createFromString(patchStr, WexprParseFlagNone, &err);
+		WEXPR_UNITTEST_ASSERT (readPatch, "Cannot read the patch back");
+		
+		WEXPR_UNITTEST_ASSERT (wexpr_Expression_applyPatch(from, readPatch, &err), "Should apply the patch");
+		
+		WexprExpression* remaining = wexpr_Expression_createDiff(from, to);
+		WEXPR_UNITTEST_ASSERT (wexpr_Expression_mapCount(remaining) == 0, "Patched should match");
+		
+		wexpr_Expression_destroy(remaining);
+		wexpr_Expression_destroy(readPatch);
+		free (patchStr);
+		wexpr_Expression_destroy(patch);
+		wexpr_Expression_destroy(to);
+		wexpr_Expression_destroy(from);
+	}
+	
+	// shared subtrees are equal, and patching one copy leaves the others alone
+	WexprExpression* shared = wexpr_Expression_createFromString("#(@(a #(1 2)) @(a #(1 2)))", WexprParseFlagDeduplicate, &err);
+	WexprExpression* changed = wexpr_Expression_createFromString("#(@(a #(1 2)) @(a #(1 3)))", WexprParseFlagNone, &err);
+	WexprExpression* patch = wexpr_Expression_createDiff(shared, changed);
+	
+	WEXPR_UNITTEST_ASSERT (wexpr_Expression_applyPatch(shared, patch, &err), "Should apply to shared");
+	char* sharedStr = wexpr_Expression_createStringRepresentation(shared, 0, WexprWriteFlagNone);
+	WEXPR_UNITTEST_ASSERT (strcmp(sharedStr, "#(@(a #(1 2)) @(a #(1 3)))") == 0, "Only one copy should change");
+	free (sharedStr);
+	
+	WexprExpression* none = wexpr_Expression_createDiff(shared, changed);
+	WEXPR_UNITTEST_ASSERT (wexpr_Expression_mapCount(none) == 0, "Same should be an empty patch");
+	WEXPR_UNITTEST_ASSERT (wexpr_Expression_applyPatch(shared, none, &err), "Empty patch should apply");
+	
+	// invalid patches leave it unchanged
+	WexprExpression* bad = wexpr_Expression_createFromString(
+		"@(array @(update @(0 @(replace z)) remove #(1 5)))", WexprParseFlagNone, &err
+	);
+	WEXPR_UNITTEST_ASSERT (!wexpr_Expression_applyPatch(shared, bad, &err), "Should fail to apply");
+	WEXPR_UNITTEST_ASSERT (err.code == WexprErrorCodeInvalidPatch, "Should be an invalid patch");
+	
+	sharedStr = wexpr_Expression_createStringRepresentation(shared, 0, WexprWriteFlagNone);
+	WEXPR_UNITTEST_ASSERT (strcmp(sharedStr, "#(@(a #(1 2)) @(a #(1 3)))") == 0, "Should be unchanged");
+	free (sharedStr);
+	
+	wexpr_Expression_destroy(bad);
+	wexpr_Expression_destroy(none);
+	wexpr_Expression_destroy(patch);
+	wexpr_Expression_destroy(changed);
+	wexpr_Expression_destroy(shared);
+	WEXPR_ERROR_FREE (err);
+	
+WEXPR_UNITTEST_END()
+
+static size_t s_batchExecutorCalls = 0;
+
+// runs everything on the calling thread, counting how often its used
+static void s_batchExecutor (void* userData, size_t count, WexprExecutorTask task, void* taskData)
+{
+	(void)userData;
+	++s_batchExecutorCalls;
+	
+	for (size_t i=0; i < count; ++i)
+	{ task(taskData, i); }
+}
+
+WEXPR_UNITTEST_BEGIN(ExpressionCanParseBatch)
+	enum { DocumentCount = 200 };
+	
+	WexprExpression* source = wexpr_Expression_createFromString("@(name [n]test list #(*[n] *[n] 3))", WexprParseFlagNone, LIBWEXPR_NULLPTR);
+	WexprMutableBuffer chunk = wexpr_Expression_createBinaryRepresentation(source);
+	char* expected = wexpr_Expression_createStringRepresentation(source, 0, WexprWriteFlagNone);
+	
+	WexprDocument documents[DocumentCount];
+	for (size_t i=0; i < DocumentCount; ++i)
+	{
+		documents[i].data = "@(name [n]test list #(*[n] *[n] 3))";
+		documents[i].length = strlen(documents[i].data);
+		documents[i].format = WexprDocumentFormatText;
+		
+		if (i % 3 == 1)
+		{
+			documents[i].data = chunk.data;
+			documents[i].length = chunk.byteSize;
+			documents[i].format = WexprDocumentFormatBinaryChunk;
+		}
+	}
+	
+	documents[7].data = "#(a b";
+	documents[7].length = 5;
+	documents[7].format = WexprDocumentFormatText;
+	
+	WexprParseFlags flagSets[2] = { WexprParseFlagNone, WexprParseFlagDeduplicate };
+	for (size_t f=0; f < 2; ++f)
+	{
+		WexprExpression* results[DocumentCount];
+		WexprError errors[DocumentCount];
+		for (size_t i=0; i < DocumentCount; ++i)
+		{ errors[i] = (WexprError)WEXPR_ERROR_INIT(); }
+		
+		// alternate between our threads and a callers executor
+		WexprExecutor executor = (f == 0) ? wexpr_Executor_forThreads(4) : wexpr_Executor_forCallback(&s_batchExecutor, LIBWEXPR_NULLPTR);
+		
+		size_t parsed = wexpr_Expression_createFromBatch(documents, DocumentCount, flagSets[f], results, errors, &executor);
+		WEXPR_UNITTEST_ASSERT (parsed == DocumentCount-1, "All but the broken document should parse");
+		
+		for (size_t i=0; i < DocumentCount; ++i)
+		{
+			if (i == 7)
+			{
+				WEXPR_UNITTEST_ASSERT (!results[i] && errors[i].code == WexprErrorCodeArrayMissingEndParen, "Broken document should fail");
+				continue;
+			}
+			
+			WEXPR_UNITTEST_ASSERT (results[i] && errors[i].code == WexprErrorCodeNone, "Document should parse");
+			
+			char* str = wexpr_Expression_createStringRepresentation(results[i], 0, WexprWriteFlagNone);
+			WEXPR_UNITTEST_ASSERT (strcmp(str, expected) == 0, "Document should match parsing it alone");
+			free (str);
+		}
+		
+		for (size_t i=0; i < DocumentCount; ++i)
+		{
+			wexpr_Expression_destroy(results[i]);
+			WEXPR_ERROR_FREE (errors[i]);
+		}
+	}
+	
+	WEXPR_UNITTEST_ASSERT (s_batchExecutorCalls == 1, "Callers executor should be used");
+	
+	free (expected);
+	free (chunk.data);
+	wexpr_Expression_destroy(source);
+	
+WEXPR_UNITTEST_END()
+
+WEXPR_UNITTEST_BEGIN(ExpressionCanWriteInParallel)
+	enum { ChildCount = 3000 };
+	
+	// a wide root array and map, with a mix of children
+	size_t capacity = ChildCount * 64;
+	char* arrayStr = malloc(capacity);
+	char* mapStr = malloc(capacity);
+	size_t arrayLength = (size_t)sprintf(arrayStr, "#(");
+	size_t mapLength = (size_t)sprintf(mapStr, "@(");
+	
+	for (size_t i=0; i < ChildCount; ++i)
+	{
+		const char* child = "null";
+		char buffer[64];
+		
+		switch (i % 5)
+		{
+			case 0: sprintf(buffer, "%zu", i); child = buffer; break;
+			case 1: sprintf(buffer, "@(id %zu name \"item %zu\")", i, i); child = buffer; break;
+			case 2: child = "#(1.5 true #() @())"; break;
+			case 3: child = "<SGVsbG8gV29ybGQgSGVsbG8gV29ybGQ=>"; break;
+		}
+		
+		arrayLength += (size_t)sprintf(arrayStr + arrayLength, " %s", child);
+		mapLength += (size_t)sprintf(mapStr + mapLength, " key%zu %s", i, child);
+	}
+	
+	sprintf(arrayStr + arrayLength, ")");
+	sprintf(mapStr + mapLength, ")");
+	
+	WexprExecutor executor = wexpr_Executor_forThreads(4);
+	const char* sources[2] = { arrayStr, mapStr };
+	
+	for (size_t s=0; s < 2; ++s)
+	{
+		WexprExpression* expr = wexpr_Expression_createFromString(sources[s], WexprParseFlagNone, LIBWEXPR_NULLPTR);
+		WEXPR_UNITTEST_ASSERT (expr != LIBWEXPR_NULLPTR, "Source should parse");
+		
+		WexprWriteFlags textFlags[2] = { WexprWriteFlagNone, WexprWriteFlagHumanReadable };
+		for (size_t f=0; f < 2; ++f)
+		{
+			char* serial = wexpr_Expression_createStringRepresentation(expr, 0, textFlags[f]);
+			char* parallel = wexpr_Expression_createStringRepresentationWithExecutor(expr, 0, textFlags[f], &executor);
+			
+			WEXPR_UNITTEST_ASSERT (strcmp(serial, parallel) == 0, "Text should be the same when written in parallel");
+			
+			free (serial);
+			free (parallel);
+		}
+		
+		WexprWriteFlags binaryFlags[3] = {
+			WexprWriteFlagNone,
+			WexprWriteFlagBinaryFileHeader | WexprWriteFlagBinaryTypedValues,
+			WexprWriteFlagBinaryFileHeader | WexprWriteFlagBinaryIndex // written on one thread
+		};
+		
+		for (size_t f=0; f < 3; ++f)
+		{
+			WexprBinaryWriteOptions options = WEXPR_BINARYWRITEOPTIONS_INIT(binaryFlags[f]);
+			options.compression = WexprBinaryCompressionZlib;
+			
+			WexprMutableBuffer serial = wexpr_Expression_createBinaryRepresentationWithOptions(expr, &options);
+			
+			options.executor = &executor;
+			WexprMutableBuffer parallel = wexpr_Expression_createBinaryRepresentationWithOptions(expr, &options);
+			
+			WEXPR_UNITTEST_ASSERT (serial.data && parallel.data, "Binary should be written");
+			WEXPR_UNITTEST_ASSERT (serial.byteSize == parallel.byteSize && memcmp(serial.data, parallel.data, serial.byteSize) == 0,
+				"Binary should be the same when written in parallel"
+			);
+			
+			free (serial.data);
+			free (parallel.data);
+		}
+		
+		wexpr_Expression_destroy(expr);
+	}
+	
+	free (arrayStr);
+	free (mapStr);
+	
+WEXPR_UNITTEST_END()
 
 WEXPR_UNITTEST_SUITE_BEGIN (Expression)
 	WEXPR_UNITTEST_SUITE_ADDTEST (Expression, ExpressionCanCreateNull);
@@ -470,6 +1544,7 @@ WEXPR_UNITTEST_SUITE_BEGIN (Expression)
 	WEXPR_UNITTEST_SUITE_ADDTEST (Expression, ExpressionCanCreateQuotedValue);
 	WEXPR_UNITTEST_SUITE_ADDTEST (Expression, ExpressionCanCreateEscapedValue);
 	WEXPR_UNITTEST_SUITE_ADDTEST (Expression, ExpressionCanEncodeEscapedValue);
+	WEXPR_UNITTEST_SUITE_ADDTEST (Expression, ExpressionCanEncodeAcrossVectorBoundaries);
 	WEXPR_UNITTEST_SUITE_ADDTEST (Expression, ExpressionCanCreateNumber);
 	WEXPR_UNITTEST_SUITE_ADDTEST (Expression, ExpressionCanCreateArray);
 	WEXPR_UNITTEST_SUITE_ADDTEST (Expression, ExpressionCanCreateMap);
@@ -479,12 +1554,27 @@ WEXPR_UNITTEST_SUITE_BEGIN (Expression)
 	WEXPR_UNITTEST_SUITE_ADDTEST (Expression, ExpressionCanDerefMapProperly);
 	WEXPR_UNITTEST_SUITE_ADDTEST (Expression, ExpressionCanDerefFromExternalTable);
 	WEXPR_UNITTEST_SUITE_ADDTEST (Expression, ExpressionCanCreateString);
+	WEXPR_UNITTEST_SUITE_ADDTEST (Expression, ExpressionCanWriteStringInto);
+	WEXPR_UNITTEST_SUITE_ADDTEST (Expression, ExpressionCanWriteBinaryInto);
+	WEXPR_UNITTEST_SUITE_ADDTEST (Expression, ExpressionCanReadBinaryFile);
+	WEXPR_UNITTEST_SUITE_ADDTEST (Expression, ExpressionCanCreateFromFile);
 	WEXPR_UNITTEST_SUITE_ADDTEST (Expression, ExpressionCanChangeType);
 	WEXPR_UNITTEST_SUITE_ADDTEST (Expression, ExpressionCanSetValue);
 	WEXPR_UNITTEST_SUITE_ADDTEST (Expression, ExpressionCanAddToArray);
 	WEXPR_UNITTEST_SUITE_ADDTEST (Expression, ExpressionCanSetInMap);
 	WEXPR_UNITTEST_SUITE_ADDTEST (Expression, ExpressionCanHandleNullExpression);
 	WEXPR_UNITTEST_SUITE_ADDTEST (Expression, ExpressionCanHandleBinaryExpression);
+	WEXPR_UNITTEST_SUITE_ADDTEST (Expression, ExpressionCanCompressBinaryData);
+	WEXPR_UNITTEST_SUITE_ADDTEST (Expression, ExpressionCanReadBlockCompressedFile);
+	WEXPR_UNITTEST_SUITE_ADDTEST (Expression, ExpressionCanUseStringTable);
+	WEXPR_UNITTEST_SUITE_ADDTEST (Expression, ExpressionCanUseTypedValues);
+	WEXPR_UNITTEST_SUITE_ADDTEST (Expression, ExpressionTypedValuesIgnoreLocale);
+	WEXPR_UNITTEST_SUITE_ADDTEST (Expression, ExpressionCanWriteDeeplyNestedBinary);
+	WEXPR_UNITTEST_SUITE_ADDTEST (Expression, ExpressionCanDeduplicate);
+	WEXPR_UNITTEST_SUITE_ADDTEST (Expression, ExpressionCanDeduplicateBinary);
+	WEXPR_UNITTEST_SUITE_ADDTEST (Expression, ExpressionCanDiffAndPatch);
+	WEXPR_UNITTEST_SUITE_ADDTEST (Expression, ExpressionCanParseBatch);
+	WEXPR_UNITTEST_SUITE_ADDTEST (Expression, ExpressionCanWriteInParallel);
 WEXPR_UNITTEST_SUITE_END ()
 
 #endif // WEXPR_TESTS_EXPRESSION_H
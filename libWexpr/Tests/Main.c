@@ -29,11 +29,17 @@
 // #LICENSE_END#
 //
 
+#include "AlignedView.h"
+#include "BinaryView.h"
 #include "Expression.h"
 #include "ExpressionErrors.h"
 #include "ExpressionType.h"
+#include "Path.h"
 #include "ReferenceTable.h"
+#include "Sink.h"
+#include "Snapshot.h"
 #include "UVLQ64.h"
+#include "Writer.h"
 
 int main (int argc, char** argv)
 {
@@ -49,11 +55,17 @@ int main (int argc, char** argv)
 			res.successes += r.successes; \
 		}
 	
+	RUN_SUITE(AlignedView)
+	RUN_SUITE(BinaryView)
 	RUN_SUITE(Expression)
 	RUN_SUITE(ExpressionErrors)
 	RUN_SUITE(ExpressionType)
+	RUN_SUITE(Path)
 	RUN_SUITE(ReferenceTable)
+	RUN_SUITE(Sink)
+	RUN_SUITE(Snapshot)
 	RUN_SUITE(UVLQ64)
+	RUN_SUITE(Writer)
 	
 	printf ("\nTEST RESULTS: Success: %d Failures: %d\n", res.successes, res.failures);
 	
@@ -0,0 +1,232 @@
+//
+/// \file Path.h
+/// \brief Path tests
+//
+// #LICENSE_BEGIN:MIT#
+// 
+// Copyright (c) 2017-2020, Kenneth Perry (thothonegan)
+// 
+// Permission is hereby granted, free of charge, to any person obtaining
+// a copy of this software and associated documentation files (the
+// "Software"), to deal in the Software without restriction, including
+// without limitation the rights to use, copy, modify, merge, publish,
+// distribute, sublicense, and/or sell copies of the Software, and to
+// permit persons to whom the Software is furnished to do so, subject to
+// the following conditions:
+// 
+// The above copyright notice and this permission notice shall be
+// included in all copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+// MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+// NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+// LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+// OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+// WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+// 
+// SPDX-License-Identifier: MIT
+// #LICENSE_END#
+//
+
+#ifndef WEXPR_TESTS_PATH_H
+#define WEXPR_TESTS_PATH_H
+
+#include <libWexpr/Expression.h>
+#include <libWexpr/Path.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "UnitTest.h"
+
+WEXPR_UNITTEST_BEGIN (PathCanFindExpressions)
+	WexprError err = WEXPR_ERROR_INIT();
+	WexprExpression* expr = wexpr_Expression_createFromString(
+		"@(servers #(@(name a port 80) @(name b port 81) @(name c)) a/b slashed)",
+		WexprParseFlagNone, &err
+	);
+	
+	WEXPR_UNITTEST_ASSERT (expr, "Cannot create expression");
+	
+	WexprPath* path = wexpr_Path_compile("/servers/[1]/port", &err);
+	WEXPR_UNITTEST_ASSERT (path, "Should compile");
+	WEXPR_UNITTEST_ASSERT (strcmp(wexpr_Path_string(path), "/servers/[1]/port") == 0, "Should keep the string");
+	WEXPR_UNITTEST_ASSERT (strcmp(wexpr_Expression_value(wexpr_Path_evaluateFirst(path, expr)), "81") == 0, "Should find the port");
+	wexpr_Path_destroy(path);
+	
+	// wildcards skip what doesnt match
+	path = wexpr_Path_compile("/servers/[*]/port", &err);
+	WexprExpression* results[4] = { NULL, NULL, NULL, NULL };
+	
+	WEXPR_UNITTEST_ASSERT (wexpr_Path_evaluate(path, expr, NULL, 0) == 2, "Should count the matches");
+	WEXPR_UNITTEST_ASSERT (wexpr_Path_evaluate(path, expr, results, 1) == 2, "Should count past the capacity");
+	WEXPR_UNITTEST_ASSERT (strcmp(wexpr_Expression_value(results[0]), "80") == 0 && results[1] == NULL, "Should only fill the capacity");
+	WEXPR_UNITTEST_ASSERT (wexpr_Path_evaluate(path, expr, results, 4) == 2, "Should find both");
+	WEXPR_UNITTEST_ASSERT (strcmp(wexpr_Expression_value(results[1]), "81") == 0, "Should be in order");
+	wexpr_Path_destroy(path);
+	
+	path = wexpr_Path_compile("/servers/[*]/*", &err);
+	WEXPR_UNITTEST_ASSERT (wexpr_Path_evaluate(path, expr, NULL, 0) == 5, "Should find every value");
+	wexpr_Path_destroy(path);
+	
+	path = wexpr_Path_compile("/", &err);
+	WEXPR_UNITTEST_ASSERT (wexpr_Path_evaluateFirst(path, expr) == expr, "Root should be itself");
+	wexpr_Path_destroy(path);
+	
+	path = wexpr_Path_compile("/a\\/b", &err);
+	WEXPR_UNITTEST_ASSERT (strcmp(wexpr_Expression_value(wexpr_Path_evaluateFirst(path, expr)), "slashed") == 0, "Should allow escapes");
+	wexpr_Path_destroy(path);
+	
+	// missing or mismatched
+	const char* missing[] = { "/servers/[3]/port", "/servers/port", "/servers/[0]/[0]", "/nope", "/servers/[0]/name/x" };
+	for (size_t i=0; i < sizeof(missing)/sizeof(missing[0]); ++i)
+	{
+		path = wexpr_Path_compile(missing[i], &err);
+		WEXPR_UNITTEST_ASSERT (path && wexpr_Path_evaluateFirst(path, expr) == NULL, "Should find nothing");
+		wexpr_Path_destroy(path);
+	}
+	
+	WEXPR_UNITTEST_ASSERT (err.code == WexprErrorCodeNone, "Should have no errors");
+	
+	wexpr_Expression_destroy(expr);
+	WEXPR_ERROR_FREE (err);
+WEXPR_UNITTEST_END ()
+
+WEXPR_UNITTEST_BEGIN (PathCanBeReused)
+	WexprError err = WEXPR_ERROR_INIT();
+	WexprPath* path = wexpr_Path_compile("/settings/port", &err);
+	
+	// same path on different documents, and on shared subtrees
+	WexprExpression* first = wexpr_Expression_createFromString("@(settings @(port 1))", WexprParseFlagNone, &err);
+	WexprExpression* second = wexpr_Expression_createFromString("#(@(settings @(port 2)) @(settings @(port 2)))", WexprParseFlagDeduplicate, &err);
+	
+	WEXPR_UNITTEST_ASSERT (strcmp(wexpr_Expression_value(wexpr_Path_evaluateFirst(path, first)), "1") == 0, "Should find it in the first");
+	
+	WexprExpression* found = wexpr_Path_evaluateFirst(path, wexpr_Expression_arrayAt(second, 1));
+	WEXPR_UNITTEST_ASSERT (found && strcmp(wexpr_Expression_value(found), "2") == 0, "Should find it in the second");
+	
+	wexpr_Expression_valueSet(found, "3");
+	char* str = wexpr_Expression_createStringRepresentation(second, 0, WexprWriteFlagNone);
+	WEXPR_UNITTEST_ASSERT (strcmp(str, "#(@(settings @(port 2)) @(settings @(port 3)))") == 0, "Only the found one should change");
+	free (str);
+	
+	wexpr_Expression_destroy(second);
+	wexpr_Expression_destroy(first);
+	wexpr_Path_destroy(path);
+	WEXPR_ERROR_FREE (err);
+WEXPR_UNITTEST_END ()
+
+WEXPR_UNITTEST_BEGIN (PathHandlesInvalidPaths)
+	const char* invalid[] = { "", "servers", "//", "/a/", "/[", "/[x]", "/[-1]", "/[01]", "/[1]x", "/a\\" };
+	
+	for (size_t i=0; i < sizeof(invalid)/sizeof(invalid[0]); ++i)
+	{
+		WexprError err = WEXPR_ERROR_INIT();
+		
+		WEXPR_UNITTEST_ASSERT (wexpr_Path_compile(invalid[i], &err) == NULL, "Should fail to compile");
+		WEXPR_UNITTEST_ASSERT (err.code == WexprErrorCodeInvalidPath && err.column != 0, "Should say where");
+		
+		WEXPR_ERROR_FREE (err);
+	}
+WEXPR_UNITTEST_END ()
+
+WEXPR_UNITTEST_BEGIN (PathCanProjectParsing)
+	WexprError err = WEXPR_ERROR_INIT();
+	const char* str =
+		"@(skipped @(big #(1 2 3) data <aGVsbG8=> ref [shared] @(port 8080))"
+		" servers #(@(name a port 80) @(name b port *[shared]) @(name c port 82) tail)"
+		" other 5)";
+	
+	WexprPath* paths[2] = {
+		wexpr_Path_compile("/servers/[*]/port", &err),
+		wexpr_Path_compile("/other", &err)
+	};
+	
+	WexprExpression* full = wexpr_Expression_createFromString(str, WexprParseFlagNone, &err);
+	WexprExpression* projected = wexpr_Expression_createFromLengthStringWithProjection(str, strlen(str), WexprParseFlagNone, paths, 2, &err);
+	WEXPR_UNITTEST_ASSERT (full && projected, "Should parse");
+	
+	// only what was selected, with the references from the skipped part
+	char* projectedStr = wexpr_Expression_createStringRepresentation(projected, 0, WexprWriteFlagNone);
+	WEXPR_UNITTEST_ASSERT (wexpr_Expression_mapCount(projected) == 2, "Should skip keys which aren't selected");
+	WEXPR_UNITTEST_ASSERT (strstr(projectedStr, "name") == NULL, "Should skip keys which aren't selected");
+	WEXPR_UNITTEST_ASSERT (wexpr_Expression_arrayCount(wexpr_Expression_mapValueForKey(projected, "servers")) == 4, "Should keep indices");
+	free (projectedStr);
+	
+	WexprPath* second = wexpr_Path_compile("/servers/[1]/port/port", &err);
+	WexprExpression* secondOnly = wexpr_Expression_createFromLengthStringWithProjection(str, strlen(str), WexprParseFlagNone, &second, 1, &err);
+	WexprExpression* secondServers = wexpr_Expression_mapValueForKey(secondOnly, "servers");
+	
+	WEXPR_UNITTEST_ASSERT (wexpr_Expression_type(wexpr_Expression_arrayAt(secondServers, 0)) == WexprExpressionTypeNull, "Unselected elements are null");
+	WEXPR_UNITTEST_ASSERT (wexpr_Expression_arrayCount(secondServers) == 4, "Should keep indices");
+	WEXPR_UNITTEST_ASSERT (strcmp(wexpr_Expression_value(wexpr_Path_evaluateFirst(second, secondOnly)), "8080") == 0, "Should insert the reference");
+	
+	wexpr_Expression_destroy(secondOnly);
+	wexpr_Path_destroy(second);
+	
+	// binary, including with a string table and the aligned layout
+	WexprWriteFlags binaryFlags[3] = {
+		WexprWriteFlagBinaryFileHeader,
+		WexprWriteFlagBinaryFileHeader | WexprWriteFlagBinaryStringTable | WexprWriteFlagBinaryTypedValues,
+		WexprWriteFlagBinaryAligned
+	};
+	
+	WexprExpression* projectedBinary[3] = { NULL, NULL, NULL };
+	for (size_t i=0; i < 3; ++i)
+	{
+		WexprMutableBuffer file = wexpr_Expression_createBinaryRepresentationWithFlags(full, binaryFlags[i]);
+		projectedBinary[i] = wexpr_Expression_createFromBinaryFileWithProjection(file.data, file.byteSize, WexprParseFlagNone, paths, 2, &err);
+		WEXPR_UNITTEST_ASSERT (projectedBinary[i], "Should read the binary");
+		WEXPR_UNITTEST_ASSERT (wexpr_Expression_mapCount(projectedBinary[i]) == 2, "Should skip keys which aren't selected");
+		free (file.data);
+	}
+	
+	// the paths find the same things as in the whole document
+	for (size_t p=0; p < 2; ++p)
+	{
+		WexprExpression* expected[4];
+		size_t expectedCount = wexpr_Path_evaluate(paths[p], full, expected, 4);
+		
+		WexprExpression* sources[4] = { projected, projectedBinary[0], projectedBinary[1], projectedBinary[2] };
+		for (size_t s=0; s < 4; ++s)
+		{
+			WexprExpression* found[4];
+			WEXPR_UNITTEST_ASSERT (wexpr_Path_evaluate(paths[p], sources[s], found, 4) == expectedCount, "Should find as many");
+			
+			for (size_t i=0; i < expectedCount; ++i)
+			{
+				char* foundStr = wexpr_Expression_createStringRepresentation(found[i], 0, WexprWriteFlagNone);
+				char* expectedStr = wexpr_Expression_createStringRepresentation(expected[i], 0, WexprWriteFlagNone);
+				WEXPR_UNITTEST_ASSERT (strcmp(foundStr, expectedStr) == 0, "Should find the same");
+				free (foundStr);
+				free (expectedStr);
+			}
+		}
+	}
+	
+	for (size_t i=0; i < 3; ++i)
+	{ wexpr_Expression_destroy(projectedBinary[i]); }
+	
+	wexpr_Expression_destroy(projected);
+	wexpr_Expression_destroy(full);
+	
+	// skipped parts still need to make sense
+	const char* broken = "@(skipped #(a b servers 1)";
+	WEXPR_UNITTEST_ASSERT (!wexpr_Expression_createFromLengthStringWithProjection(broken, strlen(broken), WexprParseFlagNone, paths, 2, &err), "Should fail");
+	WEXPR_UNITTEST_ASSERT (err.code == WexprErrorCodeMapMissingEndParen, "Should be the same error as parsing it all");
+	
+	wexpr_Path_destroy(paths[0]);
+	wexpr_Path_destroy(paths[1]);
+	WEXPR_ERROR_FREE (err);
+WEXPR_UNITTEST_END ()
+
+WEXPR_UNITTEST_SUITE_BEGIN (Path)
+	WEXPR_UNITTEST_SUITE_ADDTEST (Path, PathCanFindExpressions);
+	WEXPR_UNITTEST_SUITE_ADDTEST (Path, PathCanBeReused);
+	WEXPR_UNITTEST_SUITE_ADDTEST (Path, PathHandlesInvalidPaths);
+	WEXPR_UNITTEST_SUITE_ADDTEST (Path, PathCanProjectParsing);
+WEXPR_UNITTEST_SUITE_END ()
+
+#endif // WEXPR_TESTS_PATH_H
@@ -91,10 +91,102 @@ WEXPR_UNITTEST_BEGIN (ReferenceTableCanSetCallback)
 	wexpr_ReferenceTable_destroy (table);
 WEXPR_UNITTEST_END()
 
+WEXPR_UNITTEST_BEGIN (ReferenceTableCanFreeze)
+
+	WexprReferenceTable* table = wexpr_ReferenceTable_create ();
+	wexpr_ReferenceTable_setCreateUnknownKeyCallback(table, &createValueForKey);
+	
+	wexpr_ReferenceTable_setExpressionForKey (table, "a", wexpr_Expression_createValue ("1"));
+	wexpr_ReferenceTable_setExpressionForKey (table, "b", wexpr_Expression_createValue ("2"));
+	
+	wexpr_ReferenceTable_freeze (table);
+	WEXPR_UNITTEST_ASSERT (wexpr_ReferenceTable_isFrozen(table), "Table is frozen");
+	
+	// cant change anymore
+	wexpr_ReferenceTable_setExpressionForKey (table, "c", wexpr_Expression_createValue ("3"));
+	wexpr_ReferenceTable_removeKey (table, "a");
+	
+	WEXPR_UNITTEST_ASSERT (wexpr_ReferenceTable_count(table) == 2, "Still has the same keys");
+	WEXPR_UNITTEST_ASSERT (wexpr_ReferenceTable_expressionForKey(table, "c") == LIBWEXPR_NULLPTR, "Set key was ignored");
+	WEXPR_UNITTEST_ASSERT (wexpr_ReferenceTable_expressionForKey(table, "unknown") == LIBWEXPR_NULLPTR, "Callback isn't used");
+	
+	WexprExpression* val = wexpr_ReferenceTable_expressionForLengthKey (table, "ab", 1);
+	WEXPR_UNITTEST_ASSERT (val && strcmp(wexpr_Expression_value(val), "1") == 0, "Can find keys");
+	
+	// indexes still match
+	for (size_t i=0; i < 2; ++i)
+	{
+		const char* key = wexpr_ReferenceTable_keyAtIndex(table, i);
+		WEXPR_UNITTEST_ASSERT (key && wexpr_ReferenceTable_indexOfKey(table, key) == i, "Index matches key");
+		WEXPR_UNITTEST_ASSERT (wexpr_ReferenceTable_expressionAtIndex(table, i) == wexpr_ReferenceTable_expressionForKey(table, key), "Index matches value");
+	}
+	
+	WEXPR_UNITTEST_ASSERT (wexpr_ReferenceTable_keyAtIndex(table, 2) == LIBWEXPR_NULLPTR, "Invalid index returns null");
+	
+	// can parse against it
+	WexprError err = WEXPR_ERROR_INIT();
+	WexprExpression* expr = wexpr_Expression_createFromStringWithExternalReferenceTable ("#(*[a] *[b])", WexprParseFlagNone, table, &err);
+	WEXPR_UNITTEST_ASSERT (expr && err.code == WexprErrorCodeNone, "Parsed against the frozen table");
+	WEXPR_UNITTEST_ASSERT (wexpr_Expression_arrayCount(expr) == 2, "Got both references");
+	
+	wexpr_Expression_destroy (expr);
+	WEXPR_ERROR_FREE(err);
+	
+	wexpr_ReferenceTable_destroy (table);
+	
+WEXPR_UNITTEST_END ()
+
+WEXPR_UNITTEST_BEGIN (ReferenceTableCanBeConcurrent)
+
+	WexprReferenceTable* table = wexpr_ReferenceTable_createConcurrent (4, &createValueForKey);
+	
+	WEXPR_UNITTEST_ASSERT (wexpr_ReferenceTable_count(table) == 0, "Starts empty");
+	
+	// creates unknown keys once
+	WexprExpression* val = wexpr_ReferenceTable_expressionForLengthKey (table, "keyx", 3);
+	WEXPR_UNITTEST_ASSERT (val && strcmp(wexpr_Expression_value(val), "key") == 0, "Created the key");
+	WEXPR_UNITTEST_ASSERT (wexpr_ReferenceTable_expressionForKey (table, "key") == val, "Found the same one again");
+	
+	// setting replaces, removing hides
+	for (int i=0; i < 40; ++i)
+	{
+		char key[16];
+		snprintf (key, sizeof(key), "k%d", i);
+		wexpr_ReferenceTable_setExpressionForKey (table, key, wexpr_Expression_createValue ("old"));
+		wexpr_ReferenceTable_setExpressionForKey (table, key, wexpr_Expression_createValue ("new"));
+	}
+	
+	wexpr_ReferenceTable_removeKey (table, "k0");
+	
+	WEXPR_UNITTEST_ASSERT (wexpr_ReferenceTable_count(table) == 40, "Replaced and removed keys aren't counted");
+	
+	val = wexpr_ReferenceTable_expressionForKey (table, "k1");
+	WEXPR_UNITTEST_ASSERT (val && strcmp(wexpr_Expression_value(val), "new") == 0, "Newest value is used");
+	
+	val = wexpr_ReferenceTable_expressionForKey (table, "k0");
+	WEXPR_UNITTEST_ASSERT (val && strcmp(wexpr_Expression_value(val), "k0") == 0, "Removed key is created again");
+	
+	for (size_t i=0; i < wexpr_ReferenceTable_count(table); ++i)
+	{
+		const char* key = wexpr_ReferenceTable_keyAtIndex(table, i);
+		WEXPR_UNITTEST_ASSERT (key && wexpr_ReferenceTable_indexOfKey(table, key) == i, "Index matches key");
+	}
+	
+	// frozen concurrent tables stop creating
+	wexpr_ReferenceTable_freeze (table);
+	WEXPR_UNITTEST_ASSERT (wexpr_ReferenceTable_expressionForKey(table, "other") == LIBWEXPR_NULLPTR, "Callback isn't used once frozen");
+	WEXPR_UNITTEST_ASSERT (wexpr_ReferenceTable_expressionForKey(table, "k5") != LIBWEXPR_NULLPTR, "Can still find keys");
+	
+	wexpr_ReferenceTable_destroy (table);
+	
+WEXPR_UNITTEST_END ()
+
 WEXPR_UNITTEST_SUITE_BEGIN (ReferenceTable)
 	WEXPR_UNITTEST_SUITE_ADDTEST (ReferenceTable, ReferenceTableCanCreate);
 	WEXPR_UNITTEST_SUITE_ADDTEST (ReferenceTable, ReferenceTableCanSetKey);
 	WEXPR_UNITTEST_SUITE_ADDTEST (ReferenceTable, ReferenceTableCanSetCallback);
+	WEXPR_UNITTEST_SUITE_ADDTEST (ReferenceTable, ReferenceTableCanFreeze);
+	WEXPR_UNITTEST_SUITE_ADDTEST (ReferenceTable, ReferenceTableCanBeConcurrent);
 WEXPR_UNITTEST_SUITE_END ()
 
 #endif // WEXPR_TESTS_REFERENCETABLE_H
@@ -0,0 +1,154 @@
+//
+/// \file Sink.h
+/// \brief Sink tests
+//
+// #LICENSE_BEGIN:MIT#
+// 
+// Copyright (c) 2017-2020, Kenneth Perry (thothonegan)
+// 
+// Permission is hereby granted, free of charge, to any person obtaining
+// a copy of this software and associated documentation files (the
+// "Software"), to deal in the Software without restriction, including
+// without limitation the rights to use, copy, modify, merge, publish,
+// distribute, sublicense, and/or sell copies of the Software, and to
+// permit persons to whom the Software is furnished to do so, subject to
+// the following conditions:
+// 
+// The above copyright notice and this permission notice shall be
+// included in all copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+// MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+// NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+// LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+// OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+// WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+// 
+// SPDX-License-Identifier: MIT
+// #LICENSE_END#
+//
+
+#ifndef WEXPR_TESTS_SINK_H
+#define WEXPR_TESTS_SINK_H
+
+#include <libWexpr/Expression.h>
+#include <libWexpr/Sink.h>
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "UnitTest.h"
+
+typedef struct SinkTestsCapture
+{
+	char* data;
+	size_t size;
+	size_t writeCount;
+} SinkTestsCapture;
+
+static bool s_sinkTests_capture (void* userData, const void* data, size_t byteSize)
+{
+	SinkTestsCapture* capture = userData;
+	
+	capture->data = realloc(capture->data, capture->size + byteSize);
+	memcpy (capture->data + capture->size, data, byteSize);
+	capture->size += byteSize;
+	capture->writeCount += 1;
+	
+	return true;
+}
+
+static bool s_sinkTests_fail (void* userData, const void* data, size_t byteSize)
+{
+	(void)userData; (void)data; (void)byteSize;
+	return false;
+}
+
+WEXPR_UNITTEST_BEGIN (SinkCanWriteToCallback)
+	WexprError err = WEXPR_ERROR_INIT();
+	WexprExpression* expr = wexpr_Expression_createFromString(
+		"@(first #(a b \"c d\") second <aGVsbG8=> third nil)",
+		WexprParseFlagNone, &err
+	);
+	
+	WEXPR_UNITTEST_ASSERT (expr, "Cannot create expression");
+	
+	// text
+	SinkTestsCapture capture = { NULL, 0, 0 };
+	WexprSink sink = wexpr_Sink_forCallback(&s_sinkTests_capture, &capture);
+	
+	WEXPR_UNITTEST_ASSERT (wexpr_Expression_writeText(expr, 0, WexprWriteFlagHumanReadable, &sink), "Should write text");
+	
+	char* str = wexpr_Expression_createStringRepresentation(expr, 0, WexprWriteFlagHumanReadable);
+	WEXPR_UNITTEST_ASSERT (capture.size == strlen(str) && memcmp(capture.data, str, capture.size) == 0, "Text should match");
+	free (str);
+	
+	// binary
+	free (capture.data);
+	capture.data = NULL; capture.size = 0;
+	
+	WEXPR_UNITTEST_ASSERT (wexpr_Expression_writeBinary(expr, WexprWriteFlagNone, &sink), "Should write binary");
+	
+	WexprMutableBuffer buf = wexpr_Expression_createBinaryRepresentation(expr);
+	WEXPR_UNITTEST_ASSERT (capture.size == buf.byteSize && memcmp(capture.data, buf.data, capture.size) == 0, "Binary should match");
+	free (buf.data);
+	
+	free (capture.data);
+	wexpr_Expression_destroy(expr);
+	WEXPR_ERROR_FREE (err);
+WEXPR_UNITTEST_END ()
+
+WEXPR_UNITTEST_BEGIN (SinkBuffersLargeOutput)
+	// big enough to need several flushes of the internal buffer
+	WexprExpression* expr = wexpr_Expression_createNull();
+	wexpr_Expression_changeType(expr, WexprExpressionTypeArray);
+	
+	for (int i=0; i < 50000; ++i)
+	{
+		wexpr_Expression_arrayAddElementToEnd(expr, wexpr_Expression_createValue("some value"));
+	}
+	
+	SinkTestsCapture capture = { NULL, 0, 0 };
+	WexprSink sink = wexpr_Sink_forCallback(&s_sinkTests_capture, &capture);
+	
+	WEXPR_UNITTEST_ASSERT (wexpr_Expression_writeText(expr, 0, WexprWriteFlagNone, &sink), "Should write text");
+	WEXPR_UNITTEST_ASSERT (capture.size == wexpr_Expression_stringRepresentationSize(expr, 0, WexprWriteFlagNone), "Should write everything");
+	WEXPR_UNITTEST_ASSERT (capture.writeCount > 1 && capture.writeCount < 100, "Should write in a few large pieces");
+	
+	// failing sinks are reported
+	WexprSink failSink = wexpr_Sink_forCallback(&s_sinkTests_fail, NULL);
+	WEXPR_UNITTEST_ASSERT (!wexpr_Expression_writeBinary(expr, WexprWriteFlagNone, &failSink), "Should report the sink failing");
+	
+	free (capture.data);
+	wexpr_Expression_destroy(expr);
+WEXPR_UNITTEST_END ()
+
+WEXPR_UNITTEST_BEGIN (SinkCanWriteToFile)
+	WexprError err = WEXPR_ERROR_INIT();
+	WexprExpression* expr = wexpr_Expression_createFromString("#(a b c)", WexprParseFlagNone, &err);
+	
+	FILE* file = tmpfile();
+	WEXPR_UNITTEST_ASSERT (file, "Cannot create a temporary file");
+	
+	WexprSink sink = wexpr_Sink_forFile(file);
+	WEXPR_UNITTEST_ASSERT (wexpr_Expression_writeText(expr, 0, WexprWriteFlagNone, &sink), "Should write text");
+	
+	char buffer[32] = {0};
+	rewind (file);
+	size_t amount = fread(buffer, 1, sizeof(buffer)-1, file);
+	
+	WEXPR_UNITTEST_ASSERT (amount == 8 && strcmp(buffer, "#(a b c)") == 0, "File should contain the text");
+	
+	fclose (file);
+	wexpr_Expression_destroy(expr);
+	WEXPR_ERROR_FREE (err);
+WEXPR_UNITTEST_END ()
+
+WEXPR_UNITTEST_SUITE_BEGIN (Sink)
+	WEXPR_UNITTEST_SUITE_ADDTEST (Sink, SinkCanWriteToCallback);
+	WEXPR_UNITTEST_SUITE_ADDTEST (Sink, SinkBuffersLargeOutput);
+	WEXPR_UNITTEST_SUITE_ADDTEST (Sink, SinkCanWriteToFile);
+WEXPR_UNITTEST_SUITE_END ()
+
+#endif // WEXPR_TESTS_SINK_H
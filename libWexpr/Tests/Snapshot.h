@@ -0,0 +1,166 @@
+//
+/// \file Snapshot.h
+/// \brief Snapshot tests
+//
+// #LICENSE_BEGIN:MIT#
+// 
+// Copyright (c) 2017-2020, Kenneth Perry (thothonegan)
+// 
+// Permission is hereby granted, free of charge, to any person obtaining
+// a copy of this software and associated documentation files (the
+// "Software"), to deal in the Software without restriction, including
+// without limitation the rights to use, copy, modify, merge, publish,
+// distribute, sublicense, and/or sell copies of the Software, and to
+// permit persons to whom the Software is furnished to do so, subject to
+// the following conditions:
+// 
+// The above copyright notice and this permission notice shall be
+// included in all copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+// MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+// NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+// LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+// OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+// WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+// 
+// SPDX-License-Identifier: MIT
+// #LICENSE_END#
+//
+
+#ifndef WEXPR_TESTS_SNAPSHOT_H
+#define WEXPR_TESTS_SNAPSHOT_H
+
+#include <libWexpr/Executor.h>
+#include <libWexpr/Snapshot.h>
+
+#include "UnitTest.h"
+
+#include <stdio.h>
+
+WEXPR_UNITTEST_BEGIN (SnapshotCanPublish)
+
+	WexprSnapshot* snapshot = wexpr_Snapshot_create (LIBWEXPR_NULLPTR);
+	
+	WexprSnapshotReader empty = wexpr_Snapshot_acquire (snapshot);
+	WEXPR_UNITTEST_ASSERT (empty.expression == LIBWEXPR_NULLPTR, "Nothing published yet");
+	wexpr_SnapshotReader_release (&empty);
+	
+	wexpr_Snapshot_publish (snapshot, wexpr_Expression_createFromString ("@(name first)", WexprParseFlagNone, LIBWEXPR_NULLPTR));
+	
+	WexprSnapshotReader first = wexpr_Snapshot_acquire (snapshot);
+	WEXPR_UNITTEST_ASSERT (strcmp(wexpr_Expression_value(wexpr_Expression_mapValueForKey(first.expression, "name")), "first") == 0, "Got the published expression");
+	
+	// readers keep the old one until they release it
+	wexpr_Snapshot_publish (snapshot, wexpr_Expression_createFromString ("@(name second)", WexprParseFlagNone, LIBWEXPR_NULLPTR));
+	
+	WexprSnapshotReader second = wexpr_Snapshot_acquire (snapshot);
+	WEXPR_UNITTEST_ASSERT (strcmp(wexpr_Expression_value(wexpr_Expression_mapValueForKey(second.expression, "name")), "second") == 0, "Got the new expression");
+	WEXPR_UNITTEST_ASSERT (strcmp(wexpr_Expression_value(wexpr_Expression_mapValueForKey(first.expression, "name")), "first") == 0, "Old expression is still readable");
+	
+	wexpr_SnapshotReader_release (&first);
+	WEXPR_UNITTEST_ASSERT (first.expression == LIBWEXPR_NULLPTR, "Released reader is cleared");
+	
+	// and can outlive the snapshot
+	wexpr_Snapshot_destroy (snapshot);
+	WEXPR_UNITTEST_ASSERT (wexpr_Expression_mapCount(second.expression) == 1, "Still readable after the snapshot is destroyed");
+	wexpr_SnapshotReader_release (&second);
+	
+WEXPR_UNITTEST_END ()
+
+WEXPR_UNITTEST_BEGIN (SnapshotUnsharesPublished)
+
+	WexprExpression* expr = wexpr_Expression_createFromString ("#(@(a 1 b 2) @(a 1 b 2) @(a 1 b 2))", WexprParseFlagDeduplicate, LIBWEXPR_NULLPTR);
+	
+	WexprExpressionNodeStats before = wexpr_Expression_nodeStats (expr);
+	WEXPR_UNITTEST_ASSERT (before.nodeCount != before.uniqueNodeCount, "Deduplicated expression shares nodes");
+	
+	WexprSnapshot* snapshot = wexpr_Snapshot_create (expr);
+	WexprSnapshotReader reader = wexpr_Snapshot_acquire (snapshot);
+	
+	WexprExpressionNodeStats after = wexpr_Expression_nodeStats (reader.expression);
+	WEXPR_UNITTEST_ASSERT (after.nodeCount == before.nodeCount && after.nodeCount == after.uniqueNodeCount, "Published expression doesn't share nodes");
+	
+	wexpr_SnapshotReader_release (&reader);
+	wexpr_Snapshot_destroy (snapshot);
+	
+WEXPR_UNITTEST_END ()
+
+enum { SnapshotTestThreads = 8, SnapshotTestVersions = 200 };
+
+typedef struct SnapshotTestState
+{
+	WexprSnapshot* snapshot;
+	bool succeeded[SnapshotTestThreads];
+} SnapshotTestState;
+
+static WexprExpression* snapshotTestVersion (int64_t version)
+{
+	char str[64];
+	sprintf (str, "@(version %lld twice %lld)", (long long)version, (long long)(version * 2));
+	
+	return wexpr_Expression_createFromString (str, WexprParseFlagNone, LIBWEXPR_NULLPTR);
+}
+
+static void snapshotTestTask (void* taskData, size_t index)
+{
+	SnapshotTestState* state = taskData;
+	
+	if (index == 0)
+	{
+		// publish while the others read
+		for (int64_t v=1; v <= SnapshotTestVersions; ++v)
+		{ wexpr_Snapshot_publish (state->snapshot, snapshotTestVersion(v)); }
+		
+		state->succeeded[index] = true;
+		return;
+	}
+	
+	// each version should be complete, and they should only go forwards
+	bool succeeded = true;
+	int64_t last = 0;
+	
+	while (succeeded && last != SnapshotTestVersions)
+	{
+		WexprSnapshotReader reader = wexpr_Snapshot_acquire (state->snapshot);
+		
+		int64_t version = 0, twice = 0;
+		succeeded = wexpr_Expression_valueAsInt64 (wexpr_Expression_mapValueForKey(reader.expression, "version"), &version)
+			&& wexpr_Expression_valueAsInt64 (wexpr_Expression_mapValueForKey(reader.expression, "twice"), &twice)
+			&& twice == version * 2 && version >= last;
+		
+		last = version;
+		wexpr_SnapshotReader_release (&reader);
+	}
+	
+	state->succeeded[index] = succeeded;
+}
+
+WEXPR_UNITTEST_BEGIN (SnapshotCanBeReadWhilePublishing)
+
+	SnapshotTestState state;
+	state.snapshot = wexpr_Snapshot_create (snapshotTestVersion(0));
+	
+	for (size_t i=0; i < SnapshotTestThreads; ++i)
+	{ state.succeeded[i] = false; }
+	
+	WexprExecutor executor = wexpr_Executor_forThreads (SnapshotTestThreads);
+	wexpr_Executor_parallelFor (&executor, SnapshotTestThreads, &snapshotTestTask, &state);
+	
+	for (size_t i=0; i < SnapshotTestThreads; ++i)
+	{
+		WEXPR_UNITTEST_ASSERT (state.succeeded[i], "Every reader saw complete versions in order");
+	}
+	
+	wexpr_Snapshot_destroy (state.snapshot);
+	
+WEXPR_UNITTEST_END ()
+
+WEXPR_UNITTEST_SUITE_BEGIN (Snapshot)
+	WEXPR_UNITTEST_SUITE_ADDTEST (Snapshot, SnapshotCanPublish);
+	WEXPR_UNITTEST_SUITE_ADDTEST (Snapshot, SnapshotUnsharesPublished);
+	WEXPR_UNITTEST_SUITE_ADDTEST (Snapshot, SnapshotCanBeReadWhilePublishing);
+WEXPR_UNITTEST_SUITE_END ()
+
+#endif // WEXPR_TESTS_SNAPSHOT_H
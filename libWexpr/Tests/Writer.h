@@ -0,0 +1,179 @@
+//
+/// \file Writer.h
+/// \brief Writer tests
+//
+// #LICENSE_BEGIN:MIT#
+// 
+// Copyright (c) 2017-2020, Kenneth Perry (thothonegan)
+// 
+// Permission is hereby granted, free of charge, to any person obtaining
+// a copy of this software and associated documentation files (the
+// "Software"), to deal in the Software without restriction, including
+// without limitation the rights to use, copy, modify, merge, publish,
+// distribute, sublicense, and/or sell copies of the Software, and to
+// permit persons to whom the Software is furnished to do so, subject to
+// the following conditions:
+// 
+// The above copyright notice and this permission notice shall be
+// included in all copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+// MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+// NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+// LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+// OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+// WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+// 
+// SPDX-License-Identifier: MIT
+// #LICENSE_END#
+//
+
+#ifndef WEXPR_TESTS_WRITER_H
+#define WEXPR_TESTS_WRITER_H
+
+#include <libWexpr/Expression.h>
+#include <libWexpr/Sink.h>
+#include <libWexpr/Writer.h>
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "UnitTest.h"
+
+typedef struct WriterTestsCapture
+{
+	char* data;
+	size_t size;
+} WriterTestsCapture;
+
+static bool s_writerTests_capture (void* userData, const void* data, size_t byteSize)
+{
+	WriterTestsCapture* capture = userData;
+	
+	capture->data = realloc(capture->data, capture->size + byteSize + 1);
+	memcpy (capture->data + capture->size, data, byteSize);
+	capture->size += byteSize;
+	capture->data[capture->size] = '\0'; // so text can be compared directly
+	
+	return true;
+}
+
+// writes #(a "b c" @(key #()) <aGVsbG8=> null)
+static bool s_writerTests_writeDocument (WexprWriter* writer)
+{
+	bool success = wexpr_Writer_beginArray(writer);
+		success = success && wexpr_Writer_value(writer, "a");
+		success = success && wexpr_Writer_value(writer, "b c");
+		success = success && wexpr_Writer_beginMap(writer);
+			success = success && wexpr_Writer_key(writer, "key");
+			success = success && wexpr_Writer_beginArray(writer);
+			success = success && wexpr_Writer_endArray(writer);
+		success = success && wexpr_Writer_endMap(writer);
+		success = success && wexpr_Writer_binaryData(writer, "hello", 5);
+		success = success && wexpr_Writer_null(writer);
+	success = success && wexpr_Writer_endArray(writer);
+	
+	return success;
+}
+
+WEXPR_UNITTEST_BEGIN (WriterCanWriteText)
+	WexprError err = WEXPR_ERROR_INIT();
+	WexprExpression* expr = wexpr_Expression_createFromString(
+		"#(a \"b c\" @(key #()) <aGVsbG8=> null)", WexprParseFlagNone, &err
+	);
+	
+	WEXPR_UNITTEST_ASSERT (expr, "Cannot create expression");
+	
+	for (int i=0; i < 2; ++i)
+	{
+		WexprWriteFlags flags = (i == 0) ? WexprWriteFlagNone : WexprWriteFlagHumanReadable;
+		
+		WriterTestsCapture capture = { NULL, 0 };
+		WexprSink sink = wexpr_Sink_forCallback(&s_writerTests_capture, &capture);
+		WexprWriter* writer = wexpr_Writer_createText(&sink, flags);
+		
+		WEXPR_UNITTEST_ASSERT (s_writerTests_writeDocument(writer), "Should write the document");
+		WEXPR_UNITTEST_ASSERT (wexpr_Writer_finish(writer), "Should finish");
+		
+		// should match writing the same expression
+		char* expected = wexpr_Expression_createStringRepresentation(expr, 0, flags);
+		WEXPR_UNITTEST_ASSERT (capture.data && strcmp(capture.data, expected) == 0, "Should match the expression");
+		
+		free (expected);
+		free (capture.data);
+		wexpr_Writer_destroy(writer);
+	}
+	
+	wexpr_Expression_destroy(expr);
+	WEXPR_ERROR_FREE (err);
+WEXPR_UNITTEST_END ()
+
+WEXPR_UNITTEST_BEGIN (WriterCanWriteBinary)
+	WexprError err = WEXPR_ERROR_INIT();
+	WexprExpression* expr = wexpr_Expression_createFromString(
+		"#(a \"b c\" @(key #()) <aGVsbG8=> null)", WexprParseFlagNone, &err
+	);
+	
+	WEXPR_UNITTEST_ASSERT (expr, "Cannot create expression");
+	
+	WriterTestsCapture capture = { NULL, 0 };
+	WexprSink sink = wexpr_Sink_forCallback(&s_writerTests_capture, &capture);
+	WexprWriter* writer = wexpr_Writer_createBinary(&sink, WexprWriteFlagBinaryFileHeader);
+	
+	WEXPR_UNITTEST_ASSERT (s_writerTests_writeDocument(writer), "Should write the document");
+	WEXPR_UNITTEST_ASSERT (wexpr_Writer_finish(writer), "Should finish");
+	
+	// should match writing the same expression
+	size_t expectedSize = wexpr_Expression_binaryRepresentationSize(expr, WexprWriteFlagBinaryFileHeader);
+	void* expected = malloc(expectedSize);
+	WEXPR_UNITTEST_ASSERT (wexpr_Expression_writeBinaryInto(expr, WexprWriteFlagBinaryFileHeader, expected, expectedSize, NULL), "Can write expression");
+	
+	WEXPR_UNITTEST_ASSERT (capture.size == expectedSize, "Should be the same size as the expression");
+	WEXPR_UNITTEST_ASSERT (memcmp(capture.data, expected, expectedSize) == 0, "Should match the expression");
+	
+	free (expected);
+	free (capture.data);
+	wexpr_Writer_destroy(writer);
+	wexpr_Expression_destroy(expr);
+	WEXPR_ERROR_FREE (err);
+WEXPR_UNITTEST_END ()
+
+WEXPR_UNITTEST_BEGIN (WriterRejectsInvalidEvents)
+	WriterTestsCapture capture = { NULL, 0 };
+	WexprSink sink = wexpr_Sink_forCallback(&s_writerTests_capture, &capture);
+	
+	// value where a key is needed
+	WexprWriter* writer = wexpr_Writer_createText(&sink, WexprWriteFlagNone);
+	WEXPR_UNITTEST_ASSERT (wexpr_Writer_beginMap(writer), "Can begin map");
+	WEXPR_UNITTEST_ASSERT (!wexpr_Writer_value(writer, "a"), "Map needs a key first");
+	WEXPR_UNITTEST_ASSERT (!wexpr_Writer_key(writer, "a"), "Writer should stay failed");
+	WEXPR_UNITTEST_ASSERT (!wexpr_Writer_finish(writer), "Should not finish");
+	wexpr_Writer_destroy(writer);
+	
+	// mismatched end
+	writer = wexpr_Writer_createBinary(&sink, WexprWriteFlagNone);
+	WEXPR_UNITTEST_ASSERT (wexpr_Writer_beginArray(writer), "Can begin array");
+	WEXPR_UNITTEST_ASSERT (!wexpr_Writer_endMap(writer), "Cannot end a map when an array is open");
+	wexpr_Writer_destroy(writer);
+	
+	// incomplete and multiple roots
+	writer = wexpr_Writer_createText(&sink, WexprWriteFlagNone);
+	WEXPR_UNITTEST_ASSERT (!wexpr_Writer_finish(writer), "Should not finish without a root");
+	wexpr_Writer_destroy(writer);
+	
+	writer = wexpr_Writer_createText(&sink, WexprWriteFlagNone);
+	WEXPR_UNITTEST_ASSERT (wexpr_Writer_value(writer, "a"), "Can write a root value");
+	WEXPR_UNITTEST_ASSERT (!wexpr_Writer_value(writer, "b"), "Only one root");
+	wexpr_Writer_destroy(writer);
+	
+	free (capture.data);
+WEXPR_UNITTEST_END ()
+
+WEXPR_UNITTEST_SUITE_BEGIN (Writer)
+	WEXPR_UNITTEST_SUITE_ADDTEST (Writer, WriterCanWriteText);
+	WEXPR_UNITTEST_SUITE_ADDTEST (Writer, WriterCanWriteBinary);
+	WEXPR_UNITTEST_SUITE_ADDTEST (Writer, WriterRejectsInvalidEvents);
+WEXPR_UNITTEST_SUITE_END ()
+
+#endif // WEXPR_TESTS_WRITER_H
@@ -8,6 +8,8 @@
 
 #include <libWexprSchema/PrimitiveType.h>
 
+#include "Validation.h"
+
 #include <string.h>
 
 static const char* s_WexprSchemaPrimitiveTypeNull_String = "null";
@@ -47,7 +49,8 @@ bool wexprSchema_PrimitiveType_matchesExpressionType (WexprSchemaPrimitiveType s
 
 WexprSchemaTwine wexprSchema_PrimitiveType_toTwine(WexprSchemaPrimitiveType self)
 {
-	static WexprSchemaTwine s_twines[5*2-1]; // number of possibilities * 2 - 1
+	// per thread, since validation can run on multiple
+	static WEXPRSCHEMA_PRIVATE_THREADLOCAL WexprSchemaTwine s_twines[5*2-1]; // number of possibilities * 2 - 1
 
 	if (self == WexprSchemaPrimitiveTypeUnknown)
 	{
@@ -13,13 +13,14 @@
 #include <libWexpr/libWexpr.h>
 
 
-#include <errno.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 
 #include "../../libWexpr/Private/ThirdParty/sglib/sglib.h"
 
+#include "Validation.h"
+
 static bool s_stringStartsWith (const char* haystack, size_t haystackLength, const char* needle, size_t needleLength)
 {
 	if (haystackLength < needleLength) // cant fit
@@ -96,6 +97,8 @@ struct WexprSchemaSchema
 	// rootType - links to something inside m_types or m_referenceSchemas
 	WexprSchemaType* m_rootType;
 	
+	// how to split wide containers when validating. minimumCount is 0 if off.
+	WexprSchemaPrivateParallelValidation m_parallelValidation;
 };
 
 static void* s_defaultAlloc (void* allocatorUserData, size_t size)
@@ -119,10 +122,9 @@ static const char* s_defaultPathForSchemaID (void* userData, const char* schemaI
 }
 
 //
-/// \brief Create a string containing the contents of the path. Will be null terminated, and must not contain nulls.
-/// \note Allocated with callbacks
+/// \brief Load the expression at the given location.
 //
-static char* s_createStringFromLocation (const char* path, WexprSchemaSchema_Callbacks* callbacks, WexprSchemaError** error)
+static WexprExpression* s_createExpressionFromLocation (const char* path, WexprSchemaError** error)
 {
 	if (strstr(path, "http") == path)
 	{
@@ -139,88 +141,47 @@ static char* s_createStringFromLocation (const char* path, WexprSchemaSchema_Cal
 
 		return LIBWEXPR_NULLPTR;
 	}
-	else
-	{
-		FILE* f = fopen(path, "rb");
-		if (f == LIBWEXPR_NULLPTR) {
-			if (error) {
-				char buffer[1024] = {0};
-				sprintf(buffer, "Unable to open file %s: %s",
-					path,
-					strerror(errno)
-				);
-
-				*error = wexprSchema_Error_create(
-					WexprSchemaErrorInternal,
-					"/",
-					buffer,
-					LIBWEXPR_NULLPTR,
-					LIBWEXPR_NULLPTR
-				);
-			}
-			return LIBWEXPR_NULLPTR;
-		}
-
-		fseek(f, 0, SEEK_END);
-		long int end = ftell(f);
-		fseek(f, 0, SEEK_SET);
-		
-		char* buf = callbacks->alloc(callbacks->allocatorUserData, end+1);
-		if (buf == LIBWEXPR_NULLPTR)
-		{
-			if (error) {
-				*error = wexprSchema_Error_create(
-					WexprSchemaErrorInternal,
-					"/",
-					"Unable to allocate memory",
-					LIBWEXPR_NULLPTR,
-					LIBWEXPR_NULLPTR
-				);
-			}
-			return LIBWEXPR_NULLPTR;
-		}
-		fread(buf, end, 1, f);
-		fclose(f);
-		
-		buf[end] = 0; // terminate
-		return buf;
-	}
-}
-
-static bool s_loadFromSchemaID (WexprSchemaSchema* self, const char* schemaID, WexprSchemaError** error)
-{
-	WexprSchemaSchema_Callbacks* callbacks = &(self->m_callbacks);
-	const char* path = callbacks->pathForSchemaID(self->m_callbacks.pathForSchemaIDUserData, schemaID);
-	if (path == LIBWEXPR_NULLPTR)
-		path = schemaID;
-	
-	char* str = s_createStringFromLocation(path, callbacks, error);
-	if (str == LIBWEXPR_NULLPTR)
-		return false;
 	
 	WexprError err = WEXPR_ERROR_INIT();
 	
-	WexprExpression* wexpr = wexpr_Expression_createFromLengthString(
-		str, strlen(str), WexprParseFlagNone, &err
+	// maps the file and parses in place, rather than reading it in first
+	WexprExpression* wexpr = wexpr_Expression_createFromFile(
+		path, WexprParseFlagNone, &err
 	);
 	
 	if (!wexpr)
 	{
 		if (error)
 		{
+			const char* message = "Error when loading schema wexpr";
+			if (err.code == WexprErrorCodeUnableToReadFile && err.message)
+				message = err.message;
+			
 			*error = wexprSchema_Error_create(
 				WexprSchemaErrorInternal,
 				"/",
-				"Error when loading schema wexpr",
+				message,
 				LIBWEXPR_NULLPTR,
 				LIBWEXPR_NULLPTR
 			); 
 		}
-		return false;
 	}
-
+	
 	WEXPR_ERROR_FREE(err);
-	callbacks->dealloc(callbacks->allocatorUserData, str);
+	
+	return wexpr;
+}
+
+static bool s_loadFromSchemaID (WexprSchemaSchema* self, const char* schemaID, WexprSchemaError** error)
+{
+	WexprSchemaSchema_Callbacks* callbacks = &(self->m_callbacks);
+	const char* path = callbacks->pathForSchemaID(self->m_callbacks.pathForSchemaIDUserData, schemaID);
+	if (path == LIBWEXPR_NULLPTR)
+		path = schemaID;
+	
+	WexprExpression* wexpr = s_createExpressionFromLocation(path, error);
+	if (wexpr == LIBWEXPR_NULLPTR)
+		return false;
 	
 	// check the schema version first
 	WexprExpression* schema = wexpr_Expression_mapValueForKey(wexpr, "$schema");
@@ -334,6 +295,8 @@ WexprSchemaSchema* wexprSchema_Schema_createFromSchemaID(const char* schemaID, W
 	self->m_types = NULL;
 	self->m_rootType = NULL;
 	self->m_referenceSchemas = NULL;
+	self->m_parallelValidation.executor = wexpr_Executor_forThreads(0);
+	self->m_parallelValidation.minimumCount = 0;
 
 	// perform the load
 	if (!s_loadFromSchemaID (self, schemaID, error))
@@ -432,6 +395,12 @@ WexprSchemaType* wexprSchema_Schema_typeWithName(WexprSchemaSchema* self, const
 
 // --- public Validation
 
+void wexprSchema_Schema_setParallelValidation(WexprSchemaSchema* self, size_t minimumCount, const WexprExecutor* executor)
+{
+	self->m_parallelValidation.executor = (executor ? *executor : wexpr_Executor_forThreads(0));
+	self->m_parallelValidation.minimumCount = minimumCount;
+}
+
 bool wexprSchema_Schema_validateExpression(WexprSchemaSchema* self, WexprExpression* expression, WexprSchemaError** error)
 {
 	WexprSchemaTwine objectPath;
@@ -455,12 +424,25 @@ bool wexprSchema_Schema_validateExpression(WexprSchemaSchema* self, WexprExpress
 		return false;
 	}
 
+	// reading a shared (deduplicated) node detaches it, which isn't safe from multiple threads
+	const WexprSchemaPrivateParallelValidation* parallel = LIBWEXPR_NULLPTR;
+	if (self->m_parallelValidation.minimumCount > 0 && expression)
+	{
+		WexprExpressionNodeStats stats = wexpr_Expression_nodeStats(expression);
+		if (stats.nodeCount == stats.uniqueNodeCount)
+			parallel = &(self->m_parallelValidation);
+	}
+	
+	const WexprSchemaPrivateParallelValidation* previousParallel = wexprSchema_PrivateValidation_setParallel(parallel);
+	
 	bool success = wexprSchema_Type_validateObject(
 		rootType,
 		&objectPath,
 		expression,
 		error
 	);
+	
+	wexprSchema_PrivateValidation_setParallel(previousParallel);
 
 	if (!success)
 	{
@@ -15,11 +15,13 @@
 #include "ExternalOnigmo.h"
 
 #include <stdio.h>
+#include <stdlib.h>
 
 #include "../../libWexpr/Private/ThirdParty/c_hashmap/hashmap.h"
 #include "../../libWexpr/Private/ThirdParty/sglib/sglib.h"
 
 #include "TypeRef.h"
+#include "Validation.h"
 
 // Turns on debug output to 
 // Format:
@@ -221,6 +223,156 @@ static bool s_wexprSchema_Type_validateValue(
 	return success;
 }
 
+// Validates one child of a container against the rules for the current SchemaType, prepending any errors to error.
+typedef bool (*PrivateValidateChildFunction) (
+	WexprSchemaType* self,
+	WexprSchemaTwine* objectPath,
+	WexprExpression* expression,
+	size_t index,
+	WexprSchemaError** error
+);
+
+// Children validated by each thread at once when validating in parallel
+#define PRIVATE_PARALLEL_CHUNKSIZE 64
+
+typedef struct PrivateValidateChildrenWork
+{
+	WexprSchemaType* self;
+	WexprSchemaTwine* objectPath;
+	WexprExpression* expression;
+	PrivateValidateChildFunction validateChild;
+	size_t count;
+	
+	bool collectErrors; // if the caller wanted errors
+	WexprSchemaError** chunkErrors; // for each chunk, newest first as the serial chain would be
+	bool* chunkSuccesses;
+} PrivateValidateChildrenWork;
+
+static void s_validateChildrenTask (void* taskData, size_t chunkIndex)
+{
+	PrivateValidateChildrenWork* work = taskData;
+	
+	// only the outermost wide container is split, anything within it is validated on this thread
+	const WexprSchemaPrivateParallelValidation* previousParallel = wexprSchema_PrivateValidation_setParallel(LIBWEXPR_NULLPTR);
+	
+	size_t begin = chunkIndex * PRIVATE_PARALLEL_CHUNKSIZE;
+	size_t end = begin + PRIVATE_PARALLEL_CHUNKSIZE;
+	if (end > work->count)
+		end = work->count;
+	
+	WexprSchemaError* chunkError = LIBWEXPR_NULLPTR;
+	bool success = true;
+	
+	for (size_t i=begin; i < end; ++i)
+	{
+		success &= work->validateChild(work->self, work->objectPath, work->expression, i,
+			work->collectErrors ? &chunkError : LIBWEXPR_NULLPTR
+		);
+	}
+	
+	work->chunkErrors[chunkIndex] = chunkError;
+	work->chunkSuccesses[chunkIndex] = success;
+	
+	wexprSchema_PrivateValidation_setParallel(previousParallel);
+}
+
+// Validate each child in [0, count), in parallel if enabled and there's enough of them.
+// Errors end up in the same order as validating them one by one.
+static bool s_validateChildren (
+	WexprSchemaType* self,
+	WexprSchemaTwine* objectPath,
+	WexprExpression* expression,
+	size_t count,
+	PrivateValidateChildFunction validateChild,
+	WexprSchemaError** error
+)
+{
+	bool success = true;
+	
+	const WexprSchemaPrivateParallelValidation* parallel = wexprSchema_PrivateValidation_parallel();
+	size_t chunkCount = (count + PRIVATE_PARALLEL_CHUNKSIZE - 1) / PRIVATE_PARALLEL_CHUNKSIZE;
+	
+	if (!parallel || parallel->minimumCount == 0 || count < parallel->minimumCount || chunkCount < 2)
+	{
+		for (size_t i=0; i < count; ++i)
+		{
+			success &= validateChild(self, objectPath, expression, i, error);
+		}
+		
+		return success;
+	}
+	
+#if DEBUG_LOGSTDERR
+	fprintf(stderr, "    Validating %zu children in %zu chunks\n", count, chunkCount);
+#endif
+	
+	PrivateValidateChildrenWork work;
+	work.self = self;
+	work.objectPath = objectPath;
+	work.expression = expression;
+	work.validateChild = validateChild;
+	work.count = count;
+	work.collectErrors = (error != LIBWEXPR_NULLPTR);
+	work.chunkErrors = malloc(sizeof(WexprSchemaError*) * chunkCount);
+	work.chunkSuccesses = malloc(sizeof(bool) * chunkCount);
+	
+	if (!work.chunkErrors || !work.chunkSuccesses)
+	{
+		free(work.chunkErrors);
+		free(work.chunkSuccesses);
+		
+		// validate it here instead
+		wexprSchema_PrivateValidation_setParallel(LIBWEXPR_NULLPTR);
+		success = s_validateChildren(self, objectPath, expression, count, validateChild, error);
+		wexprSchema_PrivateValidation_setParallel(parallel);
+		
+		return success;
+	}
+	
+	wexpr_Executor_parallelFor(&parallel->executor, chunkCount, &s_validateChildrenTask, &work);
+	
+	// merge in order: each chain goes in front of the ones before it, like prepending one by one would
+	for (size_t c=0; c < chunkCount; ++c)
+	{
+		success &= work.chunkSuccesses[c];
+		
+		WexprSchemaError* chunkError = work.chunkErrors[c];
+		if (chunkError)
+		{
+			wexprSchema_Error_appendError(chunkError, *error);
+			*error = chunkError;
+		}
+	}
+	
+	free(work.chunkErrors);
+	free(work.chunkSuccesses);
+	
+	return success;
+}
+
+static bool s_validateArrayElement (
+	WexprSchemaType* self,
+	WexprSchemaTwine* objectPath,
+	WexprExpression* expression,
+	size_t index,
+	WexprSchemaError** error
+)
+{
+	char buf[32] = {0};
+	sprintf(buf, "[%zu]", index);
+	
+	WexprSchemaTwine indexObjectPath;
+	wexprSchema_Twine_init_Twine_CStr(&indexObjectPath, objectPath, buf);
+	
+	WexprExpression* childExpr = wexpr_Expression_arrayAt(expression, index);
+	return wexprSchema_TypeInstance_validateObject(
+		self->m_arrayAllElements,
+		&indexObjectPath,
+		childExpr,
+		error
+	);
+}
+
 // Validate an array object whos rules should match the current SchemaType
 static bool s_wexprSchema_Type_validateArray (
 	WexprSchemaType* self,
@@ -246,23 +398,7 @@ static bool s_wexprSchema_Type_validateArray (
 #if DEBUG_LOGSTDERR
 	fprintf(stderr, "    Validating array all elements\n");
 #endif
-		for (size_t i=0; i < count; ++i)
-		{
-			char buf[32] = {0};
-			sprintf(buf, "[%zu]", i);
-			
-			WexprSchemaTwine indexObjectPath;
-			wexprSchema_Twine_init_Twine_CStr(&indexObjectPath, objectPath, buf);
-			
-			WexprExpression* childExpr = wexpr_Expression_arrayAt(expression, i);
-			bool res = wexprSchema_TypeInstance_validateObject(
-				self->m_arrayAllElements,
-				&indexObjectPath,
-				childExpr,
-				error
-			);
-			success &= res;
-		}
+		success &= s_validateChildren(self, objectPath, expression, count, &s_validateArrayElement, error);
 	}
 	
 	return success;
@@ -323,6 +459,10 @@ static int s_validateMapProperty (any_t userData, any_t data)
 				*(params->error)
 			);
 		}
+		else if (e)
+		{
+			wexprSchema_Error_destroy(e); // nowhere to go
+		}
 	}
 	
 	params->result &= res;
@@ -330,6 +470,57 @@ static int s_validateMapProperty (any_t userData, any_t data)
 	return MAP_OK;
 }
 
+// Validate the key and value at the given index against the rules for all properties
+static bool s_validateMapEntry (
+	WexprSchemaType* self,
+	WexprSchemaTwine* objectPath,
+	WexprExpression* expression,
+	size_t index,
+	WexprSchemaError** error
+)
+{
+	bool success = true;
+	
+	const char* key = wexpr_Expression_mapKeyAt(expression, index);
+	
+	OBJECTPATH_APPEND(keyObjectPath, objectPath, key);
+	
+	if (self->m_mapKeyType)
+	{
+		// create a fake expression we can test against
+		WexprExpression* keyValue = wexpr_Expression_createValue(key);
+		
+		bool res = wexprSchema_TypeInstance_validateObject(
+			self->m_mapKeyType,
+			&keyObjectPath,
+			keyValue,
+			error
+		);
+		success &= res;
+		
+		wexpr_Expression_destroy(keyValue);
+	}
+	
+	if (self->m_mapAllProperties)
+	{
+#if DEBUG_LOGSTDERR
+		fprintf(stderr, "--- Testing against mapAllProperties: %s\n", key);
+#endif
+	
+		WexprExpression* value = wexpr_Expression_mapValueAt(expression, index);
+		
+		bool res = wexprSchema_TypeInstance_validateObject(
+			self->m_mapAllProperties,
+			&keyObjectPath,
+			value,
+			error
+		);
+		success &= res;
+	}
+	
+	return success;
+}
+
 // Validate a map object whos rules should match the current SchemaType
 static bool s_wexprSchema_Type_validateMap (
 	WexprSchemaType* self,
@@ -363,45 +554,7 @@ static bool s_wexprSchema_Type_validateMap (
 	if (self->m_mapAllProperties || self->m_mapKeyType)
 	{
 		size_t count = wexpr_Expression_mapCount(expression);
-		for (size_t i=0; i < count; ++i)
-		{
-			const char* key = wexpr_Expression_mapKeyAt(expression, i);
-			
-			OBJECTPATH_APPEND(keyObjectPath, objectPath, key);
-				
-			if (self->m_mapKeyType)
-			{
-				// create a fake expression we can test against
-				WexprExpression* keyValue = wexpr_Expression_createValue(key);
-				
-				bool res = wexprSchema_TypeInstance_validateObject(
-					self->m_mapKeyType,
-					&keyObjectPath,
-					keyValue,
-					error
-				);
-				success &= res;
-				
-				wexpr_Expression_destroy(keyValue);
-			}
-			
-			if (self->m_mapAllProperties)
-			{
-#if DEBUG_LOGSTDERR
-				fprintf(stderr, "--- Testing against mapAllProperties: %s\n", key);
-#endif
-			
-				WexprExpression* value = wexpr_Expression_mapValueAt(expression, i);
-				
-				bool res = wexprSchema_TypeInstance_validateObject(
-					self->m_mapAllProperties,
-					&keyObjectPath,
-					value,
-					error
-				);
-				success &= res;
-			}
-		}
+		success &= s_validateChildren(self, objectPath, expression, count, &s_validateMapEntry, error);
 	}
 	
 	// - we  need to check via expression, if we're not allowed to have unknown properties
@@ -0,0 +1,30 @@
+//
+/// \file libWexprSchema/Validation.c
+/// \brief State for the validation running on the current thread
+//
+// #LICENSE_BEGIN:MIT#
+// #LICENSE_END#
+//
+
+#include "Validation.h"
+
+// The validation functions dont take any context, so this is per thread instead. Only the validation
+// which started on this thread sees it, and threads validating part of a container set it to null.
+static WEXPRSCHEMA_PRIVATE_THREADLOCAL const WexprSchemaPrivateParallelValidation* s_parallel = LIBWEXPR_NULLPTR;
+
+// --- private
+
+const WexprSchemaPrivateParallelValidation* wexprSchema_PrivateValidation_parallel (void)
+{
+	return s_parallel;
+}
+
+const WexprSchemaPrivateParallelValidation* wexprSchema_PrivateValidation_setParallel (
+	const WexprSchemaPrivateParallelValidation* parallel
+)
+{
+	const WexprSchemaPrivateParallelValidation* previous = s_parallel;
+	s_parallel = parallel;
+	
+	return previous;
+}
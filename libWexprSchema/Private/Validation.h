@@ -0,0 +1,52 @@
+//
+/// \file libWexprSchema/Validation.h
+/// \brief State for the validation running on the current thread
+//
+// #LICENSE_BEGIN:MIT#
+// #LICENSE_END#
+//
+
+#ifndef LIBWEXPRSCHEMA_VALIDATION_H
+#define LIBWEXPRSCHEMA_VALIDATION_H
+
+#include <libWexpr/Executor.h>
+#include <libWexpr/Macros.h>
+
+#include <stddef.h>
+
+LIBWEXPR_EXTERN_C_BEGIN()
+
+//
+/// \brief Marks a static as one per thread, for state used while validating (which can be on multiple threads).
+//
+#if defined(_MSC_VER)
+	#define WEXPRSCHEMA_PRIVATE_THREADLOCAL __declspec(thread)
+#else
+	#define WEXPRSCHEMA_PRIVATE_THREADLOCAL __thread
+#endif
+
+//
+/// \brief How wide arrays and maps are split across threads. See wexprSchema_Schema_setParallelValidation().
+//
+typedef struct WexprSchemaPrivateParallelValidation
+{
+	WexprExecutor executor; // runs the work
+	size_t minimumCount; // containers with fewer children than this are validated on the calling thread. 0 is off.
+} WexprSchemaPrivateParallelValidation;
+
+//
+/// \brief The parallel validation for the validation running on this thread, or null to validate everything on it.
+//
+const WexprSchemaPrivateParallelValidation* wexprSchema_PrivateValidation_parallel (void);
+
+//
+/// \brief Set the parallel validation for this thread.
+/// \return The previous one, to restore once done.
+//
+const WexprSchemaPrivateParallelValidation* wexprSchema_PrivateValidation_setParallel (
+	const WexprSchemaPrivateParallelValidation* parallel
+);
+
+LIBWEXPR_EXTERN_C_END()
+
+#endif // LIBWEXPRSCHEMA_VALIDATION_H
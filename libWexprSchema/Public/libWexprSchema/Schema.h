@@ -9,6 +9,7 @@
 #ifndef LIBWEXPRSCHEMA_SCHEMA_H
 #define LIBWEXPRSCHEMA_SCHEMA_H
 
+#include <libWexpr/Executor.h>
 #include <libWexpr/Expression.h>
 
 #include "Error.h"
@@ -102,6 +103,15 @@ WexprSchemaType* wexprSchema_Schema_typeWithName(WexprSchemaSchema* self, const
 /// \see WexprSchemaSchema
 /// \{
 
+//
+/// \brief Validate the children of wide arrays and maps on multiple threads. Off by default.
+/// Only the outermost container wide enough is split, and the errors are in the same order as validating on one thread.
+/// Expressions with shared nodes (WexprParseFlagDeduplicate) are still validated on one thread.
+/// \param minimumCount Arrays and maps with at least this many children are split. 0 turns it off.
+/// \param executor Runs the work, or null to use libWexpr's own threads. Copied.
+//
+void wexprSchema_Schema_setParallelValidation(WexprSchemaSchema* self, size_t minimumCount, const WexprExecutor* executor);
+
 //
 /// \brief Validate the given expression with the loaded schema. Will return true/false, and will store
 /// the failures if we are given a location to put the resulting error.
@@ -1,6 +1,36 @@
+//
+/// \file Main.c
+/// \brief libWexprSchema tests
+//
+// #LICENSE_BEGIN:MIT#
+// #LICENSE_END#
+//
+
+#include "Schema.h"
 
 int main (int argc, char** argv)
 {
-	return 0;
+	(void)argc;
+	(void)argv;
+	
+	wexprSchema_Global_init();
+	
+	WexprSuiteResult res = {0, 0};
+	
+	#define RUN_SUITE(name) \
+		{ \
+			WexprSuiteResult r = WEXPR_UNITTEST_SUITE_RUN(name); \
+			res.failures += r.failures; \
+			res.successes += r.successes; \
+		}
+	
+	RUN_SUITE(Schema)
+	
+	printf ("\nTEST RESULTS: Success: %d Failures: %d\n", res.successes, res.failures);
+	
+#undef RUN_SUITE
+	
+	wexprSchema_Global_free();
+	
+	return res.failures;
 }
-
@@ -0,0 +1,223 @@
+//
+/// \file Schema.h
+/// \brief Schema tests
+//
+// #LICENSE_BEGIN:MIT#
+// #LICENSE_END#
+//
+
+#ifndef WEXPRSCHEMA_TESTS_SCHEMA_H
+#define WEXPRSCHEMA_TESTS_SCHEMA_H
+
+#include <libWexpr/libWexpr.h>
+#include <libWexprSchema/libWexprSchema.h>
+
+#include "../../libWexpr/Tests/UnitTest.h"
+
+// schemas are loaded by id, so the test schema is written here first
+static const char* s_schemaTestPath = "libWexprSchemaTests_Schema.tmp";
+
+static const char* s_schemaTestPathForSchemaID (void* userData, const char* schemaID)
+{
+	(void)userData;
+	(void)schemaID;
+	
+	return s_schemaTestPath;
+}
+
+// a root map with a wide array and a wide map of items
+static WexprSchemaSchema* s_schemaTestCreateItemSchema (void)
+{
+	FILE* file = fopen(s_schemaTestPath, "wb");
+	if (!file)
+	{ return NULL; }
+	
+	fputs (
+		"@(\n"
+		"	$id \"test\"\n"
+		"	$schema \"https://wexpr.hackerguild.com/versions/1.schema.wexpr\"\n"
+		"	$types @(\n"
+		"		Val @(primitiveType \"value\")\n"
+		"		Item @(primitiveType \"map\" mapProperties @(id @(type Val) name @(type Val optional true)))\n"
+		"		Items @(primitiveType \"array\" arrayAllElements @(type Item))\n"
+		"		ItemsByName @(primitiveType \"map\" mapAllProperties @(type Item))\n"
+		"		Root @(primitiveType \"map\" mapProperties @(items @(type Items) byName @(type ItemsByName)))\n"
+		"	)\n"
+		"	rootType Root\n"
+		")\n",
+		file
+	);
+	fclose (file);
+	
+	WexprSchemaSchema_Callbacks callbacks;
+	memset (&callbacks, 0, sizeof(callbacks));
+	callbacks.pathForSchemaID = &s_schemaTestPathForSchemaID;
+	
+	WexprSchemaSchema* schema = wexprSchema_Schema_createFromSchemaID("test", &callbacks, NULL);
+	remove (s_schemaTestPath);
+	
+	return schema;
+}
+
+// itemCount items in both the array and the map. Every 97th is missing its id, and every 131st has a child
+// where a value should be, so there are errors from many chunks.
+static WexprExpression* s_schemaTestCreateItems (size_t itemCount, WexprParseFlags flags)
+{
+	char* str = malloc(itemCount * 64 * 2 + 64);
+	size_t length = (size_t)sprintf(str, "@(items #(");
+	
+	for (size_t pass=0; pass < 2; ++pass)
+	{
+		for (size_t i=0; i < itemCount; ++i)
+		{
+			if (pass == 1)
+			{ length += (size_t)sprintf(str + length, " item%zu", i); }
+			
+			if (i % 97 == 0)
+			{ length += (size_t)sprintf(str + length, " @(name missing)"); }
+			else if (i % 131 == 0)
+			{ length += (size_t)sprintf(str + length, " @(id #(1) name bad)"); }
+			else
+			{ length += (size_t)sprintf(str + length, " @(id %zu)", i % 7); } // repeats, so deduplication shares them
+		}
+		
+		length += (size_t)sprintf(str + length, (pass == 0) ? ") byName @(" : "))");
+	}
+	
+	WexprExpression* expr = wexpr_Expression_createFromLengthString(str, length, flags, NULL);
+	free (str);
+	
+	return expr;
+}
+
+// true if both error chains have the same errors in the same order
+static bool s_schemaTestErrorsMatch (WexprSchemaError* lhs, WexprSchemaError* rhs)
+{
+	for (; lhs && rhs; lhs = wexprSchema_Error_nextError(lhs), rhs = wexprSchema_Error_nextError(rhs))
+	{
+		const char* lhsPath = wexprSchema_Error_objectPath(lhs);
+		const char* rhsPath = wexprSchema_Error_objectPath(rhs);
+		const char* lhsMessage = wexprSchema_Error_message(lhs);
+		const char* rhsMessage = wexprSchema_Error_message(rhs);
+		
+		if (wexprSchema_Error_code(lhs) != wexprSchema_Error_code(rhs)
+			|| strcmp(lhsPath ? lhsPath : "", rhsPath ? rhsPath : "") != 0
+			|| strcmp(lhsMessage ? lhsMessage : "", rhsMessage ? rhsMessage : "") != 0
+			|| !s_schemaTestErrorsMatch(wexprSchema_Error_childError(lhs), wexprSchema_Error_childError(rhs))
+		)
+		{ return false; }
+	}
+	
+	return lhs == rhs; // both ended
+}
+
+static size_t s_schemaTestErrorCount (WexprSchemaError* error)
+{
+	size_t count = 0;
+	
+	for (; error; error = wexprSchema_Error_nextError(error))
+	{ count += 1 + s_schemaTestErrorCount(wexprSchema_Error_childError(error)); }
+	
+	return count;
+}
+
+// runs the work on the calling thread, counting how often it's used
+static void s_schemaTestCountingParallelFor (void* userData, size_t count, WexprExecutorTask task, void* taskData)
+{
+	size_t* callCount = userData;
+	++(*callCount);
+	
+	for (size_t i=0; i < count; ++i)
+	{ task(taskData, i); }
+}
+
+WEXPR_UNITTEST_BEGIN (SchemaParallelValidationMatchesSerial)
+
+	WexprSchemaSchema* schema = s_schemaTestCreateItemSchema();
+	WEXPR_UNITTEST_ASSERT (schema != NULL, "Schema should load");
+	
+	WexprExpression* expr = s_schemaTestCreateItems(3000, WexprParseFlagNone);
+	WEXPR_UNITTEST_ASSERT (expr != NULL, "Items should parse");
+	
+	WexprSchemaError* serialError = NULL;
+	bool serialResult = wexprSchema_Schema_validateExpression(schema, expr, &serialError);
+	
+	WEXPR_UNITTEST_ASSERT (!serialResult && s_schemaTestErrorCount(serialError) > 2 * (3000 / 97), "Serial validation finds the bad items");
+	
+	// chunks in any order on the calling thread, then on real threads
+	size_t callCount = 0;
+	WexprExecutor executors[2] = {
+		wexpr_Executor_forCallback(&s_schemaTestCountingParallelFor, &callCount),
+		wexpr_Executor_forThreads(4)
+	};
+	
+	for (size_t e=0; e < 2; ++e)
+	{
+		wexprSchema_Schema_setParallelValidation(schema, 100, &executors[e]);
+		
+		for (size_t run=0; run < 4; ++run)
+		{
+			WexprSchemaError* parallelError = NULL;
+			bool parallelResult = wexprSchema_Schema_validateExpression(schema, expr, &parallelError);
+			
+			WEXPR_UNITTEST_ASSERT (parallelResult == serialResult, "Parallel validation has the same result");
+			WEXPR_UNITTEST_ASSERT (s_schemaTestErrorsMatch(serialError, parallelError), "Parallel validation has the same errors in the same order");
+			
+			if (parallelError)
+			{ wexprSchema_Error_destroy (parallelError); }
+		}
+		
+		WEXPR_UNITTEST_ASSERT (wexprSchema_Schema_validateExpression(schema, expr, NULL) == serialResult, "Same result without errors");
+	}
+	
+	WEXPR_UNITTEST_ASSERT (callCount > 0, "The array and map were split");
+	
+	if (serialError)
+	{ wexprSchema_Error_destroy (serialError); }
+	wexpr_Expression_destroy (expr);
+	wexprSchema_Schema_destroy (schema);
+	
+WEXPR_UNITTEST_END ()
+
+WEXPR_UNITTEST_BEGIN (SchemaParallelValidationSkipsSharedNodes)
+
+	WexprSchemaSchema* schema = s_schemaTestCreateItemSchema();
+	WEXPR_UNITTEST_ASSERT (schema != NULL, "Schema should load");
+	
+	WexprExpression* sharedExpr = s_schemaTestCreateItems(3000, WexprParseFlagDeduplicate);
+	WexprExpression* expr = s_schemaTestCreateItems(3000, WexprParseFlagNone);
+	
+	WexprExpressionNodeStats stats = wexpr_Expression_nodeStats(sharedExpr);
+	WEXPR_UNITTEST_ASSERT (stats.nodeCount != stats.uniqueNodeCount, "Deduplicated items share nodes");
+	
+	WexprSchemaError* serialError = NULL;
+	bool serialResult = wexprSchema_Schema_validateExpression(schema, expr, &serialError);
+	
+	size_t callCount = 0;
+	WexprExecutor executor = wexpr_Executor_forCallback(&s_schemaTestCountingParallelFor, &callCount);
+	wexprSchema_Schema_setParallelValidation(schema, 100, &executor);
+	
+	// reading shared nodes detaches them, so they have to be validated on one thread
+	WexprSchemaError* sharedError = NULL;
+	bool sharedResult = wexprSchema_Schema_validateExpression(schema, sharedExpr, &sharedError);
+	
+	WEXPR_UNITTEST_ASSERT (callCount == 0, "Expressions with shared nodes aren't split");
+	WEXPR_UNITTEST_ASSERT (sharedResult == serialResult, "Same result as the unshared expression");
+	WEXPR_UNITTEST_ASSERT (s_schemaTestErrorsMatch(serialError, sharedError), "Same errors as the unshared expression");
+	
+	if (sharedError)
+	{ wexprSchema_Error_destroy (sharedError); }
+	if (serialError)
+	{ wexprSchema_Error_destroy (serialError); }
+	wexpr_Expression_destroy (sharedExpr);
+	wexpr_Expression_destroy (expr);
+	wexprSchema_Schema_destroy (schema);
+	
+WEXPR_UNITTEST_END ()
+
+WEXPR_UNITTEST_SUITE_BEGIN (Schema)
+	WEXPR_UNITTEST_SUITE_ADDTEST (Schema, SchemaParallelValidationMatchesSerial);
+	WEXPR_UNITTEST_SUITE_ADDTEST (Schema, SchemaParallelValidationSkipsSharedNodes);
+WEXPR_UNITTEST_SUITE_END ()
+
+#endif // WEXPRSCHEMA_TESTS_SCHEMA_H